@@ -29,6 +29,7 @@ void wlr_backend_init(struct wlr_backend *backend,
 	wl_signal_init(&backend->events.destroy);
 	wl_signal_init(&backend->events.new_input);
 	wl_signal_init(&backend->events.new_output);
+	wl_signal_init(&backend->events.input_batch_done);
 }
 
 bool wlr_backend_start(struct wlr_backend *backend) {
@@ -1,3 +1,4 @@
+#include <assert.h>
 #include <gbm.h>
 #include <stdlib.h>
 #include <wlr/util/log.h>
@@ -131,12 +132,29 @@ static void plane_disable(struct atomic *atom, struct wlr_drm_plane *plane) {
 	atomic_add(atom, id, props->crtc_id, 0);
 }
 
-static void set_plane_props(struct atomic *atom, struct wlr_drm_backend *drm,
-		struct wlr_drm_plane *plane, uint32_t crtc_id, int32_t x, int32_t y) {
+static void plane_set_fb(struct atomic *atom, struct wlr_drm_plane *plane,
+		uint32_t crtc_id, uint32_t fb_id, int32_t x, int32_t y,
+		uint32_t width, uint32_t height) {
 	uint32_t id = plane->id;
 	const union wlr_drm_plane_props *props = &plane->props;
+
+	// The src_* properties are in 16.16 fixed point
+	atomic_add(atom, id, props->src_x, 0);
+	atomic_add(atom, id, props->src_y, 0);
+	atomic_add(atom, id, props->src_w, (uint64_t)width << 16);
+	atomic_add(atom, id, props->src_h, (uint64_t)height << 16);
+	atomic_add(atom, id, props->crtc_w, width);
+	atomic_add(atom, id, props->crtc_h, height);
+	atomic_add(atom, id, props->fb_id, fb_id);
+	atomic_add(atom, id, props->crtc_id, crtc_id);
+	atomic_add(atom, id, props->crtc_x, (uint64_t)x);
+	atomic_add(atom, id, props->crtc_y, (uint64_t)y);
+}
+
+static void set_plane_props(struct atomic *atom, struct wlr_drm_backend *drm,
+		struct wlr_drm_plane *plane, uint32_t crtc_id, int32_t x, int32_t y) {
 	struct wlr_drm_fb *fb = plane_get_next_fb(plane);
-	struct gbm_bo *bo = drm_fb_acquire(fb, drm, &plane->mgpu_surf);
+	struct gbm_bo *bo = drm_fb_acquire(fb, drm, plane);
 	if (!bo) {
 		goto error;
 	}
@@ -146,18 +164,8 @@ static void set_plane_props(struct atomic *atom, struct wlr_drm_backend *drm,
 		goto error;
 	}
 
-	// The src_* properties are in 16.16 fixed point
-	atomic_add(atom, id, props->src_x, 0);
-	atomic_add(atom, id, props->src_y, 0);
-	atomic_add(atom, id, props->src_w, (uint64_t)plane->surf.width << 16);
-	atomic_add(atom, id, props->src_h, (uint64_t)plane->surf.height << 16);
-	atomic_add(atom, id, props->crtc_w, plane->surf.width);
-	atomic_add(atom, id, props->crtc_h, plane->surf.height);
-	atomic_add(atom, id, props->fb_id, fb_id);
-	atomic_add(atom, id, props->crtc_id, crtc_id);
-	atomic_add(atom, id, props->crtc_x, (uint64_t)x);
-	atomic_add(atom, id, props->crtc_y, (uint64_t)y);
-
+	plane_set_fb(atom, plane, crtc_id, fb_id, x, y,
+		plane->surf.width, plane->surf.height);
 	return;
 
 error:
@@ -266,6 +274,108 @@ static bool atomic_crtc_commit(struct wlr_drm_backend *drm,
 	return ok;
 }
 
+static bool atomic_crtc_set_cursor(struct wlr_drm_backend *drm,
+		struct wlr_drm_connector *conn) {
+	struct wlr_drm_crtc *crtc = conn->crtc;
+
+	struct atomic atom;
+	atomic_begin(&atom);
+	if (drm_connector_is_cursor_visible(conn)) {
+		set_plane_props(&atom, drm, crtc->cursor, crtc->id,
+			conn->cursor_x, conn->cursor_y);
+	} else {
+		plane_disable(&atom, crtc->cursor);
+	}
+
+	bool ok = atomic_commit(&atom, conn,
+		DRM_MODE_ATOMIC_NONBLOCK | DRM_MODE_PAGE_FLIP_EVENT);
+	atomic_finish(&atom);
+	return ok;
+}
+
+bool drm_atomic_commit_modesets(struct wlr_drm_backend *drm,
+		struct wlr_drm_modeset *modesets, size_t modesets_len, uint32_t flags) {
+	assert(modesets_len > 0);
+
+	for (size_t i = 0; i < modesets_len; ++i) {
+		modesets[i].mode_id = 0;
+	}
+
+	struct atomic atom;
+	atomic_begin(&atom);
+	for (size_t i = 0; i < modesets_len && !atom.failed; ++i) {
+		struct wlr_drm_modeset *modeset = &modesets[i];
+		struct wlr_drm_connector *conn = modeset->conn;
+		struct wlr_drm_crtc *crtc = modeset->crtc;
+		bool active = crtc != NULL;
+		if (!active) {
+			// Disable the CRTC currently driving the connector, if any
+			crtc = conn->crtc;
+		}
+
+		atomic_add(&atom, conn->id, conn->props.crtc_id,
+			active ? crtc->id : 0);
+		if (crtc == NULL) {
+			continue;
+		}
+
+		if (active) {
+			if (drmModeCreatePropertyBlob(drm->fd, &modeset->mode->drm_mode,
+					sizeof(drmModeModeInfo), &modeset->mode_id)) {
+				wlr_log_errno(WLR_ERROR, "Unable to create mode property blob");
+				atom.failed = true;
+				break;
+			}
+			if (conn->props.link_status != 0) {
+				atomic_add(&atom, conn->id, conn->props.link_status,
+					DRM_MODE_LINK_STATUS_GOOD);
+			}
+		}
+		atomic_add(&atom, crtc->id, crtc->props.mode_id, modeset->mode_id);
+		atomic_add(&atom, crtc->id, crtc->props.active, active);
+
+		if (active && modeset->fb_id != 0) {
+			plane_set_fb(&atom, crtc->primary, crtc->id, modeset->fb_id, 0, 0,
+				modeset->mode->wlr_mode.width, modeset->mode->wlr_mode.height);
+		} else if (active) {
+			set_plane_props(&atom, drm, crtc->primary, crtc->id, 0, 0);
+		} else {
+			plane_disable(&atom, crtc->primary);
+		}
+		// The cursor is restored on the next page-flip
+		if (crtc->cursor) {
+			plane_disable(&atom, crtc->cursor);
+		}
+	}
+
+	bool ok = false;
+	if (!atom.failed) {
+		ok = drmModeAtomicCommit(drm->fd, atom.req, flags, drm) == 0;
+		if (!ok) {
+			wlr_log_errno(WLR_ERROR, "Atomic %s of %zu connectors failed",
+				(flags & DRM_MODE_ATOMIC_TEST_ONLY) ? "test" : "modeset",
+				modesets_len);
+		}
+	}
+	atomic_finish(&atom);
+
+	for (size_t i = 0; i < modesets_len; ++i) {
+		struct wlr_drm_crtc *crtc = modesets[i].crtc != NULL ?
+			modesets[i].crtc : modesets[i].conn->crtc;
+		if (crtc == NULL) {
+			continue;
+		}
+		if (ok && !(flags & DRM_MODE_ATOMIC_TEST_ONLY)) {
+			commit_blob(drm, &crtc->mode_id, modesets[i].mode_id);
+		} else {
+			rollback_blob(drm, &crtc->mode_id, modesets[i].mode_id);
+		}
+	}
+
+	return ok;
+}
+
 const struct wlr_drm_interface atomic_iface = {
 	.crtc_commit = atomic_crtc_commit,
+	.crtc_set_cursor = atomic_crtc_set_cursor,
 };
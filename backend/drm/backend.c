@@ -49,6 +49,7 @@ static void backend_destroy(struct wlr_backend *backend) {
 	wl_list_remove(&drm->drm_invalidated.link);
 
 	finish_drm_resources(drm);
+	finish_drm_mgpu_probes(drm);
 	finish_drm_renderer(&drm->renderer);
 	wlr_session_close_file(drm->session, drm->fd);
 	wl_event_source_remove(drm->drm_event);
@@ -71,11 +72,18 @@ static clockid_t backend_get_presentation_clock(struct wlr_backend *backend) {
 	return drm->clock;
 }
 
+static bool backend_commit_outputs(struct wlr_backend *backend,
+		struct wlr_output **outputs, size_t outputs_len, bool *committed) {
+	struct wlr_drm_backend *drm = get_drm_backend_from_backend(backend);
+	return drm_commit_outputs(drm, outputs, outputs_len, committed);
+}
+
 static struct wlr_backend_impl backend_impl = {
 	.start = backend_start,
 	.destroy = backend_destroy,
 	.get_renderer = backend_get_renderer,
 	.get_presentation_clock = backend_get_presentation_clock,
+	.commit_outputs = backend_commit_outputs,
 };
 
 bool wlr_backend_is_drm(struct wlr_backend *b) {
@@ -148,6 +156,7 @@ struct wlr_backend *wlr_drm_backend_create(struct wl_display *display,
 
 	drm->session = session;
 	wl_list_init(&drm->outputs);
+	wl_list_init(&drm->mgpu_probes);
 
 	drm->fd = gpu_fd;
 	if (parent != NULL) {
@@ -28,6 +28,8 @@
 #include "backend/drm/iface.h"
 #include "backend/drm/util.h"
 #include "util/signal.h"
+#include "util/time.h"
+#include "util/trace.h"
 
 bool check_drm_features(struct wlr_drm_backend *drm) {
 	uint64_t cap;
@@ -341,6 +343,10 @@ static bool drm_crtc_commit(struct wlr_drm_connector *conn, uint32_t flags) {
 		drm_fb_move(&crtc->primary->queued_fb, &crtc->primary->pending_fb);
 		if (crtc->cursor != NULL) {
 			drm_fb_move(&crtc->cursor->queued_fb, &crtc->cursor->pending_fb);
+			if (conn->cursor_dirty) {
+				conn->cursor_dirty = false;
+				conn->cursor_stats.merged++;
+			}
 		}
 	} else {
 		memcpy(&crtc->pending, &crtc->current, sizeof(struct wlr_drm_crtc_state));
@@ -471,6 +477,65 @@ static struct wlr_output_mode *drm_connector_get_pending_mode(
 	abort();
 }
 
+/**
+ * Get the mode the connector should be set to when its pending state
+ * contains a mode or enabled state change. The mode is NULL if the connector
+ * should be disabled.
+ */
+static bool drm_connector_get_pending_modeset(struct wlr_drm_connector *conn,
+		struct wlr_output_mode **mode_ptr) {
+	struct wlr_output *output = &conn->output;
+	struct wlr_output_mode *wlr_mode = output->current_mode;
+
+	bool enable = (output->pending.committed & WLR_OUTPUT_STATE_ENABLED) ?
+		output->pending.enabled : output->enabled;
+	if (!enable) {
+		wlr_mode = NULL;
+	}
+
+	if (output->pending.committed & WLR_OUTPUT_STATE_MODE) {
+		assert(enable);
+		wlr_mode = drm_connector_get_pending_mode(conn);
+		if (wlr_mode == NULL) {
+			return false;
+		}
+	}
+
+	*mode_ptr = wlr_mode;
+	return true;
+}
+
+static int64_t timespec_to_nsec(const struct timespec *a) {
+	return (int64_t)a->tv_sec * 1000000000 + a->tv_nsec;
+}
+
+/**
+ * Keep track of the rate at which new frames are submitted, for low
+ * framerate compensation.
+ */
+static void drm_connector_vrr_handle_frame(struct wlr_drm_connector *conn) {
+	struct timespec now, delta;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	timespec_sub(&delta, &now, &conn->last_buffer_commit);
+	int64_t interval = timespec_to_nsec(&delta);
+
+	if (conn->last_buffer_commit.tv_sec == 0 || interval > 1000000000) {
+		// The content was idle, start over
+		conn->content_interval = 0;
+	} else if (conn->content_interval == 0) {
+		conn->content_interval = interval;
+	} else {
+		conn->content_interval = (3 * conn->content_interval + interval) / 4;
+	}
+	conn->last_buffer_commit = now;
+
+	// Stop repeating the previous frame
+	conn->lfc_repeats = 0;
+	if (conn->lfc_timer != NULL) {
+		wl_event_source_timer_update(conn->lfc_timer, 0);
+	}
+}
+
 static bool drm_connector_commit_buffer(struct wlr_output *output) {
 	struct wlr_drm_connector *conn = get_drm_connector_from_output(output);
 	struct wlr_drm_backend *drm = get_drm_backend_from_backend(output->backend);
@@ -505,6 +570,7 @@ static bool drm_connector_commit_buffer(struct wlr_output *output) {
 		return false;
 	}
 
+	drm_connector_vrr_handle_frame(conn);
 	return true;
 }
 
@@ -549,20 +615,9 @@ static bool drm_connector_commit(struct wlr_output *output) {
 
 	if (output->pending.committed &
 			(WLR_OUTPUT_STATE_MODE | WLR_OUTPUT_STATE_ENABLED)) {
-		struct wlr_output_mode *wlr_mode = output->current_mode;
-
-		bool enable = (output->pending.committed & WLR_OUTPUT_STATE_ENABLED) ?
-			output->pending.enabled : output->enabled;
-		if (!enable) {
-			wlr_mode = NULL;
-		}
-
-		if (output->pending.committed & WLR_OUTPUT_STATE_MODE) {
-			assert(enable);
-			wlr_mode = drm_connector_get_pending_mode(conn);
-			if (wlr_mode == NULL) {
-				return false;
-			}
+		struct wlr_output_mode *wlr_mode;
+		if (!drm_connector_get_pending_modeset(conn, &wlr_mode)) {
+			return false;
 		}
 
 		if (!drm_connector_set_mode(conn, wlr_mode)) {
@@ -823,6 +878,298 @@ bool drm_connector_set_mode(struct wlr_drm_connector *conn,
 	return true;
 }
 
+/**
+ * Pick a CRTC for each connector of the batch which needs one. CRTCs released
+ * by the batch aren't reused, they are handed out by realloc_crtcs once the
+ * batch has been applied.
+ */
+static bool modesets_alloc_crtcs(struct wlr_drm_backend *drm,
+		struct wlr_drm_modeset *modesets, size_t modesets_len) {
+	uint32_t used = 0;
+	struct wlr_drm_connector *conn;
+	wl_list_for_each(conn, &drm->outputs, link) {
+		if (conn->crtc != NULL) {
+			used |= 1 << (conn->crtc - drm->crtcs);
+		}
+	}
+
+	for (size_t i = 0; i < modesets_len; ++i) {
+		struct wlr_drm_modeset *modeset = &modesets[i];
+		if (modeset->mode == NULL) {
+			modeset->crtc = NULL;
+			continue;
+		}
+
+		modeset->crtc = modeset->conn->crtc;
+		if (modeset->crtc != NULL) {
+			continue;
+		}
+
+		uint32_t available = modeset->conn->possible_crtc & ~used;
+		if (available == 0) {
+			wlr_log(WLR_DEBUG, "Cannot modeset '%s' in batch: no CRTC available",
+				modeset->conn->output.name);
+			return false;
+		}
+		int crtc_bit = ffs(available) - 1;
+		modeset->crtc = &drm->crtcs[crtc_bit];
+		used |= 1 << crtc_bit;
+	}
+
+	return true;
+}
+
+static bool drm_test_modesets(struct wlr_drm_backend *drm,
+		struct wlr_drm_modeset *modesets, size_t modesets_len) {
+	if (drm->iface != &atomic_iface) {
+		// Legacy can't test a configuration without applying it. Fall back
+		// to the checks done so far: each output has been tested on its own
+		// and enough CRTCs are available for the batch. The kernel may still
+		// reject the modesets, e.g. because of bandwidth limits.
+		wlr_log(WLR_DEBUG, "Legacy interface: only testing outputs "
+			"separately and checking CRTC assignment");
+		return true;
+	}
+
+	// Scan out dummy buffers instead of allocating render surfaces
+	bool ok = true;
+	for (size_t i = 0; i < modesets_len; ++i) {
+		modesets[i].test_bo = NULL;
+	}
+	for (size_t i = 0; i < modesets_len && ok; ++i) {
+		struct wlr_drm_modeset *modeset = &modesets[i];
+		if (modeset->crtc == NULL) {
+			continue;
+		}
+
+		modeset->test_bo = gbm_bo_create(drm->renderer.gbm,
+			modeset->mode->wlr_mode.width, modeset->mode->wlr_mode.height,
+			modeset->crtc->primary->drm_format, GBM_BO_USE_SCANOUT);
+		if (modeset->test_bo == NULL) {
+			wlr_log(WLR_ERROR, "Failed to allocate test buffer for '%s'",
+				modeset->conn->output.name);
+			ok = false;
+			break;
+		}
+		modeset->fb_id = get_fb_for_bo(modeset->test_bo,
+			drm->addfb2_modifiers);
+		ok = modeset->fb_id != 0;
+	}
+
+	if (ok) {
+		ok = drm_atomic_commit_modesets(drm, modesets, modesets_len,
+			DRM_MODE_ATOMIC_TEST_ONLY | DRM_MODE_ATOMIC_ALLOW_MODESET);
+	}
+
+	for (size_t i = 0; i < modesets_len; ++i) {
+		modesets[i].fb_id = 0;
+		if (modesets[i].test_bo != NULL) {
+			gbm_bo_destroy(modesets[i].test_bo);
+			modesets[i].test_bo = NULL;
+		}
+	}
+
+	return ok;
+}
+
+static bool drm_apply_modesets(struct wlr_drm_backend *drm,
+		struct wlr_drm_modeset *modesets, size_t modesets_len) {
+	bool modifiers = true;
+	const char *no_modifiers = getenv("WLR_DRM_NO_MODIFIERS");
+	if (no_modifiers != NULL && strcmp(no_modifiers, "1") == 0) {
+		modifiers = false;
+	}
+
+	// Only block if the kernel would reject a non-blocking commit because a
+	// page-flip is still pending on one of the connectors
+	bool blocking = false;
+
+	// Allocate buffers for the new modes before touching the hardware
+	for (size_t i = 0; i < modesets_len; ++i) {
+		struct wlr_drm_modeset *modeset = &modesets[i];
+		blocking = blocking || modeset->conn->pageflip_pending;
+		if (modeset->crtc == NULL) {
+			continue;
+		}
+
+		struct wlr_drm_plane *plane = modeset->crtc->primary;
+		if (!drm_plane_init_surface(plane, drm,
+				modeset->mode->wlr_mode.width, modeset->mode->wlr_mode.height,
+				drm->renderer.gbm_format, 0, modifiers) ||
+				!drm_surface_render_black_frame(&plane->surf) ||
+				!drm_fb_lock_surface(&plane->pending_fb, &plane->surf)) {
+			wlr_log(WLR_ERROR, "Failed to initialize renderer on '%s'",
+				modeset->conn->output.name);
+			goto error;
+		}
+	}
+
+	uint32_t flags = DRM_MODE_ATOMIC_ALLOW_MODESET | DRM_MODE_PAGE_FLIP_EVENT;
+	if (!blocking) {
+		flags |= DRM_MODE_ATOMIC_NONBLOCK;
+	}
+	if (!drm_atomic_commit_modesets(drm, modesets, modesets_len, flags)) {
+		goto error;
+	}
+
+	bool released_crtc = false;
+	for (size_t i = 0; i < modesets_len; ++i) {
+		struct wlr_drm_modeset *modeset = &modesets[i];
+		struct wlr_drm_connector *conn = modeset->conn;
+
+		if (modeset->crtc == NULL) {
+			struct wlr_drm_crtc *crtc = conn->crtc;
+			if (crtc != NULL) {
+				crtc->current.active = false;
+				crtc->current.mode = NULL;
+				memcpy(&crtc->pending, &crtc->current, sizeof(crtc->pending));
+				drm_plane_finish_surface(crtc->primary);
+				drm_plane_finish_surface(crtc->cursor);
+				if (crtc->cursor != NULL) {
+					crtc->cursor->cursor_enabled = false;
+				}
+				conn->crtc = NULL;
+				released_crtc = true;
+			}
+			conn->desired_enabled = false;
+			conn->desired_mode = NULL;
+			wlr_output_update_enabled(&conn->output, false);
+			continue;
+		}
+
+		struct wlr_drm_crtc *crtc = modeset->crtc;
+		conn->crtc = crtc;
+		crtc->pending_modeset = false;
+		crtc->current.active = true;
+		crtc->current.mode = modeset->mode;
+		memcpy(&crtc->pending, &crtc->current, sizeof(crtc->pending));
+		drm_fb_move(&crtc->primary->queued_fb, &crtc->primary->pending_fb);
+		conn->pageflip_pending = true;
+
+		wlr_log(WLR_INFO, "Modesetting '%s' with '%ux%u@%u mHz'",
+			conn->output.name, modeset->mode->wlr_mode.width,
+			modeset->mode->wlr_mode.height, modeset->mode->wlr_mode.refresh);
+
+		conn->state = WLR_DRM_CONN_CONNECTED;
+		conn->desired_mode = NULL;
+		conn->desired_enabled = true;
+		wlr_output_update_mode(&conn->output, &modeset->mode->wlr_mode);
+		wlr_output_update_enabled(&conn->output, true);
+		wlr_output_damage_whole(&conn->output);
+	}
+
+	if (released_crtc) {
+		realloc_crtcs(drm);
+		attempt_enable_needs_modeset(drm);
+	}
+
+	return true;
+
+error:
+	for (size_t i = 0; i < modesets_len; ++i) {
+		if (modesets[i].crtc != NULL) {
+			drm_fb_clear(&modesets[i].crtc->primary->pending_fb);
+		}
+	}
+	return false;
+}
+
+static bool drm_commit_outputs_modesets(struct wlr_drm_backend *drm,
+		struct wlr_output **outputs, size_t outputs_len,
+		struct wlr_drm_modeset *modesets, bool *committed) {
+	size_t modesets_len = 0;
+	for (size_t i = 0; i < outputs_len; ++i) {
+		struct wlr_output *output = outputs[i];
+		struct wlr_drm_connector *conn = get_drm_connector_from_output(output);
+		if (!drm_connector_test(output)) {
+			return false;
+		}
+
+		if (!(output->pending.committed &
+				(WLR_OUTPUT_STATE_MODE | WLR_OUTPUT_STATE_ENABLED))) {
+			continue;
+		}
+
+		struct wlr_output_mode *wlr_mode;
+		if (!drm_connector_get_pending_modeset(conn, &wlr_mode)) {
+			return false;
+		}
+		if (wlr_mode != NULL && conn->state != WLR_DRM_CONN_CONNECTED &&
+				conn->state != WLR_DRM_CONN_NEEDS_MODESET) {
+			wlr_log(WLR_ERROR, "Cannot modeset a disconnected output");
+			return false;
+		}
+
+		modesets[modesets_len++] = (struct wlr_drm_modeset){
+			.conn = conn,
+			.mode = (struct wlr_drm_mode *)wlr_mode,
+		};
+	}
+
+	bool batched = modesets_len > 0 &&
+		modesets_alloc_crtcs(drm, modesets, modesets_len);
+	if (committed == NULL) {
+		if (modesets_len == 0) {
+			return true;
+		}
+		if (!batched) {
+			// The CRTCs released by the batch could make it work, but we
+			// can't test that without applying it
+			wlr_log(WLR_DEBUG, "Cannot test modesets: not enough CRTCs");
+			return false;
+		}
+		return drm_test_modesets(drm, modesets, modesets_len);
+	}
+
+	if (batched && drm->iface == &atomic_iface) {
+		if (drm_apply_modesets(drm, modesets, modesets_len)) {
+			// Commit what's left, e.g. buffers of outputs without a modeset
+			bool ok = true;
+			for (size_t i = 0; i < outputs_len; ++i) {
+				struct wlr_output *output = outputs[i];
+				if (output->pending.committed &
+						(WLR_OUTPUT_STATE_MODE | WLR_OUTPUT_STATE_ENABLED)) {
+					committed[i] = true;
+				} else {
+					committed[i] = drm_connector_commit(output);
+					ok = ok && committed[i];
+				}
+			}
+			return ok;
+		}
+		wlr_log(WLR_INFO, "Batched modeset failed, "
+			"falling back to one modeset per output");
+	}
+
+	bool ok = true;
+	for (size_t i = 0; i < outputs_len; ++i) {
+		committed[i] = drm_connector_commit(outputs[i]);
+		ok = ok && committed[i];
+	}
+	return ok;
+}
+
+bool drm_commit_outputs(struct wlr_drm_backend *drm,
+		struct wlr_output **outputs, size_t outputs_len, bool *committed) {
+	if (committed != NULL) {
+		memset(committed, false, outputs_len * sizeof(committed[0]));
+	}
+	if (!drm->session->active) {
+		return false;
+	}
+
+	struct wlr_drm_modeset *modesets =
+		calloc(outputs_len, sizeof(struct wlr_drm_modeset));
+	if (modesets == NULL) {
+		wlr_log_errno(WLR_ERROR, "Allocation failed");
+		return false;
+	}
+	bool ok = drm_commit_outputs_modesets(drm, outputs, outputs_len,
+		modesets, committed);
+	free(modesets);
+	return ok;
+}
+
 struct wlr_output_mode *wlr_drm_connector_add_mode(struct wlr_output *output,
 		const drmModeModeInfo *modeinfo) {
 	struct wlr_drm_connector *conn = get_drm_connector_from_output(output);
@@ -858,6 +1205,56 @@ struct wlr_output_mode *wlr_drm_connector_add_mode(struct wlr_output *output,
 	return &mode->wlr_mode;
 }
 
+/**
+ * Submit the cursor on its own. With legacy, the cursor IOCTLs take effect
+ * immediately. With atomic, the cursor plane is updated with a non-blocking
+ * commit which occupies the CRTC until the next page-flip event, like a
+ * regular frame.
+ */
+static bool drm_connector_commit_cursor(struct wlr_drm_connector *conn) {
+	struct wlr_drm_backend *drm =
+		get_drm_backend_from_backend(conn->output.backend);
+	struct wlr_drm_crtc *crtc = conn->crtc;
+	if (!drm->session->active || crtc == NULL || crtc->cursor == NULL ||
+			!crtc->current.active) {
+		return false;
+	}
+
+	if (!drm->iface->crtc_set_cursor(drm, conn)) {
+		return false;
+	}
+
+	struct wlr_drm_plane *plane = crtc->cursor;
+	if (drm->iface == &atomic_iface) {
+		if (plane->pending_fb.type != WLR_DRM_FB_TYPE_NONE) {
+			drm_fb_move(&plane->queued_fb, &plane->pending_fb);
+		}
+		conn->pageflip_pending = true;
+		conn->cursor_flip_pending = true;
+		// Hold back frames until the cursor update has been flipped
+		conn->output.frame_pending = true;
+	} else if (plane->pending_fb.type != WLR_DRM_FB_TYPE_NONE) {
+		drm_fb_move(&plane->current_fb, &plane->pending_fb);
+	}
+	conn->cursor_dirty = false;
+	conn->cursor_stats.forced++;
+	return true;
+}
+
+static void drm_connector_queue_cursor_update(struct wlr_drm_connector *conn) {
+	conn->cursor_dirty = true;
+
+	if (conn->pageflip_pending) {
+		// The cursor will be merged into the commit following the page-flip,
+		// or submitted on its own if there is none (see page_flip_handler)
+		return;
+	}
+
+	if (!drm_connector_commit_cursor(conn)) {
+		wlr_output_update_needs_frame(&conn->output);
+	}
+}
+
 static bool drm_connector_set_cursor(struct wlr_output *output,
 		struct wlr_texture *texture, float scale,
 		enum wl_output_transform transform,
@@ -907,7 +1304,9 @@ static bool drm_connector_set_cursor(struct wlr_output *output,
 		plane->cursor_hotspot_x = hotspot.x;
 		plane->cursor_hotspot_y = hotspot.y;
 
-		wlr_output_update_needs_frame(output);
+		if (!update_texture) {
+			drm_connector_queue_cursor_update(conn);
+		}
 	}
 
 	if (!update_texture) {
@@ -950,7 +1349,7 @@ static bool drm_connector_set_cursor(struct wlr_output *output,
 	}
 
 	if (plane->cursor_enabled) {
-		drm_fb_acquire(&plane->pending_fb, drm, &plane->mgpu_surf);
+		drm_fb_acquire(&plane->pending_fb, drm, plane);
 		/* Workaround for nouveau buffers created with GBM_BO_USER_LINEAR are
 		 * placed in NOUVEAU_GEM_DOMAIN_GART. When the bo is attached to the
 		 * cursor plane it is moved to NOUVEAU_GEM_DOMAIN_VRAM. However, this
@@ -962,7 +1361,7 @@ static bool drm_connector_set_cursor(struct wlr_output *output,
 		glFinish();
 	}
 
-	wlr_output_update_needs_frame(output);
+	drm_connector_queue_cursor_update(conn);
 	return true;
 }
 
@@ -991,10 +1390,13 @@ static bool drm_connector_move_cursor(struct wlr_output *output,
 		box.y -= plane->cursor_hotspot_y;
 	}
 
+	if (conn->cursor_x == box.x && conn->cursor_y == box.y) {
+		return true;
+	}
 	conn->cursor_x = box.x;
 	conn->cursor_y = box.y;
 
-	wlr_output_update_needs_frame(output);
+	drm_connector_queue_cursor_update(conn);
 	return true;
 }
 
@@ -1012,6 +1414,9 @@ bool drm_connector_is_cursor_visible(struct wlr_drm_connector *conn) {
 static void drm_connector_destroy(struct wlr_output *output) {
 	struct wlr_drm_connector *conn = get_drm_connector_from_output(output);
 	drm_connector_cleanup(conn);
+	if (conn->lfc_timer != NULL) {
+		wl_event_source_remove(conn->lfc_timer);
+	}
 	drmModeFreeCrtc(conn->old_crtc);
 	wl_list_remove(&conn->link);
 	free(conn);
@@ -1033,6 +1438,21 @@ bool wlr_output_is_drm(struct wlr_output *output) {
 	return output->impl == &output_impl;
 }
 
+enum wlr_drm_mgpu_mode wlr_drm_connector_get_mgpu_mode(
+		struct wlr_output *output) {
+	struct wlr_drm_connector *conn = get_drm_connector_from_output(output);
+	if (conn->crtc == NULL || conn->crtc->primary == NULL) {
+		return WLR_DRM_MGPU_NONE;
+	}
+	return conn->crtc->primary->mgpu_mode;
+}
+
+void wlr_drm_connector_get_cursor_stats(struct wlr_output *output,
+		struct wlr_drm_cursor_stats *stats) {
+	struct wlr_drm_connector *conn = get_drm_connector_from_output(output);
+	*stats = conn->cursor_stats;
+}
+
 static const int32_t subpixel_map[] = {
 	[DRM_MODE_SUBPIXEL_UNKNOWN] = WL_OUTPUT_SUBPIXEL_UNKNOWN,
 	[DRM_MODE_SUBPIXEL_HORIZONTAL_RGB] = WL_OUTPUT_SUBPIXEL_HORIZONTAL_RGB,
@@ -1354,6 +1774,7 @@ void scan_drm_connectors(struct wlr_drm_backend *drm) {
 			uint8_t *edid = get_drm_prop_blob(drm->fd,
 				wlr_conn->id, wlr_conn->props.edid, &edid_len);
 			parse_edid(&wlr_conn->output, edid_len, edid);
+			wlr_conn->vrr_min_refresh = parse_edid_min_refresh(edid_len, edid);
 			free(edid);
 
 			struct wlr_output *output = &wlr_conn->output;
@@ -1463,6 +1884,102 @@ static int mhz_to_nsec(int mhz) {
 	return 1000000000000LL / mhz;
 }
 
+/**
+ * With adaptive sync, report the time elapsed since the previous page-flip
+ * instead of the nominal refresh period of the mode.
+ */
+static int drm_connector_vrr_refresh(struct wlr_drm_connector *conn,
+		const struct timespec *present_time) {
+	int64_t min_interval = mhz_to_nsec(conn->output.refresh);
+	if (conn->last_present.tv_sec == 0) {
+		return min_interval;
+	}
+
+	struct timespec delta;
+	timespec_sub(&delta, present_time, &conn->last_present);
+	int64_t interval = timespec_to_nsec(&delta);
+	if (interval < min_interval) {
+		return min_interval;
+	}
+	if (conn->vrr_min_refresh > 0 &&
+			interval > mhz_to_nsec(conn->vrr_min_refresh)) {
+		return mhz_to_nsec(conn->vrr_min_refresh);
+	}
+	return interval;
+}
+
+static int handle_lfc_timer(void *data) {
+	struct wlr_drm_connector *conn = data;
+	struct wlr_drm_backend *drm =
+		get_drm_backend_from_backend(conn->output.backend);
+
+	// Don't flush half-built output state
+	if (!drm->session->active || conn->state != WLR_DRM_CONN_CONNECTED ||
+			conn->crtc == NULL || !conn->crtc->current.active ||
+			conn->pageflip_pending || conn->lfc_repeats == 0 ||
+			conn->output.pending.committed != 0) {
+		return 0;
+	}
+
+	if (!drm_crtc_page_flip(conn)) {
+		conn->lfc_repeats = 0;
+		return 0;
+	}
+
+	conn->lfc_repeats--;
+	conn->lfc_pending = true;
+	// Hold back frame events until the repeated frame has been flipped
+	conn->output.frame_pending = true;
+	return 0;
+}
+
+/**
+ * Low framerate compensation: when new frames come in less often than the
+ * panel's minimum refresh rate, the panel refreshes on its own at arbitrary
+ * points of the content's frame interval, which causes judder. Instead,
+ * present each frame several times at regular intervals dividing the
+ * content's frame interval.
+ */
+static void drm_connector_schedule_lfc(struct wlr_drm_connector *conn,
+		bool new_frame) {
+	if (conn->output.adaptive_sync_status != WLR_OUTPUT_ADAPTIVE_SYNC_ENABLED ||
+			conn->vrr_min_refresh == 0 || conn->content_interval == 0 ||
+			conn->pageflip_pending) {
+		return;
+	}
+
+	if (new_frame) {
+		int64_t max_interval = mhz_to_nsec(conn->vrr_min_refresh);
+		if (conn->content_interval <= max_interval) {
+			return;
+		}
+		int64_t copies = (conn->content_interval + max_interval - 1) /
+			max_interval;
+		conn->lfc_interval = conn->content_interval / copies;
+		conn->lfc_repeats = copies - 1;
+	}
+
+	if (conn->lfc_repeats == 0) {
+		return;
+	}
+
+	if (conn->lfc_timer == NULL) {
+		struct wlr_drm_backend *drm =
+			get_drm_backend_from_backend(conn->output.backend);
+		struct wl_event_loop *event_loop =
+			wl_display_get_event_loop(drm->display);
+		conn->lfc_timer =
+			wl_event_loop_add_timer(event_loop, handle_lfc_timer, conn);
+		if (conn->lfc_timer == NULL) {
+			wlr_log(WLR_ERROR, "Failed to create LFC timer");
+			return;
+		}
+	}
+
+	int ms = conn->lfc_interval / 1000000;
+	wl_event_source_timer_update(conn->lfc_timer, ms > 0 ? ms : 1);
+}
+
 static void page_flip_handler(int fd, unsigned seq,
 		unsigned tv_sec, unsigned tv_usec, unsigned crtc_id, void *data) {
 	struct wlr_drm_backend *drm = data;
@@ -1480,7 +1997,13 @@ static void page_flip_handler(int fd, unsigned seq,
 		return;
 	}
 
+	TRACE_INSTANT("page_flip", conn->output.name);
+
 	conn->pageflip_pending = false;
+	bool lfc_frame = conn->lfc_pending;
+	conn->lfc_pending = false;
+	bool cursor_frame = conn->cursor_flip_pending;
+	conn->cursor_flip_pending = false;
 
 	if (conn->state != WLR_DRM_CONN_CONNECTED || conn->crtc == NULL) {
 		return;
@@ -1498,11 +2021,10 @@ static void page_flip_handler(int fd, unsigned seq,
 
 	uint32_t present_flags = WLR_OUTPUT_PRESENT_VSYNC |
 		WLR_OUTPUT_PRESENT_HW_CLOCK | WLR_OUTPUT_PRESENT_HW_COMPLETION;
-	/* Don't report ZERO_COPY in multi-gpu situations, because we had to copy
-	 * data between the GPUs, even if we were using the direct scanout
-	 * interface.
+	/* Client buffers are imported into the GPU driving the output and
+	 * scanned out as-is, even in multi-GPU situations.
 	 */
-	if (!drm->parent && plane->current_fb.type == WLR_DRM_FB_TYPE_WLR_BUFFER) {
+	if (plane->current_fb.type == WLR_DRM_FB_TYPE_WLR_BUFFER) {
 		present_flags |= WLR_OUTPUT_PRESENT_ZERO_COPY;
 	}
 
@@ -1510,20 +2032,38 @@ static void page_flip_handler(int fd, unsigned seq,
 		.tv_sec = tv_sec,
 		.tv_nsec = tv_usec * 1000,
 	};
-	struct wlr_output_event_present present_event = {
-		/* The DRM backend guarantees that the presentation event will be for
-		 * the last submitted frame. */
-		.commit_seq = conn->output.commit_seq,
-		.when = &present_time,
-		.seq = seq,
-		.refresh = mhz_to_nsec(conn->output.refresh),
-		.flags = present_flags,
-	};
-	wlr_output_send_present(&conn->output, &present_event);
+	int refresh = mhz_to_nsec(conn->output.refresh);
+	if (conn->output.adaptive_sync_status == WLR_OUTPUT_ADAPTIVE_SYNC_ENABLED) {
+		refresh = drm_connector_vrr_refresh(conn, &present_time);
+	}
+	conn->last_present = present_time;
+
+	// Repeated frames have already been presented once, and cursor-only
+	// updates don't present a new frame
+	if (!lfc_frame && !cursor_frame) {
+		struct wlr_output_event_present present_event = {
+			/* The DRM backend guarantees that the presentation event will be
+			 * for the last submitted frame. */
+			.commit_seq = conn->output.commit_seq,
+			.when = &present_time,
+			.seq = seq,
+			.refresh = refresh,
+			.flags = present_flags,
+		};
+		wlr_output_send_present(&conn->output, &present_event);
+	}
 
 	if (drm->session->active) {
 		wlr_output_send_frame(&conn->output);
 	}
+
+	// Unless the compositor submitted a new frame, repeat the current one
+	drm_connector_schedule_lfc(conn, !lfc_frame && !cursor_frame);
+
+	// The compositor didn't commit a new frame, don't hold the cursor back
+	if (conn->cursor_dirty && !conn->pageflip_pending) {
+		drm_connector_commit_cursor(conn);
+	}
 }
 
 int handle_drm_event(int fd, uint32_t mask, void *data) {
@@ -1614,6 +2154,15 @@ static void drm_connector_cleanup(struct wlr_drm_connector *conn) {
 		conn->possible_crtc = 0;
 		conn->desired_mode = NULL;
 		conn->pageflip_pending = false;
+		conn->lfc_pending = false;
+		conn->cursor_flip_pending = false;
+		conn->lfc_repeats = 0;
+		conn->content_interval = 0;
+		conn->last_present = (struct timespec){0};
+		conn->last_buffer_commit = (struct timespec){0};
+		if (conn->lfc_timer != NULL) {
+			wl_event_source_timer_update(conn->lfc_timer, 0);
+		}
 		wlr_signal_emit_safe(&conn->output.events.destroy, &conn->output);
 		break;
 	case WLR_DRM_CONN_DISCONNECTED:
@@ -8,6 +8,46 @@
 #include "backend/drm/iface.h"
 #include "backend/drm/util.h"
 
+static bool legacy_crtc_set_cursor(struct wlr_drm_backend *drm,
+		struct wlr_drm_connector *conn) {
+	struct wlr_drm_crtc *crtc = conn->crtc;
+	struct wlr_drm_plane *cursor = crtc->cursor;
+
+	if (drm_connector_is_cursor_visible(conn)) {
+		struct wlr_drm_fb *cursor_fb = plane_get_next_fb(cursor);
+		struct gbm_bo *cursor_bo =
+			drm_fb_acquire(cursor_fb, drm, cursor);
+		if (!cursor_bo) {
+			wlr_log_errno(WLR_DEBUG, "%s: failed to acquire cursor FB",
+				conn->output.name);
+			return false;
+		}
+
+		if (drmModeSetCursor(drm->fd, crtc->id,
+				gbm_bo_get_handle(cursor_bo).u32,
+				cursor->surf.width, cursor->surf.height)) {
+			wlr_log_errno(WLR_DEBUG, "%s: failed to set hardware cursor",
+				conn->output.name);
+			return false;
+		}
+
+		if (drmModeMoveCursor(drm->fd,
+			crtc->id, conn->cursor_x, conn->cursor_y) != 0) {
+			wlr_log_errno(WLR_ERROR, "%s: failed to move cursor",
+				conn->output.name);
+			return false;
+		}
+	} else {
+		if (drmModeSetCursor(drm->fd, crtc->id, 0, 0, 0)) {
+			wlr_log_errno(WLR_DEBUG, "%s: failed to unset hardware cursor",
+				conn->output.name);
+			return false;
+		}
+	}
+
+	return true;
+}
+
 static bool legacy_crtc_commit(struct wlr_drm_backend *drm,
 		struct wlr_drm_connector *conn, uint32_t flags) {
 	struct wlr_output *output = &conn->output;
@@ -17,7 +57,7 @@ static bool legacy_crtc_commit(struct wlr_drm_backend *drm,
 	uint32_t fb_id = 0;
 	if (crtc->pending.active) {
 		struct wlr_drm_fb *fb = plane_get_next_fb(crtc->primary);
-		struct gbm_bo *bo = drm_fb_acquire(fb, drm, &crtc->primary->mgpu_surf);
+		struct gbm_bo *bo = drm_fb_acquire(fb, drm, crtc->primary);
 		if (!bo) {
 			return false;
 		}
@@ -79,36 +119,8 @@ static bool legacy_crtc_commit(struct wlr_drm_backend *drm,
 			output->name);
 	}
 
-	if (cursor != NULL && drm_connector_is_cursor_visible(conn)) {
-		struct wlr_drm_fb *cursor_fb = plane_get_next_fb(cursor);
-		struct gbm_bo *cursor_bo =
-			drm_fb_acquire(cursor_fb, drm, &cursor->mgpu_surf);
-		if (!cursor_bo) {
-			wlr_log_errno(WLR_DEBUG, "%s: failed to acquire cursor FB",
-				conn->output.name);
-			return false;
-		}
-
-		if (drmModeSetCursor(drm->fd, crtc->id,
-				gbm_bo_get_handle(cursor_bo).u32,
-				cursor->surf.width, cursor->surf.height)) {
-			wlr_log_errno(WLR_DEBUG, "%s: failed to set hardware cursor",
-				conn->output.name);
-			return false;
-		}
-
-		if (drmModeMoveCursor(drm->fd,
-			crtc->id, conn->cursor_x, conn->cursor_y) != 0) {
-			wlr_log_errno(WLR_ERROR, "%s: failed to move cursor",
-				conn->output.name);
-			return false;
-		}
-	} else {
-		if (drmModeSetCursor(drm->fd, crtc->id, 0, 0, 0)) {
-			wlr_log_errno(WLR_DEBUG, "%s: failed to unset hardware cursor",
-				conn->output.name);
-			return false;
-		}
+	if (cursor != NULL && !legacy_crtc_set_cursor(drm, conn)) {
+		return false;
 	}
 
 	if (flags & DRM_MODE_PAGE_FLIP_EVENT) {
@@ -165,4 +177,5 @@ bool drm_legacy_crtc_set_gamma(struct wlr_drm_backend *drm,
 
 const struct wlr_drm_interface legacy_iface = {
 	.crtc_commit = legacy_crtc_commit,
+	.crtc_set_cursor = legacy_crtc_set_cursor,
 };
@@ -12,6 +12,7 @@
 #include <wlr/types/wlr_matrix.h>
 #include <wlr/util/log.h>
 #include "backend/drm/drm.h"
+#include "backend/drm/util.h"
 
 bool init_drm_renderer(struct wlr_drm_backend *drm,
 		struct wlr_drm_renderer *renderer, wlr_renderer_create_func_t create_renderer_func) {
@@ -117,6 +118,12 @@ static void finish_drm_surface(struct wlr_drm_surface *surf) {
 		return;
 	}
 
+	for (size_t i = 0; i < WLR_DRM_SURFACE_MAX_IMPORTS; ++i) {
+		if (surf->imports[i].mgpu_bo != NULL) {
+			gbm_bo_destroy(surf->imports[i].mgpu_bo);
+		}
+	}
+
 	wlr_egl_destroy_surface(&surf->renderer->egl, surf->egl);
 	if (surf->gbm) {
 		gbm_surface_destroy(surf->gbm);
@@ -185,6 +192,159 @@ static struct wlr_texture *get_tex_for_bo(struct wlr_drm_renderer *renderer,
 	return tex;
 }
 
+static struct gbm_bo *import_gbm_bo(struct wlr_drm_renderer *renderer,
+		struct wlr_dmabuf_attributes *attribs) {
+	if (attribs->modifier != DRM_FORMAT_MOD_INVALID ||
+			attribs->n_planes > 1 || attribs->offset[0] != 0) {
+		struct gbm_import_fd_modifier_data data = {
+			.width = attribs->width,
+			.height = attribs->height,
+			.format = attribs->format,
+			.num_fds = attribs->n_planes,
+			.modifier = attribs->modifier,
+		};
+
+		if ((size_t)attribs->n_planes > sizeof(data.fds) / sizeof(data.fds[0])) {
+			return NULL;
+		}
+
+		for (size_t i = 0; i < (size_t)attribs->n_planes; ++i) {
+			data.fds[i] = attribs->fd[i];
+			data.strides[i] = attribs->stride[i];
+			data.offsets[i] = attribs->offset[i];
+		}
+
+		return gbm_bo_import(renderer->gbm, GBM_BO_IMPORT_FD_MODIFIER,
+			&data, GBM_BO_USE_SCANOUT);
+	} else {
+		struct gbm_import_fd_data data = {
+			.fd = attribs->fd[0],
+			.width = attribs->width,
+			.height = attribs->height,
+			.stride = attribs->stride[0],
+			.format = attribs->format,
+		};
+
+		return gbm_bo_import(renderer->gbm, GBM_BO_IMPORT_FD,
+			&data, GBM_BO_USE_SCANOUT);
+	}
+}
+
+/**
+ * Import a BO of a surface allocated on the parent GPU into the GPU driving
+ * the output. The imported BO is cached for the lifetime of the surface.
+ */
+static struct gbm_bo *get_mgpu_bo_for_bo(struct wlr_drm_backend *drm,
+		struct wlr_drm_surface *surf, struct gbm_bo *bo) {
+	struct wlr_drm_mgpu_import *import = NULL;
+	for (size_t i = 0; i < WLR_DRM_SURFACE_MAX_IMPORTS; ++i) {
+		if (surf->imports[i].bo == bo) {
+			return surf->imports[i].mgpu_bo;
+		}
+		if (import == NULL && surf->imports[i].bo == NULL) {
+			import = &surf->imports[i];
+		}
+	}
+	if (import == NULL) {
+		// Evicting an import could remove a framebuffer still on screen
+		wlr_log(WLR_ERROR, "Too many parent GPU buffers to import");
+		return NULL;
+	}
+
+	struct wlr_dmabuf_attributes attribs;
+	if (!export_drm_bo(bo, &attribs)) {
+		return NULL;
+	}
+
+	struct gbm_bo *mgpu_bo = import_gbm_bo(&drm->renderer, &attribs);
+	if (mgpu_bo) {
+		import->bo = bo;
+		import->mgpu_bo = mgpu_bo;
+	}
+
+	wlr_dmabuf_attributes_finish(&attribs);
+
+	return mgpu_bo;
+}
+
+/**
+ * Check whether a buffer allocated on the parent GPU with the given
+ * modifiers (or linear if NULL) can be scanned out by the GPU driving the
+ * output. The result only depends on the device pair, the format and the
+ * modifiers, so it is cached and a small buffer is enough to find out.
+ */
+static bool probe_mgpu_import(struct wlr_drm_backend *drm, uint32_t format,
+		const uint64_t *modifiers, size_t modifiers_len) {
+	struct wlr_drm_mgpu_probe *probe;
+	wl_list_for_each(probe, &drm->mgpu_probes, link) {
+		if (probe->format != format ||
+				(probe->modifiers == NULL) != (modifiers == NULL) ||
+				probe->modifiers_len != modifiers_len) {
+			continue;
+		}
+		if (modifiers == NULL || memcmp(probe->modifiers, modifiers,
+				modifiers_len * sizeof(modifiers[0])) == 0) {
+			return probe->ok;
+		}
+	}
+
+	probe = calloc(1, sizeof(*probe));
+	if (probe == NULL) {
+		wlr_log_errno(WLR_ERROR, "Allocation failed");
+		return false;
+	}
+	if (modifiers != NULL) {
+		probe->modifiers = malloc(modifiers_len * sizeof(modifiers[0]));
+		if (probe->modifiers == NULL) {
+			wlr_log_errno(WLR_ERROR, "Allocation failed");
+			free(probe);
+			return false;
+		}
+		memcpy(probe->modifiers, modifiers,
+			modifiers_len * sizeof(modifiers[0]));
+	}
+	probe->format = format;
+	probe->modifiers_len = modifiers_len;
+	wl_list_insert(&drm->mgpu_probes, &probe->link);
+
+	struct gbm_device *parent_gbm = drm->parent->renderer.gbm;
+	struct gbm_bo *bo;
+	if (modifiers != NULL) {
+		bo = gbm_bo_create_with_modifiers(parent_gbm, 64, 64, format,
+			modifiers, modifiers_len);
+	} else {
+		bo = gbm_bo_create(parent_gbm, 64, 64, format,
+			GBM_BO_USE_RENDERING | GBM_BO_USE_LINEAR);
+	}
+	if (!bo) {
+		return false;
+	}
+
+	bool ok = false;
+	struct wlr_dmabuf_attributes attribs;
+	if (export_drm_bo(bo, &attribs)) {
+		struct gbm_bo *mgpu_bo = import_gbm_bo(&drm->renderer, &attribs);
+		if (mgpu_bo) {
+			ok = get_fb_for_bo(mgpu_bo, drm->addfb2_modifiers) != 0;
+			gbm_bo_destroy(mgpu_bo);
+		}
+		wlr_dmabuf_attributes_finish(&attribs);
+	}
+
+	gbm_bo_destroy(bo);
+	probe->ok = ok;
+	return ok;
+}
+
+void finish_drm_mgpu_probes(struct wlr_drm_backend *drm) {
+	struct wlr_drm_mgpu_probe *probe, *tmp;
+	wl_list_for_each_safe(probe, tmp, &drm->mgpu_probes, link) {
+		wl_list_remove(&probe->link);
+		free(probe->modifiers);
+		free(probe);
+	}
+}
+
 void drm_plane_finish_surface(struct wlr_drm_plane *plane) {
 	if (!plane) {
 		return;
@@ -196,6 +356,7 @@ void drm_plane_finish_surface(struct wlr_drm_plane *plane) {
 
 	finish_drm_surface(&plane->surf);
 	finish_drm_surface(&plane->mgpu_surf);
+	plane->mgpu_mode = WLR_DRM_MGPU_NONE;
 }
 
 static uint32_t strip_alpha_channel(uint32_t format) {
@@ -229,6 +390,32 @@ bool drm_plane_init_surface(struct wlr_drm_plane *plane,
 			format, format_set, flags | GBM_BO_USE_SCANOUT);
 	}
 
+	// Pick the cheapest way to get the parent GPU's frames on screen. Ideally
+	// the parent GPU renders to a buffer the secondary GPU can scan out
+	// as-is, otherwise we need to copy each frame on the secondary GPU.
+	const struct wlr_drm_format *drm_format = NULL;
+	if (format_set != NULL) {
+		drm_format = wlr_drm_format_set_get(format_set, format);
+	}
+	if (drm_format != NULL && probe_mgpu_import(drm, format,
+			drm_format->modifiers, drm_format->len) &&
+			init_drm_surface(&plane->surf, &drm->parent->renderer,
+			width, height, format, format_set, flags)) {
+		plane->mgpu_mode = WLR_DRM_MGPU_IMPORT;
+		wlr_log(WLR_DEBUG, "Plane %"PRIu32": scanning out parent GPU "
+			"buffers", plane->id);
+		return true;
+	}
+
+	if (probe_mgpu_import(drm, format, NULL, 0) &&
+			init_drm_surface(&plane->surf, &drm->parent->renderer,
+			width, height, format, NULL, flags | GBM_BO_USE_LINEAR)) {
+		plane->mgpu_mode = WLR_DRM_MGPU_LINEAR;
+		wlr_log(WLR_DEBUG, "Plane %"PRIu32": scanning out linear parent GPU "
+			"buffers", plane->id);
+		return true;
+	}
+
 	if (!init_drm_surface(&plane->surf, &drm->parent->renderer,
 			width, height, format, NULL,
 			flags | GBM_BO_USE_LINEAR)) {
@@ -242,6 +429,9 @@ bool drm_plane_init_surface(struct wlr_drm_plane *plane,
 		return false;
 	}
 
+	plane->mgpu_mode = WLR_DRM_MGPU_BLIT;
+	wlr_log(WLR_DEBUG, "Plane %"PRIu32": copying parent GPU buffers",
+		plane->id);
 	return true;
 }
 
@@ -310,41 +500,7 @@ bool drm_fb_import_wlr(struct wlr_drm_fb *fb, struct wlr_drm_renderer *renderer,
 		}
 	}
 
-	if (attribs.modifier != DRM_FORMAT_MOD_INVALID ||
-			attribs.n_planes > 1 || attribs.offset[0] != 0) {
-		struct gbm_import_fd_modifier_data data = {
-			.width = attribs.width,
-			.height = attribs.height,
-			.format = attribs.format,
-			.num_fds = attribs.n_planes,
-			.modifier = attribs.modifier,
-		};
-
-		if ((size_t)attribs.n_planes > sizeof(data.fds) / sizeof(data.fds[0])) {
-			return false;
-		}
-
-		for (size_t i = 0; i < (size_t)attribs.n_planes; ++i) {
-			data.fds[i] = attribs.fd[i];
-			data.strides[i] = attribs.stride[i];
-			data.offsets[i] = attribs.offset[i];
-		}
-
-		fb->bo = gbm_bo_import(renderer->gbm, GBM_BO_IMPORT_FD_MODIFIER,
-			&data, GBM_BO_USE_SCANOUT);
-	} else {
-		struct gbm_import_fd_data data = {
-			.fd = attribs.fd[0],
-			.width = attribs.width,
-			.height = attribs.height,
-			.stride = attribs.stride[0],
-			.format = attribs.format,
-		};
-
-		fb->bo = gbm_bo_import(renderer->gbm, GBM_BO_IMPORT_FD,
-			&data, GBM_BO_USE_SCANOUT);
-	}
-
+	fb->bo = import_gbm_bo(renderer, &attribs);
 	if (!fb->bo) {
 		return false;
 	}
@@ -376,13 +532,15 @@ bool drm_surface_render_black_frame(struct wlr_drm_surface *surf) {
 }
 
 struct gbm_bo *drm_fb_acquire(struct wlr_drm_fb *fb, struct wlr_drm_backend *drm,
-		struct wlr_drm_surface *mgpu) {
+		struct wlr_drm_plane *plane) {
 	if (!fb->bo) {
 		wlr_log(WLR_ERROR, "Tried to acquire an FB with a NULL BO");
 		return NULL;
 	}
 
-	if (!drm->parent) {
+	// Client buffers have already been imported into the GPU driving the
+	// output
+	if (!drm->parent || fb->type == WLR_DRM_FB_TYPE_WLR_BUFFER) {
 		return fb->bo;
 	}
 
@@ -390,6 +548,18 @@ struct gbm_bo *drm_fb_acquire(struct wlr_drm_fb *fb, struct wlr_drm_backend *drm
 		return fb->mgpu_bo;
 	}
 
+	switch (plane->mgpu_mode) {
+	case WLR_DRM_MGPU_IMPORT:
+	case WLR_DRM_MGPU_LINEAR:
+		assert(fb->type == WLR_DRM_FB_TYPE_SURFACE);
+		return get_mgpu_bo_for_bo(drm, fb->surf, fb->bo);
+	case WLR_DRM_MGPU_NONE:
+	case WLR_DRM_MGPU_BLIT:
+		break;
+	}
+
+	struct wlr_drm_surface *mgpu = &plane->mgpu_surf;
+
 	/* Perform copy across GPUs */
 
 	struct wlr_texture *tex = get_tex_for_bo(mgpu->renderer, fb->bo);
@@ -144,6 +144,28 @@ void parse_edid(struct wlr_output *restrict output, size_t len, const uint8_t *d
 	}
 }
 
+int32_t parse_edid_min_refresh(size_t len, const uint8_t *data) {
+	if (!data || len < 128) {
+		return 0;
+	}
+
+	for (size_t i = 54; i <= 108; i += 18) {
+		uint16_t flag = (data[i] << 8) | data[i + 1];
+		if (flag != 0 || data[i + 3] != 0xFD) {
+			continue;
+		}
+
+		// Display range limits descriptor, rates above 255 Hz have an offset
+		int32_t min_hz = data[i + 5];
+		if (data[i + 4] & 0x1) {
+			min_hz += 255;
+		}
+		return min_hz * 1000;
+	}
+
+	return 0;
+}
+
 const char *conn_get_name(uint32_t type_id) {
 	switch (type_id) {
 	case DRM_MODE_CONNECTOR_Unknown:     return "Unknown";
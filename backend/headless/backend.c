@@ -2,9 +2,11 @@
 #include <GLES2/gl2.h>
 #include <GLES2/gl2ext.h>
 #include <stdlib.h>
+#include <string.h>
 #include <wlr/interfaces/wlr_input_device.h>
 #include <wlr/interfaces/wlr_output.h>
 #include <wlr/render/egl.h>
+#include <wlr/render/pixman.h>
 #include <wlr/util/log.h>
 #include "backend/headless.h"
 #include "util/signal.h"
@@ -22,7 +24,7 @@ static bool backend_start(struct wlr_backend *wlr_backend) {
 
 	struct wlr_headless_output *output;
 	wl_list_for_each(output, &backend->outputs, link) {
-		wl_event_source_timer_update(output->frame_timer, output->frame_delay);
+		vblank_timer_schedule(&output->vblank);
 		wlr_output_update_enabled(&output->wlr_output, true);
 		wlr_signal_emit_safe(&backend->backend.events.new_output,
 			&output->wlr_output);
@@ -62,8 +64,10 @@ static void backend_destroy(struct wlr_backend *wlr_backend) {
 
 	wlr_signal_emit_safe(&wlr_backend->events.destroy, backend);
 
-	if (backend->egl == &backend->priv_egl) {
+	if (backend->own_renderer) {
 		wlr_renderer_destroy(backend->renderer);
+	}
+	if (backend->egl == &backend->priv_egl) {
 		wlr_egl_finish(&backend->priv_egl);
 	}
 	free(backend);
@@ -102,18 +106,24 @@ static bool backend_init(struct wlr_headless_backend *backend,
 	wl_list_init(&backend->input_devices);
 
 	backend->renderer = renderer;
-	backend->egl = wlr_gles2_renderer_get_egl(renderer);
 
-	if (wlr_gles2_renderer_check_ext(backend->renderer, "GL_OES_rgb8_rgba8") ||
-			wlr_gles2_renderer_check_ext(backend->renderer,
-				"GL_OES_required_internalformat") ||
-			wlr_gles2_renderer_check_ext(backend->renderer, "GL_ARM_rgba8")) {
-		backend->internal_format = GL_RGBA8_OES;
-	} else {
-		wlr_log(WLR_INFO, "GL_RGBA8_OES not supported, "
-			"falling back to GL_RGBA4 internal format "
-			"(performance may be affected)");
-		backend->internal_format = GL_RGBA4;
+	// The pixman renderer draws into shared memory buffers, EGL isn't used
+	if (!wlr_renderer_is_pixman(renderer)) {
+		backend->egl = wlr_gles2_renderer_get_egl(renderer);
+
+		if (wlr_gles2_renderer_check_ext(backend->renderer,
+					"GL_OES_rgb8_rgba8") ||
+				wlr_gles2_renderer_check_ext(backend->renderer,
+					"GL_OES_required_internalformat") ||
+				wlr_gles2_renderer_check_ext(backend->renderer,
+					"GL_ARM_rgba8")) {
+			backend->internal_format = GL_RGBA8_OES;
+		} else {
+			wlr_log(WLR_INFO, "GL_RGBA8_OES not supported, "
+				"falling back to GL_RGBA4 internal format "
+				"(performance may be affected)");
+			backend->internal_format = GL_RGBA4;
+		}
 	}
 
 	backend->display_destroy.notify = handle_display_destroy;
@@ -148,9 +158,15 @@ struct wlr_backend *wlr_headless_backend_create(struct wl_display *display,
 		create_renderer_func = wlr_renderer_autocreate;
 	}
 
-	struct wlr_renderer *renderer = create_renderer_func(&backend->priv_egl,
-		EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY,
-		(EGLint*)config_attribs, 0);
+	struct wlr_renderer *renderer;
+	const char *renderer_name = getenv("WLR_HEADLESS_RENDERER");
+	if (renderer_name != NULL && strcmp(renderer_name, "pixman") == 0) {
+		renderer = wlr_pixman_renderer_create();
+	} else {
+		renderer = create_renderer_func(&backend->priv_egl,
+			EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY,
+			(EGLint*)config_attribs, 0);
+	}
 	if (!renderer) {
 		wlr_log(WLR_ERROR, "Failed to create renderer");
 		free(backend);
@@ -162,6 +178,7 @@ struct wlr_backend *wlr_headless_backend_create(struct wl_display *display,
 		free(backend);
 		return NULL;
 	}
+	backend->own_renderer = true;
 
 	return &backend->backend;
 }
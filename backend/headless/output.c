@@ -1,12 +1,18 @@
+#define _POSIX_C_SOURCE 200112L
 #include <assert.h>
 #include <GLES2/gl2.h>
 #include <GLES2/gl2ext.h>
 #include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
 #include <wlr/interfaces/wlr_output.h>
+#include <wlr/render/pixman.h>
 #include <wlr/render/wlr_renderer.h>
 #include <wlr/util/log.h>
 #include "backend/headless.h"
+#include "util/shm.h"
 #include "util/signal.h"
+#include "util/vblank.h"
 
 static struct wlr_headless_output *headless_output_from_output(
 		struct wlr_output *wlr_output) {
@@ -61,6 +67,67 @@ static void destroy_fbo(struct wlr_headless_output *output) {
 	output->rbo = 0;
 }
 
+static bool create_image(struct wlr_headless_output *output,
+		unsigned int width, unsigned int height) {
+	int stride = width * 4;
+	size_t size = (size_t)stride * height;
+	int fd = allocate_shm_file(size);
+	if (fd < 0) {
+		wlr_log(WLR_ERROR, "Failed to allocate shared memory buffer");
+		return false;
+	}
+
+	void *data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED) {
+		wlr_log_errno(WLR_ERROR, "mmap failed");
+		return false;
+	}
+
+	pixman_image_t *image = pixman_image_create_bits_no_clear(
+		PIXMAN_x8r8g8b8, width, height, data, stride);
+	if (image == NULL) {
+		wlr_log(WLR_ERROR, "Failed to create pixman image");
+		munmap(data, size);
+		return false;
+	}
+
+	output->shm_data = data;
+	output->shm_size = size;
+	output->image = image;
+	output->image_rendered = false;
+	return true;
+}
+
+static void destroy_image(struct wlr_headless_output *output) {
+	if (output->image == NULL) {
+		return;
+	}
+
+	pixman_image_unref(output->image);
+	munmap(output->shm_data, output->shm_size);
+
+	output->image = NULL;
+	output->shm_data = NULL;
+	output->shm_size = 0;
+}
+
+static bool create_buffer(struct wlr_headless_output *output,
+		unsigned int width, unsigned int height) {
+	if (output->backend->egl == NULL) {
+		return create_image(output, width, height);
+	}
+	return create_fbo(output, width, height);
+}
+
+static void destroy_buffer(struct wlr_headless_output *output) {
+	if (output->backend->egl == NULL) {
+		destroy_image(output);
+	} else {
+		destroy_fbo(output);
+	}
+}
+
 static bool output_set_custom_mode(struct wlr_output *wlr_output, int32_t width,
 		int32_t height, int32_t refresh) {
 	struct wlr_headless_output *output =
@@ -70,13 +137,17 @@ static bool output_set_custom_mode(struct wlr_output *wlr_output, int32_t width,
 		refresh = HEADLESS_DEFAULT_REFRESH;
 	}
 
-	destroy_fbo(output);
-	if (!create_fbo(output, width, height)) {
+	destroy_buffer(output);
+	if (!create_buffer(output, width, height)) {
 		wlr_output_destroy(wlr_output);
 		return false;
 	}
 
-	output->frame_delay = 1000000 / refresh;
+	if (!vblank_timer_set_refresh(&output->vblank, refresh)) {
+		wlr_log(WLR_ERROR, "Failed to set up vblank timer");
+		wlr_output_destroy(wlr_output);
+		return false;
+	}
 
 	wlr_output_update_custom_mode(&output->wlr_output, width, height, refresh);
 	return true;
@@ -87,6 +158,16 @@ static bool output_attach_render(struct wlr_output *wlr_output,
 	struct wlr_headless_output *output =
 		headless_output_from_output(wlr_output);
 
+	if (output->backend->egl == NULL) {
+		wlr_pixman_renderer_set_image(output->backend->renderer,
+			output->image);
+		if (buffer_age != NULL) {
+			// We only have one buffer, which keeps its contents
+			*buffer_age = output->image_rendered ? 1 : 0;
+		}
+		return true;
+	}
+
 	if (!wlr_egl_make_current(output->backend->egl, EGL_NO_SURFACE, NULL)) {
 		return false;
 	}
@@ -100,6 +181,9 @@ static bool output_attach_render(struct wlr_output *wlr_output,
 }
 
 static bool output_test(struct wlr_output *wlr_output) {
+	struct wlr_headless_output *output =
+		headless_output_from_output(wlr_output);
+
 	if (wlr_output->pending.committed & WLR_OUTPUT_STATE_ENABLED) {
 		wlr_log(WLR_DEBUG, "Cannot disable a headless output");
 		return false;
@@ -109,6 +193,14 @@ static bool output_test(struct wlr_output *wlr_output) {
 		assert(wlr_output->pending.mode_type == WLR_OUTPUT_STATE_MODE_CUSTOM);
 	}
 
+	if ((wlr_output->pending.committed & WLR_OUTPUT_STATE_BUFFER) &&
+			output->present_pending) {
+		// The pending frame would never get its present event
+		wlr_log(WLR_DEBUG, "Cannot commit a buffer to headless output '%s': "
+			"a frame is already pending", wlr_output->name);
+		return false;
+	}
+
 	return true;
 }
 
@@ -130,11 +222,19 @@ static bool output_commit(struct wlr_output *wlr_output) {
 	}
 
 	if (wlr_output->pending.committed & WLR_OUTPUT_STATE_BUFFER) {
-		glBindFramebuffer(GL_FRAMEBUFFER, 0);
-		wlr_egl_unset_current(output->backend->egl);
+		if (output->backend->egl == NULL) {
+			wlr_pixman_renderer_set_image(output->backend->renderer, NULL);
+			output->image_rendered = true;
+		} else {
+			glBindFramebuffer(GL_FRAMEBUFFER, 0);
+			wlr_egl_unset_current(output->backend->egl);
+		}
 
-		// Nothing needs to be done for FBOs
-		wlr_output_send_present(wlr_output, NULL);
+		// Nothing needs to be done for FBOs and shared memory buffers, the
+		// frame is presented at the next vblank
+		output->present_pending = true;
+		output->present_commit_seq = wlr_output->commit_seq + 1;
+		vblank_timer_schedule(&output->vblank);
 	}
 
 	return true;
@@ -143,6 +243,10 @@ static bool output_commit(struct wlr_output *wlr_output) {
 static void output_rollback_render(struct wlr_output *wlr_output) {
 	struct wlr_headless_output *output =
 		headless_output_from_output(wlr_output);
+	if (output->backend->egl == NULL) {
+		wlr_pixman_renderer_set_image(output->backend->renderer, NULL);
+		return;
+	}
 	assert(wlr_egl_is_current(output->backend->egl));
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
 	wlr_egl_unset_current(output->backend->egl);
@@ -152,8 +256,8 @@ static void output_destroy(struct wlr_output *wlr_output) {
 	struct wlr_headless_output *output =
 		headless_output_from_output(wlr_output);
 	wl_list_remove(&output->link);
-	wl_event_source_remove(output->frame_timer);
-	destroy_fbo(output);
+	vblank_timer_finish(&output->vblank);
+	destroy_buffer(output);
 	free(output);
 }
 
@@ -168,11 +272,25 @@ bool wlr_output_is_headless(struct wlr_output *wlr_output) {
 	return wlr_output->impl == &output_impl;
 }
 
-static int signal_frame(void *data) {
-	struct wlr_headless_output *output = data;
+static void handle_vblank(struct vblank_timer *timer,
+		const struct timespec *when, uint64_t seq) {
+	struct wlr_headless_output *output = timer->data;
+
+	if (output->present_pending) {
+		output->present_pending = false;
+		struct timespec present_time = *when;
+		struct wlr_output_event_present event = {
+			.commit_seq = output->present_commit_seq,
+			.when = &present_time,
+			.seq = seq,
+			.refresh = vblank_timer_get_period(timer),
+			// The timestamp is the exact virtual vblank time
+			.flags = WLR_OUTPUT_PRESENT_VSYNC | WLR_OUTPUT_PRESENT_HW_CLOCK,
+		};
+		wlr_output_send_present(&output->wlr_output, &event);
+	}
+
 	wlr_output_send_frame(&output->wlr_output);
-	wl_event_source_timer_update(output->frame_timer, output->frame_delay);
-	return 0;
 }
 
 struct wlr_output *wlr_headless_add_output(struct wlr_backend *wlr_backend,
@@ -187,11 +305,13 @@ struct wlr_output *wlr_headless_add_output(struct wlr_backend *wlr_backend,
 		return NULL;
 	}
 	output->backend = backend;
+	vblank_timer_init(&output->vblank,
+		wl_display_get_event_loop(backend->display), handle_vblank, output);
 	wlr_output_init(&output->wlr_output, &backend->backend, &output_impl,
 		backend->display);
 	struct wlr_output *wlr_output = &output->wlr_output;
 
-	if (!create_fbo(output, width, height)) {
+	if (!create_buffer(output, width, height)) {
 		goto error;
 	}
 
@@ -213,14 +333,15 @@ struct wlr_output *wlr_headless_add_output(struct wlr_backend *wlr_backend,
 	wlr_renderer_begin(backend->renderer, wlr_output->width, wlr_output->height);
 	wlr_renderer_clear(backend->renderer, (float[]){ 1.0, 1.0, 1.0, 1.0 });
 	wlr_renderer_end(backend->renderer);
-
-	struct wl_event_loop *ev = wl_display_get_event_loop(backend->display);
-	output->frame_timer = wl_event_loop_add_timer(ev, signal_frame, output);
+	if (backend->egl == NULL) {
+		wlr_pixman_renderer_set_image(backend->renderer, NULL);
+		output->image_rendered = true;
+	}
 
 	wl_list_insert(&backend->outputs, &output->link);
 
 	if (backend->started) {
-		wl_event_source_timer_update(output->frame_timer, output->frame_delay);
+		vblank_timer_schedule(&output->vblank);
 		wlr_output_update_enabled(wlr_output, true);
 		wlr_signal_emit_safe(&backend->backend.events.new_output, wlr_output);
 	}
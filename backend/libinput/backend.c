@@ -1,6 +1,7 @@
 #include <assert.h>
 #include <libinput.h>
 #include <stdlib.h>
+#include <string.h>
 #include <wlr/backend/interface.h>
 #include <wlr/backend/session.h>
 #include <wlr/util/log.h>
@@ -29,8 +30,44 @@ static const struct libinput_interface libinput_impl = {
 	.close_restricted = libinput_close_restricted
 };
 
+static void flush_queued_events(struct wlr_libinput_backend *backend) {
+	if (backend->queued_events_idle) {
+		wl_event_source_remove(backend->queued_events_idle);
+		backend->queued_events_idle = NULL;
+	}
+
+	// Detached first, in case a handler ends up flushing again
+	struct wl_array events = backend->queued_events;
+	wl_array_init(&backend->queued_events);
+
+	struct libinput_event **event_ptr;
+	wl_array_for_each(event_ptr, &events) {
+		handle_libinput_event(backend, *event_ptr);
+		libinput_event_destroy(*event_ptr);
+	}
+	wl_array_release(&events);
+}
+
+static void end_input_batch(struct wlr_libinput_backend *backend) {
+	if (!backend->devices_added) {
+		return;
+	}
+	backend->devices_added = false;
+	wlr_signal_emit_safe(&backend->backend.events.input_batch_done,
+		&backend->backend);
+}
+
+static void handle_queued_events_idle(void *_backend) {
+	struct wlr_libinput_backend *backend = _backend;
+	backend->queued_events_idle = NULL;
+	flush_queued_events(backend);
+	end_input_batch(backend);
+}
+
 static int handle_libinput_readable(int fd, uint32_t mask, void *_backend) {
 	struct wlr_libinput_backend *backend = _backend;
+	// Keep the events in order
+	flush_queued_events(backend);
 	if (libinput_dispatch(backend->libinput_context) != 0) {
 		wlr_log(WLR_ERROR, "Failed to dispatch libinput");
 		// TODO: some kind of abort?
@@ -41,6 +78,7 @@ static int handle_libinput_readable(int fd, uint32_t mask, void *_backend) {
 		handle_libinput_event(backend, event);
 		libinput_event_destroy(event);
 	}
+	end_input_batch(backend);
 	return 0;
 }
 
@@ -78,17 +116,48 @@ static bool backend_start(struct wlr_backend *wlr_backend) {
 			no_devs = NULL;
 		}
 	}
-	if (!no_devs && backend->wlr_device_lists.length == 0) {
-		handle_libinput_readable(libinput_fd, WL_EVENT_READABLE, backend);
-		if (backend->wlr_device_lists.length == 0) {
-			wlr_log(WLR_ERROR, "libinput initialization failed, no input devices");
-			wlr_log(WLR_ERROR, "Set WLR_LIBINPUT_NO_DEVICES=1 to suppress this check");
-			return false;
+
+	// Creating the wlr_input_devices (and the compositor's per-device setup,
+	// such as compiling keymaps) is deferred until the event loop is idle, so
+	// that the other backends can start and the first frame isn't delayed
+	if (libinput_dispatch(backend->libinput_context) != 0) {
+		wlr_log(WLR_ERROR, "Failed to dispatch libinput");
+		return false;
+	}
+	size_t devices_len = 0;
+	struct libinput_event *event;
+	while ((event = libinput_get_event(backend->libinput_context))) {
+		if (libinput_event_get_type(event) == LIBINPUT_EVENT_DEVICE_ADDED) {
+			devices_len++;
 		}
+		struct libinput_event **event_ptr =
+			wl_array_add(&backend->queued_events, sizeof(event));
+		if (event_ptr == NULL) {
+			wlr_log(WLR_ERROR, "Allocation failed");
+			libinput_event_destroy(event);
+			continue;
+		}
+		*event_ptr = event;
+	}
+
+	if (!no_devs && backend->wlr_device_lists.length == 0 &&
+			devices_len == 0) {
+		wlr_log(WLR_ERROR, "libinput initialization failed, no input devices");
+		wlr_log(WLR_ERROR, "Set WLR_LIBINPUT_NO_DEVICES=1 to suppress this check");
+		return false;
 	}
 
 	struct wl_event_loop *event_loop =
 		wl_display_get_event_loop(backend->display);
+	if (backend->queued_events.size > 0 && !backend->queued_events_idle) {
+		backend->queued_events_idle = wl_event_loop_add_idle(event_loop,
+			handle_queued_events_idle, backend);
+		if (!backend->queued_events_idle) {
+			wlr_log(WLR_ERROR, "Failed to defer input device enumeration");
+			flush_queued_events(backend);
+			end_input_batch(backend);
+		}
+	}
 	if (backend->input_event) {
 		wl_event_source_remove(backend->input_event);
 	}
@@ -125,6 +194,17 @@ static void backend_destroy(struct wlr_backend *wlr_backend) {
 	wl_list_remove(&backend->session_signal.link);
 
 	wlr_list_finish(&backend->wlr_device_lists);
+	if (backend->queued_events_idle) {
+		wl_event_source_remove(backend->queued_events_idle);
+	}
+	if (backend->resume_idle) {
+		wl_event_source_remove(backend->resume_idle);
+	}
+	struct libinput_event **event_ptr;
+	wl_array_for_each(event_ptr, &backend->queued_events) {
+		libinput_event_destroy(*event_ptr);
+	}
+	wl_array_release(&backend->queued_events);
 	if (backend->input_event) {
 		wl_event_source_remove(backend->input_event);
 	}
@@ -141,6 +221,12 @@ bool wlr_backend_is_libinput(struct wlr_backend *b) {
 	return b->impl == &backend_impl;
 }
 
+static void handle_resume_idle(void *_backend) {
+	struct wlr_libinput_backend *backend = _backend;
+	backend->resume_idle = NULL;
+	libinput_resume(backend->libinput_context);
+}
+
 static void session_signal(struct wl_listener *listener, void *data) {
 	struct wlr_libinput_backend *backend =
 		wl_container_of(listener, backend, session_signal);
@@ -151,7 +237,23 @@ static void session_signal(struct wl_listener *listener, void *data) {
 	}
 
 	if (session->active) {
-		libinput_resume(backend->libinput_context);
+		if (backend->resume_idle != NULL) {
+			return;
+		}
+		// Re-opening the devices may wait for the session, don't hold back
+		// the outputs for it
+		struct wl_event_loop *event_loop =
+			wl_display_get_event_loop(backend->display);
+		backend->resume_idle = wl_event_loop_add_idle(event_loop,
+			handle_resume_idle, backend);
+		if (backend->resume_idle == NULL) {
+			wlr_log(WLR_ERROR, "Failed to add idle event source");
+			libinput_resume(backend->libinput_context);
+		}
+	} else if (backend->resume_idle != NULL) {
+		// Never resumed
+		wl_event_source_remove(backend->resume_idle);
+		backend->resume_idle = NULL;
 	} else {
 		libinput_suspend(backend->libinput_context);
 	}
@@ -186,6 +288,7 @@ struct wlr_backend *wlr_libinput_backend_create(struct wl_display *display,
 
 	backend->session = session;
 	backend->display = display;
+	wl_array_init(&backend->queued_events);
 
 	backend->session_signal.notify = session_signal;
 	wl_signal_add(&session->session_signal, &backend->session_signal);
@@ -185,6 +185,7 @@ static void handle_device_added(struct wlr_libinput_backend *backend,
 	if (!wl_list_empty(wlr_devices)) {
 		libinput_device_set_user_data(libinput_dev, wlr_devices);
 		wlr_list_push(&backend->wlr_device_lists, wlr_devices);
+		backend->devices_added = true;
 	} else {
 		free(wlr_devices);
 	}
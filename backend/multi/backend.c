@@ -14,6 +14,7 @@ struct subbackend_state {
 	struct wlr_backend *container;
 	struct wl_listener new_input;
 	struct wl_listener new_output;
+	struct wl_listener input_batch_done;
 	struct wl_listener destroy;
 	struct wl_list link;
 };
@@ -39,6 +40,7 @@ static bool multi_backend_start(struct wlr_backend *wlr_backend) {
 static void subbackend_state_destroy(struct subbackend_state *sub) {
 	wl_list_remove(&sub->new_input.link);
 	wl_list_remove(&sub->new_output.link);
+	wl_list_remove(&sub->input_batch_done.link);
 	wl_list_remove(&sub->destroy.link);
 	wl_list_remove(&sub->link);
 	free(sub);
@@ -146,6 +148,14 @@ static void new_output_reemit(struct wl_listener *listener, void *data) {
 	wlr_signal_emit_safe(&state->container->events.new_output, data);
 }
 
+static void input_batch_done_reemit(struct wl_listener *listener,
+		void *data) {
+	struct subbackend_state *state = wl_container_of(listener,
+			state, input_batch_done);
+	wlr_signal_emit_safe(&state->container->events.input_batch_done,
+		state->container);
+}
+
 static void handle_subbackend_destroy(struct wl_listener *listener,
 		void *data) {
 	struct subbackend_state *state = wl_container_of(listener, state, destroy);
@@ -200,6 +210,9 @@ bool wlr_multi_backend_add(struct wlr_backend *_multi,
 	wl_signal_add(&backend->events.new_output, &sub->new_output);
 	sub->new_output.notify = new_output_reemit;
 
+	wl_signal_add(&backend->events.input_batch_done, &sub->input_batch_done);
+	sub->input_batch_done.notify = input_batch_done_reemit;
+
 	wlr_signal_emit_safe(&multi->events.backend_add, backend);
 	return true;
 }
@@ -2,18 +2,21 @@
 #include <assert.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <stdarg.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
 #include <sys/sysmacros.h>
+#include <time.h>
 #include <unistd.h>
 #include <wayland-server-core.h>
 #include <wlr/backend/session/interface.h>
 #include <wlr/config.h>
 #include <wlr/util/log.h>
 #include "util/signal.h"
+#include "util/time.h"
 
 #if WLR_HAS_SYSTEMD
 	#include <systemd/sd-bus.h>
@@ -27,6 +30,23 @@ enum { DRM_MAJOR = 226 };
 
 const struct session_impl session_logind;
 
+/**
+ * An input device released while the session was inactive. It's taken again
+ * as soon as the session becomes active, concurrently with the others, and
+ * handed over to the backend re-opening it once its reply arrives.
+ */
+struct logind_device {
+	struct logind_session *session;
+	struct wl_list link; // logind_session::devices
+
+	dev_t dev;
+	sd_bus_slot *slot; // last TakeDevice call
+	int fd; // -1 until TakeDevice succeeds
+	bool pending; // TakeDevice call in flight
+	bool done; // TakeDevice replied
+	bool unused; // not re-opened on activation, released once taken
+};
+
 struct logind_session {
 	struct wlr_session base;
 
@@ -42,6 +62,21 @@ struct logind_session {
 	// if so, the session will be (de)activated with the drm fd,
 	// otherwise with the dbus PropertiesChanged on "active" signal
 	bool has_drm;
+
+	struct wl_event_loop *event_loop;
+	struct wl_list devices; // logind_device::link
+	size_t pending_takes;
+	size_t devices_taken;
+	struct timespec activate_start;
+	// Releases the devices taken on activation which weren't re-opened
+	struct wl_event_source *release_idle;
+	// Applies the activation changes received while waiting for a device
+	struct wl_event_source *activate_idle;
+	// Activation state changes received while the session signal is being
+	// emitted or while waiting for a device are applied afterwards
+	bool updating_active;
+	bool target_active;
+	struct timespec vt_switch_time;
 };
 
 static struct logind_session *logind_session_from_session(
@@ -50,6 +85,319 @@ static struct logind_session *logind_session_from_session(
 	return (struct logind_session *)base;
 }
 
+static double elapsed_msec(const struct timespec *since) {
+	struct timespec now, diff;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	timespec_sub(&diff, &now, since);
+	return diff.tv_sec * 1000.0 + diff.tv_nsec / 1000000.0;
+}
+
+static int call_method_async(struct logind_session *session,
+		sd_bus_slot **slot, const char *path, const char *interface,
+		const char *member, sd_bus_message_handler_t callback,
+		void *userdata, const char *types, ...) {
+	sd_bus_message *msg = NULL;
+	int ret = sd_bus_message_new_method_call(session->bus, &msg,
+		"org.freedesktop.login1", path, interface, member);
+	if (ret < 0) {
+		return ret;
+	}
+
+	va_list args;
+	va_start(args, types);
+	ret = sd_bus_message_appendv(msg, types, args);
+	va_end(args);
+	if (ret < 0) {
+		sd_bus_message_unref(msg);
+		return ret;
+	}
+
+	ret = sd_bus_call_async(session->bus, slot, msg, callback, userdata, 0);
+	sd_bus_message_unref(msg);
+	return ret;
+}
+
+static int log_method_reply(sd_bus_message *msg, void *userdata,
+		sd_bus_error *ret_error) {
+	const char *member = userdata;
+	const sd_bus_error *error = sd_bus_message_get_error(msg);
+	if (error != NULL) {
+		wlr_log(WLR_ERROR, "logind %s call failed: %s", member,
+			error->message);
+	}
+	return 0;
+}
+
+/**
+ * Calls a method on the session object without waiting for its reply. Errors
+ * are logged when the reply arrives.
+ */
+static bool session_call_async(struct logind_session *session,
+		const char *member, const char *types, uint32_t major,
+		uint32_t minor) {
+	int ret;
+	if (types[0] == '\0') {
+		ret = call_method_async(session, NULL, session->path,
+			"org.freedesktop.login1.Session", member, log_method_reply,
+			(void *)member, types);
+	} else {
+		ret = call_method_async(session, NULL, session->path,
+			"org.freedesktop.login1.Session", member, log_method_reply,
+			(void *)member, types, major, minor);
+	}
+	if (ret < 0) {
+		wlr_log(WLR_ERROR, "Failed to call logind %s: %s", member,
+			strerror(-ret));
+		return false;
+	}
+	return true;
+}
+
+static void device_release_fd(struct logind_device *device) {
+	if (device->fd < 0) {
+		return;
+	}
+	close(device->fd);
+	device->fd = -1;
+	session_call_async(device->session, "ReleaseDevice", "uu",
+		major(device->dev), minor(device->dev));
+}
+
+static void device_destroy(struct logind_device *device) {
+	sd_bus_slot_unref(device->slot);
+	device_release_fd(device);
+	wl_list_remove(&device->link);
+	free(device);
+}
+
+static void set_active(struct logind_session *session, bool active);
+
+/**
+ * Destroys the devices taken on activation which weren't re-opened by the
+ * backends. Those still being taken are released when their reply arrives.
+ */
+static void release_unused_devices(struct logind_session *session) {
+	struct logind_device *device, *tmp;
+	wl_list_for_each_safe(device, tmp, &session->devices, link) {
+		if (device->pending) {
+			device->unused = true;
+		} else {
+			device_destroy(device);
+		}
+	}
+}
+
+static void handle_release_idle(void *data) {
+	struct logind_session *session = data;
+	session->release_idle = NULL;
+	release_unused_devices(session);
+}
+
+/**
+ * Schedules the release of the unused devices, once the backends have
+ * re-opened theirs from their own idle callbacks.
+ */
+static void schedule_release_unused_devices(struct logind_session *session) {
+	if (session->release_idle != NULL) {
+		return;
+	}
+	session->release_idle = wl_event_loop_add_idle(session->event_loop,
+		handle_release_idle, session);
+	if (session->release_idle == NULL) {
+		wlr_log(WLR_ERROR, "Failed to add idle event source");
+	}
+}
+
+/**
+ * Releases the devices taken for an activation, they're taken again on the
+ * next one.
+ */
+static void release_taken_devices(struct logind_session *session) {
+	if (session->release_idle != NULL) {
+		wl_event_source_remove(session->release_idle);
+		session->release_idle = NULL;
+	}
+
+	struct logind_device *device, *tmp;
+	wl_list_for_each_safe(device, tmp, &session->devices, link) {
+		if (device->unused && !device->pending) {
+			device_destroy(device);
+			continue;
+		}
+		if (device->done) {
+			device_release_fd(device);
+			device->done = false;
+		}
+		device->unused = false;
+	}
+}
+
+static void log_vt_switch(struct logind_session *session) {
+	if (session->vt_switch_time.tv_sec != 0) {
+		wlr_log(WLR_INFO, "VT switch completed %.1f ms after request",
+			elapsed_msec(&session->vt_switch_time));
+		session->vt_switch_time = (struct timespec){0};
+	}
+}
+
+static void handle_activate_idle(void *data) {
+	struct logind_session *session = data;
+	session->activate_idle = NULL;
+	set_active(session, session->target_active);
+}
+
+static int device_handle_take_reply(sd_bus_message *msg, void *userdata,
+		sd_bus_error *ret_error) {
+	struct logind_device *device = userdata;
+	struct logind_session *session = device->session;
+	device->pending = false;
+	device->done = true;
+
+	const sd_bus_error *error = sd_bus_message_get_error(msg);
+	int fd = -1, paused = 0;
+	int ret;
+	if (error != NULL) {
+		wlr_log(WLR_DEBUG, "Failed to take device %u:%u: %s",
+			major(device->dev), minor(device->dev), error->message);
+	} else if ((ret = sd_bus_message_read(msg, "hb", &fd, &paused)) < 0) {
+		wlr_log(WLR_ERROR, "Failed to parse D-Bus response for TakeDevice: %s",
+			strerror(-ret));
+	} else {
+		// The fd is closed when the message is freed
+		device->fd = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+		if (device->fd < 0) {
+			wlr_log_errno(WLR_ERROR, "Failed to clone file descriptor");
+		}
+	}
+
+	assert(session->pending_takes > 0);
+	if (--session->pending_takes == 0) {
+		wlr_log(WLR_INFO, "Input devices taken %.1f ms after activation "
+			"(%zu concurrently)", elapsed_msec(&session->activate_start),
+			session->devices_taken);
+	}
+
+	if (!session->base.active) {
+		// Deactivated in the meantime, taken again on the next activation
+		device_release_fd(device);
+		device->done = false;
+		device->unused = false;
+	} else if (device->unused) {
+		// Devices can't be destroyed from their own reply callback
+		device_release_fd(device);
+		schedule_release_unused_devices(session);
+	}
+	return 0;
+}
+
+/**
+ * Takes all devices released while the session was inactive, without waiting
+ * for the replies.
+ */
+static size_t take_released_devices(struct logind_session *session) {
+	size_t n = 0;
+	struct logind_device *device;
+	wl_list_for_each(device, &session->devices, link) {
+		if (device->pending || device->done) {
+			continue;
+		}
+		sd_bus_slot_unref(device->slot);
+		device->slot = NULL;
+		int ret = call_method_async(session, &device->slot, session->path,
+			"org.freedesktop.login1.Session", "TakeDevice",
+			device_handle_take_reply, device, "uu",
+			major(device->dev), minor(device->dev));
+		if (ret < 0) {
+			wlr_log(WLR_ERROR, "Failed to take device %u:%u: %s",
+				major(device->dev), minor(device->dev), strerror(-ret));
+			device->done = true;
+			continue;
+		}
+		device->pending = true;
+		++n;
+	}
+	return n;
+}
+
+static struct logind_device *find_taken_device(
+		struct logind_session *session, dev_t dev) {
+	struct logind_device *device;
+	wl_list_for_each(device, &session->devices, link) {
+		if (device->dev == dev && (device->pending || device->done)) {
+			return device;
+		}
+	}
+	return NULL;
+}
+
+/**
+ * Waits for the reply to the TakeDevice call of a device, handing the other
+ * devices their fds as their replies arrive. Activation changes received in
+ * the meantime are applied afterwards, the caller being in the middle of
+ * re-opening its devices.
+ */
+static void wait_taken_device(struct logind_session *session,
+		struct logind_device *device) {
+	bool updating_active = session->updating_active;
+	session->updating_active = true;
+	while (device->pending) {
+		int ret = sd_bus_process(session->bus, NULL);
+		if (ret == 0) {
+			ret = sd_bus_wait(session->bus, UINT64_MAX);
+		}
+		if (ret < 0) {
+			wlr_log(WLR_ERROR, "Failed to wait for device %u:%u: %s",
+				major(device->dev), minor(device->dev), strerror(-ret));
+			break;
+		}
+	}
+	session->updating_active = updating_active;
+
+	if (updating_active || session->base.active == session->target_active ||
+			session->activate_idle != NULL) {
+		return;
+	}
+	session->activate_idle = wl_event_loop_add_idle(session->event_loop,
+		handle_activate_idle, session);
+	if (session->activate_idle == NULL) {
+		wlr_log(WLR_ERROR, "Failed to add idle event source");
+	}
+}
+
+static void set_active(struct logind_session *session, bool active) {
+	session->target_active = active;
+	if (session->updating_active) {
+		return;
+	}
+
+	session->updating_active = true;
+	while (session->base.active != session->target_active) {
+		struct timespec start;
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		if (session->target_active) {
+			// The outputs are restored right away, input devices are handed
+			// over as their replies arrive
+			session->activate_start = start;
+			session->devices_taken = take_released_devices(session);
+			session->pending_takes += session->devices_taken;
+			session->base.active = true;
+			wlr_signal_emit_safe(&session->base.session_signal, session);
+			schedule_release_unused_devices(session);
+			wlr_log(WLR_INFO, "Session activated in %.1f ms "
+				"(taking %zu input devices concurrently)",
+				elapsed_msec(&start), session->devices_taken);
+		} else {
+			release_taken_devices(session);
+			session->base.active = false;
+			wlr_signal_emit_safe(&session->base.session_signal, session);
+			wlr_log(WLR_INFO, "Session deactivated in %.1f ms",
+				elapsed_msec(&start));
+		}
+		log_vt_switch(session);
+	}
+	session->updating_active = false;
+}
+
 static int logind_take_device(struct wlr_session *base, const char *path) {
 	struct logind_session *session = logind_session_from_session(base);
 
@@ -68,6 +416,24 @@ static int logind_take_device(struct wlr_session *base, const char *path) {
 		session->has_drm = true;
 	}
 
+	struct logind_device *device = find_taken_device(session, st.st_rdev);
+	if (device != NULL && device->pending) {
+		wait_taken_device(session, device);
+		if (device->pending) {
+			// Released once its reply arrives
+			device->unused = true;
+			return -1;
+		}
+	}
+	if (device != NULL) {
+		fd = device->fd;
+		device->fd = -1;
+		device_destroy(device);
+		if (fd >= 0) {
+			return fd;
+		}
+	}
+
 	ret = sd_bus_call_method(session->bus, "org.freedesktop.login1",
 		session->path, "org.freedesktop.login1.Session", "TakeDevice",
 		&error, &msg, "uu", major(st.st_rdev), minor(st.st_rdev));
@@ -112,18 +478,30 @@ static void logind_release_device(struct wlr_session *base, int fd) {
 	}
 	close(fd);
 
-	sd_bus_message *msg = NULL;
-	sd_bus_error error = SD_BUS_ERROR_NULL;
-	int ret = sd_bus_call_method(session->bus, "org.freedesktop.login1",
-		session->path, "org.freedesktop.login1.Session", "ReleaseDevice",
-		&error, &msg, "uu", major(st.st_rdev), minor(st.st_rdev));
-	if (ret < 0) {
-		wlr_log(WLR_ERROR, "Failed to release device '%d': %s", fd,
-			error.message);
+	session_call_async(session, "ReleaseDevice", "uu",
+		major(st.st_rdev), minor(st.st_rdev));
+
+	if (session->base.active || major(st.st_rdev) == DRM_MAJOR) {
+		return;
 	}
 
-	sd_bus_error_free(&error);
-	sd_bus_message_unref(msg);
+	// Input devices closed on deactivation are taken again on activation
+	struct logind_device *device;
+	wl_list_for_each(device, &session->devices, link) {
+		if (device->dev == st.st_rdev) {
+			return;
+		}
+	}
+
+	device = calloc(1, sizeof(*device));
+	if (device == NULL) {
+		wlr_log_errno(WLR_ERROR, "Allocation failed");
+		return;
+	}
+	device->session = session;
+	device->dev = st.st_rdev;
+	device->fd = -1;
+	wl_list_insert(session->devices.prev, &device->link);
 }
 
 static bool logind_change_vt(struct wlr_session *base, unsigned vt) {
@@ -134,19 +512,17 @@ static bool logind_change_vt(struct wlr_session *base, unsigned vt) {
 		return true;
 	}
 
-	int ret;
-	sd_bus_message *msg = NULL;
-	sd_bus_error error = SD_BUS_ERROR_NULL;
+	clock_gettime(CLOCK_MONOTONIC, &session->vt_switch_time);
 
-	ret = sd_bus_call_method(session->bus, "org.freedesktop.login1",
-		"/org/freedesktop/login1/seat/seat0", "org.freedesktop.login1.Seat", "SwitchTo",
-		&error, &msg, "u", (uint32_t)vt);
+	// The switch itself is reported by PauseDevice/ResumeDevice
+	int ret = call_method_async(session, NULL,
+		"/org/freedesktop/login1/seat/seat0", "org.freedesktop.login1.Seat",
+		"SwitchTo", log_method_reply, "SwitchTo", "u", (uint32_t)vt);
 	if (ret < 0) {
-		wlr_log(WLR_ERROR, "Failed to change to vt '%d'", vt);
+		wlr_log(WLR_ERROR, "Failed to change to vt '%d': %s", vt,
+			strerror(-ret));
+		session->vt_switch_time = (struct timespec){0};
 	}
-
-	sd_bus_error_free(&error);
-	sd_bus_message_unref(msg);
 	return ret >= 0;
 }
 
@@ -207,20 +583,8 @@ out:
 }
 
 static bool session_activate(struct logind_session *session) {
-	int ret;
-	sd_bus_message *msg = NULL;
-	sd_bus_error error = SD_BUS_ERROR_NULL;
-
-	ret = sd_bus_call_method(session->bus, "org.freedesktop.login1",
-		session->path, "org.freedesktop.login1.Session", "Activate",
-		&error, &msg, "");
-	if (ret < 0) {
-		wlr_log(WLR_ERROR, "Failed to activate session: %s", error.message);
-	}
-
-	sd_bus_error_free(&error);
-	sd_bus_message_unref(msg);
-	return ret >= 0;
+	// Nothing depends on the reply, TakeControl is processed after it
+	return session_call_async(session, "Activate", "", 0, 0);
 }
 
 static bool take_control(struct logind_session *session) {
@@ -261,6 +625,17 @@ static void release_control(struct logind_session *session) {
 static void logind_session_destroy(struct wlr_session *base) {
 	struct logind_session *session = logind_session_from_session(base);
 
+	if (session->activate_idle != NULL) {
+		wl_event_source_remove(session->activate_idle);
+	}
+	if (session->release_idle != NULL) {
+		wl_event_source_remove(session->release_idle);
+	}
+	struct logind_device *device, *tmp;
+	wl_list_for_each_safe(device, tmp, &session->devices, link) {
+		device_destroy(device);
+	}
+
 	release_control(session);
 
 	wl_event_source_remove(session->event);
@@ -309,18 +684,11 @@ static int pause_device(sd_bus_message *msg, void *userdata,
 
 	if (major == DRM_MAJOR && strcmp(type, "gone") != 0) {
 		assert(session->has_drm);
-		session->base.active = false;
-		wlr_signal_emit_safe(&session->base.session_signal, session);
+		set_active(session, false);
 	}
 
 	if (strcmp(type, "pause") == 0) {
-		ret = sd_bus_call_method(session->bus, "org.freedesktop.login1",
-			session->path, "org.freedesktop.login1.Session", "PauseDeviceComplete",
-			ret_error, &msg, "uu", major, minor);
-		if (ret < 0) {
-			wlr_log(WLR_ERROR, "Failed to send PauseDeviceComplete signal: %s",
-				strerror(-ret));
-		}
+		session_call_async(session, "PauseDeviceComplete", "uu", major, minor);
 	}
 
 error:
@@ -350,10 +718,7 @@ static int resume_device(sd_bus_message *msg, void *userdata,
 			goto error;
 		}
 
-		if (!session->base.active) {
-			session->base.active = true;
-			wlr_signal_emit_safe(&session->base.session_signal, session);
-		}
+		set_active(session, true);
 	}
 
 error:
@@ -409,10 +774,7 @@ static int session_properties_changed(sd_bus_message *msg, void *userdata,
 				goto error;
 			}
 
-			if (session->base.active != active) {
-				session->base.active = active;
-				wlr_signal_emit_safe(&session->base.session_signal, session);
-			}
+			set_active(session, active);
 			return 0;
 		} else {
 			sd_bus_message_skip(msg, "{sv}");
@@ -449,10 +811,7 @@ static int session_properties_changed(sd_bus_message *msg, void *userdata,
 				return 0;
 			}
 
-			if (session->base.active != active) {
-				session->base.active = active;
-				wlr_signal_emit_safe(&session->base.session_signal, session);
-			}
+			set_active(session, active);
 			return 0;
 		}
 	}
@@ -749,6 +1108,7 @@ static struct wlr_session *logind_session_create(struct wl_display *disp) {
 		wlr_log(WLR_ERROR, "Allocation failed: %s", strerror(errno));
 		return NULL;
 	}
+	wl_list_init(&session->devices);
 
 	if (!get_display_session(&session->id)) {
 		goto error;
@@ -793,6 +1153,7 @@ static struct wlr_session *logind_session_create(struct wl_display *disp) {
 	}
 
 	struct wl_event_loop *event_loop = wl_display_get_event_loop(disp);
+	session->event_loop = event_loop;
 	session->event = wl_event_loop_add_fd(event_loop, sd_bus_get_fd(session->bus),
 		WL_EVENT_READABLE, dbus_event, session->bus);
 
@@ -0,0 +1,286 @@
+#define _POSIX_C_SOURCE 200809L
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <wayland-client.h>
+#include <wayland-server-core.h>
+
+#include <wlr/backend/wayland.h>
+#include <wlr/types/wlr_buffer.h>
+#include <wlr/util/log.h>
+
+#include "backend/wayland.h"
+#include "util/shm.h"
+
+static void shm_buffer_finish(struct wlr_wl_shm_buffer *buffer) {
+	if (buffer->wl_buffer == NULL) {
+		return;
+	}
+	wl_buffer_destroy(buffer->wl_buffer);
+	munmap(buffer->data, buffer->size);
+	memset(buffer, 0, sizeof(*buffer));
+}
+
+static void shm_buffer_handle_release(void *data, struct wl_buffer *wl_buffer) {
+	struct wlr_wl_shm_buffer *buffer = data;
+	buffer->busy = false;
+}
+
+static const struct wl_buffer_listener shm_buffer_listener = {
+	.release = shm_buffer_handle_release,
+};
+
+static bool shm_buffer_init(struct wlr_wl_shm_buffer *buffer,
+		struct wlr_wl_backend *wl, int32_t width, int32_t height,
+		int32_t stride, uint32_t format) {
+	size_t size = (size_t)stride * height;
+	int fd = allocate_shm_file(size);
+	if (fd < 0) {
+		wlr_log_errno(WLR_ERROR, "Failed to allocate shm file");
+		return false;
+	}
+
+	void *data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (data == MAP_FAILED) {
+		wlr_log_errno(WLR_ERROR, "mmap failed");
+		close(fd);
+		return false;
+	}
+
+	struct wl_shm_pool *pool = wl_shm_create_pool(wl->shm, fd, size);
+	buffer->wl_buffer = wl_shm_pool_create_buffer(pool, 0, width, height,
+		stride, format);
+	wl_shm_pool_destroy(pool);
+	close(fd);
+
+	buffer->data = data;
+	buffer->size = size;
+	buffer->width = width;
+	buffer->height = height;
+	buffer->stride = stride;
+	buffer->format = format;
+	buffer->busy = false;
+	wl_buffer_add_listener(buffer->wl_buffer, &shm_buffer_listener, buffer);
+	return true;
+}
+
+static struct wl_shm_buffer *get_wl_shm_buffer(struct wlr_buffer *buffer) {
+	struct wlr_client_buffer *client_buffer = wlr_client_buffer_get(buffer);
+	if (client_buffer == NULL || client_buffer->resource == NULL) {
+		return NULL;
+	}
+	return wl_shm_buffer_get(client_buffer->resource);
+}
+
+static bool test_shm_buffer(struct wlr_wl_backend *wl,
+		struct wl_shm_buffer *shm_buffer) {
+	if (wl->shm == NULL) {
+		return false;
+	}
+
+	// Only the formats every compositor supports are forwarded
+	uint32_t format = wl_shm_buffer_get_format(shm_buffer);
+	return format == WL_SHM_FORMAT_ARGB8888 ||
+		format == WL_SHM_FORMAT_XRGB8888;
+}
+
+/**
+ * Copies a client wl_shm buffer into a free buffer of the remote compositor.
+ * libwayland-server doesn't expose the pool's file descriptor, so the data
+ * can't be shared directly.
+ */
+static struct wlr_wl_shm_buffer *layer_copy_shm_buffer(
+		struct wlr_wl_output_layer *layer, struct wl_shm_buffer *shm_buffer) {
+	int32_t width = wl_shm_buffer_get_width(shm_buffer);
+	int32_t height = wl_shm_buffer_get_height(shm_buffer);
+	int32_t stride = wl_shm_buffer_get_stride(shm_buffer);
+	uint32_t format = wl_shm_buffer_get_format(shm_buffer);
+
+	struct wlr_wl_shm_buffer *buffer = NULL;
+	size_t buffers_len =
+		sizeof(layer->shm_buffers) / sizeof(layer->shm_buffers[0]);
+	for (size_t i = 0; i < buffers_len; ++i) {
+		struct wlr_wl_shm_buffer *b = &layer->shm_buffers[i];
+		if (b->busy) {
+			continue;
+		}
+		if (b->wl_buffer != NULL && b->width == width &&
+				b->height == height && b->stride == stride &&
+				b->format == format) {
+			buffer = b;
+			break;
+		}
+		if (buffer == NULL) {
+			buffer = b;
+		}
+	}
+	if (buffer == NULL) {
+		wlr_log(WLR_DEBUG, "All shm buffers of the layer are busy");
+		return NULL;
+	}
+
+	if (buffer->wl_buffer == NULL || buffer->width != width ||
+			buffer->height != height || buffer->stride != stride ||
+			buffer->format != format) {
+		shm_buffer_finish(buffer);
+		if (!shm_buffer_init(buffer, layer->output->backend, width, height,
+				stride, format)) {
+			return NULL;
+		}
+	}
+
+	wl_shm_buffer_begin_access(shm_buffer);
+	memcpy(buffer->data, wl_shm_buffer_get_data(shm_buffer), buffer->size);
+	wl_shm_buffer_end_access(shm_buffer);
+
+	return buffer;
+}
+
+struct wlr_wl_output_layer *wlr_wl_output_layer_create(
+		struct wlr_output *wlr_output) {
+	assert(wlr_output_is_wl(wlr_output));
+	struct wlr_wl_output *output = (struct wlr_wl_output *)wlr_output;
+	struct wlr_wl_backend *wl = output->backend;
+
+	if (wl->subcompositor == NULL) {
+		wlr_log(WLR_DEBUG,
+			"Remote Wayland compositor does not support wl_subcompositor");
+		return NULL;
+	}
+
+	struct wlr_wl_output_layer *layer = calloc(1, sizeof(*layer));
+	if (layer == NULL) {
+		wlr_log_errno(WLR_ERROR, "Allocation failed");
+		return NULL;
+	}
+	layer->output = output;
+
+	layer->surface = wl_compositor_create_surface(wl->compositor);
+	if (layer->surface == NULL) {
+		wlr_log_errno(WLR_ERROR, "Could not create layer surface");
+		free(layer);
+		return NULL;
+	}
+
+	layer->subsurface = wl_subcompositor_get_subsurface(wl->subcompositor,
+		layer->surface, output->surface);
+	if (layer->subsurface == NULL) {
+		wlr_log_errno(WLR_ERROR, "Could not create layer subsurface");
+		wl_surface_destroy(layer->surface);
+		free(layer);
+		return NULL;
+	}
+
+	// Input events go to the output's surface
+	struct wl_region *region = wl_compositor_create_region(wl->compositor);
+	wl_surface_set_input_region(layer->surface, region);
+	wl_region_destroy(region);
+
+	wl_list_insert(output->layers.prev, &layer->link);
+	return layer;
+}
+
+void destroy_wl_output_layer(struct wlr_wl_output_layer *layer) {
+	size_t buffers_len =
+		sizeof(layer->shm_buffers) / sizeof(layer->shm_buffers[0]);
+	for (size_t i = 0; i < buffers_len; ++i) {
+		shm_buffer_finish(&layer->shm_buffers[i]);
+	}
+	wl_list_remove(&layer->link);
+	wl_subsurface_destroy(layer->subsurface);
+	wl_surface_destroy(layer->surface);
+	free(layer);
+}
+
+void wlr_wl_output_layer_destroy(struct wlr_wl_output_layer *layer) {
+	if (layer == NULL) {
+		return;
+	}
+	layer->output->layers_dirty = true;
+	destroy_wl_output_layer(layer);
+}
+
+bool wlr_wl_output_layer_test_buffer(struct wlr_wl_output_layer *layer,
+		struct wlr_buffer *buffer) {
+	struct wlr_wl_backend *wl = layer->output->backend;
+
+	struct wl_shm_buffer *shm_buffer = get_wl_shm_buffer(buffer);
+	if (shm_buffer != NULL) {
+		return test_shm_buffer(wl, shm_buffer);
+	}
+	return wl->zwp_linux_dmabuf_v1 != NULL && test_wl_buffer(wl, buffer);
+}
+
+bool wlr_wl_output_layer_attach_buffer(struct wlr_wl_output_layer *layer,
+		struct wlr_buffer *buffer, pixman_region32_t *damage) {
+	struct wlr_wl_backend *wl = layer->output->backend;
+
+	struct wl_buffer *wl_buffer = NULL;
+	if (buffer != NULL) {
+		if (!wlr_wl_output_layer_test_buffer(layer, buffer)) {
+			return false;
+		}
+
+		struct wl_shm_buffer *shm_buffer = get_wl_shm_buffer(buffer);
+		if (shm_buffer != NULL) {
+			struct wlr_wl_shm_buffer *copy =
+				layer_copy_shm_buffer(layer, shm_buffer);
+			if (copy == NULL) {
+				return false;
+			}
+			copy->busy = true;
+			wl_buffer = copy->wl_buffer;
+		} else {
+			// The DMA-BUF is shared with the remote compositor, the buffer
+			// stays locked until it's released
+			struct wlr_wl_buffer *remote_buffer = create_wl_buffer(wl, buffer);
+			if (remote_buffer == NULL) {
+				return false;
+			}
+			wl_buffer = remote_buffer->wl_buffer;
+		}
+	}
+
+	wl_surface_attach(layer->surface, wl_buffer, 0, 0);
+	if (wl_buffer != NULL) {
+		damage_wl_surface(layer->surface, damage);
+	}
+	// Subsurfaces are synchronized, this is applied with the output's commit
+	wl_surface_commit(layer->surface);
+	layer->output->layers_dirty = true;
+	return true;
+}
+
+void wlr_wl_output_layer_set_position(struct wlr_wl_output_layer *layer,
+		int32_t x, int32_t y) {
+	wl_subsurface_set_position(layer->subsurface, x, y);
+	layer->output->layers_dirty = true;
+}
+
+static struct wl_surface *layer_get_sibling_surface(
+		struct wlr_wl_output_layer *layer,
+		struct wlr_wl_output_layer *sibling) {
+	if (sibling == NULL) {
+		return layer->output->surface;
+	}
+	assert(sibling->output == layer->output && sibling != layer);
+	return sibling->surface;
+}
+
+void wlr_wl_output_layer_place_above(struct wlr_wl_output_layer *layer,
+		struct wlr_wl_output_layer *sibling) {
+	wl_subsurface_place_above(layer->subsurface,
+		layer_get_sibling_surface(layer, sibling));
+	layer->output->layers_dirty = true;
+}
+
+void wlr_wl_output_layer_place_below(struct wlr_wl_output_layer *layer,
+		struct wlr_wl_output_layer *sibling) {
+	wl_subsurface_place_below(layer->subsurface,
+		layer_get_sibling_surface(layer, sibling));
+	layer->output->layers_dirty = true;
+}
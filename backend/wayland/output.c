@@ -125,7 +125,7 @@ static const struct wl_buffer_listener buffer_listener = {
 	.release = buffer_handle_release,
 };
 
-static bool test_buffer(struct wlr_wl_backend *wl,
+bool test_wl_buffer(struct wlr_wl_backend *wl,
 		struct wlr_buffer *wlr_buffer) {
 	struct wlr_dmabuf_attributes attribs;
 	if (!wlr_buffer_get_dmabuf(wlr_buffer, &attribs)) {
@@ -140,9 +140,9 @@ static bool test_buffer(struct wlr_wl_backend *wl,
 	return true;
 }
 
-static struct wlr_wl_buffer *create_wl_buffer(struct wlr_wl_backend *wl,
+struct wlr_wl_buffer *create_wl_buffer(struct wlr_wl_backend *wl,
 		struct wlr_buffer *wlr_buffer) {
-	if (!test_buffer(wl, wlr_buffer)) {
+	if (!test_wl_buffer(wl, wlr_buffer)) {
 		return NULL;
 	}
 
@@ -187,6 +187,21 @@ static struct wlr_wl_buffer *create_wl_buffer(struct wlr_wl_backend *wl,
 	return buffer;
 }
 
+void damage_wl_surface(struct wl_surface *surface, pixman_region32_t *damage) {
+	if (damage == NULL) {
+		wl_surface_damage_buffer(surface, 0, 0, INT32_MAX, INT32_MAX);
+		return;
+	}
+
+	int rects_len;
+	pixman_box32_t *rects = pixman_region32_rectangles(damage, &rects_len);
+	for (int i = 0; i < rects_len; i++) {
+		pixman_box32_t *r = &rects[i];
+		wl_surface_damage_buffer(surface, r->x1, r->y1,
+			r->x2 - r->x1, r->y2 - r->y1);
+	}
+}
+
 static bool output_test(struct wlr_output *wlr_output) {
 	struct wlr_wl_output *output =
 		get_wl_output_from_output(wlr_output);
@@ -202,7 +217,7 @@ static bool output_test(struct wlr_output *wlr_output) {
 
 	if ((wlr_output->pending.committed & WLR_OUTPUT_STATE_BUFFER) &&
 			wlr_output->pending.buffer_type == WLR_OUTPUT_STATE_BUFFER_SCANOUT &&
-			!test_buffer(output->backend, wlr_output->pending.buffer)) {
+			!test_wl_buffer(output->backend, wlr_output->pending.buffer)) {
 		return false;
 	}
 
@@ -261,20 +276,7 @@ static bool output_commit(struct wlr_output *wlr_output) {
 			}
 
 			wl_surface_attach(output->surface, buffer->wl_buffer, 0, 0);
-
-			if (damage == NULL) {
-				wl_surface_damage_buffer(output->surface,
-					0, 0, INT32_MAX, INT32_MAX);
-			} else {
-				int rects_len;
-				pixman_box32_t *rects =
-					pixman_region32_rectangles(damage, &rects_len);
-				for (int i = 0; i < rects_len; i++) {
-					pixman_box32_t *r = &rects[i];
-					wl_surface_damage_buffer(output->surface, r->x1, r->y1,
-						r->x2 - r->x1, r->y2 - r->y1);
-				}
-			}
+			damage_wl_surface(output->surface, damage);
 			wl_surface_commit(output->surface);
 			break;
 		}
@@ -296,7 +298,16 @@ static bool output_commit(struct wlr_output *wlr_output) {
 		} else {
 			wlr_output_send_present(wlr_output, NULL);
 		}
+	} else if (output->layers_dirty) {
+		// Apply the layers' subsurface state, cached until the parent commits
+		if (output->frame_callback == NULL) {
+			output->frame_callback = wl_surface_frame(output->surface);
+			wl_callback_add_listener(output->frame_callback, &frame_listener,
+				output);
+		}
+		wl_surface_commit(output->surface);
 	}
+	output->layers_dirty = false;
 
 	return true;
 }
@@ -390,6 +401,11 @@ static void output_destroy(struct wlr_output *wlr_output) {
 
 	wl_list_remove(&output->link);
 
+	struct wlr_wl_output_layer *layer, *layer_tmp;
+	wl_list_for_each_safe(layer, layer_tmp, &output->layers, link) {
+		destroy_wl_output_layer(layer);
+	}
+
 	if (output->cursor.egl_window != NULL) {
 		wl_egl_window_destroy(output->cursor.egl_window);
 	}
@@ -514,6 +530,7 @@ struct wlr_output *wlr_wl_output_create(struct wlr_backend *wlr_backend) {
 
 	output->backend = backend;
 	wl_list_init(&output->presentation_feedbacks);
+	wl_list_init(&output->layers);
 
 	output->surface = wl_compositor_create_surface(backend->compositor);
 	if (!output->surface) {
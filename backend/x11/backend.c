@@ -5,6 +5,7 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 
 #include <wlr/config.h>
@@ -14,6 +15,12 @@
 #include <xcb/xcb.h>
 #include <xcb/xfixes.h>
 #include <xcb/xinput.h>
+#if WLR_HAS_XCB_PRESENT
+#include <xcb/present.h>
+#endif
+#if WLR_HAS_XCB_SHM
+#include <xcb/shm.h>
+#endif
 
 #include <wlr/backend/interface.h>
 #include <wlr/backend/x11.h>
@@ -21,6 +28,7 @@
 #include <wlr/interfaces/wlr_keyboard.h>
 #include <wlr/interfaces/wlr_pointer.h>
 #include <wlr/render/egl.h>
+#include <wlr/render/pixman.h>
 #include <wlr/render/wlr_renderer.h>
 #include <wlr/util/log.h>
 
@@ -75,6 +83,11 @@ static void handle_x11_event(struct wlr_x11_backend *x11,
 		xcb_ge_generic_event_t *ev = (xcb_ge_generic_event_t *)event;
 		if (ev->extension == x11->xinput_opcode) {
 			handle_x11_xinput_event(x11, ev);
+#if WLR_HAS_XCB_PRESENT
+		} else if (x11->has_present &&
+				ev->extension == x11->present_opcode) {
+			handle_x11_present_event(x11, ev);
+#endif
 		}
 	}
 	}
@@ -138,7 +151,9 @@ static void backend_destroy(struct wlr_backend *backend) {
 	wl_list_remove(&x11->display_destroy.link);
 
 	wlr_renderer_destroy(x11->renderer);
-	wlr_egl_finish(&x11->egl);
+	if (!x11->use_shm) {
+		wlr_egl_finish(&x11->egl);
+	}
 
 	if (x11->xlib_conn) {
 		XCloseDisplay(x11->xlib_conn);
@@ -162,6 +177,18 @@ bool wlr_backend_is_x11(struct wlr_backend *backend) {
 	return backend->impl == &backend_impl;
 }
 
+static bool has_dri3(struct wlr_x11_backend *x11) {
+	// Only the presence of DRI3 matters here, it's used by EGL internally
+	const char name[] = "DRI3";
+	xcb_query_extension_cookie_t cookie =
+		xcb_query_extension(x11->xcb, strlen(name), name);
+	xcb_query_extension_reply_t *reply =
+		xcb_query_extension_reply(x11->xcb, cookie, NULL);
+	bool present = reply != NULL && reply->present;
+	free(reply);
+	return present;
+}
+
 static void handle_display_destroy(struct wl_listener *listener, void *data) {
 	struct wlr_x11_backend *x11 =
 		wl_container_of(listener, x11, display_destroy);
@@ -262,6 +289,42 @@ struct wlr_backend *wlr_x11_backend_create(struct wl_display *display,
 	}
 	free(xi_reply);
 
+#if WLR_HAS_XCB_PRESENT
+	ext = xcb_get_extension_data(x11->xcb, &xcb_present_id);
+	if (ext && ext->present) {
+		xcb_present_query_version_cookie_t present_cookie =
+			xcb_present_query_version(x11->xcb, 1, 0);
+		xcb_present_query_version_reply_t *present_reply =
+			xcb_present_query_version_reply(x11->xcb, present_cookie, NULL);
+		if (present_reply) {
+			x11->present_opcode = ext->major_opcode;
+			x11->has_present = true;
+		}
+		free(present_reply);
+	}
+	if (!x11->has_present) {
+		wlr_log(WLR_INFO, "X11 does not support Present extension, "
+			"frames will be paced by a timer");
+	}
+#else
+	wlr_log(WLR_INFO, "wlroots was built without xcb-present, "
+		"frames will be paced by a timer");
+#endif
+
+#if WLR_HAS_XCB_SHM
+	ext = xcb_get_extension_data(x11->xcb, &xcb_shm_id);
+	if (ext && ext->present) {
+		xcb_shm_query_version_cookie_t shm_cookie =
+			xcb_shm_query_version(x11->xcb);
+		xcb_shm_query_version_reply_t *shm_reply =
+			xcb_shm_query_version_reply(x11->xcb, shm_cookie, NULL);
+		// File descriptor passing requires MIT-SHM 1.2
+		x11->has_shm = shm_reply != NULL && (shm_reply->major_version > 1 ||
+			shm_reply->minor_version >= 2);
+		free(shm_reply);
+	}
+#endif
+
 	int fd = xcb_get_file_descriptor(x11->xcb);
 	struct wl_event_loop *ev = wl_display_get_event_loop(display);
 	uint32_t events = WL_EVENT_READABLE | WL_EVENT_ERROR | WL_EVENT_HANGUP;
@@ -274,22 +337,52 @@ struct wlr_backend *wlr_x11_backend_create(struct wl_display *display,
 
 	x11->screen = xcb_setup_roots_iterator(xcb_get_setup(x11->xcb)).data;
 
-	if (!create_renderer_func) {
-		create_renderer_func = wlr_renderer_autocreate;
+	const char *renderer_name = getenv("WLR_X11_RENDERER");
+	if (renderer_name != NULL && strcmp(renderer_name, "pixman") == 0) {
+		x11->use_shm = true;
+	} else if (!create_renderer_func && x11->has_shm && !has_dri3(x11)) {
+		// Without DRI3, EGL falls back to slow copies through the X server
+		wlr_log(WLR_INFO, "X11 does not support DRI3 extension, "
+			"using pixman renderer with MIT-SHM");
+		x11->use_shm = true;
 	}
 
-	static EGLint config_attribs[] = {
-		EGL_SURFACE_TYPE, EGL_WINDOW_BIT,
-		EGL_RENDERABLE_TYPE, EGL_OPENGL_ES2_BIT,
-		EGL_RED_SIZE, 1,
-		EGL_GREEN_SIZE, 1,
-		EGL_BLUE_SIZE, 1,
-		EGL_ALPHA_SIZE, 0,
-		EGL_NONE,
-	};
+	if (x11->use_shm) {
+		if (!x11->has_shm) {
+#if WLR_HAS_XCB_SHM
+			wlr_log(WLR_ERROR, "X11 does not support MIT-SHM 1.2, "
+				"required by pixman renderer");
+#else
+			wlr_log(WLR_ERROR, "wlroots was built without xcb-shm, "
+				"required by pixman renderer");
+#endif
+			goto error_event;
+		}
+		if (x11->screen->root_depth != 24 && x11->screen->root_depth != 32) {
+			wlr_log(WLR_ERROR, "Unsupported X11 screen depth %d "
+				"for pixman renderer", x11->screen->root_depth);
+			goto error_event;
+		}
 
-	x11->renderer = create_renderer_func(&x11->egl, EGL_PLATFORM_X11_KHR,
-		x11->xlib_conn, config_attribs, x11->screen->root_visual);
+		x11->renderer = wlr_pixman_renderer_create();
+	} else {
+		if (!create_renderer_func) {
+			create_renderer_func = wlr_renderer_autocreate;
+		}
+
+		static EGLint config_attribs[] = {
+			EGL_SURFACE_TYPE, EGL_WINDOW_BIT,
+			EGL_RENDERABLE_TYPE, EGL_OPENGL_ES2_BIT,
+			EGL_RED_SIZE, 1,
+			EGL_GREEN_SIZE, 1,
+			EGL_BLUE_SIZE, 1,
+			EGL_ALPHA_SIZE, 0,
+			EGL_NONE,
+		};
+
+		x11->renderer = create_renderer_func(&x11->egl, EGL_PLATFORM_X11_KHR,
+			x11->xlib_conn, config_attribs, x11->screen->root_visual);
+	}
 
 	if (x11->renderer == NULL) {
 		wlr_log(WLR_ERROR, "Failed to create renderer");
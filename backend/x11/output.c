@@ -1,27 +1,251 @@
 #define _POSIX_C_SOURCE 200809L
 
 #include <assert.h>
+#include <inttypes.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <wlr/config.h>
 
 #include <xcb/xcb.h>
 #include <xcb/xinput.h>
+#if WLR_HAS_XCB_PRESENT
+#include <xcb/present.h>
+#endif
+#if WLR_HAS_XCB_SHM
+#include <xcb/shm.h>
+#endif
 
 #include <wlr/interfaces/wlr_output.h>
 #include <wlr/interfaces/wlr_pointer.h>
 #include <wlr/interfaces/wlr_touch.h>
+#include <wlr/render/pixman.h>
 #include <wlr/util/log.h>
 
 #include "backend/x11.h"
+#include "util/shm.h"
 #include "util/signal.h"
+#include "util/vblank.h"
+
+static void handle_vblank(struct vblank_timer *timer,
+		const struct timespec *when, uint64_t seq) {
+	struct wlr_x11_output *output = timer->data;
+
+	if (output->present_pending) {
+		output->present_pending = false;
+		struct timespec present_time = *when;
+		struct wlr_output_event_present event = {
+			.commit_seq = output->present_commit_seq,
+			.when = &present_time,
+			.seq = seq,
+			.refresh = vblank_timer_get_period(timer),
+			.flags = WLR_OUTPUT_PRESENT_VSYNC,
+		};
+		wlr_output_send_present(&output->wlr_output, &event);
+	}
 
-static int signal_frame(void *data) {
-	struct wlr_x11_output *output = data;
 	wlr_output_send_frame(&output->wlr_output);
-	wl_event_source_timer_update(output->frame_timer, output->frame_delay);
-	return 0;
 }
 
+/**
+ * Requests a frame event on the next vblank. The Present extension is used when
+ * available, so that the X server's CRTC timings are reported.
+ */
+static void output_schedule_vblank(struct wlr_x11_output *output) {
+#if WLR_HAS_XCB_PRESENT
+	struct wlr_x11_backend *x11 = output->x11;
+	if (x11->has_present && !output->present_unreliable) {
+		if (output->present_notify_pending) {
+			return;
+		}
+
+		// With a divisor of 1 and a past target, this completes on the next
+		// MSC
+		xcb_present_notify_msc(x11->xcb, output->win, ++output->present_serial,
+			0, 1, 0);
+		output->present_notify_pending = true;
+		xcb_flush(x11->xcb);
+		return;
+	}
+#endif
+
+	vblank_timer_schedule(&output->vblank);
+}
+
+#if WLR_HAS_XCB_PRESENT
+static void handle_present_complete(struct wlr_x11_output *output,
+		uint64_t ust, uint64_t msc) {
+	output->present_notify_pending = false;
+	// Requests are processed in order, any pending PutImage is done
+	output->shm_busy = false;
+
+	int refresh = 0;
+	if (output->present_last_msc != 0 && msc > output->present_last_msc &&
+			ust > output->present_last_ust) {
+		uint64_t period = (ust - output->present_last_ust) * 1000 /
+			(msc - output->present_last_msc);
+		if (msc - output->present_last_msc == 1 &&
+				period > X11_PRESENT_MAX_PERIOD_NS) {
+			// The window isn't shown on any CRTC
+			wlr_log(WLR_INFO, "X11 Present MSC period for output '%s' "
+				"is too long (%"PRIu64" ns), falling back to a timer",
+				output->wlr_output.name, period);
+			output->present_unreliable = true;
+		} else if (period <= INT32_MAX) {
+			refresh = period;
+		}
+	}
+	output->present_last_msc = msc;
+	output->present_last_ust = ust;
+
+	if (output->present_pending) {
+		output->present_pending = false;
+		struct timespec when = {
+			.tv_sec = ust / 1000000,
+			.tv_nsec = (ust % 1000000) * 1000,
+		};
+		struct wlr_output_event_present event = {
+			.commit_seq = output->present_commit_seq,
+			.when = &when,
+			.seq = msc,
+			.refresh = refresh != 0 ? refresh :
+				vblank_timer_get_period(&output->vblank),
+			.flags = WLR_OUTPUT_PRESENT_VSYNC |
+				WLR_OUTPUT_PRESENT_HW_CLOCK,
+		};
+		wlr_output_send_present(&output->wlr_output, &event);
+	}
+
+	wlr_output_send_frame(&output->wlr_output);
+}
+
+void handle_x11_present_event(struct wlr_x11_backend *x11,
+		xcb_ge_generic_event_t *event) {
+	switch (event->event_type) {
+	case XCB_PRESENT_EVENT_COMPLETE_NOTIFY:;
+		xcb_present_complete_notify_event_t *ev =
+			(xcb_present_complete_notify_event_t *)event;
+		// PresentPixmap completions for EGL's own buffers are ignored
+		if (ev->kind != XCB_PRESENT_COMPLETE_KIND_NOTIFY_MSC) {
+			break;
+		}
+		struct wlr_x11_output *output =
+			get_x11_output_from_window_id(x11, ev->window);
+		if (output == NULL || ev->serial != output->present_serial ||
+				!output->present_notify_pending) {
+			break;
+		}
+		handle_present_complete(output, ev->ust, ev->msc);
+		break;
+	}
+}
+#endif
+
+#if WLR_HAS_XCB_SHM
+static void output_destroy_shm_buffer(struct wlr_x11_output *output) {
+	struct wlr_x11_backend *x11 = output->x11;
+
+	if (output->image == NULL) {
+		return;
+	}
+
+	pixman_image_unref(output->image);
+	xcb_shm_detach(x11->xcb, output->shm_seg);
+	munmap(output->shm_data, output->shm_size);
+	output->image = NULL;
+	output->shm_data = NULL;
+	output->shm_size = 0;
+}
+
+static bool output_create_shm_buffer(struct wlr_x11_output *output,
+		int width, int height) {
+	struct wlr_x11_backend *x11 = output->x11;
+
+	int stride = width * 4;
+	size_t size = (size_t)stride * height;
+	int fd = allocate_shm_file(size);
+	if (fd < 0) {
+		wlr_log_errno(WLR_ERROR, "Failed to allocate shm file");
+		return false;
+	}
+
+	void *data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (data == MAP_FAILED) {
+		wlr_log_errno(WLR_ERROR, "mmap failed");
+		close(fd);
+		return false;
+	}
+
+	// The file descriptor is closed by xcb once sent
+	xcb_shm_seg_t seg = xcb_generate_id(x11->xcb);
+	xcb_shm_attach_fd(x11->xcb, seg, fd, true);
+
+	pixman_image_t *image = pixman_image_create_bits(PIXMAN_x8r8g8b8,
+		width, height, data, stride);
+	if (image == NULL) {
+		wlr_log(WLR_ERROR, "Failed to create pixman image");
+		xcb_shm_detach(x11->xcb, seg);
+		munmap(data, size);
+		return false;
+	}
+
+	output_destroy_shm_buffer(output);
+	output->shm_seg = seg;
+	output->shm_data = data;
+	output->shm_size = size;
+	output->image = image;
+	output->image_rendered = false;
+	output->shm_busy = false;
+	return true;
+}
+
+static bool output_put_shm_buffer(struct wlr_x11_output *output,
+		pixman_region32_t *damage) {
+	struct wlr_x11_backend *x11 = output->x11;
+
+	int width = pixman_image_get_width(output->image);
+	int height = pixman_image_get_height(output->image);
+
+	// Only the damaged area needs to be copied by the X server
+	pixman_box32_t box = { 0, 0, width, height };
+	if (damage != NULL && output->image_rendered) {
+		pixman_region32_t clipped;
+		pixman_region32_init(&clipped);
+		pixman_region32_intersect_rect(&clipped, damage, 0, 0, width, height);
+		box = *pixman_region32_extents(&clipped);
+		pixman_region32_fini(&clipped);
+		if (box.x2 <= box.x1 || box.y2 <= box.y1) {
+			return true;
+		}
+	}
+
+	xcb_shm_put_image(x11->xcb, output->win, output->gc, width, height,
+		box.x1, box.y1, box.x2 - box.x1, box.y2 - box.y1, box.x1, box.y1,
+		x11->screen->root_depth, XCB_IMAGE_FORMAT_Z_PIXMAP, 0,
+		output->shm_seg, 0);
+	output->image_rendered = true;
+	output->shm_busy = true;
+	xcb_flush(x11->xcb);
+	return true;
+}
+#else
+// The backend never uses the pixman renderer without MIT-SHM
+static void output_destroy_shm_buffer(struct wlr_x11_output *output) {
+}
+
+static bool output_create_shm_buffer(struct wlr_x11_output *output,
+		int width, int height) {
+	return false;
+}
+
+static bool output_put_shm_buffer(struct wlr_x11_output *output,
+		pixman_region32_t *damage) {
+	return false;
+}
+#endif
+
 static void parse_xcb_setup(struct wlr_output *output,
 		xcb_connection_t *xcb) {
 	const xcb_setup_t *xcb_setup = xcb_get_setup(xcb);
@@ -50,7 +274,9 @@ static void output_set_refresh(struct wlr_output *wlr_output, int32_t refresh) {
 	wlr_output_update_custom_mode(&output->wlr_output, wlr_output->width,
 		wlr_output->height, refresh);
 
-	output->frame_delay = 1000000 / refresh;
+	if (!vblank_timer_set_refresh(&output->vblank, refresh)) {
+		wlr_log(WLR_ERROR, "Failed to set up vblank timer");
+	}
 }
 
 static bool output_set_custom_mode(struct wlr_output *wlr_output,
@@ -84,8 +310,13 @@ static void output_destroy(struct wlr_output *wlr_output) {
 	wlr_input_device_destroy(&output->touch_dev);
 
 	wl_list_remove(&output->link);
-	wl_event_source_remove(output->frame_timer);
-	wlr_egl_destroy_surface(&x11->egl, output->surf);
+	vblank_timer_finish(&output->vblank);
+	if (x11->use_shm) {
+		output_destroy_shm_buffer(output);
+		xcb_free_gc(x11->xcb, output->gc);
+	} else {
+		wlr_egl_destroy_surface(&x11->egl, output->surf);
+	}
 	xcb_destroy_window(x11->xcb, output->win);
 	xcb_flush(x11->xcb);
 	free(output);
@@ -96,10 +327,27 @@ static bool output_attach_render(struct wlr_output *wlr_output,
 	struct wlr_x11_output *output = get_x11_output_from_output(wlr_output);
 	struct wlr_x11_backend *x11 = output->x11;
 
-	return wlr_egl_make_current(&x11->egl, output->surf, buffer_age);
+	if (!x11->use_shm) {
+		return wlr_egl_make_current(&x11->egl, output->surf, buffer_age);
+	}
+
+	if (output->shm_busy) {
+		// Wait for the X server to finish reading the previous frame
+		free(xcb_get_input_focus_reply(x11->xcb,
+			xcb_get_input_focus(x11->xcb), NULL));
+		output->shm_busy = false;
+	}
+
+	wlr_pixman_renderer_set_image(x11->renderer, output->image);
+	if (buffer_age != NULL) {
+		*buffer_age = output->image_rendered ? 1 : 0;
+	}
+	return true;
 }
 
 static bool output_test(struct wlr_output *wlr_output) {
+	struct wlr_x11_output *output = get_x11_output_from_output(wlr_output);
+
 	if (wlr_output->pending.committed & WLR_OUTPUT_STATE_ENABLED) {
 		wlr_log(WLR_DEBUG, "Cannot disable an X11 output");
 		return false;
@@ -109,6 +357,14 @@ static bool output_test(struct wlr_output *wlr_output) {
 		assert(wlr_output->pending.mode_type == WLR_OUTPUT_STATE_MODE_CUSTOM);
 	}
 
+	if ((wlr_output->pending.committed & WLR_OUTPUT_STATE_BUFFER) &&
+			output->present_pending) {
+		// The pending frame would never get its present event
+		wlr_log(WLR_DEBUG, "Cannot commit a buffer to X11 output '%s': "
+			"a frame is already pending", wlr_output->name);
+		return false;
+	}
+
 	return true;
 }
 
@@ -150,11 +406,18 @@ static bool output_commit(struct wlr_output *wlr_output) {
 			damage = &wlr_output->pending.damage;
 		}
 
-		if (!wlr_egl_swap_buffers(&x11->egl, output->surf, damage)) {
+		if (x11->use_shm) {
+			wlr_pixman_renderer_set_image(x11->renderer, NULL);
+			if (!output_put_shm_buffer(output, damage)) {
+				return false;
+			}
+		} else if (!wlr_egl_swap_buffers(&x11->egl, output->surf, damage)) {
 			return false;
 		}
 
-		wlr_output_send_present(wlr_output, NULL);
+		output->present_pending = true;
+		output->present_commit_seq = wlr_output->commit_seq + 1;
+		output_schedule_vblank(output);
 	}
 
 	return true;
@@ -162,7 +425,11 @@ static bool output_commit(struct wlr_output *wlr_output) {
 
 static void output_rollback_render(struct wlr_output *wlr_output) {
 	struct wlr_x11_output *output = get_x11_output_from_output(wlr_output);
-	wlr_egl_unset_current(&output->x11->egl);
+	if (output->x11->use_shm) {
+		wlr_pixman_renderer_set_image(output->x11->renderer, NULL);
+	} else {
+		wlr_egl_unset_current(&output->x11->egl);
+	}
 }
 
 static const struct wlr_output_impl output_impl = {
@@ -186,6 +453,8 @@ struct wlr_output *wlr_x11_output_create(struct wlr_backend *backend) {
 		return NULL;
 	}
 	output->x11 = x11;
+	vblank_timer_init(&output->vblank,
+		wl_display_get_event_loop(x11->wl_display), handle_vblank, output);
 
 	struct wlr_output *wlr_output = &output->wlr_output;
 	wlr_output_init(wlr_output, &x11->backend, &output_impl, x11->wl_display);
@@ -231,11 +500,34 @@ struct wlr_output *wlr_x11_output_create(struct wlr_backend *backend) {
 	};
 	xcb_input_xi_select_events(x11->xcb, output->win, 1, &xinput_mask.head);
 
-	output->surf = wlr_egl_create_surface(&x11->egl, &output->win);
-	if (!output->surf) {
-		wlr_log(WLR_ERROR, "Failed to create EGL surface");
-		free(output);
-		return NULL;
+#if WLR_HAS_XCB_PRESENT
+	if (x11->has_present) {
+		output->present_event_id = xcb_generate_id(x11->xcb);
+		xcb_present_select_input(x11->xcb, output->present_event_id,
+			output->win, XCB_PRESENT_EVENT_MASK_COMPLETE_NOTIFY);
+	}
+#endif
+
+	if (x11->use_shm) {
+		output->gc = xcb_generate_id(x11->xcb);
+		xcb_create_gc(x11->xcb, output->gc, output->win, 0, NULL);
+		if (!output_create_shm_buffer(output,
+				wlr_output->width, wlr_output->height)) {
+			xcb_free_gc(x11->xcb, output->gc);
+			xcb_destroy_window(x11->xcb, output->win);
+			vblank_timer_finish(&output->vblank);
+			free(output);
+			return NULL;
+		}
+	} else {
+		output->surf = wlr_egl_create_surface(&x11->egl, &output->win);
+		if (!output->surf) {
+			wlr_log(WLR_ERROR, "Failed to create EGL surface");
+			xcb_destroy_window(x11->xcb, output->win);
+			vblank_timer_finish(&output->vblank);
+			free(output);
+			return NULL;
+		}
 	}
 
 	xcb_change_property(x11->xcb, XCB_PROP_MODE_REPLACE, output->win,
@@ -247,12 +539,9 @@ struct wlr_output *wlr_x11_output_create(struct wlr_backend *backend) {
 	xcb_map_window(x11->xcb, output->win);
 	xcb_flush(x11->xcb);
 
-	struct wl_event_loop *ev = wl_display_get_event_loop(x11->wl_display);
-	output->frame_timer = wl_event_loop_add_timer(ev, signal_frame, output);
-
 	wl_list_insert(&x11->outputs, &output->link);
 
-	wl_event_source_timer_update(output->frame_timer, output->frame_delay);
+	output_schedule_vblank(output);
 	wlr_output_update_enabled(wlr_output, true);
 
 	wlr_input_device_init(&output->pointer_dev, WLR_INPUT_DEVICE_POINTER,
@@ -279,6 +568,15 @@ void handle_x11_configure_notify(struct wlr_x11_output *output,
 		xcb_configure_notify_event_t *ev) {
 	// ignore events that set an invalid size:
 	if (ev->width > 0 && ev->height > 0) {
+		if (output->x11->use_shm &&
+				(ev->width != output->wlr_output.width ||
+				ev->height != output->wlr_output.height)) {
+			if (!output_create_shm_buffer(output, ev->width, ev->height)) {
+				wlr_log(WLR_ERROR, "Failed to resize shm buffer");
+				return;
+			}
+		}
+
 		wlr_output_update_custom_mode(&output->wlr_output, ev->width,
 			ev->height, output->wlr_output.refresh);
 
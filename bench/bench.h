@@ -0,0 +1,39 @@
+#ifndef BENCH_BENCH_H
+#define BENCH_BENCH_H
+
+#include <stdbool.h>
+
+enum bench_scenario {
+	// Clients committing damage at a fixed rate
+	BENCH_SCENARIO_SHM,
+	// Clients made of many desynchronized subsurfaces
+	BENCH_SCENARIO_SUBSURFACES,
+	// Clients flooded with pointer motion events
+	BENCH_SCENARIO_POINTER,
+	// Clients captured by an extra screencopy client
+	BENCH_SCENARIO_SCREENCOPY,
+};
+
+struct bench_options {
+	enum bench_scenario scenario;
+	int clients;
+	int rate; // commits per second per client
+	int subsurfaces; // per client, for BENCH_SCENARIO_SUBSURFACES
+	int pointer_rate; // motion events per second, at most 1000
+	double warmup, duration; // seconds
+};
+
+#define BENCH_SURFACE_SIZE 256
+#define BENCH_SUBSURFACE_SIZE 32
+
+/**
+ * Run a synthetic client connecting to the Wayland display named `socket`,
+ * until it receives SIGTERM. Clients with `index` equal to the number of
+ * clients are screencopy capturers. The CPU time used by the client after the
+ * warm-up is written to `result_fd` as a double, in milliseconds. Returns an
+ * exit status.
+ */
+int run_client(const char *socket, const struct bench_options *options,
+	int index, int result_fd);
+
+#endif
@@ -0,0 +1,563 @@
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+#include <wayland-client.h>
+#include "bench.h"
+#include "wlr-screencopy-unstable-v1-client-protocol.h"
+#include "xdg-shell-client-protocol.h"
+
+struct client_buffer {
+	struct wl_buffer *wl_buffer;
+	void *data;
+	int width, height, stride;
+};
+
+struct client_surface {
+	struct wl_surface *wl_surface;
+	struct wl_subsurface *subsurface;
+	struct client_buffer buffer;
+	int x, y; // relative to the toplevel
+};
+
+struct bench_client {
+	const struct bench_options *options;
+	int index;
+	uint32_t frame;
+
+	struct wl_display *display;
+	struct wl_compositor *compositor;
+	struct wl_subcompositor *subcompositor;
+	struct wl_shm *shm;
+	struct wl_seat *seat;
+	struct wl_pointer *pointer;
+	struct wl_output *output;
+	struct xdg_wm_base *wm_base;
+	struct zwlr_screencopy_manager_v1 *screencopy_manager;
+
+	struct client_surface toplevel;
+	struct xdg_surface *xdg_surface;
+	struct xdg_toplevel *xdg_toplevel;
+	bool configured;
+
+	struct client_surface *subsurfaces;
+	int subsurfaces_len;
+
+	struct zwlr_screencopy_frame_v1 *screencopy_frame;
+	struct client_buffer screencopy_buffer;
+	uint64_t motions;
+
+	int signal_fd; // readable once SIGTERM is received
+	int warmup_fd; // expires at the end of the warm-up
+	bool measuring;
+	struct rusage start_usage;
+};
+
+static bool running = true;
+
+static void tick(struct bench_client *client);
+
+/**
+ * Wait for and handle one batch of events. If `timer_fd` isn't -1, a frame is
+ * committed each time it expires. Returns false once the client should exit.
+ */
+static bool client_dispatch(struct bench_client *client, int timer_fd) {
+	struct pollfd fds[] = {
+		{ .fd = wl_display_get_fd(client->display), .events = POLLIN },
+		{ .fd = client->signal_fd, .events = POLLIN },
+		{ .fd = client->measuring ? -1 : client->warmup_fd, .events = POLLIN },
+		{ .fd = timer_fd, .events = POLLIN },
+	};
+
+	wl_display_flush(client->display);
+	if (poll(fds, sizeof(fds) / sizeof(fds[0]), -1) < 0) {
+		return errno == EINTR;
+	}
+
+	if (fds[1].revents & POLLIN) {
+		return false; // SIGTERM
+	}
+	if (fds[0].revents & (POLLERR | POLLHUP)) {
+		return false;
+	}
+	if ((fds[0].revents & POLLIN) &&
+			wl_display_dispatch(client->display) < 0) {
+		return false;
+	}
+	uint64_t expirations;
+	if ((fds[2].revents & POLLIN) &&
+			read(client->warmup_fd, &expirations, sizeof(expirations)) > 0) {
+		// Only the CPU time spent after the warm-up is reported
+		getrusage(RUSAGE_SELF, &client->start_usage);
+		client->measuring = true;
+	}
+	if ((fds[3].revents & POLLIN) &&
+			read(timer_fd, &expirations, sizeof(expirations)) > 0) {
+		tick(client);
+	}
+	return true;
+}
+
+static int create_shm_file(size_t size) {
+	static const char template[] = "/wlroots-bench-XXXXXX";
+	char name[sizeof(template)];
+	for (int retries = 100; retries > 0; --retries) {
+		strcpy(name, template);
+		struct timespec ts;
+		clock_gettime(CLOCK_REALTIME, &ts);
+		long r = ts.tv_nsec ^ getpid();
+		for (char *c = name + sizeof(template) - 7; *c != '\0'; ++c) {
+			*c = 'A' + (r & 15) + (r & 16) * 2;
+			r >>= 5;
+		}
+
+		int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+		if (fd >= 0) {
+			shm_unlink(name);
+			if (ftruncate(fd, size) < 0) {
+				close(fd);
+				return -1;
+			}
+			return fd;
+		} else if (errno != EEXIST) {
+			break;
+		}
+	}
+	return -1;
+}
+
+static bool create_buffer(struct bench_client *client,
+		struct client_buffer *buffer, uint32_t format, int width, int height,
+		int stride) {
+	size_t size = (size_t)stride * height;
+	int fd = create_shm_file(size);
+	if (fd < 0) {
+		fprintf(stderr, "Failed to create shm file\n");
+		return false;
+	}
+
+	buffer->data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (buffer->data == MAP_FAILED) {
+		fprintf(stderr, "mmap failed\n");
+		close(fd);
+		return false;
+	}
+
+	struct wl_shm_pool *pool = wl_shm_create_pool(client->shm, fd, size);
+	buffer->wl_buffer = wl_shm_pool_create_buffer(pool, 0, width, height,
+		stride, format);
+	wl_shm_pool_destroy(pool);
+	close(fd);
+
+	buffer->width = width;
+	buffer->height = height;
+	buffer->stride = stride;
+	return true;
+}
+
+static void fill_rect(struct client_buffer *buffer, int x, int y,
+		int width, int height, uint32_t color) {
+	for (int j = y; j < y + height && j < buffer->height; ++j) {
+		uint32_t *row = (uint32_t *)((char *)buffer->data + j * buffer->stride);
+		for (int i = x; i < x + width && i < buffer->width; ++i) {
+			row[i] = color;
+		}
+	}
+}
+
+static void xdg_wm_base_handle_ping(void *data, struct xdg_wm_base *wm_base,
+		uint32_t serial) {
+	xdg_wm_base_pong(wm_base, serial);
+}
+
+static const struct xdg_wm_base_listener wm_base_listener = {
+	.ping = xdg_wm_base_handle_ping,
+};
+
+static void xdg_surface_handle_configure(void *data,
+		struct xdg_surface *xdg_surface, uint32_t serial) {
+	struct bench_client *client = data;
+	xdg_surface_ack_configure(xdg_surface, serial);
+	client->configured = true;
+}
+
+static const struct xdg_surface_listener xdg_surface_listener = {
+	.configure = xdg_surface_handle_configure,
+};
+
+static void xdg_toplevel_handle_configure(void *data,
+		struct xdg_toplevel *xdg_toplevel, int32_t width, int32_t height,
+		struct wl_array *states) {
+	// The size is fixed
+}
+
+static void xdg_toplevel_handle_close(void *data,
+		struct xdg_toplevel *xdg_toplevel) {
+	running = false;
+}
+
+static const struct xdg_toplevel_listener xdg_toplevel_listener = {
+	.configure = xdg_toplevel_handle_configure,
+	.close = xdg_toplevel_handle_close,
+};
+
+static void pointer_handle_enter(void *data, struct wl_pointer *pointer,
+		uint32_t serial, struct wl_surface *surface,
+		wl_fixed_t sx, wl_fixed_t sy) {
+	// No-op
+}
+
+static void pointer_handle_leave(void *data, struct wl_pointer *pointer,
+		uint32_t serial, struct wl_surface *surface) {
+	// No-op
+}
+
+static void pointer_handle_motion(void *data, struct wl_pointer *pointer,
+		uint32_t time, wl_fixed_t sx, wl_fixed_t sy) {
+	struct bench_client *client = data;
+	client->motions++;
+}
+
+static void pointer_handle_button(void *data, struct wl_pointer *pointer,
+		uint32_t serial, uint32_t time, uint32_t button, uint32_t state) {
+	// No-op
+}
+
+static void pointer_handle_axis(void *data, struct wl_pointer *pointer,
+		uint32_t time, uint32_t axis, wl_fixed_t value) {
+	// No-op
+}
+
+static const struct wl_pointer_listener pointer_listener = {
+	.enter = pointer_handle_enter,
+	.leave = pointer_handle_leave,
+	.motion = pointer_handle_motion,
+	.button = pointer_handle_button,
+	.axis = pointer_handle_axis,
+};
+
+static void seat_handle_capabilities(void *data, struct wl_seat *seat,
+		uint32_t caps) {
+	struct bench_client *client = data;
+	if ((caps & WL_SEAT_CAPABILITY_POINTER) && client->pointer == NULL) {
+		client->pointer = wl_seat_get_pointer(seat);
+		wl_pointer_add_listener(client->pointer, &pointer_listener, client);
+	}
+}
+
+static const struct wl_seat_listener seat_listener = {
+	.capabilities = seat_handle_capabilities,
+};
+
+static void handle_global(void *data, struct wl_registry *registry,
+		uint32_t name, const char *interface, uint32_t version) {
+	struct bench_client *client = data;
+	if (strcmp(interface, wl_compositor_interface.name) == 0) {
+		client->compositor = wl_registry_bind(registry, name,
+			&wl_compositor_interface, 1);
+	} else if (strcmp(interface, wl_subcompositor_interface.name) == 0) {
+		client->subcompositor = wl_registry_bind(registry, name,
+			&wl_subcompositor_interface, 1);
+	} else if (strcmp(interface, wl_shm_interface.name) == 0) {
+		client->shm = wl_registry_bind(registry, name, &wl_shm_interface, 1);
+	} else if (strcmp(interface, wl_seat_interface.name) == 0) {
+		client->seat = wl_registry_bind(registry, name, &wl_seat_interface, 1);
+		wl_seat_add_listener(client->seat, &seat_listener, client);
+	} else if (strcmp(interface, wl_output_interface.name) == 0 &&
+			client->output == NULL) {
+		client->output = wl_registry_bind(registry, name,
+			&wl_output_interface, 1);
+	} else if (strcmp(interface, xdg_wm_base_interface.name) == 0) {
+		client->wm_base = wl_registry_bind(registry, name,
+			&xdg_wm_base_interface, 1);
+		xdg_wm_base_add_listener(client->wm_base, &wm_base_listener, client);
+	} else if (strcmp(interface,
+			zwlr_screencopy_manager_v1_interface.name) == 0) {
+		client->screencopy_manager = wl_registry_bind(registry, name,
+			&zwlr_screencopy_manager_v1_interface, 1);
+	}
+}
+
+static void handle_global_remove(void *data, struct wl_registry *registry,
+		uint32_t name) {
+	// Who cares?
+}
+
+static const struct wl_registry_listener registry_listener = {
+	.global = handle_global,
+	.global_remove = handle_global_remove,
+};
+
+static bool init_surface(struct bench_client *client,
+		struct client_surface *surface, int size) {
+	surface->wl_surface = wl_compositor_create_surface(client->compositor);
+	if (!create_buffer(client, &surface->buffer, WL_SHM_FORMAT_XRGB8888,
+			size, size, 4 * size)) {
+		return false;
+	}
+	fill_rect(&surface->buffer, 0, 0, size, size, 0xFF000000);
+	return true;
+}
+
+static bool init_toplevel(struct bench_client *client) {
+	if (client->compositor == NULL || client->shm == NULL ||
+			client->wm_base == NULL) {
+		fprintf(stderr, "Missing required globals\n");
+		return false;
+	}
+
+	struct client_surface *toplevel = &client->toplevel;
+	if (!init_surface(client, toplevel, BENCH_SURFACE_SIZE)) {
+		return false;
+	}
+	client->xdg_surface =
+		xdg_wm_base_get_xdg_surface(client->wm_base, toplevel->wl_surface);
+	xdg_surface_add_listener(client->xdg_surface, &xdg_surface_listener,
+		client);
+	client->xdg_toplevel = xdg_surface_get_toplevel(client->xdg_surface);
+	xdg_toplevel_add_listener(client->xdg_toplevel, &xdg_toplevel_listener,
+		client);
+	xdg_toplevel_set_title(client->xdg_toplevel, "headless-bench");
+	wl_surface_commit(toplevel->wl_surface);
+
+	while (running && !client->configured) {
+		if (!client_dispatch(client, -1)) {
+			return false;
+		}
+	}
+
+	if (client->options->scenario == BENCH_SCENARIO_SUBSURFACES) {
+		if (client->subcompositor == NULL) {
+			fprintf(stderr, "Missing wl_subcompositor\n");
+			return false;
+		}
+
+		int len = client->options->subsurfaces;
+		client->subsurfaces = calloc(len, sizeof(struct client_surface));
+		if (client->subsurfaces == NULL) {
+			return false;
+		}
+		client->subsurfaces_len = len;
+
+		int cols = BENCH_SURFACE_SIZE / BENCH_SUBSURFACE_SIZE;
+		for (int i = 0; i < len; ++i) {
+			struct client_surface *sub = &client->subsurfaces[i];
+			if (!init_surface(client, sub, BENCH_SUBSURFACE_SIZE)) {
+				return false;
+			}
+			sub->subsurface = wl_subcompositor_get_subsurface(
+				client->subcompositor, sub->wl_surface, toplevel->wl_surface);
+			sub->x = (i % cols) * BENCH_SUBSURFACE_SIZE;
+			sub->y = (i / cols % cols) * BENCH_SUBSURFACE_SIZE;
+			wl_subsurface_set_position(sub->subsurface, sub->x, sub->y);
+			wl_subsurface_set_desync(sub->subsurface);
+			wl_surface_attach(sub->wl_surface, sub->buffer.wl_buffer, 0, 0);
+			wl_surface_commit(sub->wl_surface);
+		}
+	}
+
+	wl_surface_attach(toplevel->wl_surface, toplevel->buffer.wl_buffer, 0, 0);
+	wl_surface_commit(toplevel->wl_surface);
+	return true;
+}
+
+/**
+ * Draw a square moving across the surface, and commit the damaged area.
+ */
+static void update_surface(struct bench_client *client,
+		struct client_surface *surface) {
+	struct client_buffer *buffer = &surface->buffer;
+	int size = buffer->width / 4;
+	int steps = buffer->width - size;
+	int x = (client->frame * 4) % steps;
+	int y = (client->index * 16) % steps;
+	uint32_t color = 0xFF000000 | (client->frame * 0x010305);
+
+	fill_rect(buffer, 0, y, buffer->width, size, 0xFF000000);
+	fill_rect(buffer, x, y, size, size, color);
+
+	wl_surface_attach(surface->wl_surface, buffer->wl_buffer, 0, 0);
+	wl_surface_damage(surface->wl_surface, 0, y, buffer->width, size);
+	wl_surface_commit(surface->wl_surface);
+}
+
+static void tick(struct bench_client *client) {
+	client->frame++;
+	for (int i = 0; i < client->subsurfaces_len; ++i) {
+		update_surface(client, &client->subsurfaces[i]);
+	}
+	update_surface(client, &client->toplevel);
+}
+
+static void screencopy_frame_handle_buffer(void *data,
+		struct zwlr_screencopy_frame_v1 *frame, uint32_t format,
+		uint32_t width, uint32_t height, uint32_t stride) {
+	struct bench_client *client = data;
+	struct client_buffer *buffer = &client->screencopy_buffer;
+	if (buffer->wl_buffer == NULL && !create_buffer(client, buffer, format,
+			width, height, stride)) {
+		running = false;
+		return;
+	}
+	zwlr_screencopy_frame_v1_copy(frame, buffer->wl_buffer);
+}
+
+static void screencopy_frame_handle_flags(void *data,
+		struct zwlr_screencopy_frame_v1 *frame, uint32_t flags) {
+	// No-op
+}
+
+static void capture_next(struct bench_client *client);
+
+static void screencopy_frame_handle_ready(void *data,
+		struct zwlr_screencopy_frame_v1 *frame, uint32_t tv_sec_hi,
+		uint32_t tv_sec_lo, uint32_t tv_nsec) {
+	struct bench_client *client = data;
+	capture_next(client);
+}
+
+static void screencopy_frame_handle_failed(void *data,
+		struct zwlr_screencopy_frame_v1 *frame) {
+	struct bench_client *client = data;
+	capture_next(client);
+}
+
+static const struct zwlr_screencopy_frame_v1_listener screencopy_frame_listener = {
+	.buffer = screencopy_frame_handle_buffer,
+	.flags = screencopy_frame_handle_flags,
+	.ready = screencopy_frame_handle_ready,
+	.failed = screencopy_frame_handle_failed,
+};
+
+static void capture_next(struct bench_client *client) {
+	if (client->screencopy_frame != NULL) {
+		zwlr_screencopy_frame_v1_destroy(client->screencopy_frame);
+	}
+	client->screencopy_frame = zwlr_screencopy_manager_v1_capture_output(
+		client->screencopy_manager, 0, client->output);
+	zwlr_screencopy_frame_v1_add_listener(client->screencopy_frame,
+		&screencopy_frame_listener, client);
+}
+
+static int run_capturer(struct bench_client *client) {
+	if (client->screencopy_manager == NULL || client->output == NULL ||
+			client->shm == NULL) {
+		fprintf(stderr, "Missing screencopy globals\n");
+		return EXIT_FAILURE;
+	}
+
+	capture_next(client);
+	while (running && client_dispatch(client, -1)) {
+		// Frames are requested from the event handlers
+	}
+	return EXIT_SUCCESS;
+}
+
+static int run_committer(struct bench_client *client) {
+	if (!init_toplevel(client)) {
+		return EXIT_FAILURE;
+	}
+
+	int timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+	if (timer_fd < 0) {
+		fprintf(stderr, "timerfd_create failed\n");
+		return EXIT_FAILURE;
+	}
+	long interval = 1000000000 / client->options->rate;
+	struct itimerspec spec = {
+		.it_interval = { .tv_sec = interval / 1000000000,
+			.tv_nsec = interval % 1000000000 },
+		.it_value = { .tv_sec = 0, .tv_nsec = 1 },
+	};
+	timerfd_settime(timer_fd, 0, &spec, NULL);
+
+	while (running && client_dispatch(client, timer_fd)) {
+		// Frames are committed when the timer expires
+	}
+
+	close(timer_fd);
+	return EXIT_SUCCESS;
+}
+
+static double timeval_to_ms(const struct timeval *tv) {
+	return tv->tv_sec * 1000.0 + tv->tv_usec / 1000.0;
+}
+
+static int run(struct bench_client *client) {
+	struct wl_registry *registry = wl_display_get_registry(client->display);
+	wl_registry_add_listener(registry, &registry_listener, client);
+	wl_display_roundtrip(client->display);
+
+	if (client->index >= client->options->clients) {
+		return run_capturer(client);
+	}
+	return run_committer(client);
+}
+
+int run_client(const char *socket, const struct bench_options *options,
+		int index, int result_fd) {
+	// SIGTERM is handled in the event loop, so that it can't be missed
+	// between two polls
+	sigset_t mask;
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGTERM);
+	sigprocmask(SIG_BLOCK, &mask, NULL);
+
+	struct bench_client client = {
+		.options = options,
+		.index = index,
+	};
+	client.signal_fd = signalfd(-1, &mask, SFD_CLOEXEC);
+	client.warmup_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+	if (client.signal_fd < 0 || client.warmup_fd < 0) {
+		fprintf(stderr, "Failed to create signalfd or timerfd\n");
+		return EXIT_FAILURE;
+	}
+	long warmup_ns = options->warmup * 1000000000;
+	struct itimerspec spec = {
+		.it_value = { .tv_sec = warmup_ns / 1000000000,
+			.tv_nsec = warmup_ns % 1000000000 },
+	};
+	if (warmup_ns == 0) {
+		spec.it_value.tv_nsec = 1; // zero would disarm the timer
+	}
+	timerfd_settime(client.warmup_fd, 0, &spec, NULL);
+
+	client.display = wl_display_connect(socket);
+	if (client.display == NULL) {
+		fprintf(stderr, "Failed to connect to %s\n", socket);
+		return EXIT_FAILURE;
+	}
+
+	int ret = run(&client);
+
+	double cpu_ms = 0;
+	if (client.measuring) {
+		struct rusage usage;
+		getrusage(RUSAGE_SELF, &usage);
+		cpu_ms = timeval_to_ms(&usage.ru_utime) +
+			timeval_to_ms(&usage.ru_stime) -
+			timeval_to_ms(&client.start_usage.ru_utime) -
+			timeval_to_ms(&client.start_usage.ru_stime);
+	}
+	if (write(result_fd, &cpu_ms, sizeof(cpu_ms)) != sizeof(cpu_ms)) {
+		fprintf(stderr, "Failed to report CPU time\n");
+	}
+
+	wl_display_disconnect(client.display);
+	close(client.signal_fd);
+	close(client.warmup_fd);
+	return ret;
+}
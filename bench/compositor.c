@@ -0,0 +1,628 @@
+#define _POSIX_C_SOURCE 200809L
+#include <getopt.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include <wayland-server-core.h>
+#include <wlr/backend.h>
+#include <wlr/backend/headless.h>
+#include <wlr/render/wlr_renderer.h>
+#include <wlr/types/wlr_compositor.h>
+#include <wlr/types/wlr_data_device.h>
+#include <wlr/types/wlr_matrix.h>
+#include <wlr/types/wlr_output.h>
+#include <wlr/types/wlr_screencopy_v1.h>
+#include <wlr/types/wlr_seat.h>
+#include <wlr/types/wlr_xdg_shell.h>
+#include <wlr/util/log.h>
+#include "bench.h"
+
+/*
+ * A minimal compositor rendering every toplevel into a single headless output,
+ * driven by synthetic clients running in child processes. Results are printed
+ * on stdout as a single JSON object.
+ */
+
+struct bench_server {
+	const struct bench_options *options;
+
+	struct wl_display *display;
+	struct wlr_backend *backend;
+	struct wlr_renderer *renderer;
+	struct wlr_compositor *compositor;
+	struct wlr_xdg_shell *xdg_shell;
+	struct wlr_seat *seat;
+	struct wlr_screencopy_manager_v1 *screencopy;
+	struct wlr_output *output;
+
+	struct wl_list views; // bench_view::link
+	int next_view;
+
+	struct wl_listener new_surface;
+	struct wl_listener new_xdg_surface;
+	struct wl_listener output_frame;
+	struct wl_listener output_present;
+
+	struct wl_event_source *pointer_timer;
+	struct wl_event_source *warmup_timer;
+	struct wl_event_source *end_timer;
+
+	bool measuring;
+	struct timespec start_time;
+	struct rusage start_usage;
+	struct wlr_screencopy_v1_output_stats start_screencopy;
+
+	// Commit times of the surfaces drawn in the frame being committed
+	struct wl_array pending_commits; // struct timespec
+	// Commit times of the surfaces drawn in the frame waiting to be presented
+	struct wl_array presenting_commits; // struct timespec
+	struct wl_array latencies; // double, in milliseconds
+	uint64_t frames;
+	uint64_t commits;
+	uint64_t motions;
+};
+
+struct bench_view {
+	struct wl_list link;
+	struct bench_server *server;
+	struct wlr_xdg_surface *xdg_surface;
+	int x, y;
+	bool mapped;
+
+	struct wl_listener map;
+	struct wl_listener unmap;
+	struct wl_listener destroy;
+};
+
+struct bench_surface {
+	struct bench_server *server;
+	struct wlr_surface *surface;
+	// Time of the latest commit not drawn yet
+	struct timespec commit_time;
+	bool committed;
+
+	struct wl_listener commit;
+	struct wl_listener destroy;
+};
+
+static double timespec_to_ms(const struct timespec *ts) {
+	return ts->tv_sec * 1000.0 + ts->tv_nsec / 1000000.0;
+}
+
+static double timeval_to_ms(const struct timeval *tv) {
+	return tv->tv_sec * 1000.0 + tv->tv_usec / 1000.0;
+}
+
+static uint32_t get_time_msec(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+static void surface_handle_commit(struct wl_listener *listener, void *data) {
+	struct bench_surface *surface =
+		wl_container_of(listener, surface, commit);
+	clock_gettime(CLOCK_MONOTONIC, &surface->commit_time);
+	surface->committed = true;
+	if (surface->server->measuring) {
+		surface->server->commits++;
+	}
+}
+
+static void surface_handle_destroy(struct wl_listener *listener, void *data) {
+	struct bench_surface *surface =
+		wl_container_of(listener, surface, destroy);
+	wl_list_remove(&surface->commit.link);
+	wl_list_remove(&surface->destroy.link);
+	free(surface);
+}
+
+static void server_handle_new_surface(struct wl_listener *listener,
+		void *data) {
+	struct bench_server *server =
+		wl_container_of(listener, server, new_surface);
+	struct wlr_surface *wlr_surface = data;
+
+	struct bench_surface *surface = calloc(1, sizeof(struct bench_surface));
+	if (surface == NULL) {
+		return;
+	}
+	surface->server = server;
+	surface->surface = wlr_surface;
+	wlr_surface->data = surface;
+
+	surface->commit.notify = surface_handle_commit;
+	wl_signal_add(&wlr_surface->events.commit, &surface->commit);
+	surface->destroy.notify = surface_handle_destroy;
+	wl_signal_add(&wlr_surface->events.destroy, &surface->destroy);
+}
+
+static void view_handle_map(struct wl_listener *listener, void *data) {
+	struct bench_view *view = wl_container_of(listener, view, map);
+	view->mapped = true;
+
+	struct wlr_seat *seat = view->server->seat;
+	if (seat->pointer_state.focused_surface == NULL) {
+		wlr_seat_pointer_notify_enter(seat, view->xdg_surface->surface, 0, 0);
+	}
+}
+
+static void view_handle_unmap(struct wl_listener *listener, void *data) {
+	struct bench_view *view = wl_container_of(listener, view, unmap);
+	view->mapped = false;
+}
+
+static void view_handle_destroy(struct wl_listener *listener, void *data) {
+	struct bench_view *view = wl_container_of(listener, view, destroy);
+	wl_list_remove(&view->map.link);
+	wl_list_remove(&view->unmap.link);
+	wl_list_remove(&view->destroy.link);
+	wl_list_remove(&view->link);
+	free(view);
+}
+
+static void server_handle_new_xdg_surface(struct wl_listener *listener,
+		void *data) {
+	struct bench_server *server =
+		wl_container_of(listener, server, new_xdg_surface);
+	struct wlr_xdg_surface *xdg_surface = data;
+	if (xdg_surface->role != WLR_XDG_SURFACE_ROLE_TOPLEVEL) {
+		return;
+	}
+
+	struct bench_view *view = calloc(1, sizeof(struct bench_view));
+	if (view == NULL) {
+		return;
+	}
+	view->server = server;
+	view->xdg_surface = xdg_surface;
+
+	// Tile views on the output, wrapping around when it's full
+	int cols = server->output->width / BENCH_SURFACE_SIZE;
+	int rows = server->output->height / BENCH_SURFACE_SIZE;
+	int cell = server->next_view++ % (cols * rows);
+	view->x = (cell % cols) * BENCH_SURFACE_SIZE;
+	view->y = (cell / cols) * BENCH_SURFACE_SIZE;
+
+	view->map.notify = view_handle_map;
+	wl_signal_add(&xdg_surface->events.map, &view->map);
+	view->unmap.notify = view_handle_unmap;
+	wl_signal_add(&xdg_surface->events.unmap, &view->unmap);
+	view->destroy.notify = view_handle_destroy;
+	wl_signal_add(&xdg_surface->events.destroy, &view->destroy);
+
+	wl_list_insert(&server->views, &view->link);
+}
+
+struct render_data {
+	struct bench_server *server;
+	struct bench_view *view;
+	struct timespec *when;
+};
+
+static void render_surface(struct wlr_surface *surface, int sx, int sy,
+		void *data) {
+	struct render_data *rdata = data;
+	struct bench_server *server = rdata->server;
+	struct wlr_output *output = server->output;
+
+	struct wlr_texture *texture = wlr_surface_get_texture(surface);
+	if (texture != NULL) {
+		struct wlr_box box = {
+			.x = rdata->view->x + sx,
+			.y = rdata->view->y + sy,
+			.width = surface->current.width,
+			.height = surface->current.height,
+		};
+		float matrix[9];
+		enum wl_output_transform transform =
+			wlr_output_transform_invert(surface->current.transform);
+		wlr_matrix_project_box(matrix, &box, transform, 0,
+			output->transform_matrix);
+		wlr_render_texture_with_matrix(server->renderer, texture, matrix, 1);
+	}
+
+	struct bench_surface *bench_surface = surface->data;
+	if (bench_surface != NULL && bench_surface->committed) {
+		struct timespec *commit_time = wl_array_add(&server->pending_commits,
+			sizeof(*commit_time));
+		if (commit_time != NULL) {
+			*commit_time = bench_surface->commit_time;
+		}
+		bench_surface->committed = false;
+	}
+
+	wlr_surface_send_frame_done(surface, rdata->when);
+}
+
+static void output_handle_frame(struct wl_listener *listener, void *data) {
+	struct bench_server *server =
+		wl_container_of(listener, server, output_frame);
+	struct wlr_output *output = server->output;
+
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	if (!wlr_output_attach_render(output, NULL)) {
+		return;
+	}
+
+	wlr_renderer_begin(server->renderer, output->width, output->height);
+	float color[4] = {0.3, 0.3, 0.3, 1.0};
+	wlr_renderer_clear(server->renderer, color);
+
+	struct bench_view *view;
+	wl_list_for_each_reverse(view, &server->views, link) {
+		if (!view->mapped) {
+			continue;
+		}
+		struct render_data rdata = {
+			.server = server,
+			.view = view,
+			.when = &now,
+		};
+		wlr_xdg_surface_for_each_surface(view->xdg_surface,
+			render_surface, &rdata);
+	}
+
+	wlr_renderer_end(server->renderer);
+	if (wlr_output_commit(output)) {
+		if (server->measuring) {
+			server->frames++;
+		}
+		// The output presents the frame at its next vblank
+		struct wl_array tmp = server->presenting_commits;
+		server->presenting_commits = server->pending_commits;
+		server->pending_commits = tmp;
+	}
+	server->pending_commits.size = 0;
+}
+
+static void output_handle_present(struct wl_listener *listener, void *data) {
+	struct bench_server *server =
+		wl_container_of(listener, server, output_present);
+	struct wlr_output_event_present *event = data;
+
+	if (!server->measuring) {
+		return;
+	}
+
+	double present_ms = timespec_to_ms(event->when);
+	struct timespec *commit_time;
+	wl_array_for_each(commit_time, &server->presenting_commits) {
+		double *latency = wl_array_add(&server->latencies, sizeof(*latency));
+		if (latency != NULL) {
+			*latency = present_ms - timespec_to_ms(commit_time);
+		}
+	}
+	server->presenting_commits.size = 0;
+}
+
+static int handle_pointer_timer(void *data) {
+	struct bench_server *server = data;
+	struct wlr_seat *seat = server->seat;
+
+	// Sweep back and forth across the focused surface
+	if (seat->pointer_state.focused_surface != NULL) {
+		double pos = (server->motions * 7) % (2 * BENCH_SURFACE_SIZE);
+		if (pos >= BENCH_SURFACE_SIZE) {
+			pos = 2 * BENCH_SURFACE_SIZE - pos - 1;
+		}
+		uint32_t time = get_time_msec();
+		wlr_seat_pointer_notify_motion(seat, time, pos, pos);
+		wlr_seat_pointer_notify_frame(seat);
+		server->motions++;
+	}
+
+	wl_event_source_timer_update(server->pointer_timer,
+		1000 / server->options->pointer_rate);
+	return 0;
+}
+
+static void get_screencopy_stats(struct bench_server *server,
+		struct wlr_screencopy_v1_output_stats *stats) {
+	if (!wlr_screencopy_manager_v1_get_output_stats(server->screencopy,
+			server->output, stats)) {
+		memset(stats, 0, sizeof(*stats));
+	}
+}
+
+static int handle_warmup_timer(void *data) {
+	struct bench_server *server = data;
+	server->measuring = true;
+	clock_gettime(CLOCK_MONOTONIC, &server->start_time);
+	getrusage(RUSAGE_SELF, &server->start_usage);
+	get_screencopy_stats(server, &server->start_screencopy);
+	return 0;
+}
+
+static int handle_end_timer(void *data) {
+	struct bench_server *server = data;
+	wl_display_terminate(server->display);
+	return 0;
+}
+
+static int compare_double(const void *a, const void *b) {
+	double da = *(const double *)a, db = *(const double *)b;
+	return (da > db) - (da < db);
+}
+
+static double percentile(const double *values, size_t len, double p) {
+	if (len == 0) {
+		return 0;
+	}
+	size_t i = p * (len - 1) + 0.5;
+	return values[i];
+}
+
+static const char *scenario_names[] = {
+	[BENCH_SCENARIO_SHM] = "shm",
+	[BENCH_SCENARIO_SUBSURFACES] = "subsurfaces",
+	[BENCH_SCENARIO_POINTER] = "pointer",
+	[BENCH_SCENARIO_SCREENCOPY] = "screencopy",
+};
+
+static void print_results(struct bench_server *server,
+		double clients_cpu_ms) {
+	const struct bench_options *options = server->options;
+
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	double elapsed_ms = timespec_to_ms(&now) -
+		timespec_to_ms(&server->start_time);
+
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	double cpu_ms = timeval_to_ms(&usage.ru_utime) +
+		timeval_to_ms(&usage.ru_stime) -
+		timeval_to_ms(&server->start_usage.ru_utime) -
+		timeval_to_ms(&server->start_usage.ru_stime);
+
+	double *latencies = server->latencies.data;
+	size_t latencies_len = server->latencies.size / sizeof(double);
+	qsort(latencies, latencies_len, sizeof(double), compare_double);
+	double latency_sum = 0;
+	for (size_t i = 0; i < latencies_len; ++i) {
+		latency_sum += latencies[i];
+	}
+
+	struct wlr_screencopy_v1_output_stats screencopy;
+	get_screencopy_stats(server, &screencopy);
+
+	uint64_t frames = server->frames;
+	printf("{\"scenario\":\"%s\",\"clients\":%d,\"rate\":%d,"
+		"\"duration_ms\":%.3f,\"frames\":%"PRIu64",\"fps\":%.3f,"
+		"\"commits\":%"PRIu64",",
+		scenario_names[options->scenario], options->clients, options->rate,
+		elapsed_ms, frames, frames * 1000.0 / elapsed_ms, server->commits);
+	printf("\"latency_ms\":{\"samples\":%zu,\"mean\":%.3f,\"p50\":%.3f,"
+		"\"p90\":%.3f,\"p99\":%.3f,\"max\":%.3f},",
+		latencies_len,
+		latencies_len > 0 ? latency_sum / latencies_len : 0,
+		percentile(latencies, latencies_len, 0.5),
+		percentile(latencies, latencies_len, 0.9),
+		percentile(latencies, latencies_len, 0.99),
+		percentile(latencies, latencies_len, 1));
+	printf("\"cpu_ms_per_frame\":%.3f,\"clients_cpu_ms\":%.3f,"
+		"\"peak_rss_kb\":%ld,\"pointer_motions\":%"PRIu64","
+		"\"screencopy_frames\":%"PRIu64",\"screencopy_bytes_read\":%"PRIu64
+		"}\n",
+		frames > 0 ? cpu_ms / frames : 0, clients_cpu_ms, usage.ru_maxrss,
+		server->motions,
+		screencopy.frames - server->start_screencopy.frames,
+		screencopy.bytes_read - server->start_screencopy.bytes_read);
+	fflush(stdout);
+}
+
+static void usage(const char *prog) {
+	fprintf(stderr, "Usage: %s [options]\n"
+		"  -s <scenario>  shm, subsurfaces, pointer or screencopy (shm)\n"
+		"  -n <clients>   number of clients (4)\n"
+		"  -r <rate>      commits per second per client (60)\n"
+		"  -S <count>     subsurfaces per client (32)\n"
+		"  -p <rate>      pointer motion events per second, at most 1000 (1000)\n"
+		"  -w <seconds>   warm-up time (1)\n"
+		"  -d <seconds>   measurement time (5)\n"
+		"  -v             enable debug logging\n", prog);
+}
+
+static bool parse_scenario(const char *name,
+		enum bench_scenario *scenario) {
+	size_t len = sizeof(scenario_names) / sizeof(scenario_names[0]);
+	for (size_t i = 0; i < len; ++i) {
+		if (strcmp(name, scenario_names[i]) == 0) {
+			*scenario = i;
+			return true;
+		}
+	}
+	return false;
+}
+
+static bool parse_options(int argc, char *argv[],
+		struct bench_options *options, bool *verbose) {
+	int c;
+	while ((c = getopt(argc, argv, "s:n:r:S:p:w:d:vh")) != -1) {
+		switch (c) {
+		case 's':
+			if (!parse_scenario(optarg, &options->scenario)) {
+				fprintf(stderr, "Unknown scenario: %s\n", optarg);
+				return false;
+			}
+			break;
+		case 'n':
+			options->clients = atoi(optarg);
+			break;
+		case 'r':
+			options->rate = atoi(optarg);
+			break;
+		case 'S':
+			options->subsurfaces = atoi(optarg);
+			break;
+		case 'p':
+			options->pointer_rate = atoi(optarg);
+			break;
+		case 'w':
+			options->warmup = atof(optarg);
+			break;
+		case 'd':
+			options->duration = atof(optarg);
+			break;
+		case 'v':
+			*verbose = true;
+			break;
+		default:
+			return false;
+		}
+	}
+
+	return options->clients > 0 && options->rate > 0 &&
+		options->subsurfaces >= 0 && options->pointer_rate > 0 &&
+		// The pointer timer has a millisecond resolution
+		options->pointer_rate <= 1000 &&
+		options->warmup >= 0 && options->duration > 0;
+}
+
+int main(int argc, char *argv[]) {
+	struct bench_options options = {
+		.scenario = BENCH_SCENARIO_SHM,
+		.clients = 4,
+		.rate = 60,
+		.subsurfaces = 32,
+		.pointer_rate = 1000,
+		.warmup = 1,
+		.duration = 5,
+	};
+	bool verbose = false;
+	if (!parse_options(argc, argv, &options, &verbose)) {
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	wlr_log_init(verbose ? WLR_DEBUG : WLR_ERROR, NULL);
+
+	// Run on machines without a GPU by default
+	setenv("WLR_HEADLESS_RENDERER", "pixman", false);
+
+	struct bench_server server = { .options = &options };
+	wl_list_init(&server.views);
+	wl_array_init(&server.pending_commits);
+	wl_array_init(&server.presenting_commits);
+	wl_array_init(&server.latencies);
+
+	server.display = wl_display_create();
+	server.backend = wlr_headless_backend_create(server.display, NULL);
+	if (server.backend == NULL) {
+		wlr_log(WLR_ERROR, "Failed to create headless backend");
+		return EXIT_FAILURE;
+	}
+	server.renderer = wlr_backend_get_renderer(server.backend);
+	wlr_renderer_init_wl_display(server.renderer, server.display);
+
+	server.compositor =
+		wlr_compositor_create(server.display, server.renderer);
+	server.new_surface.notify = server_handle_new_surface;
+	wl_signal_add(&server.compositor->events.new_surface,
+		&server.new_surface);
+
+	wlr_data_device_manager_create(server.display);
+
+	server.xdg_shell = wlr_xdg_shell_create(server.display);
+	server.new_xdg_surface.notify = server_handle_new_xdg_surface;
+	wl_signal_add(&server.xdg_shell->events.new_surface,
+		&server.new_xdg_surface);
+
+	server.seat = wlr_seat_create(server.display, "seat0");
+	wlr_seat_set_capabilities(server.seat, WL_SEAT_CAPABILITY_POINTER);
+
+	server.screencopy = wlr_screencopy_manager_v1_create(server.display);
+
+	server.output = wlr_headless_add_output(server.backend, 1920, 1080);
+	wlr_output_create_global(server.output);
+	server.output_frame.notify = output_handle_frame;
+	wl_signal_add(&server.output->events.frame, &server.output_frame);
+	server.output_present.notify = output_handle_present;
+	wl_signal_add(&server.output->events.present, &server.output_present);
+
+	const char *socket = wl_display_add_socket_auto(server.display);
+	if (socket == NULL || !wlr_backend_start(server.backend)) {
+		wlr_log(WLR_ERROR, "Failed to start compositor");
+		wlr_backend_destroy(server.backend);
+		wl_display_destroy(server.display);
+		return EXIT_FAILURE;
+	}
+
+	int clients_len = options.clients;
+	if (options.scenario == BENCH_SCENARIO_SCREENCOPY) {
+		clients_len++;
+	}
+	// Clients report the CPU time they used after the warm-up through a pipe
+	int result_fds[2];
+	if (pipe(result_fds) != 0) {
+		wlr_log_errno(WLR_ERROR, "pipe failed");
+		wlr_backend_destroy(server.backend);
+		wl_display_destroy(server.display);
+		return EXIT_FAILURE;
+	}
+	pid_t *pids = calloc(clients_len, sizeof(pid_t));
+	for (int i = 0; i < clients_len; ++i) {
+		pids[i] = fork();
+		if (pids[i] == 0) {
+			close(result_fds[0]);
+			_exit(run_client(socket, &options, i, result_fds[1]));
+		} else if (pids[i] < 0) {
+			wlr_log_errno(WLR_ERROR, "fork failed");
+		}
+	}
+	close(result_fds[1]);
+
+	struct wl_event_loop *loop = wl_display_get_event_loop(server.display);
+	if (options.scenario == BENCH_SCENARIO_POINTER) {
+		server.pointer_timer =
+			wl_event_loop_add_timer(loop, handle_pointer_timer, &server);
+		wl_event_source_timer_update(server.pointer_timer, 1);
+	}
+	server.warmup_timer =
+		wl_event_loop_add_timer(loop, handle_warmup_timer, &server);
+	wl_event_source_timer_update(server.warmup_timer,
+		options.warmup * 1000 + 1);
+	server.end_timer = wl_event_loop_add_timer(loop, handle_end_timer, &server);
+	wl_event_source_timer_update(server.end_timer,
+		(options.warmup + options.duration) * 1000 + 1);
+
+	wl_display_run(server.display);
+
+	for (int i = 0; i < clients_len; ++i) {
+		if (pids[i] > 0) {
+			kill(pids[i], SIGTERM);
+			waitpid(pids[i], NULL, 0);
+		}
+	}
+	free(pids);
+
+	double clients_cpu_ms = 0, cpu_ms;
+	while (read(result_fds[0], &cpu_ms, sizeof(cpu_ms)) == sizeof(cpu_ms)) {
+		clients_cpu_ms += cpu_ms;
+	}
+	close(result_fds[0]);
+	print_results(&server, clients_cpu_ms);
+
+	if (server.pointer_timer != NULL) {
+		wl_event_source_remove(server.pointer_timer);
+	}
+	wl_event_source_remove(server.warmup_timer);
+	wl_event_source_remove(server.end_timer);
+	wl_display_destroy_clients(server.display);
+	wl_display_destroy(server.display);
+	wl_array_release(&server.pending_commits);
+	wl_array_release(&server.presenting_commits);
+	wl_array_release(&server.latencies);
+	return EXIT_SUCCESS;
+}
@@ -24,6 +24,7 @@ struct wlr_drm_plane {
 
 	struct wlr_drm_surface surf;
 	struct wlr_drm_surface mgpu_surf;
+	enum wlr_drm_mgpu_mode mgpu_mode;
 
 	/* Buffer to be submitted to the kernel on the next page-flip */
 	struct wlr_drm_fb pending_fb;
@@ -98,6 +99,22 @@ struct wlr_drm_backend {
 
 	struct wlr_drm_renderer renderer;
 	struct wlr_session *session;
+
+	// Multi-GPU only: whether buffers of the parent GPU can be scanned out
+	struct wl_list mgpu_probes; // wlr_drm_mgpu_probe::link
+};
+
+/**
+ * The result of a test import of a parent GPU buffer with a given format and
+ * set of modifiers (or linear).
+ */
+struct wlr_drm_mgpu_probe {
+	uint32_t format;
+	uint64_t *modifiers; // NULL for linear
+	size_t modifiers_len;
+	bool ok;
+
+	struct wl_list link;
 };
 
 enum wlr_drm_connector_state {
@@ -128,6 +145,21 @@ struct wlr_drm_connector {
 	union wlr_drm_connector_props props;
 
 	int32_t cursor_x, cursor_y;
+	// The cursor changed since it was last submitted to the kernel
+	bool cursor_dirty;
+	struct wlr_drm_cursor_stats cursor_stats;
+
+	// Variable refresh rate frame pacing
+	int32_t vrr_min_refresh; // mHz, 0 if unknown
+	struct timespec last_present;
+	struct timespec last_buffer_commit;
+	int64_t content_interval; // ns, smoothed interval between new frames
+	struct wl_event_source *lfc_timer;
+	int64_t lfc_interval; // ns between two copies of the same frame
+	int lfc_repeats; // copies of the current frame left to present
+	bool lfc_pending; // the pending page-flip repeats the current frame
+	// The pending page-flip only updates the cursor plane (atomic only)
+	bool cursor_flip_pending;
 
 	drmModeCrtc *old_crtc;
 
@@ -142,6 +174,22 @@ struct wlr_drm_connector {
 	bool pageflip_pending;
 };
 
+/**
+ * A connector's part of a batched modeset.
+ */
+struct wlr_drm_modeset {
+	struct wlr_drm_connector *conn;
+	// The CRTC driving the connector after the modeset, NULL to disable it
+	struct wlr_drm_crtc *crtc;
+	struct wlr_drm_mode *mode;
+	// If non-zero, scanned out instead of the primary plane's next FB
+	uint32_t fb_id;
+
+	// private state, used while committing
+	uint32_t mode_id;
+	struct gbm_bo *test_bo;
+};
+
 struct wlr_drm_backend *get_drm_backend_from_backend(
 	struct wlr_backend *wlr_backend);
 bool check_drm_features(struct wlr_drm_backend *drm);
@@ -152,6 +200,8 @@ void scan_drm_connectors(struct wlr_drm_backend *state);
 int handle_drm_event(int fd, uint32_t mask, void *data);
 bool drm_connector_set_mode(struct wlr_drm_connector *conn,
 	struct wlr_output_mode *mode);
+bool drm_commit_outputs(struct wlr_drm_backend *drm,
+	struct wlr_output **outputs, size_t outputs_len, bool *committed);
 bool drm_connector_is_cursor_visible(struct wlr_drm_connector *conn);
 bool drm_connector_supports_vrr(struct wlr_drm_connector *conn);
 size_t drm_crtc_get_gamma_lut_size(struct wlr_drm_backend *drm,
@@ -10,12 +10,17 @@
 struct wlr_drm_backend;
 struct wlr_drm_connector;
 struct wlr_drm_crtc;
+struct wlr_drm_modeset;
 
 // Used to provide atomic or legacy DRM functions
 struct wlr_drm_interface {
 	// Commit al pending changes on a CRTC.
 	bool (*crtc_commit)(struct wlr_drm_backend *drm,
 		struct wlr_drm_connector *conn, uint32_t flags);
+	// Update the cursor plane only. Legacy updates it immediately, atomic
+	// performs a non-blocking commit completed by a page-flip event.
+	bool (*crtc_set_cursor)(struct wlr_drm_backend *drm,
+		struct wlr_drm_connector *conn);
 };
 
 extern const struct wlr_drm_interface atomic_iface;
@@ -23,5 +28,8 @@ extern const struct wlr_drm_interface legacy_iface;
 
 bool drm_legacy_crtc_set_gamma(struct wlr_drm_backend *drm,
 	struct wlr_drm_crtc *crtc, size_t size, uint16_t *lut);
+// Modeset several connectors with a single atomic commit
+bool drm_atomic_commit_modesets(struct wlr_drm_backend *drm,
+	struct wlr_drm_modeset *modesets, size_t modesets_len, uint32_t flags);
 
 #endif
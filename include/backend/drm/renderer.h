@@ -22,6 +22,18 @@ struct wlr_drm_renderer {
 	struct wlr_renderer *wlr_rend;
 };
 
+// Mesa's GBM surfaces hand out at most 4 buffers
+#define WLR_DRM_SURFACE_MAX_IMPORTS 4
+
+/**
+ * A buffer of a surface allocated on the parent GPU, imported into the GPU
+ * driving the output.
+ */
+struct wlr_drm_mgpu_import {
+	struct gbm_bo *bo;
+	struct gbm_bo *mgpu_bo;
+};
+
 struct wlr_drm_surface {
 	struct wlr_drm_renderer *renderer;
 
@@ -30,6 +42,9 @@ struct wlr_drm_surface {
 
 	struct gbm_surface *gbm;
 	EGLSurface egl;
+
+	// Only used when the output scans out the parent GPU's buffers directly
+	struct wlr_drm_mgpu_import imports[WLR_DRM_SURFACE_MAX_IMPORTS];
 };
 
 enum wlr_drm_fb_type {
@@ -54,6 +69,7 @@ struct wlr_drm_fb {
 bool init_drm_renderer(struct wlr_drm_backend *drm,
 	struct wlr_drm_renderer *renderer, wlr_renderer_create_func_t create_render);
 void finish_drm_renderer(struct wlr_drm_renderer *renderer);
+void finish_drm_mgpu_probes(struct wlr_drm_backend *drm);
 
 bool drm_surface_make_current(struct wlr_drm_surface *surf, int *buffer_age);
 bool export_drm_bo(struct gbm_bo *bo, struct wlr_dmabuf_attributes *attribs);
@@ -67,7 +83,7 @@ void drm_fb_move(struct wlr_drm_fb *new, struct wlr_drm_fb *old);
 
 bool drm_surface_render_black_frame(struct wlr_drm_surface *surf);
 struct gbm_bo *drm_fb_acquire(struct wlr_drm_fb *fb, struct wlr_drm_backend *drm,
-		struct wlr_drm_surface *mgpu);
+		struct wlr_drm_plane *plane);
 
 bool drm_plane_init_surface(struct wlr_drm_plane *plane,
 		struct wlr_drm_backend *drm, int32_t width, uint32_t height,
@@ -11,6 +11,9 @@ int32_t calculate_refresh_rate(const drmModeModeInfo *mode);
 // Populates the make/model/phys_{width,height} of output from the edid data
 void parse_edid(struct wlr_output *restrict output, size_t len,
 	const uint8_t *data);
+// Returns the minimum vertical refresh rate (mHz) advertised in the edid data,
+// or 0 if unknown
+int32_t parse_edid_min_refresh(size_t len, const uint8_t *data);
 // Returns the string representation of a DRM output type
 const char *conn_get_name(uint32_t type_id);
 // Returns the DRM framebuffer id for a gbm_bo
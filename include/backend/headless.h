@@ -1,17 +1,20 @@
 #ifndef BACKEND_HEADLESS_H
 #define BACKEND_HEADLESS_H
 
+#include <pixman.h>
 #include <wlr/backend/headless.h>
 #include <wlr/backend/interface.h>
 #include <wlr/render/gles2.h>
+#include "util/vblank.h"
 
 #define HEADLESS_DEFAULT_REFRESH (60 * 1000) // 60 Hz
 
 struct wlr_headless_backend {
 	struct wlr_backend backend;
 	struct wlr_egl priv_egl; // may be uninitialized
-	struct wlr_egl *egl;
+	struct wlr_egl *egl; // NULL when using the pixman renderer
 	struct wlr_renderer *renderer;
+	bool own_renderer;
 	struct wl_display *display;
 	struct wl_list outputs;
 	size_t last_output_num;
@@ -30,8 +33,15 @@ struct wlr_headless_output {
 
 	GLuint fbo, rbo;
 
-	struct wl_event_source *frame_timer;
-	int frame_delay; // ms
+	// Shared memory buffer, used instead of the FBO by the pixman renderer
+	void *shm_data;
+	size_t shm_size;
+	pixman_image_t *image;
+	bool image_rendered;
+
+	struct vblank_timer vblank;
+	bool present_pending;
+	uint32_t present_commit_seq;
 };
 
 struct wlr_headless_input_device {
@@ -23,6 +23,14 @@ struct wlr_libinput_backend {
 	struct wl_listener session_signal;
 
 	struct wlr_list wlr_device_lists; // list of struct wl_list
+
+	// Events read at startup, handled once all backends have started
+	struct wl_array queued_events; // struct libinput_event *
+	struct wl_event_source *queued_events_idle;
+	// Devices are re-opened after the other backends have been resumed
+	struct wl_event_source *resume_idle;
+	// Set when devices were added since the last input_batch_done
+	bool devices_added;
 };
 
 struct wlr_libinput_input_device {
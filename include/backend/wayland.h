@@ -32,6 +32,8 @@ struct wlr_wl_backend {
 	struct wl_event_source *remote_display_src;
 	struct wl_registry *registry;
 	struct wl_compositor *compositor;
+	struct wl_subcompositor *subcompositor;
+	struct wl_shm *shm;
 	struct xdg_wm_base *xdg_wm_base;
 	struct zxdg_decoration_manager_v1 *zxdg_decoration_manager_v1;
 	struct zwp_pointer_gestures_v1 *zwp_pointer_gestures_v1;
@@ -74,6 +76,9 @@ struct wlr_wl_output {
 	EGLSurface egl_surface;
 	struct wl_list presentation_feedbacks;
 
+	struct wl_list layers; // wlr_wl_output_layer::link
+	bool layers_dirty;
+
 	uint32_t enter_serial;
 
 	struct {
@@ -84,6 +89,28 @@ struct wlr_wl_output {
 	} cursor;
 };
 
+/**
+ * A copy of a client wl_shm buffer, in a shared memory pool of the remote
+ * compositor.
+ */
+struct wlr_wl_shm_buffer {
+	struct wl_buffer *wl_buffer;
+	void *data;
+	size_t size;
+	int32_t width, height, stride;
+	uint32_t format;
+	bool busy;
+};
+
+struct wlr_wl_output_layer {
+	struct wlr_wl_output *output;
+	struct wl_list link; // wlr_wl_output::layers
+
+	struct wl_surface *surface;
+	struct wl_subsurface *subsurface;
+	struct wlr_wl_shm_buffer shm_buffers[2];
+};
+
 struct wlr_wl_input_device {
 	struct wlr_input_device wlr_input_device;
 	uint32_t fingers;
@@ -109,6 +136,11 @@ struct wlr_wl_pointer {
 
 struct wlr_wl_backend *get_wl_backend_from_backend(struct wlr_backend *backend);
 void update_wl_output_cursor(struct wlr_wl_output *output);
+bool test_wl_buffer(struct wlr_wl_backend *wl, struct wlr_buffer *wlr_buffer);
+struct wlr_wl_buffer *create_wl_buffer(struct wlr_wl_backend *wl,
+	struct wlr_buffer *wlr_buffer);
+void damage_wl_surface(struct wl_surface *surface, pixman_region32_t *damage);
+void destroy_wl_output_layer(struct wlr_wl_output_layer *layer);
 struct wlr_wl_pointer *pointer_get_wl(struct wlr_pointer *wlr_pointer);
 void create_wl_pointer(struct wl_pointer *wl_pointer, struct wlr_wl_output *output);
 void create_wl_keyboard(struct wl_keyboard *wl_keyboard, struct wlr_wl_backend *wl);
@@ -4,19 +4,31 @@
 #include <stdbool.h>
 
 #include <X11/Xlib-xcb.h>
+#include <pixman.h>
 #include <wayland-server-core.h>
 #include <xcb/xcb.h>
 
 #include <wlr/backend/x11.h>
 #include <wlr/config.h>
+
+#if WLR_HAS_XCB_PRESENT
+#include <xcb/present.h>
+#endif
+#if WLR_HAS_XCB_SHM
+#include <xcb/shm.h>
+#endif
 #include <wlr/interfaces/wlr_input_device.h>
 #include <wlr/interfaces/wlr_output.h>
 #include <wlr/render/egl.h>
 #include <wlr/render/wlr_renderer.h>
 
+#include "util/vblank.h"
+
 #define XCB_EVENT_RESPONSE_TYPE_MASK 0x7f
 
 #define X11_DEFAULT_REFRESH (60 * 1000) // 60 Hz
+// Present reports windows which aren't on a CRTC with a fake, slow one
+#define X11_PRESENT_MAX_PERIOD_NS (100 * 1000 * 1000) // 10 Hz
 
 struct wlr_x11_backend;
 
@@ -35,8 +47,27 @@ struct wlr_x11_output {
 	struct wlr_input_device touch_dev;
 	struct wl_list touchpoints; // wlr_x11_touchpoint::link
 
-	struct wl_event_source *frame_timer;
-	int frame_delay;
+	// Used when the Present extension is unavailable or unreliable
+	struct vblank_timer vblank;
+	bool present_pending;
+	uint32_t present_commit_seq;
+
+	// Present extension
+	uint32_t present_event_id;
+	uint32_t present_serial;
+	bool present_notify_pending;
+	bool present_unreliable;
+	uint64_t present_last_msc, present_last_ust;
+
+	// Shared memory buffer, used instead of the EGL surface by the pixman
+	// renderer
+	uint32_t shm_seg; // xcb_shm_seg_t
+	xcb_gcontext_t gc;
+	void *shm_data;
+	size_t shm_size;
+	pixman_image_t *image;
+	bool image_rendered;
+	bool shm_busy;
 
 	bool cursor_hidden;
 };
@@ -80,6 +111,12 @@ struct wlr_x11_backend {
 
 	uint8_t xinput_opcode;
 
+	bool has_present;
+	uint8_t present_opcode;
+	bool has_shm;
+	// The pixman renderer is used, buffers are copied with MIT-SHM
+	bool use_shm;
+
 	struct wl_listener display_destroy;
 };
 
@@ -100,5 +137,9 @@ void update_x11_pointer_position(struct wlr_x11_output *output,
 
 void handle_x11_configure_notify(struct wlr_x11_output *output,
 	xcb_configure_notify_event_t *event);
+#if WLR_HAS_XCB_PRESENT
+void handle_x11_present_event(struct wlr_x11_backend *x11,
+	xcb_ge_generic_event_t *event);
+#endif
 
 #endif
@@ -100,6 +100,12 @@ const struct wlr_gles2_pixel_format *get_gles2_format_from_wl(
 	enum wl_shm_format fmt);
 const struct wlr_gles2_pixel_format *get_gles2_format_from_gl(
 	GLint gl_format, GLint gl_type, bool alpha);
+/**
+ * Get the format used to upload pixels of the given format. If it differs from
+ * `fmt`, pixels need to be converted before being uploaded.
+ */
+const struct wlr_gles2_pixel_format *get_gles2_upload_format(
+	enum wl_shm_format fmt);
 const enum wl_shm_format *get_gles2_wl_formats(size_t *len);
 
 struct wlr_gles2_texture *gles2_get_texture(
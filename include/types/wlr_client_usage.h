@@ -0,0 +1,31 @@
+#ifndef TYPES_WLR_CLIENT_USAGE_H
+#define TYPES_WLR_CLIENT_USAGE_H
+
+#include <stdbool.h>
+#include <wlr/types/wlr_client_usage.h>
+
+/**
+ * Get the resource usage of a client, creating it if needed. Returns NULL if
+ * the compositor doesn't account resources.
+ */
+struct wlr_client_usage *client_usage_from_client(struct wl_client *client);
+/**
+ * Accounts `amount` of a resource. If the client would exceed its limit, it
+ * is disconnected with a protocol error and false is returned. `usage` may be
+ * NULL.
+ */
+bool client_usage_add(struct wlr_client_usage *usage,
+	enum wlr_client_usage_resource resource, size_t amount);
+/**
+ * Gives back `amount` of a resource. `usage` may be NULL.
+ */
+void client_usage_remove(struct wlr_client_usage *usage,
+	enum wlr_client_usage_resource resource, size_t amount);
+/**
+ * Gives back `amount` of a resource of a client. Does nothing if the client is
+ * being destroyed.
+ */
+void client_usage_remove_client(struct wl_client *client,
+	enum wlr_client_usage_resource resource, size_t amount);
+
+#endif
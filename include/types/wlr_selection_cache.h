@@ -0,0 +1,18 @@
+#ifndef TYPES_WLR_SELECTION_CACHE_H
+#define TYPES_WLR_SELECTION_CACHE_H
+
+#include <stdbool.h>
+#include <wlr/types/wlr_selection_cache.h>
+
+struct wlr_selection_cache_source;
+
+/**
+ * Serve a request for the source's data from the cache. Returns false if the
+ * request must be forwarded to the source. Takes ownership of the file
+ * descriptor when returning true.
+ */
+bool selection_cache_source_send(
+	struct wlr_selection_cache_source *cache_source, const char *mime_type,
+	int fd);
+
+#endif
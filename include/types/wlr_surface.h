@@ -0,0 +1,18 @@
+#ifndef TYPES_WLR_SURFACE_H
+#define TYPES_WLR_SURFACE_H
+
+#include <wlr/types/wlr_surface.h>
+
+/**
+ * Applies the commit held back while waiting for its buffer, if any, along
+ * with the role state saved by `wlr_surface_role.hold`.
+ */
+void surface_apply_held(struct wlr_surface *surface);
+
+/**
+ * Completes the surface's frame callbacks, even if the surface is throttled.
+ */
+void surface_send_frame_done_unthrottled(struct wlr_surface *surface,
+	const struct timespec *when);
+
+#endif
@@ -21,6 +21,8 @@ void unmap_xdg_surface_v6(struct wlr_xdg_surface_v6 *surface);
 void destroy_xdg_surface_v6(struct wlr_xdg_surface_v6 *surface);
 void handle_xdg_surface_v6_commit(struct wlr_surface *wlr_surface);
 void handle_xdg_surface_v6_precommit(struct wlr_surface *wlr_surface);
+void handle_xdg_surface_v6_hold(struct wlr_surface *wlr_surface);
+void handle_xdg_surface_v6_swap_held(struct wlr_surface *wlr_surface);
 
 void create_xdg_positioner_v6(struct wlr_xdg_client_v6 *client, uint32_t id);
 struct wlr_xdg_positioner_v6_resource *get_xdg_positioner_v6_from_resource(
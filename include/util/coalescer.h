@@ -0,0 +1,41 @@
+#ifndef UTIL_COALESCER_H
+#define UTIL_COALESCER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <wayland-server-core.h>
+
+typedef void (*coalescer_flush_func_t)(void *data);
+
+/**
+ * Batches state updates. However many times an update is scheduled, the flush
+ * callback runs at most once per event loop iteration, and at most once per
+ * interval when an interval is set.
+ */
+struct wlr_coalescer {
+	struct wl_event_loop *event_loop;
+	struct wl_event_source *idle_source;
+	struct wl_event_source *timer_source;
+	uint32_t interval_ms;
+	uint32_t last_flush_ms;
+	bool pending;
+
+	coalescer_flush_func_t flush;
+	void *data;
+};
+
+struct wlr_coalescer *coalescer_create(struct wl_event_loop *event_loop,
+	coalescer_flush_func_t flush, void *data);
+void coalescer_destroy(struct wlr_coalescer *coalescer);
+/**
+ * Set the minimum interval between two flushes, in milliseconds. Zero flushes
+ * when the event loop becomes idle.
+ */
+void coalescer_set_interval(struct wlr_coalescer *coalescer,
+	uint32_t interval_ms);
+/**
+ * Schedule a flush, unless one is already pending.
+ */
+void coalescer_schedule(struct wlr_coalescer *coalescer);
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef UTIL_PIXEL_CONVERT_H
+#define UTIL_PIXEL_CONVERT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <wayland-server-protocol.h>
+
+/**
+ * Check whether pixels can be converted from `src_fmt` to `dst_fmt`. Only
+ * 32-bit RGB formats are supported.
+ */
+bool pixel_convert_supported(enum wl_shm_format dst_fmt,
+	enum wl_shm_format src_fmt);
+
+/**
+ * Copy a `width`x`height` rectangle of pixels, converting them from `src_fmt`
+ * to `dst_fmt`. Rows are flipped vertically if `flip_y` is set. When the
+ * destination has an alpha or padding channel the source lacks, it is filled
+ * with 0xFF.
+ *
+ * The source and destination must not overlap.
+ */
+bool convert_pixels(enum wl_shm_format dst_fmt, void *dst, uint32_t dst_stride,
+	enum wl_shm_format src_fmt, const void *src, uint32_t src_stride,
+	uint32_t width, uint32_t height, bool flip_y);
+
+#endif
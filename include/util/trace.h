@@ -0,0 +1,26 @@
+#ifndef UTIL_TRACE_H
+#define UTIL_TRACE_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+
+extern atomic_bool trace_enabled;
+
+/**
+ * Record an event in the current thread's ring buffer. `name` must be a string
+ * literal, `label` is copied and may be NULL. `phase` is a Chrome trace event
+ * phase: 'B' (begin), 'E' (end) or 'i' (instant).
+ */
+void trace_record(char phase, const char *name, const char *label);
+
+#define TRACE_IS_ENABLED() \
+	atomic_load_explicit(&trace_enabled, memory_order_relaxed)
+
+#define TRACE_BEGIN(name, label) \
+	do { if (TRACE_IS_ENABLED()) trace_record('B', name, label); } while (0)
+#define TRACE_END(name, label) \
+	do { if (TRACE_IS_ENABLED()) trace_record('E', name, label); } while (0)
+#define TRACE_INSTANT(name, label) \
+	do { if (TRACE_IS_ENABLED()) trace_record('i', name, label); } while (0)
+
+#endif
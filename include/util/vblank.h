@@ -0,0 +1,52 @@
+#ifndef UTIL_VBLANK_H
+#define UTIL_VBLANK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include <wayland-server-core.h>
+
+struct vblank_timer;
+
+/**
+ * Called at a virtual vblank, with its exact time on CLOCK_MONOTONIC and its
+ * sequence number.
+ */
+typedef void (*vblank_func_t)(struct vblank_timer *timer,
+	const struct timespec *when, uint64_t seq);
+
+/**
+ * A virtual vblank clock, for outputs without a real display behind them.
+ *
+ * Vblanks happen at absolute times computed from the refresh rate, so the
+ * clock doesn't drift. Timers with the same refresh rate on the same event
+ * loop share a clock: they are phase-locked and woken up together. The clock
+ * only ticks while a timer is scheduled.
+ */
+struct vblank_timer {
+	struct wl_event_loop *event_loop;
+	struct vblank_clock *clock; // NULL until a refresh rate is set
+	struct wl_list link; // vblank_clock::timers
+	bool scheduled, firing;
+
+	vblank_func_t func;
+	void *data;
+};
+
+void vblank_timer_init(struct vblank_timer *timer,
+	struct wl_event_loop *event_loop, vblank_func_t func, void *data);
+void vblank_timer_finish(struct vblank_timer *timer);
+/**
+ * Set the refresh rate, in mHz. Returns false on error.
+ */
+bool vblank_timer_set_refresh(struct vblank_timer *timer, int32_t refresh);
+/**
+ * Call the timer's function at the next vblank.
+ */
+void vblank_timer_schedule(struct vblank_timer *timer);
+/**
+ * Get the duration of a refresh cycle, in nanoseconds.
+ */
+int64_t vblank_timer_get_period(struct vblank_timer *timer);
+
+#endif
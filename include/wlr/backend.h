@@ -25,6 +25,11 @@ struct wlr_backend {
 		struct wl_signal new_input;
 		/** Raised when new outputs are added, passed the wlr_output */
 		struct wl_signal new_output;
+		/**
+		 * Raised after a batch of new_input signals for devices discovered
+		 * together (e.g. at startup or on hotplug), passed the wlr_backend
+		 */
+		struct wl_signal input_batch_done;
 	} events;
 };
 
@@ -28,6 +28,44 @@ struct wlr_backend *wlr_drm_backend_create(struct wl_display *display,
 bool wlr_backend_is_drm(struct wlr_backend *backend);
 bool wlr_output_is_drm(struct wlr_output *output);
 
+/**
+ * How frames rendered by the parent backend's GPU reach the screen of an
+ * output driven by a secondary GPU.
+ */
+enum wlr_drm_mgpu_mode {
+	/* The output is driven by the rendering GPU, no transfer is needed */
+	WLR_DRM_MGPU_NONE,
+	/* Buffers of the rendering GPU are scanned out directly */
+	WLR_DRM_MGPU_IMPORT,
+	/* The rendering GPU renders to linear buffers, scanned out directly */
+	WLR_DRM_MGPU_LINEAR,
+	/* Linear buffers are copied to scanout buffers by the secondary GPU */
+	WLR_DRM_MGPU_BLIT,
+};
+
+/**
+ * Get the way frames are transferred between GPUs for this output's primary
+ * plane. This is only meaningful once the output has a mode set.
+ */
+enum wlr_drm_mgpu_mode wlr_drm_connector_get_mgpu_mode(
+	struct wlr_output *output);
+
+/**
+ * Statistics about hardware cursor updates.
+ */
+struct wlr_drm_cursor_stats {
+	/* Updates submitted along with the next page-flip */
+	uint64_t merged;
+	/* Updates submitted on their own, without waiting for a page-flip */
+	uint64_t forced;
+};
+
+/**
+ * Get statistics about the hardware cursor updates of this output.
+ */
+void wlr_drm_connector_get_cursor_stats(struct wlr_output *output,
+	struct wlr_drm_cursor_stats *stats);
+
 /**
  * Add mode to the list of available modes
  */
@@ -10,16 +10,29 @@
 #define WLR_BACKEND_INTERFACE_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <time.h>
 #include <wlr/backend.h>
 #include <wlr/render/egl.h>
 
+struct wlr_output;
+
 struct wlr_backend_impl {
 	bool (*start)(struct wlr_backend *backend);
 	void (*destroy)(struct wlr_backend *backend);
 	struct wlr_renderer *(*get_renderer)(struct wlr_backend *backend);
 	struct wlr_session *(*get_session)(struct wlr_backend *backend);
 	clockid_t (*get_presentation_clock)(struct wlr_backend *backend);
+	/**
+	 * Tests or commits the pending state of several outputs at once. If
+	 * `committed` is NULL, the outputs are only tested. Otherwise,
+	 * `committed[i]` is set to whether the state of `outputs[i]` has been
+	 * applied, and true is returned if all of them have. Backends which
+	 * can't test a whole configuration without applying it should test each
+	 * output separately.
+	 */
+	bool (*commit_outputs)(struct wlr_backend *backend,
+		struct wlr_output **outputs, size_t outputs_len, bool *committed);
 };
 
 /**
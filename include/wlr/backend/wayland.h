@@ -1,12 +1,16 @@
 #ifndef WLR_BACKEND_WAYLAND_H
 #define WLR_BACKEND_WAYLAND_H
 #include <stdbool.h>
+#include <pixman.h>
 #include <wayland-client.h>
 #include <wayland-server-core.h>
 #include <wlr/backend.h>
+#include <wlr/types/wlr_buffer.h>
 #include <wlr/types/wlr_input_device.h>
 #include <wlr/types/wlr_output.h>
 
+struct wlr_wl_output_layer;
+
 /**
  * Creates a new wlr_wl_backend. This backend will be created with no outputs;
  * you must use wlr_wl_output_create to add them.
@@ -56,6 +60,57 @@ void wlr_wl_output_set_title(struct wlr_output *output, const char *title);
  */
 struct wl_surface *wlr_wl_output_get_surface(struct wlr_output *output);
 
+/**
+ * Creates a passthrough layer on a Wayland output. Layers are subsurfaces of
+ * the output's surface on the remote compositor. Buffers attached to them are
+ * composited by the remote compositor instead of being rendered into the
+ * output's buffer. New layers are stacked above the existing ones.
+ *
+ * Returns NULL if the remote compositor doesn't support subsurfaces.
+ */
+struct wlr_wl_output_layer *wlr_wl_output_layer_create(
+	struct wlr_output *output);
+/**
+ * Destroys a layer. Unlike the other layer changes, this isn't deferred to
+ * the next output commit: the remote compositor hides the layer immediately.
+ */
+void wlr_wl_output_layer_destroy(struct wlr_wl_output_layer *layer);
+/**
+ * Checks whether a buffer can be displayed by a layer: DMA-BUFs in a format
+ * supported by the remote compositor and ARGB8888/XRGB8888 client wl_shm
+ * buffers.
+ */
+bool wlr_wl_output_layer_test_buffer(struct wlr_wl_output_layer *layer,
+	struct wlr_buffer *buffer);
+/**
+ * Displays a buffer in the layer, or hides the layer if the buffer is NULL.
+ * DMA-BUFs are shared with the remote compositor and stay locked until it
+ * releases them. wl_shm buffers are copied right away, so they should be
+ * attached while handling the client's commit, before the client reuses them.
+ * The damage is in buffer-local coordinates, NULL damages the whole buffer.
+ *
+ * Returns false if the buffer can't be displayed, in which case the layer is
+ * left unchanged and the buffer should be composited instead. The change is
+ * applied on the next output commit.
+ */
+bool wlr_wl_output_layer_attach_buffer(struct wlr_wl_output_layer *layer,
+	struct wlr_buffer *buffer, pixman_region32_t *damage);
+/**
+ * Sets the position of the layer relative to the top-left corner of the
+ * output's buffer. The change is applied on the next output commit.
+ */
+void wlr_wl_output_layer_set_position(struct wlr_wl_output_layer *layer,
+	int32_t x, int32_t y);
+/**
+ * Restacks the layer directly above or below a sibling layer of the same
+ * output, or the output's own buffer if the sibling is NULL. The change is
+ * applied on the next output commit.
+ */
+void wlr_wl_output_layer_place_above(struct wlr_wl_output_layer *layer,
+	struct wlr_wl_output_layer *sibling);
+void wlr_wl_output_layer_place_below(struct wlr_wl_output_layer *layer,
+	struct wlr_wl_output_layer *sibling);
+
 /**
  * Returns the remote wl_seat for a Wayland input device.
  */
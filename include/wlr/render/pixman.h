@@ -0,0 +1,34 @@
+/*
+ * This an unstable interface of wlroots. No guarantees are made regarding the
+ * future consistency of this API.
+ */
+#ifndef WLR_USE_UNSTABLE
+#error "Add -DWLR_USE_UNSTABLE to enable unstable wlroots features"
+#endif
+
+#ifndef WLR_RENDER_PIXMAN_H
+#define WLR_RENDER_PIXMAN_H
+
+#include <pixman.h>
+#include <wlr/render/wlr_renderer.h>
+
+/**
+ * Create a software renderer, compositing with pixman. It renders to images
+ * set with wlr_pixman_renderer_set_image and only supports shm textures.
+ */
+struct wlr_renderer *wlr_pixman_renderer_create(void);
+
+bool wlr_renderer_is_pixman(struct wlr_renderer *renderer);
+
+/**
+ * Set the image rendered to by the following wlr_renderer_begin calls. The
+ * image isn't referenced, the caller must keep it alive while rendering.
+ * Passing NULL unsets it.
+ */
+void wlr_pixman_renderer_set_image(struct wlr_renderer *renderer,
+	pixman_image_t *image);
+
+bool wlr_texture_is_pixman(struct wlr_texture *texture);
+pixman_image_t *wlr_pixman_texture_get_image(struct wlr_texture *texture);
+
+#endif
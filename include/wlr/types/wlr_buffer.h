@@ -14,6 +14,7 @@
 #include <wlr/render/dmabuf.h>
 
 struct wlr_buffer;
+struct wlr_client_usage;
 
 struct wlr_buffer_impl {
 	void (*destroy)(struct wlr_buffer *buffer);
@@ -93,12 +94,24 @@ struct wlr_client_buffer {
 	bool resource_released;
 	/**
 	 * The buffer's texture, if any. A buffer will not have a texture if the
-	 * client destroys the buffer before it has been released.
+	 * client destroys the buffer before it has been released, or if the
+	 * texture has been evicted.
 	 */
 	struct wlr_texture *texture;
+	/**
+	 * Whether the texture has been evicted to save memory.
+	 */
+	bool texture_evicted;
 
 	struct wl_listener resource_destroy;
 	struct wl_listener release;
+
+	// private state
+
+	struct wlr_renderer *renderer;
+	struct wlr_client_usage *usage;
+	size_t usage_bytes;
+	struct wl_listener usage_destroy;
 };
 
 struct wlr_renderer;
@@ -119,6 +132,11 @@ bool wlr_resource_get_buffer_size(struct wl_resource *resource,
  */
 struct wlr_client_buffer *wlr_client_buffer_import(
 	struct wlr_renderer *renderer, struct wl_resource *resource);
+/**
+ * Get the client buffer wrapped by a buffer, or NULL if the buffer isn't a
+ * client buffer.
+ */
+struct wlr_client_buffer *wlr_client_buffer_get(struct wlr_buffer *buffer);
 /**
  * Try to update the buffer's content. On success, returns the updated buffer
  * and destroys the provided `buffer`. On error, `buffer` is intact and NULL is
@@ -130,5 +148,19 @@ struct wlr_client_buffer *wlr_client_buffer_import(
 struct wlr_client_buffer *wlr_client_buffer_apply_damage(
 	struct wlr_client_buffer *buffer, struct wl_resource *resource,
 	pixman_region32_t *damage);
+/**
+ * Destroy the buffer's texture to save memory. The texture isn't evicted if
+ * another consumer than the surface holds the buffer. Returns the estimated
+ * number of bytes freed.
+ */
+size_t wlr_client_buffer_evict_texture(struct wlr_client_buffer *buffer);
+/**
+ * Re-create an evicted texture from the buffer resource. Fails if the buffer
+ * has been released to the client, which may have re-used it, or if the client
+ * has destroyed it: a new buffer is needed then. wl_shm buffers are released
+ * once uploaded, so their textures can't be restored. On failure, the buffer
+ * is left without a texture and isn't restored again.
+ */
+bool wlr_client_buffer_restore_texture(struct wlr_client_buffer *buffer);
 
 #endif
@@ -0,0 +1,95 @@
+/*
+ * This an unstable interface of wlroots. No guarantees are made regarding the
+ * future consistency of this API.
+ */
+#ifndef WLR_USE_UNSTABLE
+#error "Add -DWLR_USE_UNSTABLE to enable unstable wlroots features"
+#endif
+
+#ifndef WLR_TYPES_WLR_CLIENT_USAGE_H
+#define WLR_TYPES_WLR_CLIENT_USAGE_H
+
+#include <stddef.h>
+#include <wayland-server-core.h>
+
+enum wlr_client_usage_resource {
+	WLR_CLIENT_USAGE_SURFACES,
+	WLR_CLIENT_USAGE_TEXTURES,
+	WLR_CLIENT_USAGE_TEXTURE_BYTES,
+	WLR_CLIENT_USAGE_DMABUF_BUFFERS,
+};
+
+#define WLR_CLIENT_USAGE_RESOURCE_COUNT 4
+
+/**
+ * The resources currently held by a client:
+ *
+ * - WLR_CLIENT_USAGE_SURFACES: wl_surfaces
+ * - WLR_CLIENT_USAGE_TEXTURES: textures imported from the client's buffers,
+ *   including wl_shm buffers uploaded to the GPU
+ * - WLR_CLIENT_USAGE_TEXTURE_BYTES: the estimated size of these textures
+ * - WLR_CLIENT_USAGE_DMABUF_BUFFERS: wl_buffers created with linux-dmabuf
+ */
+struct wlr_client_usage {
+	struct wlr_client_usage_manager *manager;
+	struct wl_client *client;
+	struct wl_list link; // wlr_client_usage_manager::clients
+
+	size_t current[WLR_CLIENT_USAGE_RESOURCE_COUNT];
+
+	struct {
+		struct wl_signal destroy;
+	} events;
+
+	// private state
+
+	struct wl_listener client_destroy;
+};
+
+struct wlr_client_usage_limit_event {
+	struct wlr_client_usage *usage;
+	enum wlr_client_usage_resource resource;
+	size_t requested;
+};
+
+/**
+ * Accounts the resources allocated by clients on their behalf.
+ *
+ * A limit of zero means the resource is unlimited, which is the default. When
+ * an allocation would exceed a non-zero limit, `limit_exceeded` is emitted and
+ * the client is disconnected with a protocol error.
+ */
+struct wlr_client_usage_manager {
+	struct wl_display *display;
+	struct wl_list clients; // wlr_client_usage::link
+
+	size_t limits[WLR_CLIENT_USAGE_RESOURCE_COUNT];
+
+	struct {
+		struct wl_signal new_client; // wlr_client_usage
+		struct wl_signal limit_exceeded; // wlr_client_usage_limit_event
+		struct wl_signal destroy;
+	} events;
+
+	// private state
+
+	struct wl_listener display_destroy;
+};
+
+struct wlr_client_usage_manager *wlr_client_usage_manager_create(
+	struct wl_display *display);
+/**
+ * Get the resource usage of a client. Returns NULL if the client doesn't hold
+ * any accounted resource yet.
+ */
+struct wlr_client_usage *wlr_client_usage_get(
+	struct wlr_client_usage_manager *manager, struct wl_client *client);
+/**
+ * Sets the limit of a resource for every client. Clients already above the
+ * limit keep their resources but can't allocate more.
+ */
+void wlr_client_usage_manager_set_limit(
+	struct wlr_client_usage_manager *manager,
+	enum wlr_client_usage_resource resource, size_t limit);
+
+#endif
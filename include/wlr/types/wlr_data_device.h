@@ -83,6 +83,8 @@ struct wlr_data_source {
 	enum wl_data_device_manager_dnd_action current_dnd_action;
 	uint32_t compositor_action;
 
+	struct wlr_selection_cache_source *cache; // private state
+
 	struct {
 		struct wl_signal destroy;
 	} events;
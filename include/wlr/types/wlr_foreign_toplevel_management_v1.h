@@ -17,6 +17,7 @@ struct wlr_foreign_toplevel_manager_v1 {
 	struct wl_global *global;
 	struct wl_list resources; // wl_resource_get_link
 	struct wl_list toplevels; // wlr_foreign_toplevel_handle_v1::link
+	uint32_t update_interval_ms;
 
 	struct wl_listener display_destroy;
 
@@ -46,7 +47,8 @@ struct wlr_foreign_toplevel_handle_v1 {
 	struct wlr_foreign_toplevel_manager_v1 *manager;
 	struct wl_list resources;
 	struct wl_list link;
-	struct wl_event_source *idle_source;
+	struct wlr_coalescer *coalescer; // private state
+	uint32_t pending; // private state
 
 	char *title;
 	char *app_id;
@@ -102,6 +104,14 @@ struct wlr_foreign_toplevel_handle_v1_set_rectangle_event {
 struct wlr_foreign_toplevel_manager_v1 *wlr_foreign_toplevel_manager_v1_create(
 	struct wl_display *display);
 
+/**
+ * Set the minimum interval between two updates sent for a toplevel, in
+ * milliseconds. Changes made in between are batched together. By default,
+ * changes are batched until the event loop becomes idle.
+ */
+void wlr_foreign_toplevel_manager_v1_set_update_interval(
+	struct wlr_foreign_toplevel_manager_v1 *manager, uint32_t interval_ms);
+
 struct wlr_foreign_toplevel_handle_v1 *wlr_foreign_toplevel_handle_v1_create(
 	struct wlr_foreign_toplevel_manager_v1 *manager);
 void wlr_foreign_toplevel_handle_v1_destroy(
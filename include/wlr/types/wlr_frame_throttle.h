@@ -0,0 +1,65 @@
+/*
+ * This an unstable interface of wlroots. No guarantees are made regarding the
+ * future consistency of this API.
+ */
+#ifndef WLR_USE_UNSTABLE
+#error "Add -DWLR_USE_UNSTABLE to enable unstable wlroots features"
+#endif
+
+#ifndef WLR_TYPES_WLR_FRAME_THROTTLE_H
+#define WLR_TYPES_WLR_FRAME_THROTTLE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <wayland-server-core.h>
+#include <wlr/types/wlr_output.h>
+#include <wlr/types/wlr_surface.h>
+
+/**
+ * Throttles the frame callbacks of surfaces which aren't visible.
+ *
+ * The compositor (or its scene graph) reports on which outputs each surface,
+ * with its subsurfaces, is visible. A surface which is fully occluded on an
+ * output should be reported as not visible there. Once a surface has been
+ * reported, it's throttled while it isn't visible on any output: its frame
+ * callbacks are completed at most once per interval, by wlroots if the
+ * compositor stops rendering it. Surfaces never reported aren't throttled.
+ *
+ * The interval is `default_interval` milliseconds, and can be overridden per
+ * client. An interval of zero disables throttling.
+ */
+struct wlr_frame_throttle {
+	uint32_t default_interval; // ms
+
+	struct wl_list surfaces; // private state
+	struct wl_list clients; // private state
+	struct wl_list outputs; // private state
+
+	struct {
+		struct wl_signal destroy;
+	} events;
+
+	// private state
+
+	struct wl_event_source *timer;
+
+	struct wl_listener display_destroy;
+};
+
+struct wlr_frame_throttle *wlr_frame_throttle_create(
+	struct wl_display *display, uint32_t default_interval);
+void wlr_frame_throttle_destroy(struct wlr_frame_throttle *throttle);
+/**
+ * Report whether a surface is visible on an output.
+ */
+void wlr_frame_throttle_set_visible(struct wlr_frame_throttle *throttle,
+	struct wlr_surface *surface, struct wlr_output *output, bool visible);
+/**
+ * Set the throttling interval of a client's hidden surfaces, in milliseconds.
+ * Zero disables throttling for the client.
+ */
+void wlr_frame_throttle_set_client_interval(
+	struct wlr_frame_throttle *throttle, struct wl_client *client,
+	uint32_t interval);
+
+#endif
@@ -24,6 +24,7 @@
 struct wlr_idle {
 	struct wl_global *global;
 	struct wl_list idle_timers; // wlr_idle_timeout::link
+	struct wl_list seats; // private state
 	struct wl_event_loop *event_loop;
 	bool enabled;
 
@@ -39,12 +40,14 @@ struct wlr_idle {
 struct wlr_idle_timeout {
 	struct wl_resource *resource;
 	struct wl_list link;
+	struct wlr_idle *idle;
 	struct wlr_seat *seat;
 
-	struct wl_event_source *idle_source;
 	bool idle_state;
 	bool enabled;
 	uint32_t timeout; // milliseconds
+	// Last simulated activity, or when the timeout was last restarted (ms)
+	int64_t last_activity;
 
 	struct {
 		struct wl_signal idle;
@@ -52,7 +55,6 @@ struct wlr_idle_timeout {
 		struct wl_signal destroy;
 	} events;
 
-	struct wl_listener input_listener;
 	struct wl_listener seat_destroy;
 
 	void *data;
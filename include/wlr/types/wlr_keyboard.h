@@ -51,7 +51,7 @@ struct wlr_keyboard {
 	const struct wlr_keyboard_impl *impl;
 	struct wlr_keyboard_group *group;
 
-	char *keymap_string;
+	char *keymap_string; // shared by keyboards with the same keymap
 	size_t keymap_size;
 	struct xkb_keymap *keymap;
 	struct xkb_state *xkb_state;
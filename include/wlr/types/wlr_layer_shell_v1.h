@@ -83,6 +83,10 @@ struct wlr_layer_surface_v1 {
 	struct wlr_layer_surface_v1_state server_pending;
 	struct wlr_layer_surface_v1_state current;
 
+	// Saved along with a held surface commit, see wlr_surface_role.hold
+	struct wlr_layer_surface_v1_state held_client_pending;
+	struct wlr_layer_surface_v1_configure *held_acked_configure;
+
 	struct wl_listener surface_destroy;
 
 	struct {
@@ -145,6 +145,10 @@ struct wlr_output {
 	// damage for cursors and fullscreen surface, in output-local coordinates
 	bool frame_pending;
 	float transform_matrix[9];
+	// transform_matrix scaled by the output scale, projects output-local
+	// coordinates in logical pixels. Both are updated when the mode, scale or
+	// transform changes.
+	float scaled_transform_matrix[9];
 
 	struct wlr_output_state pending;
 
@@ -361,6 +365,30 @@ bool wlr_output_test(struct wlr_output *output);
  * On failure, the pending changes are rolled back.
  */
 bool wlr_output_commit(struct wlr_output *output);
+/**
+ * Test whether the pending state of all of the given outputs would be accepted
+ * at once. Backends able to validate a whole configuration (e.g. DRM with
+ * atomic modesetting) check it with a single test-only request, without
+ * allocating render buffers. Other backends only test each output
+ * separately: with legacy DRM, this checks the state of each output and that
+ * enough CRTCs are available, but the kernel may still reject the whole
+ * configuration when it is committed.
+ *
+ * This function doesn't mutate the pending state.
+ */
+bool wlr_output_test_many(struct wlr_output **outputs, size_t outputs_len);
+/**
+ * Commit the pending state of all of the given outputs. Outputs sharing a
+ * backend which supports it are committed at once: with DRM atomic
+ * modesetting, the modes, enabled state and CRTC routing of all outputs are
+ * applied with a single non-blocking commit, and completion is reported via
+ * the usual `present` and `frame` events. Atomicity is only guaranteed for
+ * outputs sharing a backend.
+ *
+ * On failure, outputs whose state the backend did apply are committed as
+ * usual, and the pending changes of the other outputs are rolled back.
+ */
+bool wlr_output_commit_many(struct wlr_output **outputs, size_t outputs_len);
 /**
  * Discard the pending output state.
  */
@@ -17,9 +17,11 @@
 /**
  * Damage tracking requires to keep track of previous frames' damage. To allow
  * damage tracking to work with triple buffering, a history of two frames is
- * required.
+ * required. The history grows up to WLR_OUTPUT_DAMAGE_PREVIOUS_MAX_LEN frames
+ * when the backend returns older buffers.
  */
 #define WLR_OUTPUT_DAMAGE_PREVIOUS_LEN 2
+#define WLR_OUTPUT_DAMAGE_PREVIOUS_MAX_LEN 8
 
 /**
  * Tracks damage for an output.
@@ -35,11 +37,15 @@
 struct wlr_output_damage {
 	struct wlr_output *output;
 	int max_rects; // max number of damaged rectangles
+	// overhead of painting a damaged rectangle, in pixels: rectangles are
+	// merged when the extra area painted costs less
+	int rect_cost;
 
 	pixman_region32_t current; // in output-local coordinates
 
 	// circular queue for previous damage
-	pixman_region32_t previous[WLR_OUTPUT_DAMAGE_PREVIOUS_LEN];
+	pixman_region32_t previous[WLR_OUTPUT_DAMAGE_PREVIOUS_MAX_LEN];
+	size_t previous_len;
 	size_t previous_idx;
 
 	struct {
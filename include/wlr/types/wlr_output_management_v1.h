@@ -130,6 +130,16 @@ void wlr_output_configuration_v1_send_succeeded(
 void wlr_output_configuration_v1_send_failed(
 	struct wlr_output_configuration_v1 *config);
 
+/**
+ * Set the pending state of all outputs of the configuration and test or
+ * commit them together with `wlr_output_test_many` or
+ * `wlr_output_commit_many`. The output positions are left to the compositor.
+ *
+ * When testing, the pending state of the outputs is rolled back afterwards.
+ */
+bool wlr_output_configuration_v1_apply(
+	struct wlr_output_configuration_v1 *config, bool test_only);
+
 /**
  * Create a new configuration head for the given output. This adds the head to
  * the provided output configuration.
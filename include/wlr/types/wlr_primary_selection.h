@@ -32,6 +32,8 @@ struct wlr_primary_selection_source {
 	// source metadata
 	struct wl_array mime_types;
 
+	struct wlr_selection_cache_source *cache; // private state
+
 	struct {
 		struct wl_signal destroy;
 	} events;
@@ -16,6 +16,7 @@
 struct wlr_screencopy_manager_v1 {
 	struct wl_global *global;
 	struct wl_list frames; // wlr_screencopy_frame_v1::link
+	struct wl_list outputs; // private state
 
 	struct wl_listener display_destroy;
 
@@ -32,6 +33,15 @@ struct wlr_screencopy_v1_client {
 	struct wl_list damages;
 };
 
+/**
+ * Capture statistics for an output.
+ */
+struct wlr_screencopy_v1_output_stats {
+	uint64_t readbacks; // pixel readbacks from the renderer
+	uint64_t bytes_read; // bytes read back from the renderer
+	uint64_t frames; // shm frames copied
+};
+
 struct wlr_screencopy_frame_v1 {
 	struct wl_resource *resource;
 	struct wlr_screencopy_v1_client *client;
@@ -62,4 +72,12 @@ struct wlr_screencopy_frame_v1 {
 struct wlr_screencopy_manager_v1 *wlr_screencopy_manager_v1_create(
 	struct wl_display *display);
 
+/**
+ * Get the capture statistics of an output. Returns false if no client ever
+ * captured the output.
+ */
+bool wlr_screencopy_manager_v1_get_output_stats(
+	struct wlr_screencopy_manager_v1 *manager, struct wlr_output *output,
+	struct wlr_screencopy_v1_output_stats *stats);
+
 #endif
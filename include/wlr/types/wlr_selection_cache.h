@@ -0,0 +1,52 @@
+/*
+ * This an unstable interface of wlroots. No guarantees are made regarding the
+ * future consistency of this API.
+ */
+#ifndef WLR_USE_UNSTABLE
+#error "Add -DWLR_USE_UNSTABLE to enable unstable wlroots features"
+#endif
+
+#ifndef WLR_TYPES_WLR_SELECTION_CACHE_H
+#define WLR_TYPES_WLR_SELECTION_CACHE_H
+
+#include <stddef.h>
+#include <wayland-server-core.h>
+#include <wlr/types/wlr_seat.h>
+
+/**
+ * A compositor-side cache for the selection and the primary selection of a
+ * seat.
+ *
+ * The first time a MIME type of the current selection is requested, its data
+ * is read once from the source and stored in memory. Subsequent requests for
+ * that MIME type, from any consumer (wl_data_device, primary selection,
+ * data-control, Xwayland), are served from the cache without waking up the
+ * source client again.
+ *
+ * A selection whose data exceeds `max_size` bytes is not cached, requests are
+ * forwarded to its source as usual.
+ */
+struct wlr_selection_cache {
+	struct wlr_seat *seat;
+	struct wl_event_loop *event_loop;
+	size_t max_size; // bytes per selection
+
+	struct wl_list sources; // private state
+	struct wl_list transfers; // private state
+
+	struct wl_listener set_selection;
+	struct wl_listener set_primary_selection;
+	struct wl_listener seat_destroy;
+
+	struct {
+		struct wl_signal destroy;
+	} events;
+
+	void *data;
+};
+
+struct wlr_selection_cache *wlr_selection_cache_create(struct wlr_seat *seat,
+	size_t max_size);
+void wlr_selection_cache_destroy(struct wlr_selection_cache *cache);
+
+#endif
@@ -65,6 +65,19 @@ struct wlr_surface_role {
 	const char *name;
 	void (*commit)(struct wlr_surface *surface);
 	void (*precommit)(struct wlr_surface *surface);
+	/**
+	 * Called when a commit is held back until its buffer is ready (see
+	 * `wlr_surface.wait_for_buffers`). The role saves its pending state along
+	 * with the held commit, on top of the state saved by previous commits
+	 * squashed into it.
+	 */
+	void (*hold)(struct wlr_surface *surface);
+	/**
+	 * Exchanges the role's pending state with the state saved by `hold`.
+	 * Called right before and right after the held commit is applied, so that
+	 * `commit` sees the role state the held commit was made with.
+	 */
+	void (*swap_held)(struct wlr_surface *surface);
 };
 
 struct wlr_surface {
@@ -112,6 +125,31 @@ struct wlr_surface {
 	 */
 	struct wlr_surface_state current, pending, previous;
 
+	/**
+	 * If set, commits attaching a DMA-BUF which the client is still rendering
+	 * to are held back until the buffer's implicit fence signals, so that the
+	 * compositor doesn't stall on the client's GPU work. The current state is
+	 * left untouched in the meantime. See wlr_surface_set_wait_for_buffers.
+	 */
+	bool wait_for_buffers;
+	/**
+	 * State committed by the client but not yet applied because its buffer
+	 * isn't ready. Only valid if `has_held` is true.
+	 */
+	struct wlr_surface_state held;
+	bool has_held;
+	struct wl_event_source *held_source;
+
+	/**
+	 * If non-zero, frame callbacks of the surface and its subsurfaces are
+	 * completed at most once per `frame_throttle_interval` milliseconds. A
+	 * subsurface uses the interval of its closest throttled ancestor, so it
+	 * isn't throttled anymore once it leaves the tree. Set by
+	 * wlr_frame_throttle for surfaces which aren't visible.
+	 */
+	uint32_t frame_throttle_interval;
+	int64_t last_frame_done; // ms, private state
+
 	const struct wlr_surface_role *role; // the lifetime-bound role or NULL
 	void *role_data; // role-specific data
 
@@ -119,12 +157,21 @@ struct wlr_surface {
 		struct wl_signal commit;
 		struct wl_signal new_subsurface;
 		struct wl_signal destroy;
+		/**
+		 * Emitted on the root surface when an evicted texture of the surface
+		 * tree can't be restored, with the surface which lost its texture.
+		 * The surface has no buffer until the client commits a new one: the
+		 * compositor must make the client draw, e.g. by configuring it.
+		 */
+		struct wl_signal restore_failed;
 	} events;
 
 	struct wl_list subsurfaces; // wlr_subsurface::parent_link
 
 	// wlr_subsurface::parent_pending_link
 	struct wl_list subsurface_pending_list;
+	// wlr_subsurface::parent_held_link, the order of the held commit
+	struct wl_list subsurface_held_list;
 
 	struct wl_listener renderer_destroy;
 
@@ -140,7 +187,7 @@ struct wlr_subsurface {
 	struct wlr_surface *surface;
 	struct wlr_surface *parent;
 
-	struct wlr_subsurface_state current, pending;
+	struct wlr_subsurface_state current, pending, held;
 
 	struct wlr_surface_state cached;
 	bool has_cache;
@@ -151,6 +198,7 @@ struct wlr_subsurface {
 
 	struct wl_list parent_link;
 	struct wl_list parent_pending_link;
+	struct wl_list parent_held_link;
 
 	struct wl_listener surface_destroy;
 	struct wl_listener parent_destroy;
@@ -185,6 +233,16 @@ bool wlr_surface_set_role(struct wlr_surface *surface,
 		const struct wlr_surface_role *role, void *role_data,
 		struct wl_resource *error_resource, uint32_t error_code);
 
+/**
+ * Enable or disable waiting for client rendering to complete before applying
+ * commits which attach a DMA-BUF. When disabled while a commit is held back,
+ * the held commit is applied immediately. The double-buffered state of the
+ * surface's role and the order of its subsurfaces are held back along with the
+ * commit, see `wlr_surface_role.hold`.
+ */
+void wlr_surface_set_wait_for_buffers(struct wlr_surface *surface,
+		bool enabled);
+
 /**
  * Whether or not this surface currently has an attached buffer. A surface has
  * an attached buffer when it commits with a non-null buffer in its pending
@@ -196,7 +254,8 @@ bool wlr_surface_has_buffer(struct wlr_surface *surface);
 /**
  * Get the texture of the buffer currently attached to this surface. Returns
  * NULL if no buffer is currently attached or if something went wrong with
- * uploading the buffer.
+ * uploading the buffer. An evicted texture is restored, `restore_failed` is
+ * emitted if that fails.
  */
 struct wlr_texture *wlr_surface_get_texture(struct wlr_surface *surface);
 
@@ -234,6 +293,11 @@ void wlr_surface_send_enter(struct wlr_surface *surface,
 void wlr_surface_send_leave(struct wlr_surface *surface,
 		struct wlr_output *output);
 
+/**
+ * Complete the surface's frame callbacks, unless the surface or one of its
+ * ancestors is throttled and the callbacks have been completed less than
+ * `frame_throttle_interval` milliseconds ago.
+ */
 void wlr_surface_send_frame_done(struct wlr_surface *surface,
 		const struct timespec *when);
 
@@ -0,0 +1,81 @@
+/*
+ * This an unstable interface of wlroots. No guarantees are made regarding the
+ * future consistency of this API.
+ */
+#ifndef WLR_USE_UNSTABLE
+#error "Add -DWLR_USE_UNSTABLE to enable unstable wlroots features"
+#endif
+
+#ifndef WLR_TYPES_WLR_TEXTURE_RESIDENCY_H
+#define WLR_TYPES_WLR_TEXTURE_RESIDENCY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <wayland-server-core.h>
+#include <wlr/types/wlr_surface.h>
+
+/**
+ * Evicts the textures of hidden surfaces when memory runs low.
+ *
+ * The compositor marks surfaces as hidden or visible (e.g. when they are
+ * unmapped, on another workspace or fully occluded). Textures of hidden
+ * surfaces, including their subsurfaces, are evicted oldest hidden first when
+ * the textures of the tracked surfaces exceed `budget` bytes, or all at once
+ * when the memory pressure reported by the kernel exceeds the PSI threshold.
+ *
+ * Evicted textures are re-created from the buffers still attached to the
+ * surfaces when they are drawn again. The content of buffers which have been
+ * released to the client is lost instead, which is always the case for wl_shm
+ * buffers. If the content is lost, `restore_failed` is emitted when the
+ * surface is made visible, or drawn while hidden. The surface's pending frame
+ * callbacks are completed, bypassing frame throttling, but an idle client
+ * won't draw again on its own: the compositor must make it draw a new frame,
+ * e.g. by sending a configure event, and the surface is drawn without that
+ * content in the meantime.
+ */
+struct wlr_texture_residency_manager {
+	size_t budget; // bytes, 0 if unlimited
+	float psi_threshold; // percent, 0 if PSI isn't monitored
+
+	struct wl_list surfaces; // private state
+
+	struct {
+		struct wl_signal restore_failed; // wlr_surface
+		struct wl_signal destroy;
+	} events;
+
+	// private state
+
+	struct wl_event_loop *event_loop;
+	struct wl_event_source *timer;
+	int psi_fd;
+
+	struct wl_listener display_destroy;
+};
+
+struct wlr_texture_residency_manager *wlr_texture_residency_manager_create(
+	struct wl_display *display, size_t budget);
+void wlr_texture_residency_manager_destroy(
+	struct wlr_texture_residency_manager *manager);
+/**
+ * Evict textures when the "some" memory pressure averaged over 10 seconds,
+ * read from /proc/pressure/memory, exceeds `threshold` percent. Returns false
+ * if the kernel doesn't support PSI.
+ */
+bool wlr_texture_residency_manager_monitor_psi(
+	struct wlr_texture_residency_manager *manager, float threshold);
+/**
+ * Mark a surface and its subsurfaces as visible or hidden. Textures of hidden
+ * surfaces can be evicted. Making a surface visible restores its textures.
+ */
+void wlr_texture_residency_manager_set_visible(
+	struct wlr_texture_residency_manager *manager,
+	struct wlr_surface *surface, bool visible);
+/**
+ * Evict at least `bytes` bytes of textures of hidden surfaces, if possible.
+ * Pass SIZE_MAX to evict all of them. Returns the number of bytes evicted.
+ */
+size_t wlr_texture_residency_manager_evict(
+	struct wlr_texture_residency_manager *manager, size_t bytes);
+
+#endif
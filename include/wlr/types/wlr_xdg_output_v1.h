@@ -30,6 +30,7 @@ struct wlr_xdg_output_manager_v1 {
 	struct wlr_output_layout *layout;
 
 	struct wl_list outputs;
+	struct wlr_coalescer *coalescer; // private state
 
 	struct {
 		struct wl_signal destroy;
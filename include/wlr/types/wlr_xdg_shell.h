@@ -126,6 +126,12 @@ struct wlr_xdg_toplevel {
 	struct wlr_xdg_toplevel_state server_pending;
 	struct wlr_xdg_toplevel_state current;
 
+	// Saved along with a held surface commit, see wlr_surface_role.hold
+	struct {
+		uint32_t max_width, max_height;
+		uint32_t min_width, min_height;
+	} held;
+
 	char *title;
 	char *app_id;
 
@@ -184,6 +190,18 @@ struct wlr_xdg_surface {
 	struct wlr_box next_geometry;
 	struct wlr_box geometry;
 
+	// A configure acked while a commit was held back, applied on commit
+	bool has_pending_ack;
+	uint32_t pending_ack_serial;
+
+	// Saved along with a held surface commit, see wlr_surface_role.hold
+	struct {
+		bool has_next_geometry;
+		struct wlr_box next_geometry;
+		bool has_pending_ack;
+		uint32_t pending_ack_serial;
+	} held;
+
 	struct wl_listener surface_destroy;
 	struct wl_listener surface_commit;
 
@@ -19,6 +19,7 @@
 
 #include <stdbool.h>
 #include <stdarg.h>
+#include <stddef.h>
 #include <string.h>
 #include <errno.h>
 
@@ -42,6 +43,27 @@ void wlr_log_init(enum wlr_log_importance verbosity, wlr_log_func_t callback);
 // Returns the log verbosity provided to wlr_log_init
 enum wlr_log_importance wlr_log_get_verbosity(void);
 
+// Record all messages less than or equal to `verbosity` into an in-memory ring
+// buffer of `size` bytes, independently of the verbosity provided to
+// wlr_log_init. Recording a message only stores its format string and a copy
+// of its arguments, messages are formatted when the ring buffer is dumped.
+// Passing a size of zero disables the ring buffer. Returns false on allocation
+// failure.
+bool wlr_log_ring_init(size_t size, enum wlr_log_importance verbosity);
+
+// Formats the messages recorded in the ring buffer, oldest first, and writes
+// them to `fd`. Messages are formatted with vsnprintf, which isn't
+// async-signal-safe: this must not be called from a signal handler, except as a
+// last resort when the process is about to die anyway.
+void wlr_log_ring_dump(int fd);
+
+// Dumps the ring buffer to `fd` when the process receives a fatal signal
+// (SIGSEGV, SIGBUS, SIGILL, SIGFPE or SIGABRT), then hands the signal over to
+// the previously installed handler. The dump is best-effort: it isn't
+// async-signal-safe, so it may deadlock or be incomplete if the crash happened
+// inside the C library. Passing -1 uninstalls the handlers.
+void wlr_log_ring_set_crash_fd(int fd);
+
 #ifdef __GNUC__
 #define _WLR_ATTRIB_PRINTF(start, end) __attribute__((format(printf, start, end)))
 #else
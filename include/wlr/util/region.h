@@ -39,6 +39,15 @@ void wlr_region_scale_xy(pixman_region32_t *dst, pixman_region32_t *src,
 void wlr_region_transform(pixman_region32_t *dst, pixman_region32_t *src,
 	enum wl_output_transform transform, int width, int height);
 
+/**
+ * Applies a transform to a region inside a box of size `width` x `height`,
+ * then scales it. This is faster than `wlr_region_transform` followed by
+ * `wlr_region_scale`.
+ */
+void wlr_region_transform_scale(pixman_region32_t *dst,
+	pixman_region32_t *src, enum wl_output_transform transform,
+	int width, int height, float scale);
+
 /**
  * Expands the region of `distance`. If `distance` is negative, it shrinks the
  * region.
@@ -53,6 +62,24 @@ void wlr_region_expand(pixman_region32_t *dst, pixman_region32_t *src,
 void wlr_region_rotated_bounds(pixman_region32_t *dst, pixman_region32_t *src,
 	float rotation, int ox, int oy);
 
+/**
+ * Regions with more rectangles than this are not merged rectangle by
+ * rectangle by `wlr_region_merge_rects`.
+ */
+#define WLR_REGION_MERGE_RECTS_MAX 256
+
+/**
+ * Merges the rectangles of a region when painting their bounding box is
+ * cheaper than painting them separately. `rect_cost` is the overhead of a
+ * rectangle, in pixels. If more than `max_rects` rectangles remain, the
+ * region is replaced with its extents.
+ *
+ * The resulting region contains the original one, and isn't more expensive to
+ * paint once pixman has split it into bands.
+ */
+void wlr_region_merge_rects(pixman_region32_t *dst, pixman_region32_t *src,
+	int rect_cost, int max_rects);
+
 bool wlr_region_confine(pixman_region32_t *region, double x1, double y1, double x2,
 	double y2, double *x2_out, double *y2_out);
 
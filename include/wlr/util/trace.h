@@ -0,0 +1,42 @@
+/*
+ * This an unstable interface of wlroots. No guarantees are made regarding the
+ * future consistency of this API.
+ */
+#ifndef WLR_USE_UNSTABLE
+#error "Add -DWLR_USE_UNSTABLE to enable unstable wlroots features"
+#endif
+
+#ifndef WLR_UTIL_TRACE_H
+#define WLR_UTIL_TRACE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * Start recording frame timing events: output commits, surface commits,
+ * client buffer imports, renderer begin/end and page-flips. Each thread keeps
+ * its last `capacity` events in a ring buffer.
+ *
+ * Tracing is disabled by default, in which case each tracepoint costs a
+ * single branch.
+ */
+bool wlr_trace_start(size_t capacity);
+/**
+ * Stop recording events and discard them. Other threads may still be
+ * recording events. The ring buffers are kept to be re-used by the next
+ * wlr_trace_start call.
+ */
+void wlr_trace_stop(void);
+/**
+ * Write all recorded events to `fd` as a Chrome trace event JSON object, which
+ * can be loaded by chrome://tracing or Perfetto.
+ */
+bool wlr_trace_dump(int fd);
+/**
+ * Write the events recorded since the previous call to `fd`, as elements of an
+ * unterminated Chrome trace event JSON array. Calling this periodically
+ * streams events, e.g. to a Unix socket.
+ */
+bool wlr_trace_flush(int fd);
+
+#endif
@@ -41,6 +41,23 @@ static const struct wlr_gles2_pixel_format formats[] = {
 	},
 };
 
+/*
+ * Formats GL can't upload directly, converted on the CPU to a format it can.
+ */
+static const struct {
+	enum wl_shm_format wl_format;
+	enum wl_shm_format upload_format;
+} converted_formats[] = {
+	{ WL_SHM_FORMAT_RGBA8888, WL_SHM_FORMAT_ABGR8888 },
+	{ WL_SHM_FORMAT_RGBX8888, WL_SHM_FORMAT_XBGR8888 },
+	{ WL_SHM_FORMAT_BGRA8888, WL_SHM_FORMAT_ARGB8888 },
+	{ WL_SHM_FORMAT_BGRX8888, WL_SHM_FORMAT_XRGB8888 },
+};
+
+#define FORMATS_LEN (sizeof(formats) / sizeof(formats[0]))
+#define CONVERTED_FORMATS_LEN \
+	(sizeof(converted_formats) / sizeof(converted_formats[0]))
+
 // TODO: more pixel formats
 
 const struct wlr_gles2_pixel_format *get_gles2_format_from_wl(
@@ -65,11 +82,25 @@ const struct wlr_gles2_pixel_format *get_gles2_format_from_gl(
 	return NULL;
 }
 
+const struct wlr_gles2_pixel_format *get_gles2_upload_format(
+		enum wl_shm_format fmt) {
+	for (size_t i = 0; i < CONVERTED_FORMATS_LEN; ++i) {
+		if (converted_formats[i].wl_format == fmt) {
+			fmt = converted_formats[i].upload_format;
+			break;
+		}
+	}
+	return get_gles2_format_from_wl(fmt);
+}
+
 const enum wl_shm_format *get_gles2_wl_formats(size_t *len) {
-	static enum wl_shm_format wl_formats[sizeof(formats) / sizeof(formats[0])];
-	*len = sizeof(formats) / sizeof(formats[0]);
-	for (size_t i = 0; i < sizeof(formats) / sizeof(formats[0]); i++) {
+	static enum wl_shm_format wl_formats[FORMATS_LEN + CONVERTED_FORMATS_LEN];
+	*len = FORMATS_LEN + CONVERTED_FORMATS_LEN;
+	for (size_t i = 0; i < FORMATS_LEN; i++) {
 		wl_formats[i] = formats[i].wl_format;
 	}
+	for (size_t i = 0; i < CONVERTED_FORMATS_LEN; i++) {
+		wl_formats[FORMATS_LEN + i] = converted_formats[i].wl_format;
+	}
 	return wl_formats;
 }
@@ -13,6 +13,8 @@
 #include <wlr/types/wlr_linux_dmabuf_v1.h>
 #include <wlr/util/log.h>
 #include "render/gles2.h"
+#include "util/pixel_convert.h"
+#include "util/trace.h"
 
 static const GLfloat verts[] = {
 	1, 0, // top right
@@ -43,6 +45,7 @@ static void gles2_begin(struct wlr_renderer *wlr_renderer, uint32_t width,
 	struct wlr_gles2_renderer *renderer =
 		gles2_get_renderer_in_context(wlr_renderer);
 
+	TRACE_BEGIN("render", NULL);
 	PUSH_GLES2_DEBUG;
 
 	glViewport(0, 0, width, height);
@@ -61,7 +64,7 @@ static void gles2_begin(struct wlr_renderer *wlr_renderer, uint32_t width,
 
 static void gles2_end(struct wlr_renderer *wlr_renderer) {
 	gles2_get_renderer_in_context(wlr_renderer);
-	// no-op
+	TRACE_END("render", NULL);
 }
 
 static void gles2_clear(struct wlr_renderer *wlr_renderer,
@@ -245,7 +248,7 @@ static const enum wl_shm_format *gles2_renderer_formats(
 
 static bool gles2_format_supported(struct wlr_renderer *wlr_renderer,
 		enum wl_shm_format wl_fmt) {
-	return get_gles2_format_from_wl(wl_fmt) != NULL;
+	return get_gles2_upload_format(wl_fmt) != NULL;
 }
 
 static bool gles2_resource_is_wl_drm_buffer(struct wlr_renderer *wlr_renderer,
@@ -317,17 +320,20 @@ static bool gles2_read_pixels(struct wlr_renderer *wlr_renderer,
 		gles2_get_renderer_in_context(wlr_renderer);
 
 	const struct wlr_gles2_pixel_format *fmt = get_gles2_format_from_wl(wl_fmt);
+	if (fmt != NULL && fmt->gl_format == GL_BGRA_EXT &&
+			!renderer->exts.read_format_bgra_ext) {
+		fmt = NULL;
+	}
+	if (fmt == NULL && pixel_convert_supported(wl_fmt,
+			WL_SHM_FORMAT_ABGR8888)) {
+		// GL_RGBA is always readable, convert from it on the CPU
+		fmt = get_gles2_format_from_wl(WL_SHM_FORMAT_ABGR8888);
+	}
 	if (fmt == NULL) {
 		wlr_log(WLR_ERROR, "Cannot read pixels: unsupported pixel format");
 		return false;
 	}
 
-	if (fmt->gl_format == GL_BGRA_EXT && !renderer->exts.read_format_bgra_ext) {
-		wlr_log(WLR_ERROR,
-			"Cannot read pixels: missing GL_EXT_read_format_bgra extension");
-		return false;
-	}
-
 	PUSH_GLES2_DEBUG;
 
 	// Make sure any pending drawing is finished before we try to read it
@@ -337,19 +343,30 @@ static bool gles2_read_pixels(struct wlr_renderer *wlr_renderer,
 
 	unsigned char *p = (unsigned char *)data + dst_y * stride;
 	uint32_t pack_stride = width * fmt->bpp / 8;
-	if (pack_stride == stride && dst_x == 0 && flags != NULL) {
-		// Under these particular conditions, we can read the pixels with only
-		// one glReadPixels call
+	bool ok;
+	if (fmt->wl_format == wl_fmt && pack_stride == stride && dst_x == 0 &&
+			flags != NULL) {
+		// Under these particular conditions, we can read the pixels directly
+		// into the destination
 		glReadPixels(src_x, renderer->viewport_height - height - src_y,
 			width, height, fmt->gl_format, fmt->gl_type, p);
 		*flags = WLR_RENDERER_READ_PIXELS_Y_INVERT;
+		ok = glGetError() == GL_NO_ERROR;
 	} else {
-		// Unfortunately GLES2 doesn't support GL_PACK_*, so we have to read
-		// the lines out row by row
-		for (size_t i = 0; i < height; ++i) {
-			glReadPixels(src_x, renderer->viewport_height - src_y - i - 1, width, 1, fmt->gl_format,
-				fmt->gl_type, p + i * stride + dst_x * fmt->bpp / 8);
+		// GLES2 doesn't support GL_PACK_*, so read the pixels into a packed
+		// buffer with a single call, then convert, flip and repack them
+		unsigned char *packed = malloc((size_t)pack_stride * height);
+		if (packed == NULL) {
+			wlr_log_errno(WLR_ERROR, "Allocation failed");
+			POP_GLES2_DEBUG;
+			return false;
 		}
+		glReadPixels(src_x, renderer->viewport_height - height - src_y,
+			width, height, fmt->gl_format, fmt->gl_type, packed);
+		ok = glGetError() == GL_NO_ERROR &&
+			convert_pixels(wl_fmt, p + dst_x * fmt->bpp / 8, stride,
+				fmt->wl_format, packed, pack_stride, width, height, true);
+		free(packed);
 		if (flags != NULL) {
 			*flags = 0;
 		}
@@ -357,7 +374,7 @@ static bool gles2_read_pixels(struct wlr_renderer *wlr_renderer,
 
 	POP_GLES2_DEBUG;
 
-	return glGetError() == GL_NO_ERROR;
+	return ok;
 }
 
 static bool gles2_blit_dmabuf(struct wlr_renderer *wlr_renderer,
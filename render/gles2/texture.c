@@ -12,6 +12,7 @@
 #include <wlr/types/wlr_matrix.h>
 #include <wlr/util/log.h>
 #include "render/gles2.h"
+#include "util/pixel_convert.h"
 #include "util/signal.h"
 
 static const struct wlr_texture_impl texture_impl;
@@ -38,6 +39,31 @@ static bool gles2_texture_is_opaque(struct wlr_texture *wlr_texture) {
 	return !texture->has_alpha;
 }
 
+/**
+ * Convert a rectangle of pixels to the format used for uploading it, packing
+ * its rows. Returns a newly allocated buffer.
+ */
+static void *convert_upload_pixels(const struct wlr_gles2_pixel_format *fmt,
+		enum wl_shm_format wl_fmt, uint32_t stride, uint32_t width,
+		uint32_t height, uint32_t src_x, uint32_t src_y, const void *data) {
+	uint32_t pack_stride = width * fmt->bpp / 8;
+	void *converted = malloc((size_t)pack_stride * height);
+	if (converted == NULL) {
+		wlr_log_errno(WLR_ERROR, "Allocation failed");
+		return NULL;
+	}
+
+	const unsigned char *src = (const unsigned char *)data +
+		(size_t)src_y * stride + src_x * fmt->bpp / 8;
+	if (!convert_pixels(fmt->wl_format, converted, pack_stride,
+			wl_fmt, src, stride, width, height, false)) {
+		wlr_log(WLR_ERROR, "Failed to convert pixels");
+		free(converted);
+		return NULL;
+	}
+	return converted;
+}
+
 static bool gles2_texture_write_pixels(struct wlr_texture *wlr_texture,
 		uint32_t stride, uint32_t width, uint32_t height,
 		uint32_t src_x, uint32_t src_y, uint32_t dst_x, uint32_t dst_y,
@@ -52,9 +78,22 @@ static bool gles2_texture_write_pixels(struct wlr_texture *wlr_texture,
 	}
 
 	const struct wlr_gles2_pixel_format *fmt =
-		get_gles2_format_from_wl(texture->wl_format);
+		get_gles2_upload_format(texture->wl_format);
 	assert(fmt);
 
+	void *converted = NULL;
+	if (fmt->wl_format != texture->wl_format) {
+		converted = convert_upload_pixels(fmt, texture->wl_format, stride,
+			width, height, src_x, src_y, data);
+		if (converted == NULL) {
+			wlr_egl_unset_current(texture->egl);
+			return false;
+		}
+		data = converted;
+		stride = width * fmt->bpp / 8;
+		src_x = src_y = 0;
+	}
+
 	// TODO: what if the unpack subimage extension isn't supported?
 	PUSH_GLES2_DEBUG;
 
@@ -66,6 +105,7 @@ static bool gles2_texture_write_pixels(struct wlr_texture *wlr_texture,
 
 	glTexSubImage2D(GL_TEXTURE_2D, 0, dst_x, dst_y, width, height,
 		fmt->gl_format, fmt->gl_type, data);
+	free(converted);
 
 	glPixelStorei(GL_UNPACK_ROW_LENGTH_EXT, 0);
 	glPixelStorei(GL_UNPACK_SKIP_PIXELS_EXT, 0);
@@ -139,23 +179,35 @@ struct wlr_texture *wlr_gles2_texture_from_pixels(struct wlr_egl *egl,
 		uint32_t height, const void *data) {
 	wlr_egl_make_current(egl, EGL_NO_SURFACE, NULL);
 
-	const struct wlr_gles2_pixel_format *fmt = get_gles2_format_from_wl(wl_fmt);
+	const struct wlr_gles2_pixel_format *fmt = get_gles2_upload_format(wl_fmt);
 	if (fmt == NULL) {
 		wlr_log(WLR_ERROR, "Unsupported pixel format %"PRIu32, wl_fmt);
 		return NULL;
 	}
 
+	void *converted = NULL;
+	if (fmt->wl_format != wl_fmt) {
+		converted = convert_upload_pixels(fmt, wl_fmt, stride,
+			width, height, 0, 0, data);
+		if (converted == NULL) {
+			return NULL;
+		}
+		data = converted;
+		stride = width * fmt->bpp / 8;
+	}
+
 	struct wlr_gles2_texture *texture =
 		calloc(1, sizeof(struct wlr_gles2_texture));
 	if (texture == NULL) {
 		wlr_log(WLR_ERROR, "Allocation failed");
+		free(converted);
 		return NULL;
 	}
 	wlr_texture_init(&texture->wlr_texture, &texture_impl, width, height);
 	texture->egl = egl;
 	texture->target = GL_TEXTURE_2D;
 	texture->has_alpha = fmt->has_alpha;
-	texture->wl_format = fmt->wl_format;
+	texture->wl_format = wl_fmt;
 
 	PUSH_GLES2_DEBUG;
 
@@ -171,6 +223,7 @@ struct wlr_texture *wlr_gles2_texture_from_pixels(struct wlr_egl *egl,
 
 	POP_GLES2_DEBUG;
 
+	free(converted);
 	wlr_egl_unset_current(egl);
 	return &texture->wlr_texture;
 }
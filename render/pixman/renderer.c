@@ -0,0 +1,409 @@
+#include <assert.h>
+#include <math.h>
+#include <pixman.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <wayland-server-protocol.h>
+#include <wlr/render/interface.h>
+#include <wlr/render/wlr_renderer.h>
+#include <wlr/types/wlr_matrix.h>
+#include <wlr/util/log.h>
+#include "render/pixman.h"
+#include "util/trace.h"
+
+static const struct wlr_renderer_impl renderer_impl;
+
+bool wlr_renderer_is_pixman(struct wlr_renderer *wlr_renderer) {
+	return wlr_renderer->impl == &renderer_impl;
+}
+
+static struct wlr_pixman_renderer *pixman_get_renderer(
+		struct wlr_renderer *wlr_renderer) {
+	assert(wlr_renderer_is_pixman(wlr_renderer));
+	return (struct wlr_pixman_renderer *)wlr_renderer;
+}
+
+static struct wlr_pixman_renderer *pixman_get_renderer_in_context(
+		struct wlr_renderer *wlr_renderer) {
+	struct wlr_pixman_renderer *renderer = pixman_get_renderer(wlr_renderer);
+	assert(renderer->image != NULL);
+	return renderer;
+}
+
+static void color_to_pixman(const float color[static 4], pixman_color_t *out) {
+	out->red = color[0] * 0xFFFF;
+	out->green = color[1] * 0xFFFF;
+	out->blue = color[2] * 0xFFFF;
+	out->alpha = color[3] * 0xFFFF;
+}
+
+static bool is_close(double a, double b) {
+	return fabs(a - b) < 1e-4;
+}
+
+/**
+ * Get the transform from the unit square to the pixels of the image we're
+ * rendering to. The matrices passed to the renderer map the unit square to
+ * normalized device coordinates, with the Y axis pointing up.
+ */
+static void get_pixel_transform(struct wlr_pixman_renderer *renderer,
+		const float matrix[static 9], struct pixman_f_transform *out) {
+	float width = renderer->width, height = renderer->height;
+	const float viewport[9] = {
+		width / 2, 0, width / 2,
+		0, -height / 2, height / 2,
+		0, 0, 1,
+	};
+
+	float mat[9];
+	wlr_matrix_multiply(mat, viewport, matrix);
+	for (size_t i = 0; i < 3; ++i) {
+		for (size_t j = 0; j < 3; ++j) {
+			out->m[i][j] = mat[i * 3 + j];
+		}
+	}
+}
+
+/**
+ * Whether the unit square is mapped to a rectangle whose edges are parallel
+ * to the axes.
+ */
+static bool is_axis_aligned(const struct pixman_f_transform *t) {
+	return (is_close(t->m[0][1], 0) && is_close(t->m[1][0], 0)) ||
+		(is_close(t->m[0][0], 0) && is_close(t->m[1][1], 0));
+}
+
+static bool is_integer_translation(const struct pixman_f_transform *t) {
+	return is_close(t->m[0][0], 1) && is_close(t->m[0][1], 0) &&
+		is_close(t->m[1][0], 0) && is_close(t->m[1][1], 1) &&
+		is_close(t->m[0][2], round(t->m[0][2])) &&
+		is_close(t->m[1][2], round(t->m[1][2]));
+}
+
+/**
+ * Get the pixels covered by the unit square, clipped to the image we're
+ * rendering to. Returns false if there are none.
+ */
+static bool get_pixel_bounds(struct wlr_pixman_renderer *renderer,
+		const struct pixman_f_transform *t, struct wlr_box *box) {
+	double x1 = INFINITY, y1 = INFINITY, x2 = -INFINITY, y2 = -INFINITY;
+	for (int i = 0; i < 4; ++i) {
+		double v[3] = { i & 1, i >> 1, 1 };
+		pixman_f_transform_point(t, v);
+		x1 = fmin(x1, v[0]);
+		y1 = fmin(y1, v[1]);
+		x2 = fmax(x2, v[0]);
+		y2 = fmax(y2, v[1]);
+	}
+
+	// Don't let rounding errors cover an extra row or column
+	x1 = fmax(floor(x1 + 1e-4), 0);
+	y1 = fmax(floor(y1 + 1e-4), 0);
+	x2 = fmin(ceil(x2 - 1e-4), renderer->width);
+	y2 = fmin(ceil(y2 - 1e-4), renderer->height);
+	if (x2 <= x1 || y2 <= y1) {
+		return false;
+	}
+
+	box->x = x1;
+	box->y = y1;
+	box->width = x2 - x1;
+	box->height = y2 - y1;
+	return true;
+}
+
+static void pixman_begin(struct wlr_renderer *wlr_renderer, uint32_t width,
+		uint32_t height) {
+	struct wlr_pixman_renderer *renderer =
+		pixman_get_renderer_in_context(wlr_renderer);
+
+	TRACE_BEGIN("render", NULL);
+	renderer->width = width;
+	renderer->height = height;
+	pixman_image_set_clip_region32(renderer->image, NULL);
+}
+
+static void pixman_end(struct wlr_renderer *wlr_renderer) {
+	struct wlr_pixman_renderer *renderer =
+		pixman_get_renderer_in_context(wlr_renderer);
+	pixman_image_set_clip_region32(renderer->image, NULL);
+	TRACE_END("render", NULL);
+}
+
+static void pixman_clear(struct wlr_renderer *wlr_renderer,
+		const float color[static 4]) {
+	struct wlr_pixman_renderer *renderer =
+		pixman_get_renderer_in_context(wlr_renderer);
+
+	pixman_color_t pcolor;
+	color_to_pixman(color, &pcolor);
+	pixman_image_t *fill = pixman_image_create_solid_fill(&pcolor);
+	pixman_image_composite32(PIXMAN_OP_SRC, fill, NULL, renderer->image,
+		0, 0, 0, 0, 0, 0, renderer->width, renderer->height);
+	pixman_image_unref(fill);
+}
+
+static void pixman_scissor(struct wlr_renderer *wlr_renderer,
+		struct wlr_box *box) {
+	struct wlr_pixman_renderer *renderer =
+		pixman_get_renderer_in_context(wlr_renderer);
+
+	if (box != NULL) {
+		pixman_region32_t region;
+		pixman_region32_init_rect(&region, box->x, box->y,
+			box->width, box->height);
+		pixman_image_set_clip_region32(renderer->image, &region);
+		pixman_region32_fini(&region);
+	} else {
+		pixman_image_set_clip_region32(renderer->image, NULL);
+	}
+}
+
+static bool pixman_render_subtexture_with_matrix(
+		struct wlr_renderer *wlr_renderer, struct wlr_texture *wlr_texture,
+		const struct wlr_fbox *box, const float matrix[static 9],
+		float alpha) {
+	struct wlr_pixman_renderer *renderer =
+		pixman_get_renderer_in_context(wlr_renderer);
+	struct wlr_pixman_texture *texture = pixman_get_texture(wlr_texture);
+
+	struct pixman_f_transform pixel_transform;
+	get_pixel_transform(renderer, matrix, &pixel_transform);
+
+	struct wlr_box dst_box;
+	if (!get_pixel_bounds(renderer, &pixel_transform, &dst_box)) {
+		return true;
+	}
+
+	// pixman wants the transform from destination to source pixels
+	struct pixman_f_transform inv;
+	if (!pixman_f_transform_invert(&inv, &pixel_transform)) {
+		return true;
+	}
+	struct pixman_f_transform box_transform = {{
+		{ box->width, 0, box->x },
+		{ 0, box->height, box->y },
+		{ 0, 0, 1 },
+	}};
+	struct pixman_f_transform src_transform;
+	pixman_f_transform_multiply(&src_transform, &box_transform, &inv);
+
+	int src_x = dst_box.x, src_y = dst_box.y;
+	bool translation = is_integer_translation(&src_transform);
+	if (translation) {
+		// Translations by whole pixels hit pixman's fast paths
+		src_x += round(src_transform.m[0][2]);
+		src_y += round(src_transform.m[1][2]);
+	} else {
+		struct pixman_transform transform;
+		pixman_transform_from_pixman_f_transform(&transform, &src_transform);
+		pixman_image_set_transform(texture->image, &transform);
+		pixman_image_set_filter(texture->image, PIXMAN_FILTER_BILINEAR,
+			NULL, 0);
+	}
+
+	pixman_image_t *mask = NULL;
+	if (alpha < 1.0) {
+		pixman_color_t mask_color = { .alpha = alpha * 0xFFFF };
+		mask = pixman_image_create_solid_fill(&mask_color);
+	}
+
+	pixman_image_composite32(PIXMAN_OP_OVER, texture->image, mask,
+		renderer->image, src_x, src_y, 0, 0, dst_box.x, dst_box.y,
+		dst_box.width, dst_box.height);
+
+	if (mask != NULL) {
+		pixman_image_unref(mask);
+	}
+	if (!translation) {
+		pixman_image_set_transform(texture->image, NULL);
+	}
+	return true;
+}
+
+/**
+ * Create an A8 mask covering the unit square transformed by `t`, clipped to
+ * `box`. `inside` decides whether a point of the unit square is covered.
+ */
+static pixman_image_t *create_mask(const struct pixman_f_transform *t,
+		const struct wlr_box *box, bool (*inside)(double x, double y)) {
+	struct pixman_f_transform inv;
+	if (!pixman_f_transform_invert(&inv, t)) {
+		return NULL;
+	}
+
+	pixman_image_t *mask = pixman_image_create_bits(PIXMAN_a8,
+		box->width, box->height, NULL, 0);
+	if (mask == NULL) {
+		return NULL;
+	}
+
+	uint8_t *data = (uint8_t *)pixman_image_get_data(mask);
+	int stride = pixman_image_get_stride(mask);
+	for (int y = 0; y < box->height; ++y) {
+		for (int x = 0; x < box->width; ++x) {
+			// Sample at the pixel center
+			double v[3] = { box->x + x + 0.5, box->y + y + 0.5, 1 };
+			pixman_f_transform_point(&inv, v);
+			if (inside(v[0], v[1])) {
+				data[y * stride + x] = 0xFF;
+			}
+		}
+	}
+
+	return mask;
+}
+
+static bool inside_quad(double x, double y) {
+	return x >= 0 && x <= 1 && y >= 0 && y <= 1;
+}
+
+static bool inside_ellipse(double x, double y) {
+	double dx = x - 0.5, dy = y - 0.5;
+	return dx * dx + dy * dy <= 0.25;
+}
+
+static void render_fill(struct wlr_pixman_renderer *renderer,
+		const float color[static 4], const float matrix[static 9],
+		bool (*inside)(double x, double y)) {
+	struct pixman_f_transform pixel_transform;
+	get_pixel_transform(renderer, matrix, &pixel_transform);
+
+	struct wlr_box box;
+	if (!get_pixel_bounds(renderer, &pixel_transform, &box)) {
+		return;
+	}
+
+	pixman_image_t *mask = NULL;
+	if (inside != inside_quad || !is_axis_aligned(&pixel_transform)) {
+		mask = create_mask(&pixel_transform, &box, inside);
+		if (mask == NULL) {
+			return;
+		}
+	}
+
+	pixman_color_t pcolor;
+	color_to_pixman(color, &pcolor);
+	pixman_image_t *fill = pixman_image_create_solid_fill(&pcolor);
+	pixman_image_composite32(PIXMAN_OP_OVER, fill, mask, renderer->image,
+		0, 0, 0, 0, box.x, box.y, box.width, box.height);
+	pixman_image_unref(fill);
+
+	if (mask != NULL) {
+		pixman_image_unref(mask);
+	}
+}
+
+static void pixman_render_quad_with_matrix(struct wlr_renderer *wlr_renderer,
+		const float color[static 4], const float matrix[static 9]) {
+	struct wlr_pixman_renderer *renderer =
+		pixman_get_renderer_in_context(wlr_renderer);
+	render_fill(renderer, color, matrix, inside_quad);
+}
+
+static void pixman_render_ellipse_with_matrix(
+		struct wlr_renderer *wlr_renderer, const float color[static 4],
+		const float matrix[static 9]) {
+	struct wlr_pixman_renderer *renderer =
+		pixman_get_renderer_in_context(wlr_renderer);
+	render_fill(renderer, color, matrix, inside_ellipse);
+}
+
+static const enum wl_shm_format *pixman_renderer_formats(
+		struct wlr_renderer *wlr_renderer, size_t *len) {
+	return get_pixman_wl_formats(len);
+}
+
+static bool pixman_format_supported(struct wlr_renderer *wlr_renderer,
+		enum wl_shm_format wl_fmt) {
+	return get_pixman_format_from_wl(wl_fmt) != NULL;
+}
+
+static enum wl_shm_format pixman_preferred_read_format(
+		struct wlr_renderer *wlr_renderer) {
+	struct wlr_pixman_renderer *renderer =
+		pixman_get_renderer_in_context(wlr_renderer);
+
+	const struct wlr_pixman_pixel_format *fmt = get_pixman_format_from_pixman(
+		pixman_image_get_format(renderer->image));
+	if (fmt != NULL) {
+		return fmt->wl_format;
+	}
+	return WL_SHM_FORMAT_XRGB8888;
+}
+
+static bool pixman_read_pixels(struct wlr_renderer *wlr_renderer,
+		enum wl_shm_format wl_fmt, uint32_t *flags, uint32_t stride,
+		uint32_t width, uint32_t height, uint32_t src_x, uint32_t src_y,
+		uint32_t dst_x, uint32_t dst_y, void *data) {
+	struct wlr_pixman_renderer *renderer =
+		pixman_get_renderer_in_context(wlr_renderer);
+
+	const struct wlr_pixman_pixel_format *fmt = get_pixman_format_from_wl(wl_fmt);
+	if (fmt == NULL) {
+		wlr_log(WLR_ERROR, "Cannot read pixels: unsupported pixel format");
+		return false;
+	}
+
+	pixman_image_t *dst = pixman_image_create_bits_no_clear(fmt->pixman_format,
+		dst_x + width, dst_y + height, data, stride);
+	if (dst == NULL) {
+		wlr_log(WLR_ERROR, "Cannot read pixels: failed to wrap buffer");
+		return false;
+	}
+
+	pixman_image_composite32(PIXMAN_OP_SRC, renderer->image, NULL, dst,
+		src_x, src_y, 0, 0, dst_x, dst_y, width, height);
+	pixman_image_unref(dst);
+
+	if (flags != NULL) {
+		*flags = 0;
+	}
+	return true;
+}
+
+static struct wlr_texture *pixman_texture_from_pixels_impl(
+		struct wlr_renderer *wlr_renderer, enum wl_shm_format wl_fmt,
+		uint32_t stride, uint32_t width, uint32_t height, const void *data) {
+	return pixman_texture_from_pixels(wl_fmt, stride, width, height, data);
+}
+
+static void pixman_destroy(struct wlr_renderer *wlr_renderer) {
+	struct wlr_pixman_renderer *renderer = pixman_get_renderer(wlr_renderer);
+	free(renderer);
+}
+
+static const struct wlr_renderer_impl renderer_impl = {
+	.destroy = pixman_destroy,
+	.begin = pixman_begin,
+	.end = pixman_end,
+	.clear = pixman_clear,
+	.scissor = pixman_scissor,
+	.render_subtexture_with_matrix = pixman_render_subtexture_with_matrix,
+	.render_quad_with_matrix = pixman_render_quad_with_matrix,
+	.render_ellipse_with_matrix = pixman_render_ellipse_with_matrix,
+	.formats = pixman_renderer_formats,
+	.format_supported = pixman_format_supported,
+	.preferred_read_format = pixman_preferred_read_format,
+	.read_pixels = pixman_read_pixels,
+	.texture_from_pixels = pixman_texture_from_pixels_impl,
+};
+
+struct wlr_renderer *wlr_pixman_renderer_create(void) {
+	struct wlr_pixman_renderer *renderer =
+		calloc(1, sizeof(struct wlr_pixman_renderer));
+	if (renderer == NULL) {
+		return NULL;
+	}
+	wlr_renderer_init(&renderer->wlr_renderer, &renderer_impl);
+
+	wlr_log(WLR_INFO, "Using pixman software renderer");
+	return &renderer->wlr_renderer;
+}
+
+void wlr_pixman_renderer_set_image(struct wlr_renderer *wlr_renderer,
+		pixman_image_t *image) {
+	struct wlr_pixman_renderer *renderer = pixman_get_renderer(wlr_renderer);
+	assert(!wlr_renderer->rendering);
+	renderer->image = image;
+}
@@ -0,0 +1,114 @@
+#include <assert.h>
+#include <inttypes.h>
+#include <pixman.h>
+#include <stdlib.h>
+#include <wlr/render/interface.h>
+#include <wlr/render/wlr_texture.h>
+#include <wlr/util/log.h>
+#include "render/pixman.h"
+
+static const struct wlr_texture_impl texture_impl;
+
+bool wlr_texture_is_pixman(struct wlr_texture *wlr_texture) {
+	return wlr_texture->impl == &texture_impl;
+}
+
+struct wlr_pixman_texture *pixman_get_texture(
+		struct wlr_texture *wlr_texture) {
+	assert(wlr_texture_is_pixman(wlr_texture));
+	return (struct wlr_pixman_texture *)wlr_texture;
+}
+
+static bool pixman_texture_is_opaque(struct wlr_texture *wlr_texture) {
+	struct wlr_pixman_texture *texture = pixman_get_texture(wlr_texture);
+	return !texture->format->has_alpha;
+}
+
+/**
+ * Copy a rectangle of client pixels into an image. The pixels are wrapped,
+ * not copied, before being composited.
+ */
+static bool copy_pixels(pixman_image_t *dst,
+		const struct wlr_pixman_pixel_format *fmt, uint32_t stride,
+		uint32_t width, uint32_t height, uint32_t src_x, uint32_t src_y,
+		uint32_t dst_x, uint32_t dst_y, const void *data) {
+	pixman_image_t *src = pixman_image_create_bits_no_clear(
+		fmt->pixman_format, src_x + width, src_y + height,
+		(uint32_t *)data, stride);
+	if (src == NULL) {
+		wlr_log(WLR_ERROR, "Failed to wrap pixels");
+		return false;
+	}
+
+	pixman_image_composite32(PIXMAN_OP_SRC, src, NULL, dst,
+		src_x, src_y, 0, 0, dst_x, dst_y, width, height);
+	pixman_image_unref(src);
+	return true;
+}
+
+static bool pixman_texture_write_pixels(struct wlr_texture *wlr_texture,
+		uint32_t stride, uint32_t width, uint32_t height,
+		uint32_t src_x, uint32_t src_y, uint32_t dst_x, uint32_t dst_y,
+		const void *data) {
+	struct wlr_pixman_texture *texture = pixman_get_texture(wlr_texture);
+	return copy_pixels(texture->image, texture->format, stride, width, height,
+		src_x, src_y, dst_x, dst_y, data);
+}
+
+static void pixman_texture_destroy(struct wlr_texture *wlr_texture) {
+	if (wlr_texture == NULL) {
+		return;
+	}
+
+	struct wlr_pixman_texture *texture = pixman_get_texture(wlr_texture);
+	pixman_image_unref(texture->image);
+	free(texture);
+}
+
+static const struct wlr_texture_impl texture_impl = {
+	.is_opaque = pixman_texture_is_opaque,
+	.write_pixels = pixman_texture_write_pixels,
+	.destroy = pixman_texture_destroy,
+};
+
+struct wlr_texture *pixman_texture_from_pixels(enum wl_shm_format wl_fmt,
+		uint32_t stride, uint32_t width, uint32_t height, const void *data) {
+	const struct wlr_pixman_pixel_format *fmt =
+		get_pixman_format_from_wl(wl_fmt);
+	if (fmt == NULL) {
+		wlr_log(WLR_ERROR, "Unsupported pixel format %"PRIu32, wl_fmt);
+		return NULL;
+	}
+
+	struct wlr_pixman_texture *texture =
+		calloc(1, sizeof(struct wlr_pixman_texture));
+	if (texture == NULL) {
+		wlr_log(WLR_ERROR, "Allocation failed");
+		return NULL;
+	}
+	wlr_texture_init(&texture->wlr_texture, &texture_impl, width, height);
+	texture->format = fmt;
+
+	// Let pixman allocate the storage, so that it is properly aligned for
+	// its SIMD paths
+	texture->image = pixman_image_create_bits_no_clear(fmt->pixman_format,
+		width, height, NULL, 0);
+	if (texture->image == NULL) {
+		wlr_log(WLR_ERROR, "Failed to create pixman image");
+		free(texture);
+		return NULL;
+	}
+
+	if (!copy_pixels(texture->image, fmt, stride, width, height,
+			0, 0, 0, 0, data)) {
+		pixman_texture_destroy(&texture->wlr_texture);
+		return NULL;
+	}
+
+	return &texture->wlr_texture;
+}
+
+pixman_image_t *wlr_pixman_texture_get_image(struct wlr_texture *wlr_texture) {
+	struct wlr_pixman_texture *texture = pixman_get_texture(wlr_texture);
+	return texture->image;
+}
@@ -52,6 +52,7 @@ struct tinywl_server {
 	struct wl_listener request_cursor;
 	struct wl_listener request_set_selection;
 	struct wl_list keyboards;
+	struct xkb_keymap *keymap;
 	enum tinywl_cursor_mode cursor_mode;
 	struct tinywl_view *grabbed_view;
 	double grab_x, grab_y;
@@ -221,15 +222,17 @@ static void server_new_keyboard(struct tinywl_server *server,
 	keyboard->device = device;
 
 	/* We need to prepare an XKB keymap and assign it to the keyboard. This
-	 * assumes the defaults (e.g. layout = "us"). */
-	struct xkb_rule_names rules = { 0 };
-	struct xkb_context *context = xkb_context_new(XKB_CONTEXT_NO_FLAGS);
-	struct xkb_keymap *keymap = xkb_map_new_from_names(context, &rules,
-		XKB_KEYMAP_COMPILE_NO_FLAGS);
-
-	wlr_keyboard_set_keymap(device->keyboard, keymap);
-	xkb_keymap_unref(keymap);
-	xkb_context_unref(context);
+	 * assumes the defaults (e.g. layout = "us"). Compiling a keymap is slow, so
+	 * we do it once and share it between all of our keyboards. */
+	if (server->keymap == NULL) {
+		struct xkb_rule_names rules = { 0 };
+		struct xkb_context *context = xkb_context_new(XKB_CONTEXT_NO_FLAGS);
+		server->keymap = xkb_map_new_from_names(context, &rules,
+			XKB_KEYMAP_COMPILE_NO_FLAGS);
+		xkb_context_unref(context);
+	}
+
+	wlr_keyboard_set_keymap(device->keyboard, server->keymap);
 	wlr_keyboard_set_repeat_info(device->keyboard, 25, 600);
 
 	/* Here we set up listeners for keyboard events. */
@@ -974,5 +977,6 @@ int main(int argc, char *argv[]) {
 	/* Once wl_display_run returns, we shut down the server. */
 	wl_display_destroy_clients(server.wl_display);
 	wl_display_destroy(server.wl_display);
+	xkb_keymap_unref(server.keymap);
 	return 0;
 }
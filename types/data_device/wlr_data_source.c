@@ -9,6 +9,7 @@
 #include <wlr/types/wlr_seat.h>
 #include <wlr/util/log.h>
 #include "types/wlr_data_device.h"
+#include "types/wlr_selection_cache.h"
 #include "util/signal.h"
 
 void wlr_data_source_init(struct wlr_data_source *source,
@@ -23,6 +24,10 @@ void wlr_data_source_init(struct wlr_data_source *source,
 
 void wlr_data_source_send(struct wlr_data_source *source, const char *mime_type,
 		int32_t fd) {
+	if (source->cache != NULL &&
+			selection_cache_source_send(source->cache, mime_type, fd)) {
+		return;
+	}
 	source->impl->send(source, mime_type, fd);
 }
 
@@ -4,7 +4,9 @@
 #include <wlr/types/wlr_buffer.h>
 #include <wlr/types/wlr_linux_dmabuf_v1.h>
 #include <wlr/util/log.h>
+#include "types/wlr_client_usage.h"
 #include "util/signal.h"
+#include "util/trace.h"
 
 void wlr_buffer_init(struct wlr_buffer *buffer,
 		const struct wlr_buffer_impl *impl, int width, int height) {
@@ -110,6 +112,12 @@ static void client_buffer_destroy(struct wlr_buffer *_buffer) {
 	}
 
 	wl_list_remove(&buffer->resource_destroy.link);
+	wl_list_remove(&buffer->usage_destroy.link);
+	if (buffer->texture != NULL) {
+		client_usage_remove(buffer->usage, WLR_CLIENT_USAGE_TEXTURES, 1);
+		client_usage_remove(buffer->usage, WLR_CLIENT_USAGE_TEXTURE_BYTES,
+			buffer->usage_bytes);
+	}
 	wlr_texture_destroy(buffer->texture);
 	free(buffer);
 }
@@ -139,6 +147,13 @@ static const struct wlr_buffer_impl client_buffer_impl = {
 	.get_dmabuf = client_buffer_get_dmabuf,
 };
 
+struct wlr_client_buffer *wlr_client_buffer_get(struct wlr_buffer *buffer) {
+	if (buffer->impl != &client_buffer_impl) {
+		return NULL;
+	}
+	return (struct wlr_client_buffer *)buffer;
+}
+
 static void client_buffer_resource_handle_destroy(struct wl_listener *listener,
 		void *data) {
 	struct wlr_client_buffer *buffer =
@@ -155,6 +170,15 @@ static void client_buffer_resource_handle_destroy(struct wl_listener *listener,
 	// which case we'll read garbage. We decide to accept this risk.
 }
 
+static void client_buffer_handle_usage_destroy(struct wl_listener *listener,
+		void *data) {
+	struct wlr_client_buffer *buffer =
+		wl_container_of(listener, buffer, usage_destroy);
+	wl_list_remove(&buffer->usage_destroy.link);
+	wl_list_init(&buffer->usage_destroy.link);
+	buffer->usage = NULL;
+}
+
 static void client_buffer_handle_release(struct wl_listener *listener,
 		void *data) {
 	struct wlr_client_buffer *buffer =
@@ -165,25 +189,35 @@ static void client_buffer_handle_release(struct wl_listener *listener,
 	}
 }
 
-struct wlr_client_buffer *wlr_client_buffer_import(
+static struct wlr_texture *texture_from_shm_buffer(
+		struct wlr_renderer *renderer, struct wl_shm_buffer *shm_buf) {
+	enum wl_shm_format fmt = wl_shm_buffer_get_format(shm_buf);
+	int32_t stride = wl_shm_buffer_get_stride(shm_buf);
+	int32_t width = wl_shm_buffer_get_width(shm_buf);
+	int32_t height = wl_shm_buffer_get_height(shm_buf);
+
+	wl_shm_buffer_begin_access(shm_buf);
+	void *data = wl_shm_buffer_get_data(shm_buf);
+	struct wlr_texture *texture = wlr_texture_from_pixels(renderer, fmt,
+		stride, width, height, data);
+	wl_shm_buffer_end_access(shm_buf);
+	return texture;
+}
+
+static struct wlr_client_buffer *client_buffer_import(
 		struct wlr_renderer *renderer, struct wl_resource *resource) {
 	assert(wlr_resource_is_buffer(resource));
 
 	struct wlr_texture *texture = NULL;
 	bool resource_released = false;
+	size_t texture_bytes = 0;
 
 	struct wl_shm_buffer *shm_buf = wl_shm_buffer_get(resource);
 	if (shm_buf != NULL) {
-		enum wl_shm_format fmt = wl_shm_buffer_get_format(shm_buf);
-		int32_t stride = wl_shm_buffer_get_stride(shm_buf);
-		int32_t width = wl_shm_buffer_get_width(shm_buf);
-		int32_t height = wl_shm_buffer_get_height(shm_buf);
-
-		wl_shm_buffer_begin_access(shm_buf);
-		void *data = wl_shm_buffer_get_data(shm_buf);
-		texture = wlr_texture_from_pixels(renderer, fmt, stride,
-			width, height, data);
-		wl_shm_buffer_end_access(shm_buf);
+		texture = texture_from_shm_buffer(renderer, shm_buf);
+		texture_bytes =
+			(size_t)wl_shm_buffer_get_stride(shm_buf) *
+			wl_shm_buffer_get_height(shm_buf);
 
 		// We have uploaded the data, we don't need to access the wl_buffer
 		// anymore
@@ -216,10 +250,30 @@ struct wlr_client_buffer *wlr_client_buffer_import(
 
 	int width, height;
 	wlr_resource_get_buffer_size(resource, renderer, &width, &height);
+	if (texture_bytes == 0) {
+		// Assume 32 bits per pixel
+		texture_bytes = (size_t)width * height * 4;
+	}
+
+	struct wlr_client_usage *usage =
+		client_usage_from_client(wl_resource_get_client(resource));
+	if (!client_usage_add(usage, WLR_CLIENT_USAGE_TEXTURES, 1)) {
+		wlr_texture_destroy(texture);
+		return NULL;
+	}
+	if (!client_usage_add(usage, WLR_CLIENT_USAGE_TEXTURE_BYTES,
+			texture_bytes)) {
+		client_usage_remove(usage, WLR_CLIENT_USAGE_TEXTURES, 1);
+		wlr_texture_destroy(texture);
+		return NULL;
+	}
 
 	struct wlr_client_buffer *buffer =
 		calloc(1, sizeof(struct wlr_client_buffer));
 	if (buffer == NULL) {
+		client_usage_remove(usage, WLR_CLIENT_USAGE_TEXTURES, 1);
+		client_usage_remove(usage, WLR_CLIENT_USAGE_TEXTURE_BYTES,
+			texture_bytes);
 		wlr_texture_destroy(texture);
 		wl_resource_post_no_memory(resource);
 		return NULL;
@@ -228,6 +282,17 @@ struct wlr_client_buffer *wlr_client_buffer_import(
 	buffer->resource = resource;
 	buffer->texture = texture;
 	buffer->resource_released = resource_released;
+	buffer->renderer = renderer;
+
+	// The texture may outlive the client
+	buffer->usage = usage;
+	buffer->usage_bytes = texture_bytes;
+	if (usage != NULL) {
+		buffer->usage_destroy.notify = client_buffer_handle_usage_destroy;
+		wl_signal_add(&usage->events.destroy, &buffer->usage_destroy);
+	} else {
+		wl_list_init(&buffer->usage_destroy.link);
+	}
 
 	wl_resource_add_destroy_listener(resource, &buffer->resource_destroy);
 	buffer->resource_destroy.notify = client_buffer_resource_handle_destroy;
@@ -242,6 +307,14 @@ struct wlr_client_buffer *wlr_client_buffer_import(
 	return buffer;
 }
 
+struct wlr_client_buffer *wlr_client_buffer_import(
+		struct wlr_renderer *renderer, struct wl_resource *resource) {
+	TRACE_BEGIN("client_buffer_import", NULL);
+	struct wlr_client_buffer *buffer = client_buffer_import(renderer, resource);
+	TRACE_END("client_buffer_import", NULL);
+	return buffer;
+}
+
 struct wlr_client_buffer *wlr_client_buffer_apply_damage(
 		struct wlr_client_buffer *buffer, struct wl_resource *resource,
 		pixman_region32_t *damage) {
@@ -271,6 +344,11 @@ struct wlr_client_buffer *wlr_client_buffer_apply_damage(
 	int32_t width = wl_shm_buffer_get_width(shm_buf);
 	int32_t height = wl_shm_buffer_get_height(shm_buf);
 
+	if (buffer->texture == NULL) {
+		// The texture has been evicted
+		return NULL;
+	}
+
 	int32_t texture_width, texture_height;
 	wlr_texture_get_size(buffer->texture, &texture_width, &texture_height);
 	if (width != texture_width || height != texture_height) {
@@ -306,3 +384,61 @@ struct wlr_client_buffer *wlr_client_buffer_apply_damage(
 	buffer->resource_released = true;
 	return buffer;
 }
+
+size_t wlr_client_buffer_evict_texture(struct wlr_client_buffer *buffer) {
+	if (buffer->texture == NULL || buffer->base.n_locks > 1) {
+		// Other consumers may be reading the texture
+		return 0;
+	}
+
+	wlr_texture_destroy(buffer->texture);
+	buffer->texture = NULL;
+	buffer->texture_evicted = true;
+	client_usage_remove(buffer->usage, WLR_CLIENT_USAGE_TEXTURES, 1);
+	client_usage_remove(buffer->usage, WLR_CLIENT_USAGE_TEXTURE_BYTES,
+		buffer->usage_bytes);
+	return buffer->usage_bytes;
+}
+
+bool wlr_client_buffer_restore_texture(struct wlr_client_buffer *buffer) {
+	if (!buffer->texture_evicted) {
+		return buffer->texture != NULL;
+	}
+	// On failure the content is lost, don't try again on every frame
+	buffer->texture_evicted = false;
+	if (buffer->resource == NULL || buffer->resource_released) {
+		// The client destroyed the buffer, or may be re-using it since it has
+		// been released. This is always the case for wl_shm buffers, which
+		// are released as soon as they are uploaded.
+		return false;
+	}
+
+	struct wl_resource *resource = buffer->resource;
+	struct wlr_renderer *renderer = buffer->renderer;
+	struct wlr_texture *texture = NULL;
+	if (wlr_renderer_resource_is_wl_drm_buffer(renderer, resource)) {
+		texture = wlr_texture_from_wl_drm(renderer, resource);
+	} else if (wlr_dmabuf_v1_resource_is_buffer(resource)) {
+		struct wlr_dmabuf_v1_buffer *dmabuf =
+			wlr_dmabuf_v1_buffer_from_buffer_resource(resource);
+		texture = wlr_texture_from_dmabuf(renderer, &dmabuf->attributes);
+	}
+	if (texture == NULL) {
+		wlr_log(WLR_ERROR, "Failed to restore evicted texture");
+		return false;
+	}
+
+	if (!client_usage_add(buffer->usage, WLR_CLIENT_USAGE_TEXTURES, 1)) {
+		wlr_texture_destroy(texture);
+		return false;
+	}
+	if (!client_usage_add(buffer->usage, WLR_CLIENT_USAGE_TEXTURE_BYTES,
+			buffer->usage_bytes)) {
+		client_usage_remove(buffer->usage, WLR_CLIENT_USAGE_TEXTURES, 1);
+		wlr_texture_destroy(texture);
+		return false;
+	}
+
+	buffer->texture = texture;
+	return true;
+}
@@ -0,0 +1,182 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <wayland-server-core.h>
+#include <wlr/types/wlr_client_usage.h>
+#include <wlr/util/log.h>
+#include "types/wlr_client_usage.h"
+#include "util/signal.h"
+
+static const char *resource_names[WLR_CLIENT_USAGE_RESOURCE_COUNT] = {
+	[WLR_CLIENT_USAGE_SURFACES] = "surfaces",
+	[WLR_CLIENT_USAGE_TEXTURES] = "textures",
+	[WLR_CLIENT_USAGE_TEXTURE_BYTES] = "texture bytes",
+	[WLR_CLIENT_USAGE_DMABUF_BUFFERS] = "DMA-BUF buffers",
+};
+
+static void client_usage_destroy(struct wlr_client_usage *usage) {
+	wlr_signal_emit_safe(&usage->events.destroy, usage);
+	wl_list_remove(&usage->client_destroy.link);
+	wl_list_remove(&usage->link);
+	free(usage);
+}
+
+static void client_usage_handle_client_destroy(struct wl_listener *listener,
+		void *data) {
+	struct wlr_client_usage *usage =
+		wl_container_of(listener, usage, client_destroy);
+	client_usage_destroy(usage);
+}
+
+struct wlr_client_usage *wlr_client_usage_get(
+		struct wlr_client_usage_manager *manager, struct wl_client *client) {
+	// The client's resources are destroyed after its destroy listeners have
+	// been removed, so the lookup fails during teardown
+	struct wl_listener *listener = wl_client_get_destroy_listener(client,
+		client_usage_handle_client_destroy);
+	if (listener == NULL) {
+		return NULL;
+	}
+	struct wlr_client_usage *usage =
+		wl_container_of(listener, usage, client_destroy);
+	assert(usage->manager == manager);
+	return usage;
+}
+
+static void manager_handle_display_destroy(struct wl_listener *listener,
+		void *data) {
+	struct wlr_client_usage_manager *manager =
+		wl_container_of(listener, manager, display_destroy);
+	wlr_signal_emit_safe(&manager->events.destroy, manager);
+	struct wlr_client_usage *usage, *tmp;
+	wl_list_for_each_safe(usage, tmp, &manager->clients, link) {
+		client_usage_destroy(usage);
+	}
+	wl_list_remove(&manager->display_destroy.link);
+	free(manager);
+}
+
+static struct wlr_client_usage_manager *manager_from_display(
+		struct wl_display *display) {
+	struct wl_listener *listener = wl_display_get_destroy_listener(display,
+		manager_handle_display_destroy);
+	if (listener == NULL) {
+		return NULL;
+	}
+	struct wlr_client_usage_manager *manager =
+		wl_container_of(listener, manager, display_destroy);
+	return manager;
+}
+
+struct wlr_client_usage_manager *wlr_client_usage_manager_create(
+		struct wl_display *display) {
+	if (manager_from_display(display) != NULL) {
+		wlr_log(WLR_ERROR, "A client usage manager already exists "
+			"for this display");
+		return NULL;
+	}
+
+	struct wlr_client_usage_manager *manager =
+		calloc(1, sizeof(struct wlr_client_usage_manager));
+	if (manager == NULL) {
+		return NULL;
+	}
+	manager->display = display;
+	wl_list_init(&manager->clients);
+	wl_signal_init(&manager->events.new_client);
+	wl_signal_init(&manager->events.limit_exceeded);
+	wl_signal_init(&manager->events.destroy);
+
+	manager->display_destroy.notify = manager_handle_display_destroy;
+	wl_display_add_destroy_listener(display, &manager->display_destroy);
+
+	return manager;
+}
+
+void wlr_client_usage_manager_set_limit(
+		struct wlr_client_usage_manager *manager,
+		enum wlr_client_usage_resource resource, size_t limit) {
+	assert(resource < WLR_CLIENT_USAGE_RESOURCE_COUNT);
+	manager->limits[resource] = limit;
+}
+
+struct wlr_client_usage *client_usage_from_client(struct wl_client *client) {
+	struct wlr_client_usage_manager *manager =
+		manager_from_display(wl_client_get_display(client));
+	if (manager == NULL) {
+		return NULL;
+	}
+
+	struct wlr_client_usage *usage = wlr_client_usage_get(manager, client);
+	if (usage != NULL) {
+		return usage;
+	}
+
+	usage = calloc(1, sizeof(struct wlr_client_usage));
+	if (usage == NULL) {
+		wlr_log(WLR_ERROR, "Allocation failed");
+		return NULL;
+	}
+	usage->manager = manager;
+	usage->client = client;
+	wl_signal_init(&usage->events.destroy);
+
+	usage->client_destroy.notify = client_usage_handle_client_destroy;
+	wl_client_add_destroy_listener(client, &usage->client_destroy);
+	wl_list_insert(&manager->clients, &usage->link);
+
+	wlr_signal_emit_safe(&manager->events.new_client, usage);
+	return usage;
+}
+
+bool client_usage_add(struct wlr_client_usage *usage,
+		enum wlr_client_usage_resource resource, size_t amount) {
+	if (usage == NULL) {
+		return true;
+	}
+	assert(resource < WLR_CLIENT_USAGE_RESOURCE_COUNT);
+
+	size_t limit = usage->manager->limits[resource];
+	size_t requested = usage->current[resource] + amount;
+	if (limit == 0 || requested <= limit) {
+		usage->current[resource] = requested;
+		return true;
+	}
+
+	wlr_log(WLR_INFO, "Client %p exceeded its limit of %zu %s",
+		usage->client, limit, resource_names[resource]);
+	struct wlr_client_usage_limit_event event = {
+		.usage = usage,
+		.resource = resource,
+		.requested = requested,
+	};
+	wlr_signal_emit_safe(&usage->manager->events.limit_exceeded, &event);
+
+	wl_client_post_implementation_error(usage->client,
+		"limit of %zu %s exceeded", limit, resource_names[resource]);
+	return false;
+}
+
+void client_usage_remove(struct wlr_client_usage *usage,
+		enum wlr_client_usage_resource resource, size_t amount) {
+	if (usage == NULL) {
+		return;
+	}
+	assert(resource < WLR_CLIENT_USAGE_RESOURCE_COUNT);
+	// Resources allocated before the manager was created aren't accounted
+	if (usage->current[resource] < amount) {
+		usage->current[resource] = 0;
+	} else {
+		usage->current[resource] -= amount;
+	}
+}
+
+void client_usage_remove_client(struct wl_client *client,
+		enum wlr_client_usage_resource resource, size_t amount) {
+	struct wlr_client_usage_manager *manager =
+		manager_from_display(wl_client_get_display(client));
+	if (manager == NULL) {
+		return;
+	}
+	client_usage_remove(wlr_client_usage_get(manager, client), resource,
+		amount);
+}
@@ -6,11 +6,18 @@
 #include <wlr/types/wlr_foreign_toplevel_management_v1.h>
 #include <wlr/types/wlr_seat.h>
 #include <wlr/util/log.h>
+#include "util/coalescer.h"
 #include "util/signal.h"
 #include "wlr-foreign-toplevel-management-unstable-v1-protocol.h"
 
 #define FOREIGN_TOPLEVEL_MANAGEMENT_V1_VERSION 2
 
+enum toplevel_pending {
+	TOPLEVEL_PENDING_TITLE = 1 << 0,
+	TOPLEVEL_PENDING_APP_ID = 1 << 1,
+	TOPLEVEL_PENDING_STATE = 1 << 2,
+};
+
 static const struct zwlr_foreign_toplevel_handle_v1_interface toplevel_handle_impl;
 
 static struct wlr_foreign_toplevel_handle_v1 *toplevel_handle_from_resource(
@@ -171,50 +178,66 @@ static const struct zwlr_foreign_toplevel_handle_v1_interface toplevel_handle_im
 	.unset_fullscreen = foreign_toplevel_handle_unset_fullscreen,
 };
 
-static void toplevel_idle_send_done(void *data) {
+static void toplevel_send_state(struct wlr_foreign_toplevel_handle_v1 *toplevel);
+
+static void toplevel_flush(void *data) {
 	struct wlr_foreign_toplevel_handle_v1 *toplevel = data;
+	uint32_t pending = toplevel->pending;
+	toplevel->pending = 0;
+
 	struct wl_resource *resource;
+	wl_resource_for_each(resource, &toplevel->resources) {
+		if ((pending & TOPLEVEL_PENDING_TITLE) && toplevel->title) {
+			zwlr_foreign_toplevel_handle_v1_send_title(resource,
+				toplevel->title);
+		}
+		if ((pending & TOPLEVEL_PENDING_APP_ID) && toplevel->app_id) {
+			zwlr_foreign_toplevel_handle_v1_send_app_id(resource,
+				toplevel->app_id);
+		}
+	}
+	if (pending & TOPLEVEL_PENDING_STATE) {
+		toplevel_send_state(toplevel);
+	}
+
 	wl_resource_for_each(resource, &toplevel->resources) {
 		zwlr_foreign_toplevel_handle_v1_send_done(resource);
 	}
+}
 
-	toplevel->idle_source = NULL;
+static void toplevel_schedule_update(
+		struct wlr_foreign_toplevel_handle_v1 *toplevel, uint32_t pending) {
+	toplevel->pending |= pending;
+	coalescer_set_interval(toplevel->coalescer,
+		toplevel->manager->update_interval_ms);
+	coalescer_schedule(toplevel->coalescer);
 }
 
-static void toplevel_update_idle_source(
-	struct wlr_foreign_toplevel_handle_v1 *toplevel) {
-	if (toplevel->idle_source) {
-		return;
+static bool update_string(char **dst, const char *src) {
+	if (*dst != NULL && strcmp(*dst, src) == 0) {
+		return false;
 	}
-
-	toplevel->idle_source = wl_event_loop_add_idle(toplevel->manager->event_loop,
-		toplevel_idle_send_done, toplevel);
+	char *dup = strdup(src);
+	if (dup == NULL) {
+		return false;
+	}
+	free(*dst);
+	*dst = dup;
+	return true;
 }
 
 void wlr_foreign_toplevel_handle_v1_set_title(
 		struct wlr_foreign_toplevel_handle_v1 *toplevel, const char *title) {
-	free(toplevel->title);
-	toplevel->title = strdup(title);
-
-	struct wl_resource *resource;
-	wl_resource_for_each(resource, &toplevel->resources) {
-		zwlr_foreign_toplevel_handle_v1_send_title(resource, title);
+	if (update_string(&toplevel->title, title)) {
+		toplevel_schedule_update(toplevel, TOPLEVEL_PENDING_TITLE);
 	}
-
-	toplevel_update_idle_source(toplevel);
 }
 
 void wlr_foreign_toplevel_handle_v1_set_app_id(
 		struct wlr_foreign_toplevel_handle_v1 *toplevel, const char *app_id) {
-	free(toplevel->app_id);
-	toplevel->app_id = strdup(app_id);
-
-	struct wl_resource *resource;
-	wl_resource_for_each(resource, &toplevel->resources) {
-		zwlr_foreign_toplevel_handle_v1_send_app_id(resource, app_id);
+	if (update_string(&toplevel->app_id, app_id)) {
+		toplevel_schedule_update(toplevel, TOPLEVEL_PENDING_APP_ID);
 	}
-
-	toplevel_update_idle_source(toplevel);
 }
 
 static void send_output_to_resource(struct wl_resource *resource,
@@ -242,7 +265,9 @@ static void toplevel_send_output(struct wlr_foreign_toplevel_handle_v1 *toplevel
 		send_output_to_resource(resource, output, enter);
 	}
 
-	toplevel_update_idle_source(toplevel);
+	// Output resources may be gone by the time the update is flushed, only
+	// the done event is delayed
+	toplevel_schedule_update(toplevel, 0);
 }
 
 static void toplevel_handle_output_destroy(struct wl_listener *listener,
@@ -362,47 +387,41 @@ static void toplevel_send_state(struct wlr_foreign_toplevel_handle_v1 *toplevel)
 	}
 
 	wl_array_release(&states);
-	toplevel_update_idle_source(toplevel);
+}
+
+static void toplevel_set_state(struct wlr_foreign_toplevel_handle_v1 *toplevel,
+		uint32_t state, bool enabled) {
+	uint32_t new_state = enabled ?
+		toplevel->state | state : toplevel->state & ~state;
+	if (new_state == toplevel->state) {
+		return;
+	}
+	toplevel->state = new_state;
+	toplevel_schedule_update(toplevel, TOPLEVEL_PENDING_STATE);
 }
 
 void wlr_foreign_toplevel_handle_v1_set_maximized(
 		struct wlr_foreign_toplevel_handle_v1 *toplevel, bool maximized) {
-	if (maximized) {
-		toplevel->state |= WLR_FOREIGN_TOPLEVEL_HANDLE_V1_STATE_MAXIMIZED;
-	} else {
-		toplevel->state &= ~WLR_FOREIGN_TOPLEVEL_HANDLE_V1_STATE_MAXIMIZED;
-	}
-	toplevel_send_state(toplevel);
+	toplevel_set_state(toplevel,
+		WLR_FOREIGN_TOPLEVEL_HANDLE_V1_STATE_MAXIMIZED, maximized);
 }
 
 void wlr_foreign_toplevel_handle_v1_set_minimized(
 		struct wlr_foreign_toplevel_handle_v1 *toplevel, bool minimized) {
-	if (minimized) {
-		toplevel->state |= WLR_FOREIGN_TOPLEVEL_HANDLE_V1_STATE_MINIMIZED;
-	} else {
-		toplevel->state &= ~WLR_FOREIGN_TOPLEVEL_HANDLE_V1_STATE_MINIMIZED;
-	}
-	toplevel_send_state(toplevel);
+	toplevel_set_state(toplevel,
+		WLR_FOREIGN_TOPLEVEL_HANDLE_V1_STATE_MINIMIZED, minimized);
 }
 
 void wlr_foreign_toplevel_handle_v1_set_activated(
 		struct wlr_foreign_toplevel_handle_v1 *toplevel, bool activated) {
-	if (activated) {
-		toplevel->state |= WLR_FOREIGN_TOPLEVEL_HANDLE_V1_STATE_ACTIVATED;
-	} else {
-		toplevel->state &= ~WLR_FOREIGN_TOPLEVEL_HANDLE_V1_STATE_ACTIVATED;
-	}
-	toplevel_send_state(toplevel);
+	toplevel_set_state(toplevel,
+		WLR_FOREIGN_TOPLEVEL_HANDLE_V1_STATE_ACTIVATED, activated);
 }
 
 void wlr_foreign_toplevel_handle_v1_set_fullscreen(
 		struct wlr_foreign_toplevel_handle_v1 * toplevel, bool fullscreen) {
-	if (fullscreen) {
-		toplevel->state |= WLR_FOREIGN_TOPLEVEL_HANDLE_V1_STATE_FULLSCREEN;
-	} else {
-		toplevel->state &= ~WLR_FOREIGN_TOPLEVEL_HANDLE_V1_STATE_FULLSCREEN;
-	}
-	toplevel_send_state(toplevel);
+	toplevel_set_state(toplevel,
+		WLR_FOREIGN_TOPLEVEL_HANDLE_V1_STATE_FULLSCREEN, fullscreen);
 }
 
 void wlr_foreign_toplevel_handle_v1_destroy(
@@ -426,9 +445,7 @@ void wlr_foreign_toplevel_handle_v1_destroy(
 		toplevel_output_destroy(toplevel_output);
 	}
 
-	if (toplevel->idle_source) {
-		wl_event_source_remove(toplevel->idle_source);
-	}
+	coalescer_destroy(toplevel->coalescer);
 
 	wl_list_remove(&toplevel->link);
 
@@ -470,6 +487,13 @@ wlr_foreign_toplevel_handle_v1_create(
 		return NULL;
 	}
 
+	toplevel->coalescer = coalescer_create(manager->event_loop,
+		toplevel_flush, toplevel);
+	if (!toplevel->coalescer) {
+		free(toplevel);
+		return NULL;
+	}
+
 	wl_list_insert(&manager->toplevels, &toplevel->link);
 	toplevel->manager = manager;
 
@@ -492,6 +516,11 @@ wlr_foreign_toplevel_handle_v1_create(
 	return toplevel;
 }
 
+void wlr_foreign_toplevel_manager_v1_set_update_interval(
+		struct wlr_foreign_toplevel_manager_v1 *manager, uint32_t interval_ms) {
+	manager->update_interval_ms = interval_ms;
+}
+
 static const struct zwlr_foreign_toplevel_manager_v1_interface
 	foreign_toplevel_manager_impl;
 
@@ -0,0 +1,332 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <time.h>
+#include <wayland-server-core.h>
+#include <wlr/types/wlr_frame_throttle.h>
+#include <wlr/util/log.h>
+#include "util/signal.h"
+
+struct frame_throttle_surface {
+	struct wlr_frame_throttle *throttle;
+	struct wlr_surface *surface;
+	struct wl_list link; // wlr_frame_throttle::surfaces
+	struct wl_array outputs; // struct wlr_output *, where the surface is visible
+	uint32_t interval; // ms, 0 if not throttled
+
+	struct wl_listener surface_destroy;
+};
+
+struct frame_throttle_client {
+	struct wl_client *client;
+	struct wl_list link; // wlr_frame_throttle::clients
+	uint32_t interval;
+
+	struct wl_listener client_destroy;
+};
+
+struct frame_throttle_output {
+	struct wlr_frame_throttle *throttle;
+	struct wlr_output *output;
+	struct wl_list link; // wlr_frame_throttle::outputs
+
+	struct wl_listener output_destroy;
+};
+
+static void send_frame_done_iterator(struct wlr_surface *surface,
+		int sx, int sy, void *data) {
+	const struct timespec *now = data;
+	wlr_surface_send_frame_done(surface, now);
+}
+
+static void throttle_update_timer(struct wlr_frame_throttle *throttle) {
+	uint32_t min_interval = 0;
+	struct frame_throttle_surface *tsurface;
+	wl_list_for_each(tsurface, &throttle->surfaces, link) {
+		if (tsurface->interval > 0 &&
+				(min_interval == 0 || tsurface->interval < min_interval)) {
+			min_interval = tsurface->interval;
+		}
+	}
+	// Zero disarms the timer
+	wl_event_source_timer_update(throttle->timer, min_interval);
+}
+
+static int handle_timer(void *data) {
+	struct wlr_frame_throttle *throttle = data;
+
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	struct frame_throttle_surface *tsurface;
+	wl_list_for_each(tsurface, &throttle->surfaces, link) {
+		if (tsurface->interval == 0) {
+			continue;
+		}
+		// Callbacks completed recently by the compositor are skipped
+		wlr_surface_for_each_surface(tsurface->surface,
+			send_frame_done_iterator, &now);
+	}
+
+	throttle_update_timer(throttle);
+	return 0;
+}
+
+static uint32_t client_get_interval(struct wlr_frame_throttle *throttle,
+		struct wl_client *client) {
+	struct frame_throttle_client *tclient;
+	wl_list_for_each(tclient, &throttle->clients, link) {
+		if (tclient->client == client) {
+			return tclient->interval;
+		}
+	}
+	return throttle->default_interval;
+}
+
+static void surface_update(struct frame_throttle_surface *tsurface) {
+	uint32_t interval = 0;
+	if (tsurface->outputs.size == 0) {
+		interval = client_get_interval(tsurface->throttle,
+			wl_resource_get_client(tsurface->surface->resource));
+	}
+	if (interval == tsurface->interval) {
+		return;
+	}
+
+	tsurface->interval = interval;
+	// Subsurfaces look the interval up from their ancestors
+	tsurface->surface->frame_throttle_interval = interval;
+	throttle_update_timer(tsurface->throttle);
+}
+
+static void surface_destroy(struct frame_throttle_surface *tsurface) {
+	wl_list_remove(&tsurface->surface_destroy.link);
+	wl_list_remove(&tsurface->link);
+	wl_array_release(&tsurface->outputs);
+	free(tsurface);
+}
+
+/**
+ * Stops tracking a surface, its frame callbacks aren't throttled anymore.
+ */
+static void surface_untrack(struct frame_throttle_surface *tsurface) {
+	tsurface->surface->frame_throttle_interval = 0;
+	surface_destroy(tsurface);
+}
+
+static void surface_handle_surface_destroy(struct wl_listener *listener,
+		void *data) {
+	struct frame_throttle_surface *tsurface =
+		wl_container_of(listener, tsurface, surface_destroy);
+	struct wlr_frame_throttle *throttle = tsurface->throttle;
+	surface_destroy(tsurface);
+	throttle_update_timer(throttle);
+}
+
+static struct frame_throttle_surface *surface_get_or_create(
+		struct wlr_frame_throttle *throttle, struct wlr_surface *surface) {
+	struct frame_throttle_surface *tsurface;
+	wl_list_for_each(tsurface, &throttle->surfaces, link) {
+		if (tsurface->surface == surface) {
+			return tsurface;
+		}
+	}
+
+	tsurface = calloc(1, sizeof(struct frame_throttle_surface));
+	if (tsurface == NULL) {
+		wlr_log(WLR_ERROR, "Allocation failed");
+		return NULL;
+	}
+	tsurface->throttle = throttle;
+	tsurface->surface = surface;
+	wl_array_init(&tsurface->outputs);
+	wl_list_insert(&throttle->surfaces, &tsurface->link);
+
+	tsurface->surface_destroy.notify = surface_handle_surface_destroy;
+	wl_signal_add(&surface->events.destroy, &tsurface->surface_destroy);
+
+	return tsurface;
+}
+
+static bool surface_remove_output(struct frame_throttle_surface *tsurface,
+		struct wlr_output *output) {
+	struct wlr_output **outputs = tsurface->outputs.data;
+	size_t outputs_len = tsurface->outputs.size / sizeof(outputs[0]);
+	for (size_t i = 0; i < outputs_len; ++i) {
+		if (outputs[i] == output) {
+			outputs[i] = outputs[outputs_len - 1];
+			tsurface->outputs.size -= sizeof(outputs[0]);
+			return true;
+		}
+	}
+	return false;
+}
+
+static void output_handle_output_destroy(struct wl_listener *listener,
+		void *data) {
+	struct frame_throttle_output *toutput =
+		wl_container_of(listener, toutput, output_destroy);
+
+	struct frame_throttle_surface *tsurface;
+	wl_list_for_each(tsurface, &toutput->throttle->surfaces, link) {
+		if (surface_remove_output(tsurface, toutput->output)) {
+			surface_update(tsurface);
+		}
+	}
+
+	wl_list_remove(&toutput->output_destroy.link);
+	wl_list_remove(&toutput->link);
+	free(toutput);
+}
+
+static bool track_output(struct wlr_frame_throttle *throttle,
+		struct wlr_output *output) {
+	struct frame_throttle_output *toutput;
+	wl_list_for_each(toutput, &throttle->outputs, link) {
+		if (toutput->output == output) {
+			return true;
+		}
+	}
+
+	toutput = calloc(1, sizeof(struct frame_throttle_output));
+	if (toutput == NULL) {
+		wlr_log(WLR_ERROR, "Allocation failed");
+		return false;
+	}
+	toutput->throttle = throttle;
+	toutput->output = output;
+	wl_list_insert(&throttle->outputs, &toutput->link);
+
+	toutput->output_destroy.notify = output_handle_output_destroy;
+	wl_signal_add(&output->events.destroy, &toutput->output_destroy);
+	return true;
+}
+
+void wlr_frame_throttle_set_visible(struct wlr_frame_throttle *throttle,
+		struct wlr_surface *surface, struct wlr_output *output, bool visible) {
+	struct frame_throttle_surface *tsurface =
+		surface_get_or_create(throttle, surface);
+	if (tsurface == NULL) {
+		return;
+	}
+
+	surface_remove_output(tsurface, output);
+	if (visible) {
+		struct wlr_output **output_ptr = NULL;
+		if (track_output(throttle, output)) {
+			output_ptr = wl_array_add(&tsurface->outputs, sizeof(*output_ptr));
+		}
+		if (output_ptr == NULL) {
+			wlr_log(WLR_ERROR, "Allocation failed");
+			// Never throttle a visible surface
+			surface_untrack(tsurface);
+			throttle_update_timer(throttle);
+			return;
+		}
+		*output_ptr = output;
+	}
+
+	surface_update(tsurface);
+}
+
+static void client_handle_client_destroy(struct wl_listener *listener,
+		void *data) {
+	struct frame_throttle_client *tclient =
+		wl_container_of(listener, tclient, client_destroy);
+	wl_list_remove(&tclient->client_destroy.link);
+	wl_list_remove(&tclient->link);
+	free(tclient);
+}
+
+void wlr_frame_throttle_set_client_interval(
+		struct wlr_frame_throttle *throttle, struct wl_client *client,
+		uint32_t interval) {
+	struct frame_throttle_client *tclient = NULL, *iter;
+	wl_list_for_each(iter, &throttle->clients, link) {
+		if (iter->client == client) {
+			tclient = iter;
+			break;
+		}
+	}
+
+	if (tclient == NULL) {
+		tclient = calloc(1, sizeof(struct frame_throttle_client));
+		if (tclient == NULL) {
+			wlr_log(WLR_ERROR, "Allocation failed");
+			return;
+		}
+		tclient->client = client;
+		wl_list_insert(&throttle->clients, &tclient->link);
+
+		tclient->client_destroy.notify = client_handle_client_destroy;
+		wl_client_add_destroy_listener(client, &tclient->client_destroy);
+	}
+	tclient->interval = interval;
+
+	struct frame_throttle_surface *tsurface;
+	wl_list_for_each(tsurface, &throttle->surfaces, link) {
+		if (wl_resource_get_client(tsurface->surface->resource) == client) {
+			surface_update(tsurface);
+		}
+	}
+}
+
+static void handle_display_destroy(struct wl_listener *listener, void *data) {
+	struct wlr_frame_throttle *throttle =
+		wl_container_of(listener, throttle, display_destroy);
+	wlr_frame_throttle_destroy(throttle);
+}
+
+struct wlr_frame_throttle *wlr_frame_throttle_create(
+		struct wl_display *display, uint32_t default_interval) {
+	struct wlr_frame_throttle *throttle =
+		calloc(1, sizeof(struct wlr_frame_throttle));
+	if (throttle == NULL) {
+		return NULL;
+	}
+	throttle->default_interval = default_interval;
+	wl_list_init(&throttle->surfaces);
+	wl_list_init(&throttle->clients);
+	wl_list_init(&throttle->outputs);
+	wl_signal_init(&throttle->events.destroy);
+
+	struct wl_event_loop *event_loop = wl_display_get_event_loop(display);
+	throttle->timer = wl_event_loop_add_timer(event_loop, handle_timer,
+		throttle);
+	if (throttle->timer == NULL) {
+		free(throttle);
+		return NULL;
+	}
+
+	throttle->display_destroy.notify = handle_display_destroy;
+	wl_display_add_destroy_listener(display, &throttle->display_destroy);
+
+	return throttle;
+}
+
+void wlr_frame_throttle_destroy(struct wlr_frame_throttle *throttle) {
+	if (throttle == NULL) {
+		return;
+	}
+	wlr_signal_emit_safe(&throttle->events.destroy, throttle);
+
+	struct frame_throttle_surface *tsurface, *tmp_surface;
+	wl_list_for_each_safe(tsurface, tmp_surface, &throttle->surfaces, link) {
+		surface_untrack(tsurface);
+	}
+	struct frame_throttle_client *tclient, *tmp_client;
+	wl_list_for_each_safe(tclient, tmp_client, &throttle->clients, link) {
+		wl_list_remove(&tclient->client_destroy.link);
+		wl_list_remove(&tclient->link);
+		free(tclient);
+	}
+	struct frame_throttle_output *toutput, *tmp_output;
+	wl_list_for_each_safe(toutput, tmp_output, &throttle->outputs, link) {
+		wl_list_remove(&toutput->output_destroy.link);
+		wl_list_remove(&toutput->link);
+		free(toutput);
+	}
+
+	wl_event_source_remove(throttle->timer);
+	wl_list_remove(&throttle->display_destroy.link);
+	free(throttle);
+}
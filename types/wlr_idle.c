@@ -1,6 +1,7 @@
 #include <assert.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <wayland-server-core.h>
 #include <wlr/types/wlr_idle.h>
 #include <wlr/util/log.h>
@@ -16,40 +17,181 @@ static struct wlr_idle_timeout *idle_timeout_from_resource(
 	return wl_resource_get_user_data(resource);
 }
 
-static int idle_notify(void *data) {
-	struct wlr_idle_timeout *timer = data;
+/**
+ * Per-seat idle state. Input activity only updates the last activity time, the
+ * seat's timer is armed for the nearest deadline among the seat's timeouts and
+ * re-checks them when it fires.
+ */
+struct wlr_idle_seat {
+	struct wl_list link; // wlr_idle::seats
+	struct wlr_idle *idle;
+	struct wlr_seat *seat;
+
+	int64_t last_activity; // ms
+	struct wl_event_source *timer;
+	int64_t deadline; // ms, when the timer fires, 0 if disarmed
+	int idle_timeouts; // timeouts currently in the idle state
+
+	struct wl_listener seat_destroy;
+};
+
+static int64_t get_time_msec(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (int64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+static struct wlr_idle_seat *idle_seat_find(struct wlr_idle *idle,
+		struct wlr_seat *seat) {
+	struct wlr_idle_seat *idle_seat;
+	wl_list_for_each(idle_seat, &idle->seats, link) {
+		if (idle_seat->seat == seat) {
+			return idle_seat;
+		}
+	}
+	return NULL;
+}
+
+static int64_t timeout_get_deadline(struct wlr_idle_timeout *timer,
+		struct wlr_idle_seat *idle_seat) {
+	int64_t last_activity = timer->last_activity;
+	if (idle_seat->last_activity > last_activity) {
+		last_activity = idle_seat->last_activity;
+	}
+	return last_activity + timer->timeout;
+}
+
+static void idle_seat_arm(struct wlr_idle_seat *idle_seat, int64_t deadline,
+		int64_t now) {
+	if (idle_seat->deadline != 0 && idle_seat->deadline <= deadline) {
+		return;
+	}
+	idle_seat->deadline = deadline;
+	// A zero delay would disarm the timer
+	int64_t delay = deadline > now ? deadline - now : 1;
+	wl_event_source_timer_update(idle_seat->timer, delay);
+}
+
+static void idle_notify(struct wlr_idle_timeout *timer,
+		struct wlr_idle_seat *idle_seat) {
 	if (timer->idle_state) {
-		return 0;
+		return;
 	}
 	timer->idle_state = true;
+	idle_seat->idle_timeouts++;
 	wlr_signal_emit_safe(&timer->events.idle, timer);
 
 	if (timer->resource) {
 		org_kde_kwin_idle_timeout_send_idle(timer->resource);
 	}
-	return 1;
 }
 
-static void handle_activity(struct wlr_idle_timeout *timer) {
-	if (!timer->enabled) {
+static void idle_resume(struct wlr_idle_timeout *timer,
+		struct wlr_idle_seat *idle_seat) {
+	if (!timer->idle_state) {
 		return;
 	}
+	timer->idle_state = false;
+	idle_seat->idle_timeouts--;
+	wlr_signal_emit_safe(&timer->events.resume, timer);
 
-	// in case the previous state was sleeping send a resume event and switch state
-	if (timer->idle_state) {
-		timer->idle_state = false;
-		wlr_signal_emit_safe(&timer->events.resume, timer);
+	if (timer->resource) {
+		org_kde_kwin_idle_timeout_send_resumed(timer->resource);
+	}
+}
 
-		if (timer->resource) {
-			org_kde_kwin_idle_timeout_send_resumed(timer->resource);
+static int idle_seat_handle_timer(void *data) {
+	struct wlr_idle_seat *idle_seat = data;
+	int64_t now = get_time_msec();
+	idle_seat->deadline = 0;
+
+	int64_t next_deadline = 0;
+	struct wlr_idle_timeout *timer, *tmp;
+	wl_list_for_each_safe(timer, tmp, &idle_seat->idle->idle_timers, link) {
+		if (timer->seat != idle_seat->seat || !timer->enabled ||
+				timer->idle_state) {
+			continue;
 		}
+		int64_t deadline = timeout_get_deadline(timer, idle_seat);
+		if (deadline <= now) {
+			idle_notify(timer, idle_seat);
+		} else if (next_deadline == 0 || deadline < next_deadline) {
+			next_deadline = deadline;
+		}
+	}
+
+	if (next_deadline != 0) {
+		idle_seat_arm(idle_seat, next_deadline, now);
 	}
+	return 0;
+}
 
-	// rearm the timer
-	wl_event_source_timer_update(timer->idle_source, timer->timeout);
+static void idle_seat_destroy(struct wlr_idle_seat *idle_seat) {
+	wl_list_remove(&idle_seat->seat_destroy.link);
+	wl_list_remove(&idle_seat->link);
+	wl_event_source_remove(idle_seat->timer);
+	free(idle_seat);
+}
+
+static void idle_seat_handle_seat_destroy(struct wl_listener *listener,
+		void *data) {
+	struct wlr_idle_seat *idle_seat =
+		wl_container_of(listener, idle_seat, seat_destroy);
+	idle_seat_destroy(idle_seat);
+}
+
+static struct wlr_idle_seat *idle_seat_get_or_create(struct wlr_idle *idle,
+		struct wlr_seat *seat) {
+	struct wlr_idle_seat *idle_seat = idle_seat_find(idle, seat);
+	if (idle_seat != NULL) {
+		return idle_seat;
+	}
+
+	idle_seat = calloc(1, sizeof(struct wlr_idle_seat));
+	if (idle_seat == NULL) {
+		return NULL;
+	}
+	idle_seat->timer = wl_event_loop_add_timer(idle->event_loop,
+		idle_seat_handle_timer, idle_seat);
+	if (idle_seat->timer == NULL) {
+		free(idle_seat);
+		return NULL;
+	}
+	idle_seat->idle = idle;
+	idle_seat->seat = seat;
+	idle_seat->last_activity = get_time_msec();
+
+	idle_seat->seat_destroy.notify = idle_seat_handle_seat_destroy;
+	wl_signal_add(&seat->events.destroy, &idle_seat->seat_destroy);
+
+	wl_list_insert(&idle->seats, &idle_seat->link);
+	return idle_seat;
+}
+
+/**
+ * Start counting down from now, or go idle right away for a zero timeout.
+ */
+static void timeout_restart(struct wlr_idle_timeout *timer,
+		struct wlr_idle_seat *idle_seat, int64_t now) {
+	timer->last_activity = now;
 	if (timer->timeout == 0) {
-		idle_notify(timer);
+		idle_notify(timer, idle_seat);
+	} else {
+		idle_seat_arm(idle_seat, timeout_get_deadline(timer, idle_seat), now);
+	}
+}
+
+static void handle_activity(struct wlr_idle_timeout *timer) {
+	if (!timer->enabled) {
+		return;
 	}
+
+	struct wlr_idle_seat *idle_seat = idle_seat_find(timer->idle, timer->seat);
+	assert(idle_seat != NULL);
+
+	// in case the previous state was sleeping send a resume event and switch state
+	idle_resume(timer, idle_seat);
+	timeout_restart(timer, idle_seat, get_time_msec());
 }
 
 static void handle_timer_resource_destroy(struct wl_resource *timer_resource) {
@@ -91,23 +233,20 @@ static struct wlr_idle *idle_from_resource(
 	return wl_resource_get_user_data(resource);
 }
 
-static void handle_input_notification(struct wl_listener *listener, void *data) {
-	struct wlr_idle_timeout *timer =
-		wl_container_of(listener, timer, input_listener);
-	struct wlr_seat *seat = data;
-	if (timer->seat == seat) {
-		handle_activity(timer);
-	}
-}
-
 static struct wlr_idle_timeout *create_timer(struct wlr_idle *idle,
 		struct wlr_seat *seat, uint32_t timeout, struct wl_resource *resource) {
+	struct wlr_idle_seat *idle_seat = idle_seat_get_or_create(idle, seat);
+	if (idle_seat == NULL) {
+		return NULL;
+	}
+
 	struct wlr_idle_timeout *timer =
 		calloc(1, sizeof(struct wlr_idle_timeout));
 	if (!timer) {
 		return NULL;
 	}
 
+	timer->idle = idle;
 	timer->seat = seat;
 	timer->timeout = timeout;
 	timer->idle_state = false;
@@ -121,30 +260,13 @@ static struct wlr_idle_timeout *create_timer(struct wlr_idle *idle,
 	timer->seat_destroy.notify = handle_seat_destroy;
 	wl_signal_add(&timer->seat->events.destroy, &timer->seat_destroy);
 
-	timer->input_listener.notify = handle_input_notification;
-	wl_signal_add(&idle->events.activity_notify, &timer->input_listener);
-	// create the timer
-	timer->idle_source =
-		wl_event_loop_add_timer(idle->event_loop, idle_notify, timer);
-	if (timer->idle_source == NULL) {
-		wl_list_remove(&timer->link);
-		wl_list_remove(&timer->input_listener.link);
-		wl_list_remove(&timer->seat_destroy.link);
-		free(timer);
-		return NULL;
-	}
-
 	if (resource) {
 		timer->resource = resource;
 		wl_resource_set_user_data(resource, timer);
 	}
 
 	if (timer->enabled) {
-		// arm the timer
-		wl_event_source_timer_update(timer->idle_source, timer->timeout);
-		if (timer->timeout == 0) {
-			idle_notify(timer);
-		}
+		timeout_restart(timer, idle_seat, get_time_msec());
 	}
 
 	return timer;
@@ -185,14 +307,19 @@ void wlr_idle_set_enabled(struct wlr_idle *idle, struct wlr_seat *seat,
 		enabled ? "Enabling" : "Disabling",
 		seat ? seat->name : "all seats");
 	idle->enabled = enabled;
+	int64_t now = get_time_msec();
 	struct wlr_idle_timeout *timer;
 	wl_list_for_each(timer, &idle->idle_timers, link) {
 		if (seat != NULL && timer->seat != seat) {
 			continue;
 		}
-		int timeout = enabled ? timer->timeout : 0;
-		wl_event_source_timer_update(timer->idle_source, timeout);
 		timer->enabled = enabled;
+		if (enabled && !timer->idle_state) {
+			// Disabled timeouts are skipped when the seat's timer fires
+			struct wlr_idle_seat *idle_seat =
+				idle_seat_find(idle, timer->seat);
+			timeout_restart(timer, idle_seat, now);
+		}
 	}
 }
 
@@ -214,6 +341,10 @@ static void handle_display_destroy(struct wl_listener *listener, void *data) {
 	struct wlr_idle *idle = wl_container_of(listener, idle, display_destroy);
 	wlr_signal_emit_safe(&idle->events.destroy, idle);
 	wl_list_remove(&idle->display_destroy.link);
+	struct wlr_idle_seat *idle_seat, *tmp;
+	wl_list_for_each_safe(idle_seat, tmp, &idle->seats, link) {
+		idle_seat_destroy(idle_seat);
+	}
 	wl_global_destroy(idle->global);
 	free(idle);
 }
@@ -224,6 +355,7 @@ struct wlr_idle *wlr_idle_create(struct wl_display *display) {
 		return NULL;
 	}
 	wl_list_init(&idle->idle_timers);
+	wl_list_init(&idle->seats);
 	wl_signal_init(&idle->events.activity_notify);
 	wl_signal_init(&idle->events.destroy);
 	idle->enabled = true;
@@ -249,6 +381,24 @@ struct wlr_idle *wlr_idle_create(struct wl_display *display) {
 }
 
 void wlr_idle_notify_activity(struct wlr_idle *idle, struct wlr_seat *seat) {
+	struct wlr_idle_seat *idle_seat = idle_seat_find(idle, seat);
+	if (idle_seat != NULL) {
+		// The seat's timer will notice the new activity when it fires
+		idle_seat->last_activity = get_time_msec();
+
+		if (idle_seat->idle_timeouts > 0) {
+			int64_t now = idle_seat->last_activity;
+			struct wlr_idle_timeout *timer, *tmp;
+			wl_list_for_each_safe(timer, tmp, &idle->idle_timers, link) {
+				if (timer->seat == seat && timer->enabled &&
+						timer->idle_state) {
+					idle_resume(timer, idle_seat);
+					timeout_restart(timer, idle_seat, now);
+				}
+			}
+		}
+	}
+
 	wlr_signal_emit_safe(&idle->events.activity_notify, seat);
 }
 
@@ -260,9 +410,15 @@ struct wlr_idle_timeout *wlr_idle_timeout_create(struct wlr_idle *idle,
 void wlr_idle_timeout_destroy(struct wlr_idle_timeout *timer) {
 	wlr_signal_emit_safe(&timer->events.destroy, NULL);
 
-	wl_list_remove(&timer->input_listener.link);
+	if (timer->idle_state) {
+		struct wlr_idle_seat *idle_seat =
+			idle_seat_find(timer->idle, timer->seat);
+		if (idle_seat != NULL) {
+			idle_seat->idle_timeouts--;
+		}
+	}
+
 	wl_list_remove(&timer->seat_destroy.link);
-	wl_event_source_remove(timer->idle_source);
 	wl_list_remove(&timer->link);
 
 	if (timer->resource) {
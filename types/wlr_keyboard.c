@@ -9,6 +9,63 @@
 #include "types/wlr_keyboard.h"
 #include "util/signal.h"
 
+/**
+ * Keymaps are usually compiled once by the compositor and set on every
+ * keyboard, so their serialized form is shared between keyboards.
+ */
+struct keymap_string {
+	struct wl_list link; // keymap_strings
+	struct xkb_keymap *keymap;
+	char *string;
+	size_t refs;
+};
+
+static struct wl_list keymap_strings = { &keymap_strings, &keymap_strings };
+
+static char *keymap_string_get(struct xkb_keymap *keymap) {
+	struct keymap_string *ks;
+	wl_list_for_each(ks, &keymap_strings, link) {
+		if (ks->keymap == keymap) {
+			ks->refs++;
+			return ks->string;
+		}
+	}
+
+	ks = calloc(1, sizeof(*ks));
+	if (ks == NULL) {
+		wlr_log(WLR_ERROR, "Allocation failed");
+		return NULL;
+	}
+	ks->string = xkb_keymap_get_as_string(keymap, XKB_KEYMAP_FORMAT_TEXT_V1);
+	if (ks->string == NULL) {
+		free(ks);
+		return NULL;
+	}
+	ks->keymap = xkb_keymap_ref(keymap);
+	ks->refs = 1;
+	wl_list_insert(&keymap_strings, &ks->link);
+	return ks->string;
+}
+
+static void keymap_string_put(char *string) {
+	if (string == NULL) {
+		return;
+	}
+	struct keymap_string *ks;
+	wl_list_for_each(ks, &keymap_strings, link) {
+		if (ks->string == string) {
+			if (--ks->refs == 0) {
+				wl_list_remove(&ks->link);
+				xkb_keymap_unref(ks->keymap);
+				free(ks->string);
+				free(ks);
+			}
+			return;
+		}
+	}
+	assert(false && "keymap string not found");
+}
+
 void keyboard_led_update(struct wlr_keyboard *keyboard) {
 	if (keyboard->xkb_state == NULL) {
 		return;
@@ -131,7 +188,7 @@ void wlr_keyboard_destroy(struct wlr_keyboard *kb) {
 	wlr_signal_emit_safe(&kb->events.destroy, kb);
 	xkb_state_unref(kb->xkb_state);
 	xkb_keymap_unref(kb->keymap);
-	free(kb->keymap_string);
+	keymap_string_put(kb->keymap_string);
 	if (kb->impl && kb->impl->destroy) {
 		kb->impl->destroy(kb);
 	} else {
@@ -182,13 +239,12 @@ bool wlr_keyboard_set_keymap(struct wlr_keyboard *kb,
 		kb->mod_indexes[i] = xkb_map_mod_get_index(kb->keymap, mod_names[i]);
 	}
 
-	char *tmp_keymap_string = xkb_keymap_get_as_string(kb->keymap,
-		XKB_KEYMAP_FORMAT_TEXT_V1);
+	char *tmp_keymap_string = keymap_string_get(kb->keymap);
 	if (tmp_keymap_string == NULL) {
 		wlr_log(WLR_ERROR, "Failed to get string version of keymap");
 		goto err;
 	}
-	free(kb->keymap_string);
+	keymap_string_put(kb->keymap_string);
 	kb->keymap_string = tmp_keymap_string;
 	kb->keymap_size = strlen(kb->keymap_string) + 1;
 
@@ -207,7 +263,7 @@ err:
 	kb->xkb_state = NULL;
 	xkb_keymap_unref(keymap);
 	kb->keymap = NULL;
-	free(kb->keymap_string);
+	keymap_string_put(kb->keymap_string);
 	kb->keymap_string = NULL;
 	return false;
 }
@@ -242,6 +298,9 @@ bool wlr_keyboard_keymaps_match(struct xkb_keymap *km1,
 	if (!km1 || !km2) {
 		return false;
 	}
+	if (km1 == km2) {
+		return true;
+	}
 	char *km1_str = xkb_keymap_get_as_string(km1, XKB_KEYMAP_FORMAT_TEXT_V1);
 	char *km2_str = xkb_keymap_get_as_string(km2, XKB_KEYMAP_FORMAT_TEXT_V1);
 	bool result = strcmp(km1_str, km2_str) == 0;
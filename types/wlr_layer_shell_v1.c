@@ -229,6 +229,7 @@ static void layer_surface_destroy(struct wlr_layer_surface_v1 *surface) {
 	surface->surface->role_data = NULL;
 	wl_list_remove(&surface->surface_destroy.link);
 	wl_list_remove(&surface->link);
+	layer_surface_configure_destroy(surface->held_acked_configure);
 	free(surface->namespace);
 	free(surface);
 }
@@ -355,9 +356,43 @@ static void layer_surface_role_commit(struct wlr_surface *wlr_surface) {
 	}
 }
 
+static void layer_surface_role_hold(struct wlr_surface *wlr_surface) {
+	struct wlr_layer_surface_v1 *surface =
+		wlr_layer_surface_v1_from_wlr_surface(wlr_surface);
+	if (surface == NULL) {
+		return;
+	}
+
+	surface->held_client_pending = surface->client_pending;
+	if (surface->acked_configure) {
+		layer_surface_configure_destroy(surface->held_acked_configure);
+		surface->held_acked_configure = surface->acked_configure;
+		surface->acked_configure = NULL;
+	}
+}
+
+static void layer_surface_role_swap_held(struct wlr_surface *wlr_surface) {
+	struct wlr_layer_surface_v1 *surface =
+		wlr_layer_surface_v1_from_wlr_surface(wlr_surface);
+	if (surface == NULL) {
+		return;
+	}
+
+	struct wlr_layer_surface_v1_state state = surface->client_pending;
+	surface->client_pending = surface->held_client_pending;
+	surface->held_client_pending = state;
+
+	struct wlr_layer_surface_v1_configure *configure =
+		surface->acked_configure;
+	surface->acked_configure = surface->held_acked_configure;
+	surface->held_acked_configure = configure;
+}
+
 static const struct wlr_surface_role layer_surface_role = {
 	.name = "zwlr_layer_surface_v1",
 	.commit = layer_surface_role_commit,
+	.hold = layer_surface_role_hold,
+	.swap_held = layer_surface_role_swap_held,
 };
 
 static void handle_surface_destroyed(struct wl_listener *listener,
@@ -9,6 +9,7 @@
 #include <wlr/types/wlr_linux_dmabuf_v1.h>
 #include <wlr/util/log.h>
 #include "linux-dmabuf-unstable-v1-protocol.h"
+#include "types/wlr_client_usage.h"
 #include "util/signal.h"
 
 #define LINUX_DMABUF_VERSION 3
@@ -118,6 +119,8 @@ static void params_add(struct wl_client *client,
 static void buffer_handle_resource_destroy(struct wl_resource *buffer_resource) {
 	struct wlr_dmabuf_v1_buffer *buffer =
 		wlr_dmabuf_v1_buffer_from_buffer_resource(buffer_resource);
+	client_usage_remove_client(wl_resource_get_client(buffer_resource),
+		WLR_CLIENT_USAGE_DMABUF_BUFFERS, 1);
 	linux_dmabuf_buffer_destroy(buffer);
 }
 
@@ -247,9 +250,15 @@ static void params_create_common(struct wl_client *client,
 		goto err_failed;
 	}
 
+	if (!client_usage_add(client_usage_from_client(client),
+			WLR_CLIENT_USAGE_DMABUF_BUFFERS, 1)) {
+		goto err_out;
+	}
+
 	buffer->buffer_resource = wl_resource_create(client, &wl_buffer_interface,
 		1, buffer_id);
 	if (!buffer->buffer_resource) {
+		client_usage_remove_client(client, WLR_CLIENT_USAGE_DMABUF_BUFFERS, 1);
 		wl_resource_post_no_memory(params_resource);
 		goto err_failed;
 	}
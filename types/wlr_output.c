@@ -5,6 +5,7 @@
 #include <tgmath.h>
 #include <time.h>
 #include <wayland-server-core.h>
+#include <wlr/backend/interface.h>
 #include <wlr/interfaces/wlr_output.h>
 #include <wlr/render/interface.h>
 #include <wlr/render/wlr_renderer.h>
@@ -17,6 +18,7 @@
 #include <wlr/util/region.h>
 #include "util/global.h"
 #include "util/signal.h"
+#include "util/trace.h"
 
 #define OUTPUT_VERSION 3
 
@@ -135,6 +137,10 @@ void wlr_output_update_enabled(struct wlr_output *output, bool enabled) {
 static void output_update_matrix(struct wlr_output *output) {
 	wlr_matrix_projection(output->transform_matrix, output->width,
 		output->height, output->transform);
+	memcpy(output->scaled_transform_matrix, output->transform_matrix,
+		sizeof(output->transform_matrix));
+	wlr_matrix_scale(output->scaled_transform_matrix, output->scale,
+		output->scale);
 }
 
 void wlr_output_enable(struct wlr_output *output, bool enable) {
@@ -562,39 +568,34 @@ bool wlr_output_test(struct wlr_output *output) {
 	return output->impl->test(output);
 }
 
-bool wlr_output_commit(struct wlr_output *output) {
-	if (!output_basic_test(output)) {
-		wlr_log(WLR_ERROR, "Basic output test failed");
-		return false;
-	}
-
+static void output_precommit(struct wlr_output *output,
+		struct timespec *now) {
 	if ((output->pending.committed & WLR_OUTPUT_STATE_BUFFER) &&
 			output->idle_frame != NULL) {
 		wl_event_source_remove(output->idle_frame);
 		output->idle_frame = NULL;
 	}
 
-	struct timespec now;
-	clock_gettime(CLOCK_MONOTONIC, &now);
-
 	struct wlr_output_event_precommit event = {
 		.output = output,
-		.when = &now,
+		.when = now,
 	};
 	wlr_signal_emit_safe(&output->events.precommit, &event);
+}
 
-	if (!output->impl->commit(output)) {
-		output_state_clear(&output->pending);
-		return false;
-	}
-
+/**
+ * Update the output after the backend has successfully applied the pending
+ * state.
+ */
+static void output_commit_done(struct wlr_output *output,
+		struct timespec *now) {
 	if (output->pending.committed & WLR_OUTPUT_STATE_BUFFER) {
 		struct wlr_output_cursor *cursor;
 		wl_list_for_each(cursor, &output->cursors, link) {
 			if (!cursor->enabled || !cursor->visible || cursor->surface == NULL) {
 				continue;
 			}
-			wlr_surface_send_frame_done(cursor->surface, &now);
+			wlr_surface_send_frame_done(cursor->surface, now);
 		}
 	}
 
@@ -605,6 +606,7 @@ bool wlr_output_commit(struct wlr_output *output) {
 	bool scale_updated = output->pending.committed & WLR_OUTPUT_STATE_SCALE;
 	if (scale_updated) {
 		output->scale = output->pending.scale;
+		output_update_matrix(output);
 		wlr_signal_emit_safe(&output->events.scale, output);
 	}
 
@@ -635,9 +637,181 @@ bool wlr_output_commit(struct wlr_output *output) {
 	}
 
 	output_state_clear(&output->pending);
+}
+
+static bool output_commit(struct wlr_output *output, struct timespec *now) {
+	if (!output->impl->commit(output)) {
+		output_state_clear(&output->pending);
+		return false;
+	}
+
+	output_commit_done(output, now);
+	return true;
+}
+
+bool wlr_output_commit(struct wlr_output *output) {
+	TRACE_BEGIN("output_commit", output->name);
+
+	if (!output_basic_test(output)) {
+		wlr_log(WLR_ERROR, "Basic output test failed");
+		TRACE_END("output_commit", output->name);
+		return false;
+	}
+
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	output_precommit(output, &now);
+	bool ok = output_commit(output, &now);
+	TRACE_END("output_commit", output->name);
+	return ok;
+}
+
+/**
+ * Collect the outputs sharing the backend of `outputs[start]` which haven't
+ * been handled yet into `group`, and mark them as handled.
+ */
+static size_t output_group_by_backend(struct wlr_output **outputs,
+		size_t outputs_len, size_t start, bool *handled,
+		struct wlr_output **group) {
+	struct wlr_backend *backend = outputs[start]->backend;
+	size_t group_len = 0;
+	for (size_t i = start; i < outputs_len; ++i) {
+		if (!handled[i] && outputs[i]->backend == backend) {
+			group[group_len++] = outputs[i];
+			handled[i] = true;
+		}
+	}
+	return group_len;
+}
+
+/**
+ * Scratch arrays used to split a list of outputs by backend.
+ */
+struct output_groups {
+	bool *handled;
+	bool *committed;
+	struct wlr_output **group;
+};
+
+static bool output_groups_init(struct output_groups *groups,
+		size_t outputs_len) {
+	groups->handled = calloc(outputs_len, sizeof(bool));
+	groups->committed = calloc(outputs_len, sizeof(bool));
+	groups->group = calloc(outputs_len, sizeof(struct wlr_output *));
+	if (groups->handled == NULL || groups->committed == NULL ||
+			groups->group == NULL) {
+		wlr_log_errno(WLR_ERROR, "Allocation failed");
+		free(groups->handled);
+		free(groups->committed);
+		free(groups->group);
+		return false;
+	}
 	return true;
 }
 
+static void output_groups_finish(struct output_groups *groups) {
+	free(groups->handled);
+	free(groups->committed);
+	free(groups->group);
+}
+
+bool wlr_output_test_many(struct wlr_output **outputs, size_t outputs_len) {
+	if (outputs_len == 0) {
+		return true;
+	}
+
+	for (size_t i = 0; i < outputs_len; ++i) {
+		if (!output_basic_test(outputs[i])) {
+			return false;
+		}
+	}
+
+	struct output_groups groups;
+	if (!output_groups_init(&groups, outputs_len)) {
+		return false;
+	}
+
+	bool ok = true;
+	for (size_t i = 0; i < outputs_len && ok; ++i) {
+		if (groups.handled[i]) {
+			continue;
+		}
+
+		struct wlr_backend *backend = outputs[i]->backend;
+		size_t group_len = output_group_by_backend(outputs, outputs_len, i,
+			groups.handled, groups.group);
+		if (backend->impl->commit_outputs != NULL) {
+			ok = backend->impl->commit_outputs(backend, groups.group,
+				group_len, NULL);
+			continue;
+		}
+
+		for (size_t j = 0; j < group_len && ok; ++j) {
+			ok = groups.group[j]->impl->test(groups.group[j]);
+		}
+	}
+
+	output_groups_finish(&groups);
+	return ok;
+}
+
+bool wlr_output_commit_many(struct wlr_output **outputs, size_t outputs_len) {
+	if (outputs_len == 0) {
+		return true;
+	}
+
+	for (size_t i = 0; i < outputs_len; ++i) {
+		if (!output_basic_test(outputs[i])) {
+			wlr_log(WLR_ERROR, "Basic output test failed");
+			return false;
+		}
+	}
+
+	struct output_groups groups;
+	if (!output_groups_init(&groups, outputs_len)) {
+		return false;
+	}
+
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	for (size_t i = 0; i < outputs_len; ++i) {
+		output_precommit(outputs[i], &now);
+	}
+
+	bool ok = true;
+	for (size_t i = 0; i < outputs_len; ++i) {
+		if (groups.handled[i]) {
+			continue;
+		}
+
+		struct wlr_backend *backend = outputs[i]->backend;
+		size_t group_len = output_group_by_backend(outputs, outputs_len, i,
+			groups.handled, groups.group);
+		if (backend->impl->commit_outputs == NULL) {
+			for (size_t j = 0; j < group_len; ++j) {
+				ok = output_commit(groups.group[j], &now) && ok;
+			}
+			continue;
+		}
+
+		// The backend may have applied the state of some of the outputs only
+		ok = backend->impl->commit_outputs(backend, groups.group, group_len,
+			groups.committed) && ok;
+		for (size_t j = 0; j < group_len; ++j) {
+			if (groups.committed[j]) {
+				output_commit_done(groups.group[j], &now);
+			} else {
+				output_state_clear(&groups.group[j]->pending);
+			}
+		}
+	}
+
+	output_groups_finish(&groups);
+	return ok;
+}
+
 void wlr_output_rollback(struct wlr_output *output) {
 	if (output->impl->rollback_render &&
 			(output->pending.committed & WLR_OUTPUT_STATE_BUFFER) &&
@@ -811,27 +985,6 @@ void wlr_output_lock_software_cursors(struct wlr_output *output, bool lock) {
 	// again.
 }
 
-static void output_scissor(struct wlr_output *output, pixman_box32_t *rect) {
-	struct wlr_renderer *renderer = wlr_backend_get_renderer(output->backend);
-	assert(renderer);
-
-	struct wlr_box box = {
-		.x = rect->x1,
-		.y = rect->y1,
-		.width = rect->x2 - rect->x1,
-		.height = rect->y2 - rect->y1,
-	};
-
-	int ow, oh;
-	wlr_output_transformed_resolution(output, &ow, &oh);
-
-	enum wl_output_transform transform =
-		wlr_output_transform_invert(output->transform);
-	wlr_box_transform(&box, &box, transform, ow, oh);
-
-	wlr_renderer_scissor(renderer, &box);
-}
-
 static void output_cursor_get_box(struct wlr_output_cursor *cursor,
 	struct wlr_box *box);
 
@@ -865,10 +1018,22 @@ static void output_cursor_render(struct wlr_output_cursor *cursor,
 	wlr_matrix_project_box(matrix, &box, WL_OUTPUT_TRANSFORM_NORMAL, 0,
 		cursor->output->transform_matrix);
 
+	// Scissor boxes are in buffer coordinates, transform all of them at once
+	int ow, oh;
+	wlr_output_transformed_resolution(cursor->output, &ow, &oh);
+	wlr_region_transform(&surface_damage, &surface_damage,
+		wlr_output_transform_invert(cursor->output->transform), ow, oh);
+
 	int nrects;
 	pixman_box32_t *rects = pixman_region32_rectangles(&surface_damage, &nrects);
 	for (int i = 0; i < nrects; ++i) {
-		output_scissor(cursor->output, &rects[i]);
+		struct wlr_box scissor_box = {
+			.x = rects[i].x1,
+			.y = rects[i].y1,
+			.width = rects[i].x2 - rects[i].x1,
+			.height = rects[i].y2 - rects[i].y1,
+		};
+		wlr_renderer_scissor(renderer, &scissor_box);
 		wlr_render_texture_with_matrix(renderer, texture, matrix, 1.0f);
 	}
 	wlr_renderer_scissor(renderer, NULL);
@@ -1,10 +1,13 @@
+#include <assert.h>
 #include <stddef.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 #include <wayland-server-core.h>
 #include <wlr/types/wlr_box.h>
 #include <wlr/types/wlr_output_damage.h>
 #include <wlr/types/wlr_output.h>
+#include <wlr/util/region.h>
 #include "util/signal.h"
 
 static void output_handle_destroy(struct wl_listener *listener, void *data) {
@@ -70,8 +73,8 @@ static void output_handle_commit(struct wl_listener *listener, void *data) {
 		// render-buffers have been swapped, rotate the damage
 
 		// same as decrementing, but works on unsigned integers
-		output_damage->previous_idx += WLR_OUTPUT_DAMAGE_PREVIOUS_LEN - 1;
-		output_damage->previous_idx %= WLR_OUTPUT_DAMAGE_PREVIOUS_LEN;
+		output_damage->previous_idx += output_damage->previous_len - 1;
+		output_damage->previous_idx %= output_damage->previous_len;
 
 		prev = &output_damage->previous[output_damage->previous_idx];
 		pixman_region32_copy(prev, &output_damage->current);
@@ -95,11 +98,13 @@ struct wlr_output_damage *wlr_output_damage_create(struct wlr_output *output) {
 
 	output_damage->output = output;
 	output_damage->max_rects = 20;
+	output_damage->rect_cost = 64 * 64;
+	output_damage->previous_len = WLR_OUTPUT_DAMAGE_PREVIOUS_LEN;
 	wl_signal_init(&output_damage->events.frame);
 	wl_signal_init(&output_damage->events.destroy);
 
 	pixman_region32_init(&output_damage->current);
-	for (size_t i = 0; i < WLR_OUTPUT_DAMAGE_PREVIOUS_LEN; ++i) {
+	for (size_t i = 0; i < WLR_OUTPUT_DAMAGE_PREVIOUS_MAX_LEN; ++i) {
 		pixman_region32_init(&output_damage->previous[i]);
 	}
 
@@ -137,12 +142,42 @@ void wlr_output_damage_destroy(struct wlr_output_damage *output_damage) {
 	wl_list_remove(&output_damage->output_frame.link);
 	wl_list_remove(&output_damage->output_commit.link);
 	pixman_region32_fini(&output_damage->current);
-	for (size_t i = 0; i < WLR_OUTPUT_DAMAGE_PREVIOUS_LEN; ++i) {
+	for (size_t i = 0; i < WLR_OUTPUT_DAMAGE_PREVIOUS_MAX_LEN; ++i) {
 		pixman_region32_fini(&output_damage->previous[i]);
 	}
 	free(output_damage);
 }
 
+/**
+ * Grows the damage history, for backends with more buffers than expected. The
+ * damage of the frames before the history was grown is unknown, so the new
+ * entries contain the whole output.
+ */
+static void output_damage_grow_previous(
+		struct wlr_output_damage *output_damage, size_t len) {
+	size_t old_len = output_damage->previous_len;
+	assert(len > old_len && len <= WLR_OUTPUT_DAMAGE_PREVIOUS_MAX_LEN);
+
+	// Unroll the circular queue, oldest entries last
+	pixman_region32_t previous[WLR_OUTPUT_DAMAGE_PREVIOUS_MAX_LEN];
+	for (size_t i = 0; i < old_len; ++i) {
+		size_t j = (output_damage->previous_idx + i) % old_len;
+		previous[i] = output_damage->previous[j];
+	}
+	memcpy(output_damage->previous, previous,
+		old_len * sizeof(pixman_region32_t));
+
+	int width, height;
+	wlr_output_transformed_resolution(output_damage->output, &width, &height);
+	for (size_t i = old_len; i < len; ++i) {
+		pixman_region32_union_rect(&output_damage->previous[i],
+			&output_damage->previous[i], 0, 0, width, height);
+	}
+
+	output_damage->previous_idx = 0;
+	output_damage->previous_len = len;
+}
+
 bool wlr_output_damage_attach_render(struct wlr_output_damage *output_damage,
 		bool *needs_frame, pixman_region32_t *damage) {
 	struct wlr_output *output = output_damage->output;
@@ -155,7 +190,15 @@ bool wlr_output_damage_attach_render(struct wlr_output_damage *output_damage,
 	*needs_frame =
 		output->needs_frame || pixman_region32_not_empty(&output_damage->current);
 	// Check if we can use damage tracking
-	if (buffer_age <= 0 || buffer_age - 1 > WLR_OUTPUT_DAMAGE_PREVIOUS_LEN) {
+	if (buffer_age <= 0 ||
+			(size_t)buffer_age - 1 > output_damage->previous_len) {
+		if (buffer_age > 0 &&
+				buffer_age - 1 <= WLR_OUTPUT_DAMAGE_PREVIOUS_MAX_LEN) {
+			// The backend has more buffers than the history, the next time
+			// this buffer is used its damage will be known
+			output_damage_grow_previous(output_damage, buffer_age - 1);
+		}
+
 		int width, height;
 		wlr_output_transformed_resolution(output, &width, &height);
 
@@ -168,17 +211,13 @@ bool wlr_output_damage_attach_render(struct wlr_output_damage *output_damage,
 		// Accumulate damage from old buffers
 		size_t idx = output_damage->previous_idx;
 		for (int i = 0; i < buffer_age - 1; ++i) {
-			int j = (idx + i) % WLR_OUTPUT_DAMAGE_PREVIOUS_LEN;
+			int j = (idx + i) % output_damage->previous_len;
 			pixman_region32_union(damage, damage, &output_damage->previous[j]);
 		}
 
-		// Check the number of rectangles
-		int n_rects = pixman_region32_n_rects(damage);
-		if (n_rects > output_damage->max_rects) {
-			pixman_box32_t *extents = pixman_region32_extents(damage);
-			pixman_region32_union_rect(damage, damage, extents->x1, extents->y1,
-				extents->x2 - extents->x1, extents->y2 - extents->y1);
-		}
+		// Trade a few more painted pixels for fewer rectangles
+		wlr_region_merge_rects(damage, damage, output_damage->rect_cost,
+			output_damage->max_rects);
 	}
 
 	return true;
@@ -507,6 +507,57 @@ void wlr_output_configuration_v1_send_failed(
 	config->finished = true;
 }
 
+bool wlr_output_configuration_v1_apply(
+		struct wlr_output_configuration_v1 *config, bool test_only) {
+	size_t outputs_len = wl_list_length(&config->heads);
+	if (outputs_len == 0) {
+		return true;
+	}
+
+	struct wlr_output **outputs = calloc(outputs_len, sizeof(outputs[0]));
+	if (outputs == NULL) {
+		wlr_log_errno(WLR_ERROR, "Allocation failed");
+		return false;
+	}
+	size_t i = 0;
+	struct wlr_output_configuration_head_v1 *config_head;
+	wl_list_for_each(config_head, &config->heads, link) {
+		struct wlr_output_head_v1_state *state = &config_head->state;
+		struct wlr_output *output = state->output;
+		outputs[i++] = output;
+
+		wlr_output_enable(output, state->enabled);
+		if (!state->enabled) {
+			continue;
+		}
+		if (state->mode != NULL) {
+			wlr_output_set_mode(output, state->mode);
+		} else {
+			wlr_output_set_custom_mode(output, state->custom_mode.width,
+				state->custom_mode.height, state->custom_mode.refresh);
+		}
+		wlr_output_set_transform(output, state->transform);
+		wlr_output_set_scale(output, state->scale);
+	}
+
+	bool ok;
+	if (test_only) {
+		ok = wlr_output_test_many(outputs, outputs_len);
+		for (i = 0; i < outputs_len; ++i) {
+			wlr_output_rollback(outputs[i]);
+		}
+	} else {
+		ok = wlr_output_commit_many(outputs, outputs_len);
+		if (!ok) {
+			for (i = 0; i < outputs_len; ++i) {
+				wlr_output_rollback(outputs[i]);
+			}
+		}
+	}
+	free(outputs);
+	return ok;
+}
+
 
 static const struct zwlr_output_manager_v1_interface manager_impl;
 
@@ -2,6 +2,7 @@
 #include <stdlib.h>
 #include <wlr/types/wlr_primary_selection.h>
 #include <wlr/util/log.h>
+#include "types/wlr_selection_cache.h"
 #include "util/signal.h"
 
 void wlr_primary_selection_source_init(
@@ -37,6 +38,10 @@ void wlr_primary_selection_source_destroy(
 void wlr_primary_selection_source_send(
 		struct wlr_primary_selection_source *source, const char *mime_type,
 		int32_t fd) {
+	if (source->cache != NULL &&
+			selection_cache_source_send(source->cache, mime_type, fd)) {
+		return;
+	}
 	source->impl->send(source, mime_type, fd);
 }
 
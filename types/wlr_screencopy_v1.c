@@ -1,5 +1,6 @@
 #include <assert.h>
 #include <stdlib.h>
+#include <string.h>
 #include <drm_fourcc.h>
 #include <wlr/render/wlr_renderer.h>
 #include <wlr/types/wlr_output.h>
@@ -11,6 +12,8 @@
 #include "util/signal.h"
 
 #define SCREENCOPY_MANAGER_VERSION 3
+// Above this, damage is read back as its bounding box
+#define SCREENCOPY_MAX_READ_RECTS 8
 
 struct screencopy_damage {
 	struct wl_list link;
@@ -19,6 +22,26 @@ struct screencopy_damage {
 	struct wl_listener output_precommit;
 	struct wl_listener output_destroy;
 	uint32_t last_commit_seq;
+
+	// Buffer and box of the last copy, the damage is relative to them
+	struct wl_resource *buffer;
+	struct wlr_box box;
+	struct wl_listener buffer_destroy;
+};
+
+/**
+ * Per-output state shared by all frames capturing an output.
+ */
+struct screencopy_output {
+	struct wl_list link; // wlr_screencopy_manager_v1::outputs
+	struct wlr_output *output;
+	struct wl_listener output_destroy;
+
+	// Output pixels read back once per commit and copied to each frame
+	void *staging;
+	size_t staging_size;
+
+	struct wlr_screencopy_v1_output_stats stats;
 };
 
 static const struct zwlr_screencopy_frame_v1_interface frame_impl;
@@ -62,6 +85,7 @@ static void screencopy_damage_handle_output_precommit(
 }
 
 static void screencopy_damage_destroy(struct screencopy_damage *damage) {
+	wl_list_remove(&damage->buffer_destroy.link);
 	wl_list_remove(&damage->output_destroy.link);
 	wl_list_remove(&damage->output_precommit.link);
 	wl_list_remove(&damage->link);
@@ -76,6 +100,35 @@ static void screencopy_damage_handle_output_destroy(
 	screencopy_damage_destroy(damage);
 }
 
+static void screencopy_damage_handle_buffer_destroy(
+		struct wl_listener *listener, void *data) {
+	struct screencopy_damage *damage =
+		wl_container_of(listener, damage, buffer_destroy);
+	wl_list_remove(&damage->buffer_destroy.link);
+	wl_list_init(&damage->buffer_destroy.link);
+	damage->buffer = NULL;
+}
+
+/**
+ * Damage is only tracked for the buffer and box of the previous copy. Copying
+ * into any other buffer damages the whole output.
+ */
+static void screencopy_damage_set_buffer(struct screencopy_damage *damage,
+		struct wl_resource *buffer, const struct wlr_box *box) {
+	if (damage->buffer == buffer && memcmp(&damage->box, box,
+			sizeof(*box)) == 0) {
+		return;
+	}
+
+	pixman_region32_union_rect(&damage->damage, &damage->damage, 0, 0,
+		damage->output->width, damage->output->height);
+
+	wl_list_remove(&damage->buffer_destroy.link);
+	wl_resource_add_destroy_listener(buffer, &damage->buffer_destroy);
+	damage->buffer = buffer;
+	damage->box = *box;
+}
+
 static struct screencopy_damage *screencopy_damage_create(
 		struct wlr_screencopy_v1_client *client,
 		struct wlr_output *output) {
@@ -98,6 +151,9 @@ static struct screencopy_damage *screencopy_damage_create(
 	wl_signal_add(&output->events.destroy, &damage->output_destroy);
 	damage->output_destroy.notify = screencopy_damage_handle_output_destroy;
 
+	wl_list_init(&damage->buffer_destroy.link);
+	damage->buffer_destroy.notify = screencopy_damage_handle_buffer_destroy;
+
 	return damage;
 }
 
@@ -152,76 +208,81 @@ static void frame_destroy(struct wlr_screencopy_frame_v1 *frame) {
 	free(frame);
 }
 
-static void frame_handle_output_precommit(struct wl_listener *listener,
-		void *_data) {
-	struct wlr_screencopy_frame_v1 *frame =
-		wl_container_of(listener, frame, output_precommit);
-	struct wlr_output_event_precommit *event = _data;
-	struct wlr_output *output = frame->output;
-	struct wlr_renderer *renderer = wlr_backend_get_renderer(output->backend);
-	assert(renderer);
-
-	if (!(output->pending.committed & WLR_OUTPUT_STATE_BUFFER)) {
-		return;
-	}
-
-	struct screencopy_damage *damage = NULL;
-	if (frame->with_damage) {
-		damage = screencopy_damage_get_or_create(frame->client, output);
-		if (damage) {
-			screencopy_damage_accumulate(damage);
-			if (!pixman_region32_not_empty(&damage->damage)) {
-				return;
-			}
+static struct screencopy_output *screencopy_output_find(
+		struct wlr_screencopy_manager_v1 *manager,
+		struct wlr_output *output) {
+	struct screencopy_output *sc_output;
+	wl_list_for_each(sc_output, &manager->outputs, link) {
+		if (sc_output->output == output) {
+			return sc_output;
 		}
 	}
+	return NULL;
+}
 
-	wl_list_remove(&frame->output_precommit.link);
-	wl_list_init(&frame->output_precommit.link);
+static void screencopy_output_destroy(struct screencopy_output *sc_output) {
+	wl_list_remove(&sc_output->output_destroy.link);
+	wl_list_remove(&sc_output->link);
+	free(sc_output->staging);
+	free(sc_output);
+}
 
-	int x = frame->box.x;
-	int y = frame->box.y;
+static void screencopy_output_handle_output_destroy(
+		struct wl_listener *listener, void *data) {
+	struct screencopy_output *sc_output =
+		wl_container_of(listener, sc_output, output_destroy);
+	screencopy_output_destroy(sc_output);
+}
 
-	bool ok = false;
-	uint32_t flags = 0;
+static struct screencopy_output *screencopy_output_get_or_create(
+		struct wlr_screencopy_manager_v1 *manager,
+		struct wlr_output *output) {
+	struct screencopy_output *sc_output =
+		screencopy_output_find(manager, output);
+	if (sc_output != NULL) {
+		return sc_output;
+	}
 
-	struct wl_shm_buffer *shm_buffer = frame->shm_buffer;
-	struct wlr_dmabuf_v1_buffer *dma_buffer = frame->dma_buffer;
-	assert(shm_buffer || dma_buffer);
+	sc_output = calloc(1, sizeof(struct screencopy_output));
+	if (sc_output == NULL) {
+		return NULL;
+	}
+	sc_output->output = output;
+	wl_list_insert(&manager->outputs, &sc_output->link);
 
-	if (shm_buffer) {
-		enum wl_shm_format fmt = wl_shm_buffer_get_format(shm_buffer);
-		int32_t width = wl_shm_buffer_get_width(shm_buffer);
-		int32_t height = wl_shm_buffer_get_height(shm_buffer);
-		int32_t stride = wl_shm_buffer_get_stride(shm_buffer);
+	wl_signal_add(&output->events.destroy, &sc_output->output_destroy);
+	sc_output->output_destroy.notify = screencopy_output_handle_output_destroy;
 
-		wl_shm_buffer_begin_access(shm_buffer);
-		void *data = wl_shm_buffer_get_data(shm_buffer);
-		uint32_t renderer_flags = 0;
-		ok = wlr_renderer_read_pixels(renderer, fmt, &renderer_flags,
-				stride, width, height, x, y, 0, 0, data);
-		flags |= renderer_flags & WLR_RENDERER_READ_PIXELS_Y_INVERT ?
-				ZWLR_SCREENCOPY_FRAME_V1_FLAGS_Y_INVERT : 0;
-		wl_shm_buffer_end_access(shm_buffer);
-	} else if (dma_buffer) {
-		struct wlr_dmabuf_attributes attr = { 0 };
-		ok = wlr_output_export_dmabuf(frame->output, &attr);
-		ok = ok && wlr_renderer_blit_dmabuf(renderer,
-				&dma_buffer->attributes, &attr);
-		flags |= attr.flags & WLR_DMABUF_ATTRIBUTES_FLAGS_Y_INVERT ?
-				ZWLR_SCREENCOPY_FRAME_V1_FLAGS_Y_INVERT : 0;
-		wlr_dmabuf_attributes_finish(&attr);
+	return sc_output;
+}
+
+/**
+ * Check whether the frame has something to copy on this commit. Frames
+ * waiting for damage are skipped until the output is damaged.
+ */
+static bool frame_is_ready(struct wlr_screencopy_frame_v1 *frame) {
+	if (!frame->with_damage) {
+		return true;
 	}
 
-	if (!ok) {
-		zwlr_screencopy_frame_v1_send_failed(frame->resource);
-		frame_destroy(frame);
-		return;
+	struct screencopy_damage *damage =
+		screencopy_damage_get_or_create(frame->client, frame->output);
+	if (damage == NULL) {
+		return true;
 	}
+	screencopy_damage_accumulate(damage);
+	return pixman_region32_not_empty(&damage->damage);
+}
 
+static void frame_send_ready(struct wlr_screencopy_frame_v1 *frame,
+		uint32_t flags, struct timespec *when) {
 	zwlr_screencopy_frame_v1_send_flags(frame->resource, flags);
 
 	// TODO: send fine-grained damage events
+	struct screencopy_damage *damage = NULL;
+	if (frame->with_damage) {
+		damage = screencopy_damage_find(frame->client, frame->output);
+	}
 	if (damage) {
 		struct pixman_box32 *damage_box =
 			pixman_region32_extents(&damage->damage);
@@ -237,12 +298,274 @@ static void frame_handle_output_precommit(struct wl_listener *listener,
 		pixman_region32_clear(&damage->damage);
 	}
 
-	time_t tv_sec = event->when->tv_sec;
+	time_t tv_sec = when->tv_sec;
 	uint32_t tv_sec_hi = (sizeof(tv_sec) > 4) ? tv_sec >> 32 : 0;
 	uint32_t tv_sec_lo = tv_sec & 0xFFFFFFFF;
 	zwlr_screencopy_frame_v1_send_ready(frame->resource,
-		tv_sec_hi, tv_sec_lo, event->when->tv_nsec);
+		tv_sec_hi, tv_sec_lo, when->tv_nsec);
+}
+
+static bool frame_copy_dmabuf(struct wlr_screencopy_frame_v1 *frame,
+		uint32_t *flags) {
+	struct wlr_renderer *renderer =
+		wlr_backend_get_renderer(frame->output->backend);
+	struct wlr_dmabuf_attributes attr = { 0 };
+	bool ok = wlr_output_export_dmabuf(frame->output, &attr);
+	ok = ok && wlr_renderer_blit_dmabuf(renderer,
+			&frame->dma_buffer->attributes, &attr);
+	*flags = attr.flags & WLR_DMABUF_ATTRIBUTES_FLAGS_Y_INVERT ?
+			ZWLR_SCREENCOPY_FRAME_V1_FLAGS_Y_INVERT : 0;
+	wlr_dmabuf_attributes_finish(&attr);
+	return ok;
+}
+
+/**
+ * Copy the region of the output out of the staging buffer into the frame's
+ * buffer. The staging buffer contains the `staging` box of the output, stored
+ * bottom-up if `y_invert` is set. The frame's buffer is always top-down.
+ */
+static void frame_copy_from_staging(struct wlr_screencopy_frame_v1 *frame,
+		struct screencopy_output *sc_output, const struct wlr_box *staging,
+		bool y_invert, pixman_region32_t *region) {
+	struct wl_shm_buffer *shm_buffer = frame->shm_buffer;
+	int32_t stride = wl_shm_buffer_get_stride(shm_buffer);
+	const struct wlr_box *box = &frame->box;
+	size_t staging_stride = 4 * staging->width;
+	const unsigned char *src = sc_output->staging;
+
+	wl_shm_buffer_begin_access(shm_buffer);
+	unsigned char *data = wl_shm_buffer_get_data(shm_buffer);
+	int rects_len;
+	pixman_box32_t *rects = pixman_region32_rectangles(region, &rects_len);
+	for (int i = 0; i < rects_len; ++i) {
+		size_t row_size = 4 * (rects[i].x2 - rects[i].x1);
+		size_t src_x = 4 * (rects[i].x1 - staging->x);
+		size_t dst_x = 4 * (rects[i].x1 - box->x);
+		for (int y = rects[i].y1; y < rects[i].y2; ++y) {
+			size_t src_y = y_invert ?
+				staging->y + staging->height - 1 - y : y - staging->y;
+			memcpy(data + (y - box->y) * stride + dst_x,
+				src + src_y * staging_stride + src_x, row_size);
+		}
+	}
+	wl_shm_buffer_end_access(shm_buffer);
+}
+
+/**
+ * Get the part of the output to copy into the frame's buffer, in buffer
+ * coordinates. Frames copied with damage only need their damaged part, the
+ * rest of their buffer is left untouched since the previous copy.
+ */
+static void frame_get_copy_region(struct wlr_screencopy_frame_v1 *frame,
+		pixman_region32_t *region) {
+	const struct wlr_box *box = &frame->box;
+	pixman_region32_init_rect(region, box->x, box->y, box->width, box->height);
+
+	struct screencopy_damage *damage = NULL;
+	if (frame->with_damage) {
+		damage = screencopy_damage_find(frame->client, frame->output);
+	}
+	if (damage != NULL) {
+		pixman_region32_intersect(region, region, &damage->damage);
+	}
+}
+
+/**
+ * Read a region of the output into a buffer containing the `dst` box. Each
+ * rectangle is read separately unless there are too many of them.
+ */
+static bool read_region(struct wlr_renderer *renderer,
+		enum wl_shm_format fmt, uint32_t *flags, pixman_region32_t *region,
+		const struct wlr_box *dst, uint32_t stride, void *data,
+		uint64_t *bytes_read) {
+	int rects_len;
+	pixman_box32_t *rects = pixman_region32_rectangles(region, &rects_len);
+	if (rects_len > SCREENCOPY_MAX_READ_RECTS) {
+		rects = pixman_region32_extents(region);
+		rects_len = 1;
+	}
+	if (rects_len != 1 || rects[0].x1 != dst->x || rects[0].y1 != dst->y ||
+			rects[0].x2 - rects[0].x1 != dst->width ||
+			rects[0].y2 - rects[0].y1 != dst->height) {
+		// Partial reads can't be Y-inverted
+		flags = NULL;
+	}
+
+	if (flags != NULL) {
+		*flags = 0;
+	}
+	for (int i = 0; i < rects_len; ++i) {
+		uint32_t width = rects[i].x2 - rects[i].x1;
+		uint32_t height = rects[i].y2 - rects[i].y1;
+		if (!wlr_renderer_read_pixels(renderer, fmt, flags, stride,
+				width, height, rects[i].x1, rects[i].y1,
+				rects[i].x1 - dst->x, rects[i].y1 - dst->y, data)) {
+			return false;
+		}
+		*bytes_read += (uint64_t)4 * width * height;
+	}
+	return true;
+}
+
+struct screencopy_copy {
+	struct wlr_screencopy_frame_v1 *frame;
+	pixman_region32_t region;
+	uint32_t renderer_flags;
+};
+
+/**
+ * Copy all shm frames ready on this commit with a single readback: the union
+ * of the regions they need is read into a staging buffer, then each frame
+ * gets its region copied out of it.
+ */
+static void copy_shm_frames(struct wlr_screencopy_frame_v1 *frame,
+		struct timespec *when) {
+	struct wlr_screencopy_manager_v1 *manager = frame->client->manager;
+	struct wlr_output *output = frame->output;
+	struct wlr_renderer *renderer = wlr_backend_get_renderer(output->backend);
+	enum wl_shm_format fmt = frame->format;
+
+	struct wl_array copies;
+	wl_array_init(&copies);
+
+	pixman_region32_t region;
+	pixman_region32_init(&region);
+	struct wlr_screencopy_frame_v1 *other;
+	wl_list_for_each(other, &manager->frames, link) {
+		if (other != frame && (other->output != output ||
+				other->shm_buffer == NULL || other->format != fmt ||
+				wl_list_empty(&other->output_precommit.link) ||
+				!frame_is_ready(other))) {
+			continue;
+		}
+
+		struct screencopy_copy *copy = wl_array_add(&copies, sizeof(*copy));
+		if (copy == NULL) {
+			continue;
+		}
+		copy->frame = other;
+		copy->renderer_flags = 0;
+		frame_get_copy_region(other, &copy->region);
+		pixman_region32_union(&region, &region, &copy->region);
+
+		// Don't let the frame's own precommit handler copy it again
+		wl_list_remove(&other->output_precommit.link);
+		wl_list_init(&other->output_precommit.link);
+	}
+
+	size_t copies_len = copies.size / sizeof(struct screencopy_copy);
+	struct screencopy_copy *copies_data = copies.data;
+	struct screencopy_output *sc_output =
+		screencopy_output_get_or_create(manager, output);
+	uint64_t bytes_read = 0;
+
+	bool ok = true;
+	bool direct = copies_len == 1 || sc_output == NULL;
+	bool staging_y_invert = false;
+	struct wlr_box staging = {0};
+	wlr_box_from_pixman_box32(&staging, *pixman_region32_extents(&region));
+	if (direct) {
+		// Read each frame straight into its buffer
+		for (size_t i = 0; i < copies_len && ok; ++i) {
+			struct wlr_screencopy_frame_v1 *f = copies_data[i].frame;
+			// The buffer of a frame copied with damage keeps the content of
+			// previous copies, so it's always read top-down
+			uint32_t *renderer_flags = f->with_damage ?
+				NULL : &copies_data[i].renderer_flags;
+			struct wl_shm_buffer *shm_buffer = f->shm_buffer;
+			wl_shm_buffer_begin_access(shm_buffer);
+			ok = read_region(renderer, fmt, renderer_flags,
+				&copies_data[i].region, &f->box,
+				wl_shm_buffer_get_stride(shm_buffer),
+				wl_shm_buffer_get_data(shm_buffer), &bytes_read);
+			wl_shm_buffer_end_access(shm_buffer);
+		}
+	} else {
+		size_t staging_size = (size_t)4 * staging.width * staging.height;
+		if (sc_output->staging_size < staging_size) {
+			void *data = realloc(sc_output->staging, staging_size);
+			if (data != NULL) {
+				sc_output->staging = data;
+				sc_output->staging_size = staging_size;
+			}
+		}
+		if (sc_output->staging_size >= staging_size) {
+			uint32_t renderer_flags = 0;
+			ok = read_region(renderer, fmt, &renderer_flags, &region,
+				&staging, 4 * staging.width, sc_output->staging,
+				&bytes_read);
+			staging_y_invert =
+				renderer_flags & WLR_RENDERER_READ_PIXELS_Y_INVERT;
+		} else {
+			wlr_log_errno(WLR_ERROR, "Allocation failed");
+			ok = false;
+		}
+	}
+
+	if (sc_output != NULL && bytes_read > 0) {
+		sc_output->stats.readbacks++;
+		sc_output->stats.bytes_read += bytes_read;
+	}
+
+	for (size_t i = 0; i < copies_len; ++i) {
+		struct wlr_screencopy_frame_v1 *f = copies_data[i].frame;
+		uint32_t flags = 0;
+		if (!ok) {
+			zwlr_screencopy_frame_v1_send_failed(f->resource);
+		} else if (!direct) {
+			frame_copy_from_staging(f, sc_output, &staging, staging_y_invert,
+				&copies_data[i].region);
+		} else if (copies_data[i].renderer_flags &
+				WLR_RENDERER_READ_PIXELS_Y_INVERT) {
+			flags = ZWLR_SCREENCOPY_FRAME_V1_FLAGS_Y_INVERT;
+		}
+		if (ok) {
+			if (sc_output != NULL) {
+				sc_output->stats.frames++;
+			}
+			frame_send_ready(f, flags, when);
+		}
+		pixman_region32_fini(&copies_data[i].region);
+		frame_destroy(f);
+	}
 
+	pixman_region32_fini(&region);
+	wl_array_release(&copies);
+}
+
+static void frame_handle_output_precommit(struct wl_listener *listener,
+		void *_data) {
+	struct wlr_screencopy_frame_v1 *frame =
+		wl_container_of(listener, frame, output_precommit);
+	struct wlr_output_event_precommit *event = _data;
+	struct wlr_output *output = frame->output;
+	assert(wlr_backend_get_renderer(output->backend));
+
+	if (!(output->pending.committed & WLR_OUTPUT_STATE_BUFFER)) {
+		return;
+	}
+
+	if (!frame_is_ready(frame)) {
+		return;
+	}
+
+	assert(frame->shm_buffer || frame->dma_buffer);
+	if (frame->shm_buffer) {
+		copy_shm_frames(frame, event->when);
+		return;
+	}
+
+	wl_list_remove(&frame->output_precommit.link);
+	wl_list_init(&frame->output_precommit.link);
+
+	uint32_t flags = 0;
+	if (!frame_copy_dmabuf(frame, &flags)) {
+		zwlr_screencopy_frame_v1_send_failed(frame->resource);
+		frame_destroy(frame);
+		return;
+	}
+
+	frame_send_ready(frame, flags, event->when);
 	frame_destroy(frame);
 }
 
@@ -358,6 +681,14 @@ static void frame_handle_copy(struct wl_client *wl_client,
 		return;
 	}
 
+	if (frame->with_damage && shm_buffer != NULL) {
+		struct screencopy_damage *damage =
+			screencopy_damage_get_or_create(frame->client, output);
+		if (damage != NULL) {
+			screencopy_damage_set_buffer(damage, buffer_resource, &frame->box);
+		}
+	}
+
 	frame->shm_buffer = shm_buffer;
 	frame->dma_buffer = dma_buffer;
 
@@ -608,6 +939,10 @@ static void handle_display_destroy(struct wl_listener *listener, void *data) {
 		wl_container_of(listener, manager, display_destroy);
 	wlr_signal_emit_safe(&manager->events.destroy, manager);
 	wl_list_remove(&manager->display_destroy.link);
+	struct screencopy_output *sc_output, *tmp;
+	wl_list_for_each_safe(sc_output, tmp, &manager->outputs, link) {
+		screencopy_output_destroy(sc_output);
+	}
 	wl_global_destroy(manager->global);
 	free(manager);
 }
@@ -628,6 +963,7 @@ struct wlr_screencopy_manager_v1 *wlr_screencopy_manager_v1_create(
 		return NULL;
 	}
 	wl_list_init(&manager->frames);
+	wl_list_init(&manager->outputs);
 
 	wl_signal_init(&manager->events.destroy);
 
@@ -636,3 +972,15 @@ struct wlr_screencopy_manager_v1 *wlr_screencopy_manager_v1_create(
 
 	return manager;
 }
+
+bool wlr_screencopy_manager_v1_get_output_stats(
+		struct wlr_screencopy_manager_v1 *manager, struct wlr_output *output,
+		struct wlr_screencopy_v1_output_stats *stats) {
+	struct screencopy_output *sc_output =
+		screencopy_output_find(manager, output);
+	if (sc_output == NULL) {
+		return false;
+	}
+	*stats = sc_output->stats;
+	return true;
+}
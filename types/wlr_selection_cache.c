@@ -0,0 +1,478 @@
+#define _POSIX_C_SOURCE 200809L
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/sendfile.h>
+#include <unistd.h>
+#include <wayland-server-core.h>
+#include <wlr/types/wlr_data_device.h>
+#include <wlr/types/wlr_primary_selection.h>
+#include <wlr/types/wlr_selection_cache.h>
+#include <wlr/util/log.h>
+#include "types/wlr_selection_cache.h"
+#include "util/shm.h"
+#include "util/signal.h"
+
+enum cache_entry_state {
+	CACHE_ENTRY_FETCHING,
+	CACHE_ENTRY_READY,
+	CACHE_ENTRY_UNCACHEABLE,
+};
+
+/**
+ * Per-source cache state, attached to a wlr_data_source or a
+ * wlr_primary_selection_source while it is the seat's selection.
+ */
+struct wlr_selection_cache_source {
+	struct wlr_selection_cache *cache;
+	struct wl_list link; // wlr_selection_cache::sources
+
+	// Exactly one of these is set
+	struct wlr_data_source *data_source;
+	struct wlr_primary_selection_source *primary_source;
+
+	struct wl_list entries; // cache_entry::link
+	size_t size; // bytes stored for all entries
+
+	struct wl_listener source_destroy;
+};
+
+struct cache_entry {
+	struct wlr_selection_cache_source *cache_source;
+	struct wl_list link; // wlr_selection_cache_source::entries
+	char *mime_type;
+	enum cache_entry_state state;
+
+	int data_fd;
+	size_t size;
+
+	// While fetching
+	int pipe_fd;
+	struct wl_event_source *pipe_source;
+	struct wl_list waiters; // cache_transfer::link
+};
+
+/**
+ * A consumer's request being served from the cache.
+ */
+struct cache_transfer {
+	struct wl_list link; // wlr_selection_cache::transfers, cache_entry::waiters
+	int fd;
+	int data_fd; // -1 while waiting
+	off_t offset;
+	size_t size;
+	struct wl_event_source *event_source;
+};
+
+static void transfer_destroy(struct cache_transfer *transfer) {
+	if (transfer->event_source != NULL) {
+		wl_event_source_remove(transfer->event_source);
+	}
+	if (transfer->data_fd >= 0) {
+		close(transfer->data_fd);
+	}
+	close(transfer->fd);
+	wl_list_remove(&transfer->link);
+	free(transfer);
+}
+
+static int transfer_handle_writable(int fd, uint32_t mask, void *data) {
+	struct cache_transfer *transfer = data;
+
+	while ((size_t)transfer->offset < transfer->size) {
+		ssize_t n = sendfile(transfer->fd, transfer->data_fd,
+			&transfer->offset, transfer->size - transfer->offset);
+		if (n < 0 && errno == EAGAIN) {
+			return 0;
+		} else if (n < 0 && errno == EINTR) {
+			continue;
+		} else if (n <= 0) {
+			if (n < 0 && errno != EPIPE) {
+				wlr_log_errno(WLR_DEBUG, "Failed to send cached selection");
+			}
+			break;
+		}
+	}
+
+	transfer_destroy(transfer);
+	return 0;
+}
+
+static void transfer_start(struct wlr_selection_cache *cache,
+		struct cache_transfer *transfer, struct cache_entry *entry) {
+	wl_list_remove(&transfer->link);
+	wl_list_insert(&cache->transfers, &transfer->link);
+
+	transfer->size = entry->size;
+	transfer->data_fd = fcntl(entry->data_fd, F_DUPFD_CLOEXEC, 0);
+	if (transfer->data_fd < 0) {
+		wlr_log_errno(WLR_ERROR, "Failed to duplicate selection data fd");
+		transfer_destroy(transfer);
+		return;
+	}
+
+	int flags = fcntl(transfer->fd, F_GETFL);
+	if (flags == -1 || fcntl(transfer->fd, F_SETFL, flags | O_NONBLOCK) == -1) {
+		wlr_log_errno(WLR_ERROR, "Failed to make selection fd non-blocking");
+		transfer_destroy(transfer);
+		return;
+	}
+
+	transfer->event_source = wl_event_loop_add_fd(cache->event_loop,
+		transfer->fd, WL_EVENT_WRITABLE, transfer_handle_writable, transfer);
+	if (transfer->event_source == NULL) {
+		transfer_destroy(transfer);
+	}
+}
+
+static void cache_source_send_direct(
+		struct wlr_selection_cache_source *cache_source,
+		const char *mime_type, int fd) {
+	if (cache_source->data_source != NULL) {
+		struct wlr_data_source *source = cache_source->data_source;
+		source->impl->send(source, mime_type, fd);
+	} else {
+		struct wlr_primary_selection_source *source =
+			cache_source->primary_source;
+		source->impl->send(source, mime_type, fd);
+	}
+}
+
+static void entry_stop_fetching(struct cache_entry *entry) {
+	if (entry->pipe_source != NULL) {
+		wl_event_source_remove(entry->pipe_source);
+		entry->pipe_source = NULL;
+	}
+	if (entry->pipe_fd >= 0) {
+		close(entry->pipe_fd);
+		entry->pipe_fd = -1;
+	}
+}
+
+/**
+ * Give up on caching this MIME type, and forward the pending requests to the
+ * source.
+ */
+static void entry_set_uncacheable(struct cache_entry *entry) {
+	entry_stop_fetching(entry);
+	if (entry->data_fd >= 0) {
+		close(entry->data_fd);
+		entry->data_fd = -1;
+	}
+	entry->cache_source->size -= entry->size;
+	entry->size = 0;
+	entry->state = CACHE_ENTRY_UNCACHEABLE;
+
+	struct cache_transfer *waiter, *tmp;
+	wl_list_for_each_safe(waiter, tmp, &entry->waiters, link) {
+		wl_list_remove(&waiter->link);
+		cache_source_send_direct(entry->cache_source, entry->mime_type,
+			waiter->fd);
+		free(waiter);
+	}
+}
+
+static void entry_set_ready(struct cache_entry *entry) {
+	entry_stop_fetching(entry);
+	entry->state = CACHE_ENTRY_READY;
+
+	struct wlr_selection_cache *cache = entry->cache_source->cache;
+	struct cache_transfer *waiter, *tmp;
+	wl_list_for_each_safe(waiter, tmp, &entry->waiters, link) {
+		transfer_start(cache, waiter, entry);
+	}
+}
+
+static int entry_handle_readable(int fd, uint32_t mask, void *data) {
+	struct cache_entry *entry = data;
+	struct wlr_selection_cache_source *cache_source = entry->cache_source;
+	size_t max_size = cache_source->cache->max_size;
+
+	char buf[4096];
+	while (true) {
+		ssize_t n = read(fd, buf, sizeof(buf));
+		if (n < 0 && errno == EAGAIN) {
+			return 0;
+		} else if (n < 0 && errno == EINTR) {
+			continue;
+		} else if (n < 0) {
+			wlr_log_errno(WLR_ERROR, "Failed to read selection data");
+			entry_set_uncacheable(entry);
+			return 0;
+		} else if (n == 0) {
+			entry_set_ready(entry);
+			return 0;
+		}
+
+		if (cache_source->size + n > max_size) {
+			wlr_log(WLR_DEBUG, "Selection data for '%s' exceeds cache size",
+				entry->mime_type);
+			entry_set_uncacheable(entry);
+			return 0;
+		}
+
+		ssize_t written = 0;
+		while (written < n) {
+			ssize_t ret = write(entry->data_fd, buf + written, n - written);
+			if (ret < 0 && errno == EINTR) {
+				continue;
+			} else if (ret < 0) {
+				wlr_log_errno(WLR_ERROR, "Failed to store selection data");
+				entry_set_uncacheable(entry);
+				return 0;
+			}
+			written += ret;
+		}
+		entry->size += n;
+		cache_source->size += n;
+	}
+}
+
+static bool entry_start_fetching(struct cache_entry *entry) {
+	entry->data_fd = create_shm_file();
+	if (entry->data_fd < 0) {
+		return false;
+	}
+
+	int fds[2];
+	if (pipe(fds) != 0) {
+		wlr_log_errno(WLR_ERROR, "pipe() failed");
+		return false;
+	}
+	// The write end is handed over to the source client, keep it blocking
+	if (fcntl(fds[0], F_SETFD, FD_CLOEXEC) == -1 ||
+			fcntl(fds[0], F_SETFL, O_NONBLOCK) == -1 ||
+			fcntl(fds[1], F_SETFD, FD_CLOEXEC) == -1) {
+		wlr_log_errno(WLR_ERROR, "fcntl() failed");
+		close(fds[0]);
+		close(fds[1]);
+		return false;
+	}
+
+	entry->pipe_fd = fds[0];
+	entry->pipe_source = wl_event_loop_add_fd(
+		entry->cache_source->cache->event_loop, entry->pipe_fd,
+		WL_EVENT_READABLE, entry_handle_readable, entry);
+	if (entry->pipe_source == NULL) {
+		close(fds[1]);
+		return false;
+	}
+
+	cache_source_send_direct(entry->cache_source, entry->mime_type, fds[1]);
+	return true;
+}
+
+static void entry_destroy(struct cache_entry *entry) {
+	entry_stop_fetching(entry);
+	if (entry->data_fd >= 0) {
+		close(entry->data_fd);
+	}
+	// Consumers still waiting for the data get an empty transfer
+	struct cache_transfer *waiter, *tmp;
+	wl_list_for_each_safe(waiter, tmp, &entry->waiters, link) {
+		transfer_destroy(waiter);
+	}
+	wl_list_remove(&entry->link);
+	free(entry->mime_type);
+	free(entry);
+}
+
+static struct cache_entry *entry_create(
+		struct wlr_selection_cache_source *cache_source,
+		const char *mime_type) {
+	struct cache_entry *entry = calloc(1, sizeof(struct cache_entry));
+	if (entry == NULL) {
+		return NULL;
+	}
+	entry->mime_type = strdup(mime_type);
+	if (entry->mime_type == NULL) {
+		free(entry);
+		return NULL;
+	}
+	entry->cache_source = cache_source;
+	entry->data_fd = -1;
+	entry->pipe_fd = -1;
+	wl_list_init(&entry->waiters);
+	wl_list_insert(&cache_source->entries, &entry->link);
+	return entry;
+}
+
+bool selection_cache_source_send(
+		struct wlr_selection_cache_source *cache_source, const char *mime_type,
+		int fd) {
+	struct cache_entry *entry = NULL, *iter;
+	wl_list_for_each(iter, &cache_source->entries, link) {
+		if (strcmp(iter->mime_type, mime_type) == 0) {
+			entry = iter;
+			break;
+		}
+	}
+
+	if (entry != NULL && entry->state == CACHE_ENTRY_UNCACHEABLE) {
+		return false;
+	}
+
+	struct cache_transfer *transfer = calloc(1, sizeof(struct cache_transfer));
+	if (transfer == NULL) {
+		return false;
+	}
+	transfer->fd = fd;
+	transfer->data_fd = -1;
+
+	if (entry == NULL) {
+		entry = entry_create(cache_source, mime_type);
+		if (entry == NULL) {
+			free(transfer);
+			return false;
+		}
+		entry->state = CACHE_ENTRY_FETCHING;
+		wl_list_insert(&entry->waiters, &transfer->link);
+		if (!entry_start_fetching(entry)) {
+			// Forwards the request to the source
+			entry_set_uncacheable(entry);
+		}
+		return true;
+	}
+
+	if (entry->state == CACHE_ENTRY_FETCHING) {
+		wl_list_insert(entry->waiters.prev, &transfer->link);
+	} else {
+		wl_list_init(&transfer->link);
+		transfer_start(cache_source->cache, transfer, entry);
+	}
+	return true;
+}
+
+static void cache_source_destroy(
+		struct wlr_selection_cache_source *cache_source) {
+	struct cache_entry *entry, *tmp;
+	wl_list_for_each_safe(entry, tmp, &cache_source->entries, link) {
+		entry_destroy(entry);
+	}
+	if (cache_source->data_source != NULL) {
+		cache_source->data_source->cache = NULL;
+	} else {
+		cache_source->primary_source->cache = NULL;
+	}
+	wl_list_remove(&cache_source->source_destroy.link);
+	wl_list_remove(&cache_source->link);
+	free(cache_source);
+}
+
+static void cache_source_handle_source_destroy(struct wl_listener *listener,
+		void *data) {
+	struct wlr_selection_cache_source *cache_source =
+		wl_container_of(listener, cache_source, source_destroy);
+	cache_source_destroy(cache_source);
+}
+
+static struct wlr_selection_cache_source *cache_source_create(
+		struct wlr_selection_cache *cache, struct wl_signal *destroy_signal) {
+	struct wlr_selection_cache_source *cache_source =
+		calloc(1, sizeof(struct wlr_selection_cache_source));
+	if (cache_source == NULL) {
+		return NULL;
+	}
+	cache_source->cache = cache;
+	wl_list_init(&cache_source->entries);
+	cache_source->source_destroy.notify = cache_source_handle_source_destroy;
+	wl_signal_add(destroy_signal, &cache_source->source_destroy);
+	wl_list_insert(&cache->sources, &cache_source->link);
+	return cache_source;
+}
+
+static void cache_handle_set_selection(struct wl_listener *listener,
+		void *data) {
+	struct wlr_selection_cache *cache =
+		wl_container_of(listener, cache, set_selection);
+	struct wlr_data_source *source = cache->seat->selection_source;
+	if (source == NULL || source->cache != NULL) {
+		return;
+	}
+
+	struct wlr_selection_cache_source *cache_source =
+		cache_source_create(cache, &source->events.destroy);
+	if (cache_source == NULL) {
+		return;
+	}
+	cache_source->data_source = source;
+	source->cache = cache_source;
+}
+
+static void cache_handle_set_primary_selection(struct wl_listener *listener,
+		void *data) {
+	struct wlr_selection_cache *cache =
+		wl_container_of(listener, cache, set_primary_selection);
+	struct wlr_primary_selection_source *source =
+		cache->seat->primary_selection_source;
+	if (source == NULL || source->cache != NULL) {
+		return;
+	}
+
+	struct wlr_selection_cache_source *cache_source =
+		cache_source_create(cache, &source->events.destroy);
+	if (cache_source == NULL) {
+		return;
+	}
+	cache_source->primary_source = source;
+	source->cache = cache_source;
+}
+
+static void cache_handle_seat_destroy(struct wl_listener *listener,
+		void *data) {
+	struct wlr_selection_cache *cache =
+		wl_container_of(listener, cache, seat_destroy);
+	wlr_selection_cache_destroy(cache);
+}
+
+struct wlr_selection_cache *wlr_selection_cache_create(struct wlr_seat *seat,
+		size_t max_size) {
+	struct wlr_selection_cache *cache =
+		calloc(1, sizeof(struct wlr_selection_cache));
+	if (cache == NULL) {
+		return NULL;
+	}
+	cache->seat = seat;
+	cache->event_loop = wl_display_get_event_loop(seat->display);
+	cache->max_size = max_size;
+	wl_list_init(&cache->sources);
+	wl_list_init(&cache->transfers);
+	wl_signal_init(&cache->events.destroy);
+
+	cache->set_selection.notify = cache_handle_set_selection;
+	wl_signal_add(&seat->events.set_selection, &cache->set_selection);
+	cache->set_primary_selection.notify = cache_handle_set_primary_selection;
+	wl_signal_add(&seat->events.set_primary_selection,
+		&cache->set_primary_selection);
+	cache->seat_destroy.notify = cache_handle_seat_destroy;
+	wl_signal_add(&seat->events.destroy, &cache->seat_destroy);
+
+	// Start caching the current selections
+	cache_handle_set_selection(&cache->set_selection, seat);
+	cache_handle_set_primary_selection(&cache->set_primary_selection, seat);
+
+	return cache;
+}
+
+void wlr_selection_cache_destroy(struct wlr_selection_cache *cache) {
+	if (cache == NULL) {
+		return;
+	}
+	wlr_signal_emit_safe(&cache->events.destroy, cache);
+
+	struct wlr_selection_cache_source *cache_source, *tmp_source;
+	wl_list_for_each_safe(cache_source, tmp_source, &cache->sources, link) {
+		cache_source_destroy(cache_source);
+	}
+	struct cache_transfer *transfer, *tmp_transfer;
+	wl_list_for_each_safe(transfer, tmp_transfer, &cache->transfers, link) {
+		transfer_destroy(transfer);
+	}
+
+	wl_list_remove(&cache->set_selection.link);
+	wl_list_remove(&cache->set_primary_selection.link);
+	wl_list_remove(&cache->seat_destroy.link);
+	free(cache);
+}
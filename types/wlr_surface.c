@@ -1,17 +1,23 @@
+#define _POSIX_C_SOURCE 200809L
 #include <assert.h>
+#include <poll.h>
 #include <stdlib.h>
 #include <wayland-server-core.h>
 #include <wlr/render/interface.h>
 #include <wlr/types/wlr_buffer.h>
 #include <wlr/types/wlr_compositor.h>
+#include <wlr/types/wlr_linux_dmabuf_v1.h>
 #include <wlr/types/wlr_matrix.h>
 #include <wlr/types/wlr_region.h>
 #include <wlr/types/wlr_surface.h>
 #include <wlr/types/wlr_output.h>
 #include <wlr/util/log.h>
 #include <wlr/util/region.h>
+#include "types/wlr_client_usage.h"
+#include "types/wlr_surface.h"
 #include "util/signal.h"
 #include "util/time.h"
+#include "util/trace.h"
 
 #define CALLBACK_VERSION 1
 #define SURFACE_VERSION 4
@@ -230,10 +236,9 @@ static void surface_update_damage(pixman_region32_t *buffer_damage,
 				floor(pending->viewport.src.y));
 		}
 
-		wlr_region_transform(&surface_damage, &surface_damage,
+		wlr_region_transform_scale(&surface_damage, &surface_damage,
 			wlr_output_transform_invert(pending->transform),
-			pending->width, pending->height);
-		wlr_region_scale(&surface_damage, &surface_damage, pending->scale);
+			pending->width, pending->height, pending->scale);
 
 		pixman_region32_union(buffer_damage,
 			&pending->buffer_damage, &surface_damage);
@@ -364,7 +369,9 @@ static void surface_apply_damage(struct wlr_surface *surface) {
 }
 
 static void surface_update_opaque_region(struct wlr_surface *surface) {
-	struct wlr_texture *texture = wlr_surface_get_texture(surface);
+	// Don't restore an evicted texture, the surface is likely hidden
+	struct wlr_texture *texture =
+		surface->buffer != NULL ? surface->buffer->texture : NULL;
 	if (texture == NULL) {
 		pixman_region32_clear(&surface->opaque_region);
 		return;
@@ -387,7 +394,11 @@ static void surface_update_input_region(struct wlr_surface *surface) {
 		0, 0, surface->current.width, surface->current.height);
 }
 
-static void surface_commit_pending(struct wlr_surface *surface) {
+/**
+ * Applies the pending state. If `held` is set, the pending state is a held
+ * commit and the subsurfaces are ordered as they were when it was committed.
+ */
+static void surface_commit_pending(struct wlr_surface *surface, bool held) {
 	surface_state_finalize(surface, &surface->pending);
 
 	if (surface->role && surface->role->precommit) {
@@ -412,11 +423,20 @@ static void surface_commit_pending(struct wlr_surface *surface) {
 
 	// commit subsurface order
 	struct wlr_subsurface *subsurface;
-	wl_list_for_each_reverse(subsurface, &surface->subsurface_pending_list,
-			parent_pending_link) {
-		wl_list_remove(&subsurface->parent_link);
-		wl_list_insert(&surface->subsurfaces, &subsurface->parent_link);
-
+	if (held) {
+		wl_list_for_each_reverse(subsurface, &surface->subsurface_held_list,
+				parent_held_link) {
+			wl_list_remove(&subsurface->parent_link);
+			wl_list_insert(&surface->subsurfaces, &subsurface->parent_link);
+		}
+	} else {
+		wl_list_for_each_reverse(subsurface,
+				&surface->subsurface_pending_list, parent_pending_link) {
+			wl_list_remove(&subsurface->parent_link);
+			wl_list_insert(&surface->subsurfaces, &subsurface->parent_link);
+		}
+	}
+	wl_list_for_each(subsurface, &surface->subsurfaces, parent_link) {
 		if (subsurface->reordered) {
 			// TODO: damage all the subsurfaces
 			surface_damage_subsurfaces(subsurface);
@@ -458,7 +478,7 @@ static void subsurface_parent_commit(struct wlr_subsurface *subsurface,
 	if (synchronized || subsurface->synchronized) {
 		if (subsurface->has_cache) {
 			surface_state_move(&surface->pending, &subsurface->cached);
-			surface_commit_pending(surface);
+			surface_commit_pending(surface, false);
 			subsurface->has_cache = false;
 			subsurface->cached.committed = 0;
 		}
@@ -470,7 +490,7 @@ static void subsurface_parent_commit(struct wlr_subsurface *subsurface,
 	}
 }
 
-static void subsurface_commit(struct wlr_subsurface *subsurface) {
+static void subsurface_commit(struct wlr_subsurface *subsurface, bool held) {
 	struct wlr_surface *surface = subsurface->surface;
 
 	if (subsurface_is_synchronized(subsurface)) {
@@ -479,24 +499,21 @@ static void subsurface_commit(struct wlr_subsurface *subsurface) {
 	} else {
 		if (subsurface->has_cache) {
 			surface_state_move(&surface->pending, &subsurface->cached);
-			surface_commit_pending(surface);
+			surface_commit_pending(surface, held);
 			subsurface->has_cache = false;
 		} else {
-			surface_commit_pending(surface);
+			surface_commit_pending(surface, held);
 		}
 	}
 }
 
-static void surface_commit(struct wl_client *client,
-		struct wl_resource *resource) {
-	struct wlr_surface *surface = wlr_surface_from_resource(resource);
-
+static void surface_commit_state(struct wlr_surface *surface, bool held) {
 	struct wlr_subsurface *subsurface = wlr_surface_is_subsurface(surface) ?
 		wlr_subsurface_from_wlr_surface(surface) : NULL;
 	if (subsurface != NULL) {
-		subsurface_commit(subsurface);
+		subsurface_commit(subsurface, held);
 	} else {
-		surface_commit_pending(surface);
+		surface_commit_pending(surface, held);
 	}
 
 	wl_list_for_each(subsurface, &surface->subsurfaces, parent_link) {
@@ -504,6 +521,196 @@ static void surface_commit(struct wl_client *client,
 	}
 }
 
+/**
+ * Returns a file descriptor of a DMA-BUF plane the client is still rendering
+ * to, or -1 if the buffer can be read from without waiting.
+ */
+static int buffer_get_busy_fd(struct wl_resource *buffer_resource) {
+	if (buffer_resource == NULL ||
+			!wlr_dmabuf_v1_resource_is_buffer(buffer_resource)) {
+		return -1;
+	}
+
+	struct wlr_dmabuf_v1_buffer *dmabuf =
+		wlr_dmabuf_v1_buffer_from_buffer_resource(buffer_resource);
+	struct wlr_dmabuf_attributes *attribs = &dmabuf->attributes;
+	for (int i = 0; i < attribs->n_planes; ++i) {
+		// A DMA-BUF becomes readable once its exclusive fence has signaled
+		struct pollfd pollfd = { .fd = attribs->fd[i], .events = POLLIN };
+		if (poll(&pollfd, 1, 0) == 0) {
+			return attribs->fd[i];
+		}
+	}
+	return -1;
+}
+
+static void surface_state_init(struct wlr_surface_state *state);
+static void surface_state_finish(struct wlr_surface_state *state);
+
+void surface_apply_held(struct wlr_surface *surface) {
+	if (surface->held_source != NULL) {
+		wl_event_source_remove(surface->held_source);
+		surface->held_source = NULL;
+	}
+	if (!surface->has_held) {
+		return;
+	}
+
+	// The client may have started building its next state already: stash it
+	// away while the held state goes through the regular commit path
+	struct wlr_surface_state next = {0};
+	surface_state_init(&next);
+	surface_state_move(&next, &surface->pending);
+
+	surface_state_move(&surface->pending, &surface->held);
+	surface->has_held = false;
+
+	// Same for the role state, which is swapped back afterwards
+	const struct wlr_surface_role *role = surface->role;
+	if (role != NULL && role->swap_held) {
+		role->swap_held(surface);
+	}
+	surface_commit_state(surface, true);
+	if (role != NULL && role->swap_held) {
+		role->swap_held(surface);
+	}
+
+	surface_state_move(&surface->pending, &next);
+	surface_state_finish(&next);
+}
+
+static void surface_wait_held(struct wlr_surface *surface);
+
+static int surface_handle_held_readable(int fd, uint32_t mask, void *data) {
+	struct wlr_surface *surface = data;
+	// Other planes might still be busy, check them all again
+	surface_wait_held(surface);
+	return 0;
+}
+
+static void surface_wait_held(struct wlr_surface *surface) {
+	if (surface->held_source != NULL) {
+		wl_event_source_remove(surface->held_source);
+		surface->held_source = NULL;
+	}
+
+	int fd = -1;
+	if (surface->wait_for_buffers) {
+		fd = buffer_get_busy_fd(surface->held.buffer_resource);
+	}
+	if (fd < 0) {
+		surface_apply_held(surface);
+		return;
+	}
+
+	struct wl_client *client = wl_resource_get_client(surface->resource);
+	struct wl_event_loop *loop =
+		wl_display_get_event_loop(wl_client_get_display(client));
+	surface->held_source = wl_event_loop_add_fd(loop, fd, WL_EVENT_READABLE,
+		surface_handle_held_readable, surface);
+	if (surface->held_source == NULL) {
+		wlr_log(WLR_ERROR, "Failed to wait for buffer to become ready");
+		surface_apply_held(surface);
+	}
+}
+
+/**
+ * Saves the role state and the subsurface order along with the commit being
+ * held back.
+ */
+static void surface_hold_role_state(struct wlr_surface *surface) {
+	if (surface->role != NULL && surface->role->hold) {
+		surface->role->hold(surface);
+	}
+
+	struct wlr_subsurface *subsurface;
+	wl_list_for_each(subsurface, &surface->subsurface_pending_list,
+			parent_pending_link) {
+		wl_list_remove(&subsurface->parent_held_link);
+		wl_list_insert(surface->subsurface_held_list.prev,
+			&subsurface->parent_held_link);
+	}
+}
+
+static void surface_hold_pending(struct wlr_surface *surface) {
+	surface_hold_role_state(surface);
+
+	if (!surface->has_held) {
+		surface_state_move(&surface->held, &surface->pending);
+		surface->has_held = true;
+		surface_wait_held(surface);
+		return;
+	}
+
+	// Squash the new commit into the held one. Damage and buffer offsets
+	// accumulate, everything else is overwritten by the newer commit.
+	struct wlr_surface_state *held = &surface->held;
+	struct wlr_surface_state *pending = &surface->pending;
+	int32_t dx = 0, dy = 0;
+	if (held->committed & WLR_SURFACE_STATE_BUFFER) {
+		dx = held->dx;
+		dy = held->dy;
+	}
+	if ((held->committed & WLR_SURFACE_STATE_BUFFER) &&
+			(pending->committed & WLR_SURFACE_STATE_BUFFER) &&
+			held->buffer_resource != NULL &&
+			held->buffer_resource != pending->buffer_resource) {
+		// The replaced buffer is never going to be read from
+		wl_buffer_send_release(held->buffer_resource);
+	}
+	if (held->committed & WLR_SURFACE_STATE_SURFACE_DAMAGE) {
+		pixman_region32_union(&pending->surface_damage,
+			&pending->surface_damage, &held->surface_damage);
+		pending->committed |= WLR_SURFACE_STATE_SURFACE_DAMAGE;
+	}
+	if (held->committed & WLR_SURFACE_STATE_BUFFER_DAMAGE) {
+		pixman_region32_union(&pending->buffer_damage,
+			&pending->buffer_damage, &held->buffer_damage);
+		pending->committed |= WLR_SURFACE_STATE_BUFFER_DAMAGE;
+	}
+
+	surface_state_move(held, pending);
+	held->dx += dx;
+	held->dy += dy;
+
+	surface_wait_held(surface);
+}
+
+static bool surface_should_hold_pending(struct wlr_surface *surface) {
+	if (surface->has_held) {
+		// Commits must be applied in order
+		return true;
+	}
+	if (!surface->wait_for_buffers ||
+			!(surface->pending.committed & WLR_SURFACE_STATE_BUFFER)) {
+		return false;
+	}
+
+	if (wlr_surface_is_subsurface(surface)) {
+		struct wlr_subsurface *subsurface =
+			wlr_subsurface_from_wlr_surface(surface);
+		if (subsurface != NULL && subsurface_is_synchronized(subsurface)) {
+			// Synchronized state is applied atomically with the parent's
+			return false;
+		}
+	}
+
+	return buffer_get_busy_fd(surface->pending.buffer_resource) >= 0;
+}
+
+static void surface_commit(struct wl_client *client,
+		struct wl_resource *resource) {
+	struct wlr_surface *surface = wlr_surface_from_resource(resource);
+
+	TRACE_BEGIN("surface_commit", NULL);
+	if (surface_should_hold_pending(surface)) {
+		surface_hold_pending(surface);
+	} else {
+		surface_commit_state(surface, false);
+	}
+	TRACE_END("surface_commit", NULL);
+}
+
 static void surface_set_buffer_transform(struct wl_client *client,
 		struct wl_resource *resource, int32_t transform) {
 	if (transform < WL_OUTPUT_TRANSFORM_NORMAL ||
@@ -606,6 +813,7 @@ static void subsurface_destroy(struct wlr_subsurface *subsurface) {
 	if (subsurface->parent) {
 		wl_list_remove(&subsurface->parent_link);
 		wl_list_remove(&subsurface->parent_pending_link);
+		wl_list_remove(&subsurface->parent_held_link);
 		wl_list_remove(&subsurface->parent_destroy.link);
 	}
 
@@ -624,6 +832,10 @@ static void surface_handle_resource_destroy(struct wl_resource *resource) {
 	wl_list_remove(wl_resource_get_link(surface->resource));
 
 	wl_list_remove(&surface->renderer_destroy.link);
+	if (surface->held_source != NULL) {
+		wl_event_source_remove(surface->held_source);
+	}
+	surface_state_finish(&surface->held);
 	surface_state_finish(&surface->pending);
 	surface_state_finish(&surface->current);
 	surface_state_finish(&surface->previous);
@@ -633,6 +845,8 @@ static void surface_handle_resource_destroy(struct wl_resource *resource) {
 	if (surface->buffer != NULL) {
 		wlr_buffer_unlock(&surface->buffer->base);
 	}
+	client_usage_remove_client(wl_resource_get_client(resource),
+		WLR_CLIENT_USAGE_SURFACES, 1);
 	free(surface);
 }
 
@@ -648,8 +862,14 @@ struct wlr_surface *wlr_surface_create(struct wl_client *client,
 		struct wl_list *resource_list) {
 	assert(version <= SURFACE_VERSION);
 
+	struct wlr_client_usage *usage = client_usage_from_client(client);
+	if (!client_usage_add(usage, WLR_CLIENT_USAGE_SURFACES, 1)) {
+		return NULL;
+	}
+
 	struct wlr_surface *surface = calloc(1, sizeof(struct wlr_surface));
 	if (!surface) {
+		client_usage_remove(usage, WLR_CLIENT_USAGE_SURFACES, 1);
 		wl_client_post_no_memory(client);
 		return NULL;
 	}
@@ -657,6 +877,7 @@ struct wlr_surface *wlr_surface_create(struct wl_client *client,
 		version, id);
 	if (surface->resource == NULL) {
 		free(surface);
+		client_usage_remove(usage, WLR_CLIENT_USAGE_SURFACES, 1);
 		wl_client_post_no_memory(client);
 		return NULL;
 	}
@@ -670,12 +891,15 @@ struct wlr_surface *wlr_surface_create(struct wl_client *client,
 	surface_state_init(&surface->current);
 	surface_state_init(&surface->pending);
 	surface_state_init(&surface->previous);
+	surface_state_init(&surface->held);
 
 	wl_signal_init(&surface->events.commit);
 	wl_signal_init(&surface->events.destroy);
 	wl_signal_init(&surface->events.new_subsurface);
+	wl_signal_init(&surface->events.restore_failed);
 	wl_list_init(&surface->subsurfaces);
 	wl_list_init(&surface->subsurface_pending_list);
+	wl_list_init(&surface->subsurface_held_list);
 	pixman_region32_init(&surface->buffer_damage);
 	pixman_region32_init(&surface->opaque_region);
 	pixman_region32_init(&surface->input_region);
@@ -693,15 +917,33 @@ struct wlr_surface *wlr_surface_create(struct wl_client *client,
 	return surface;
 }
 
+void wlr_surface_set_wait_for_buffers(struct wlr_surface *surface,
+		bool enabled) {
+	surface->wait_for_buffers = enabled;
+	if (!enabled) {
+		surface_apply_held(surface);
+	}
+}
+
 struct wlr_texture *wlr_surface_get_texture(struct wlr_surface *surface) {
 	if (surface->buffer == NULL) {
 		return NULL;
 	}
+	// Restored lazily, when the surface needs to be drawn
+	if (surface->buffer->texture_evicted &&
+			!wlr_client_buffer_restore_texture(surface->buffer)) {
+		wlr_log(WLR_ERROR, "Failed to restore the evicted texture of "
+			"surface %p, waiting for a new buffer", surface);
+		wlr_signal_emit_safe(
+			&wlr_surface_get_root_surface(surface)->events.restore_failed,
+			surface);
+	}
 	return surface->buffer->texture;
 }
 
 bool wlr_surface_has_buffer(struct wlr_surface *surface) {
-	return wlr_surface_get_texture(surface) != NULL;
+	return surface->buffer != NULL && (surface->buffer->texture != NULL ||
+		surface->buffer->texture_evicted);
 }
 
 bool wlr_surface_set_role(struct wlr_surface *surface,
@@ -726,6 +968,11 @@ bool wlr_surface_set_role(struct wlr_surface *surface,
 		return false;
 	}
 
+	if (surface->role_data != role_data) {
+		// The new role object has no state to hold along with the commit
+		surface_apply_held(surface);
+	}
+
 	surface->role = role;
 	surface->role_data = role_data;
 	return true;
@@ -964,10 +1211,34 @@ static void subsurface_role_precommit(struct wlr_surface *surface) {
 	}
 }
 
+static void subsurface_role_hold(struct wlr_surface *surface) {
+	struct wlr_subsurface *subsurface =
+		wlr_subsurface_from_wlr_surface(surface);
+	if (subsurface == NULL) {
+		return;
+	}
+
+	subsurface->held = subsurface->pending;
+}
+
+static void subsurface_role_swap_held(struct wlr_surface *surface) {
+	struct wlr_subsurface *subsurface =
+		wlr_subsurface_from_wlr_surface(surface);
+	if (subsurface == NULL) {
+		return;
+	}
+
+	struct wlr_subsurface_state tmp = subsurface->pending;
+	subsurface->pending = subsurface->held;
+	subsurface->held = tmp;
+}
+
 const struct wlr_surface_role subsurface_role = {
 	.name = "wl_subsurface",
 	.commit = subsurface_role_commit,
 	.precommit = subsurface_role_precommit,
+	.hold = subsurface_role_hold,
+	.swap_held = subsurface_role_swap_held,
 };
 
 static void subsurface_handle_parent_destroy(struct wl_listener *listener,
@@ -977,6 +1248,7 @@ static void subsurface_handle_parent_destroy(struct wl_listener *listener,
 	subsurface_unmap(subsurface);
 	wl_list_remove(&subsurface->parent_link);
 	wl_list_remove(&subsurface->parent_pending_link);
+	wl_list_remove(&subsurface->parent_held_link);
 	wl_list_remove(&subsurface->parent_destroy.link);
 	subsurface->parent = NULL;
 }
@@ -1030,6 +1302,8 @@ struct wlr_subsurface *wlr_subsurface_create(struct wlr_surface *surface,
 	wl_list_insert(parent->subsurfaces.prev, &subsurface->parent_link);
 	wl_list_insert(parent->subsurface_pending_list.prev,
 		&subsurface->parent_pending_link);
+	wl_list_insert(parent->subsurface_held_list.prev,
+		&subsurface->parent_held_link);
 
 	surface->role_data = subsurface;
 
@@ -1113,12 +1387,48 @@ void wlr_surface_send_leave(struct wlr_surface *surface,
 	}
 }
 
+static uint32_t surface_get_frame_throttle_interval(
+		struct wlr_surface *surface) {
+	while (surface->frame_throttle_interval == 0 &&
+			wlr_surface_is_subsurface(surface)) {
+		struct wlr_subsurface *subsurface =
+			wlr_subsurface_from_wlr_surface(surface);
+		if (subsurface == NULL) {
+			break;
+		}
+		surface = subsurface->parent;
+	}
+	return surface->frame_throttle_interval;
+}
+
 void wlr_surface_send_frame_done(struct wlr_surface *surface,
 		const struct timespec *when) {
+	if (wl_list_empty(&surface->current.frame_callback_list)) {
+		return;
+	}
+
+	int64_t when_msec = timespec_to_msec(when);
+	uint32_t interval = surface_get_frame_throttle_interval(surface);
+	if (interval > 0 && when_msec - surface->last_frame_done < interval) {
+		return;
+	}
+
+	surface_send_frame_done_unthrottled(surface, when);
+}
+
+void surface_send_frame_done_unthrottled(struct wlr_surface *surface,
+		const struct timespec *when) {
+	if (wl_list_empty(&surface->current.frame_callback_list)) {
+		return;
+	}
+
+	int64_t when_msec = timespec_to_msec(when);
+	surface->last_frame_done = when_msec;
+
 	struct wl_resource *resource, *tmp;
 	wl_resource_for_each_safe(resource, tmp,
 			&surface->current.frame_callback_list) {
-		wl_callback_send_done(resource, timespec_to_msec(when));
+		wl_callback_send_done(resource, when_msec);
 		wl_resource_destroy(resource);
 	}
 }
@@ -1187,10 +1497,9 @@ void wlr_surface_get_effective_damage(struct wlr_surface *surface,
 	pixman_region32_clear(damage);
 
 	// Transform and copy the buffer damage in terms of surface coordinates.
-	wlr_region_transform(damage, &surface->buffer_damage,
+	wlr_region_transform_scale(damage, &surface->buffer_damage,
 		surface->current.transform, surface->current.buffer_width,
-		surface->current.buffer_height);
-	wlr_region_scale(damage, damage, 1.0 / (float)surface->current.scale);
+		surface->current.buffer_height, 1.0 / (float)surface->current.scale);
 
 	if (surface->current.viewport.has_src) {
 		struct wlr_box src_box = {
@@ -0,0 +1,285 @@
+#define _POSIX_C_SOURCE 200809L
+#include <assert.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <wayland-server-core.h>
+#include <wlr/types/wlr_buffer.h>
+#include <wlr/types/wlr_surface.h>
+#include <wlr/types/wlr_texture_residency.h>
+#include <wlr/util/log.h>
+#include "types/wlr_surface.h"
+#include "util/signal.h"
+
+#define RESIDENCY_CHECK_INTERVAL_MS 2000
+
+struct residency_surface {
+	struct wlr_texture_residency_manager *manager;
+	struct wlr_surface *surface;
+	struct wl_list link; // wlr_texture_residency_manager::surfaces
+	bool visible;
+
+	struct wl_listener surface_destroy;
+	struct wl_listener surface_restore_failed;
+};
+
+static void residency_surface_destroy(struct residency_surface *rsurface) {
+	wl_list_remove(&rsurface->surface_destroy.link);
+	wl_list_remove(&rsurface->surface_restore_failed.link);
+	wl_list_remove(&rsurface->link);
+	free(rsurface);
+}
+
+static void residency_surface_handle_surface_destroy(
+		struct wl_listener *listener, void *data) {
+	struct residency_surface *rsurface =
+		wl_container_of(listener, rsurface, surface_destroy);
+	residency_surface_destroy(rsurface);
+}
+
+static void send_frame_done(struct wlr_surface *surface) {
+	// The content is lost. This only helps clients which are waiting for a
+	// frame callback to draw, the compositor has to make the others draw.
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	surface_send_frame_done_unthrottled(surface, &now);
+}
+
+static void residency_surface_handle_surface_restore_failed(
+		struct wl_listener *listener, void *data) {
+	struct residency_surface *rsurface =
+		wl_container_of(listener, rsurface, surface_restore_failed);
+	struct wlr_surface *surface = data;
+	// A texture was restored lazily while drawing the surface
+	send_frame_done(surface);
+	wlr_signal_emit_safe(&rsurface->manager->events.restore_failed,
+		rsurface->surface);
+}
+
+static struct residency_surface *residency_surface_get(
+		struct wlr_texture_residency_manager *manager,
+		struct wlr_surface *surface) {
+	struct residency_surface *rsurface;
+	wl_list_for_each(rsurface, &manager->surfaces, link) {
+		if (rsurface->surface == surface) {
+			return rsurface;
+		}
+	}
+
+	rsurface = calloc(1, sizeof(struct residency_surface));
+	if (rsurface == NULL) {
+		wlr_log(WLR_ERROR, "Allocation failed");
+		return NULL;
+	}
+	rsurface->manager = manager;
+	rsurface->surface = surface;
+	rsurface->visible = true;
+	wl_list_insert(manager->surfaces.prev, &rsurface->link);
+
+	rsurface->surface_destroy.notify = residency_surface_handle_surface_destroy;
+	wl_signal_add(&surface->events.destroy, &rsurface->surface_destroy);
+	rsurface->surface_restore_failed.notify =
+		residency_surface_handle_surface_restore_failed;
+	wl_signal_add(&surface->events.restore_failed,
+		&rsurface->surface_restore_failed);
+
+	return rsurface;
+}
+
+static void count_resident_iterator(struct wlr_surface *surface,
+		int sx, int sy, void *data) {
+	size_t *bytes = data;
+	if (surface->buffer != NULL && surface->buffer->texture != NULL) {
+		*bytes += surface->buffer->usage_bytes;
+	}
+}
+
+static size_t count_resident_bytes(
+		struct wlr_texture_residency_manager *manager) {
+	size_t bytes = 0;
+	struct residency_surface *rsurface;
+	wl_list_for_each(rsurface, &manager->surfaces, link) {
+		wlr_surface_for_each_surface(rsurface->surface,
+			count_resident_iterator, &bytes);
+	}
+	return bytes;
+}
+
+static void evict_iterator(struct wlr_surface *surface,
+		int sx, int sy, void *data) {
+	size_t *bytes = data;
+	if (surface->buffer != NULL) {
+		*bytes += wlr_client_buffer_evict_texture(surface->buffer);
+	}
+}
+
+size_t wlr_texture_residency_manager_evict(
+		struct wlr_texture_residency_manager *manager, size_t bytes) {
+	size_t evicted = 0;
+	// Surfaces are ordered by the time they were hidden, oldest first
+	struct residency_surface *rsurface;
+	wl_list_for_each(rsurface, &manager->surfaces, link) {
+		if (evicted >= bytes) {
+			break;
+		}
+		if (rsurface->visible) {
+			continue;
+		}
+		wlr_surface_for_each_surface(rsurface->surface, evict_iterator,
+			&evicted);
+	}
+	if (evicted > 0) {
+		wlr_log(WLR_DEBUG, "Evicted %zu bytes of textures", evicted);
+	}
+	return evicted;
+}
+
+static void check_budget(struct wlr_texture_residency_manager *manager) {
+	if (manager->budget == 0) {
+		return;
+	}
+	size_t resident = count_resident_bytes(manager);
+	if (resident > manager->budget) {
+		wlr_texture_residency_manager_evict(manager,
+			resident - manager->budget);
+	}
+}
+
+static bool read_psi(int fd, float *avg10) {
+	char buf[256];
+	ssize_t n = pread(fd, buf, sizeof(buf) - 1, 0);
+	if (n <= 0) {
+		return false;
+	}
+	buf[n] = '\0';
+	return sscanf(buf, "some avg10=%f", avg10) == 1;
+}
+
+static int handle_timer(void *data) {
+	struct wlr_texture_residency_manager *manager = data;
+
+	float avg10;
+	if (manager->psi_fd >= 0 && read_psi(manager->psi_fd, &avg10) &&
+			avg10 >= manager->psi_threshold) {
+		wlr_log(WLR_DEBUG, "Memory pressure at %.2f%%, evicting textures",
+			avg10);
+		wlr_texture_residency_manager_evict(manager, SIZE_MAX);
+	} else {
+		check_budget(manager);
+	}
+
+	wl_event_source_timer_update(manager->timer, RESIDENCY_CHECK_INTERVAL_MS);
+	return 0;
+}
+
+static void handle_display_destroy(struct wl_listener *listener, void *data) {
+	struct wlr_texture_residency_manager *manager =
+		wl_container_of(listener, manager, display_destroy);
+	wlr_texture_residency_manager_destroy(manager);
+}
+
+struct wlr_texture_residency_manager *wlr_texture_residency_manager_create(
+		struct wl_display *display, size_t budget) {
+	struct wlr_texture_residency_manager *manager =
+		calloc(1, sizeof(struct wlr_texture_residency_manager));
+	if (manager == NULL) {
+		return NULL;
+	}
+	manager->budget = budget;
+	manager->psi_fd = -1;
+	manager->event_loop = wl_display_get_event_loop(display);
+	wl_list_init(&manager->surfaces);
+	wl_signal_init(&manager->events.restore_failed);
+	wl_signal_init(&manager->events.destroy);
+
+	manager->timer = wl_event_loop_add_timer(manager->event_loop,
+		handle_timer, manager);
+	if (manager->timer == NULL) {
+		free(manager);
+		return NULL;
+	}
+	if (budget > 0) {
+		wl_event_source_timer_update(manager->timer,
+			RESIDENCY_CHECK_INTERVAL_MS);
+	}
+
+	manager->display_destroy.notify = handle_display_destroy;
+	wl_display_add_destroy_listener(display, &manager->display_destroy);
+
+	return manager;
+}
+
+void wlr_texture_residency_manager_destroy(
+		struct wlr_texture_residency_manager *manager) {
+	if (manager == NULL) {
+		return;
+	}
+	wlr_signal_emit_safe(&manager->events.destroy, manager);
+	struct residency_surface *rsurface, *tmp;
+	wl_list_for_each_safe(rsurface, tmp, &manager->surfaces, link) {
+		residency_surface_destroy(rsurface);
+	}
+	wl_event_source_remove(manager->timer);
+	if (manager->psi_fd >= 0) {
+		close(manager->psi_fd);
+	}
+	wl_list_remove(&manager->display_destroy.link);
+	free(manager);
+}
+
+bool wlr_texture_residency_manager_monitor_psi(
+		struct wlr_texture_residency_manager *manager, float threshold) {
+	if (manager->psi_fd < 0) {
+		manager->psi_fd = open("/proc/pressure/memory", O_RDONLY | O_CLOEXEC);
+		float avg10;
+		if (manager->psi_fd < 0 || !read_psi(manager->psi_fd, &avg10)) {
+			wlr_log(WLR_INFO, "Memory pressure information is unavailable");
+			if (manager->psi_fd >= 0) {
+				close(manager->psi_fd);
+				manager->psi_fd = -1;
+			}
+			return false;
+		}
+	}
+
+	manager->psi_threshold = threshold;
+	wl_event_source_timer_update(manager->timer, RESIDENCY_CHECK_INTERVAL_MS);
+	return true;
+}
+
+static void restore_iterator(struct wlr_surface *surface,
+		int sx, int sy, void *data) {
+	bool *restored = data;
+	if (surface->buffer != NULL &&
+			!wlr_client_buffer_restore_texture(surface->buffer)) {
+		*restored = false;
+	}
+}
+
+void wlr_texture_residency_manager_set_visible(
+		struct wlr_texture_residency_manager *manager,
+		struct wlr_surface *surface, bool visible) {
+	struct residency_surface *rsurface = residency_surface_get(manager, surface);
+	if (rsurface == NULL || rsurface->visible == visible) {
+		return;
+	}
+	rsurface->visible = visible;
+
+	if (!visible) {
+		// Keep the surfaces ordered by the time they were hidden
+		wl_list_remove(&rsurface->link);
+		wl_list_insert(manager->surfaces.prev, &rsurface->link);
+		check_budget(manager);
+		return;
+	}
+
+	bool restored = true;
+	wlr_surface_for_each_surface(surface, restore_iterator, &restored);
+	if (!restored) {
+		send_frame_done(surface);
+		wlr_signal_emit_safe(&manager->events.restore_failed, surface);
+	}
+}
@@ -6,6 +6,7 @@
 #include <wlr/types/wlr_xdg_output_v1.h>
 #include <wlr/util/log.h>
 #include "xdg-output-unstable-v1-protocol.h"
+#include "util/coalescer.h"
 #include "util/signal.h"
 
 #define OUTPUT_MANAGER_VERSION 3
@@ -205,8 +206,8 @@ static void add_output(struct wlr_xdg_output_manager_v1 *manager,
 	output_update(output);
 }
 
-static void output_manager_send_details(
-		struct wlr_xdg_output_manager_v1 *manager) {
+static void output_manager_send_details(void *data) {
+	struct wlr_xdg_output_manager_v1 *manager = data;
 	struct wlr_xdg_output_v1 *output;
 	wl_list_for_each(output, &manager->outputs, link) {
 		output_update(output);
@@ -223,7 +224,8 @@ static void handle_layout_add(struct wl_listener *listener, void *data) {
 static void handle_layout_change(struct wl_listener *listener, void *data) {
 	struct wlr_xdg_output_manager_v1 *manager =
 		wl_container_of(listener, manager, layout_change);
-	output_manager_send_details(manager);
+	// Layout changes often come in bursts, send a single update
+	coalescer_schedule(manager->coalescer);
 }
 
 static void manager_destroy(struct wlr_xdg_output_manager_v1 *manager) {
@@ -232,6 +234,7 @@ static void manager_destroy(struct wlr_xdg_output_manager_v1 *manager) {
 	wl_list_remove(&manager->layout_add.link);
 	wl_list_remove(&manager->layout_change.link);
 	wl_list_remove(&manager->layout_destroy.link);
+	coalescer_destroy(manager->coalescer);
 	free(manager);
 }
 
@@ -261,10 +264,17 @@ struct wlr_xdg_output_manager_v1 *wlr_xdg_output_manager_v1_create(
 		return NULL;
 	}
 	manager->layout = layout;
+	manager->coalescer = coalescer_create(wl_display_get_event_loop(display),
+		output_manager_send_details, manager);
+	if (manager->coalescer == NULL) {
+		free(manager);
+		return NULL;
+	}
 	manager->global = wl_global_create(display,
 		&zxdg_output_manager_v1_interface, version, manager,
 		output_manager_bind);
 	if (!manager->global) {
+		coalescer_destroy(manager->coalescer);
 		free(manager);
 		return NULL;
 	}
@@ -275,6 +275,8 @@ const struct wlr_surface_role xdg_popup_surface_role = {
 	.name = "xdg_popup",
 	.commit = handle_xdg_surface_commit,
 	.precommit = handle_xdg_surface_precommit,
+	.hold = handle_xdg_surface_hold,
+	.swap_held = handle_xdg_surface_swap_held,
 };
 
 void create_xdg_popup(struct wlr_xdg_surface *xdg_surface,
@@ -93,20 +93,23 @@ void unmap_xdg_surface(struct wlr_xdg_surface *surface) {
 }
 
 
-static void xdg_surface_handle_ack_configure(struct wl_client *client,
-		struct wl_resource *resource, uint32_t serial) {
-	struct wlr_xdg_surface *surface = wlr_xdg_surface_from_resource(resource);
-	if (surface == NULL) {
-		return;
-	}
-
-	if (surface->role == WLR_XDG_SURFACE_ROLE_NONE) {
-		wl_resource_post_error(surface->resource,
-			XDG_SURFACE_ERROR_NOT_CONSTRUCTED,
-			"xdg_surface must have a role");
-		return;
+static bool xdg_surface_has_configure(struct wlr_xdg_surface *surface,
+		uint32_t serial) {
+	struct wlr_xdg_surface_configure *configure;
+	wl_list_for_each(configure, &surface->configure_list, link) {
+		if (configure->serial == serial) {
+			return true;
+		}
 	}
+	return false;
+}
 
+/**
+ * Applies the configure with the given serial, dropping the ones sent before
+ * it. Returns false if there is no such configure.
+ */
+static bool xdg_surface_ack_configure(struct wlr_xdg_surface *surface,
+		uint32_t serial) {
 	bool found = false;
 	struct wlr_xdg_surface_configure *configure, *tmp;
 	wl_list_for_each_safe(configure, tmp, &surface->configure_list, link) {
@@ -121,10 +124,7 @@ static void xdg_surface_handle_ack_configure(struct wl_client *client,
 		}
 	}
 	if (!found) {
-		wl_resource_post_error(surface->client->resource,
-			XDG_WM_BASE_ERROR_INVALID_SURFACE_STATE,
-			"wrong configure serial: %u", serial);
-		return;
+		return false;
 	}
 
 	switch (surface->role) {
@@ -143,6 +143,40 @@ static void xdg_surface_handle_ack_configure(struct wl_client *client,
 
 	wlr_signal_emit_safe(&surface->events.ack_configure, configure);
 	xdg_surface_configure_destroy(configure);
+	return true;
+}
+
+static void xdg_surface_handle_ack_configure(struct wl_client *client,
+		struct wl_resource *resource, uint32_t serial) {
+	struct wlr_xdg_surface *surface = wlr_xdg_surface_from_resource(resource);
+	if (surface == NULL) {
+		return;
+	}
+
+	if (surface->role == WLR_XDG_SURFACE_ROLE_NONE) {
+		wl_resource_post_error(surface->resource,
+			XDG_SURFACE_ERROR_NOT_CONSTRUCTED,
+			"xdg_surface must have a role");
+		return;
+	}
+
+	bool found;
+	if (surface->surface->has_held) {
+		// The configure applies to the next commit, which comes after the
+		// held one
+		found = xdg_surface_has_configure(surface, serial);
+		if (found) {
+			surface->has_pending_ack = true;
+			surface->pending_ack_serial = serial;
+		}
+	} else {
+		found = xdg_surface_ack_configure(surface, serial);
+	}
+	if (!found) {
+		wl_resource_post_error(surface->client->resource,
+			XDG_WM_BASE_ERROR_INVALID_SURFACE_STATE,
+			"wrong configure serial: %u", serial);
+	}
 }
 
 static void surface_send_configure(void *user_data) {
@@ -347,6 +381,13 @@ void handle_xdg_surface_commit(struct wlr_surface *wlr_surface) {
 		return;
 	}
 
+	if (surface->has_pending_ack) {
+		surface->has_pending_ack = false;
+		// The configure may have been dropped in the meantime, e.g. by an
+		// unmap
+		xdg_surface_ack_configure(surface, surface->pending_ack_serial);
+	}
+
 	if (surface->has_next_geometry) {
 		surface->has_next_geometry = false;
 		surface->geometry.x = surface->next_geometry.x;
@@ -382,6 +423,74 @@ void handle_xdg_surface_commit(struct wlr_surface *wlr_surface) {
 	}
 }
 
+void handle_xdg_surface_hold(struct wlr_surface *wlr_surface) {
+	struct wlr_xdg_surface *surface =
+		wlr_xdg_surface_from_wlr_surface(wlr_surface);
+	if (surface == NULL) {
+		return;
+	}
+
+	// Squashed commits accumulate their geometry and acks
+	if (surface->has_next_geometry) {
+		surface->has_next_geometry = false;
+		surface->held.has_next_geometry = true;
+		surface->held.next_geometry = surface->next_geometry;
+	}
+	if (surface->has_pending_ack) {
+		surface->has_pending_ack = false;
+		surface->held.has_pending_ack = true;
+		surface->held.pending_ack_serial = surface->pending_ack_serial;
+	}
+
+	if (surface->role == WLR_XDG_SURFACE_ROLE_TOPLEVEL) {
+		struct wlr_xdg_toplevel *toplevel = surface->toplevel;
+		toplevel->held.max_width = toplevel->client_pending.max_width;
+		toplevel->held.max_height = toplevel->client_pending.max_height;
+		toplevel->held.min_width = toplevel->client_pending.min_width;
+		toplevel->held.min_height = toplevel->client_pending.min_height;
+	}
+}
+
+static void swap_u32(uint32_t *a, uint32_t *b) {
+	uint32_t tmp = *a;
+	*a = *b;
+	*b = tmp;
+}
+
+void handle_xdg_surface_swap_held(struct wlr_surface *wlr_surface) {
+	struct wlr_xdg_surface *surface =
+		wlr_xdg_surface_from_wlr_surface(wlr_surface);
+	if (surface == NULL) {
+		return;
+	}
+
+	bool has_next_geometry = surface->has_next_geometry;
+	struct wlr_box next_geometry = surface->next_geometry;
+	surface->has_next_geometry = surface->held.has_next_geometry;
+	surface->next_geometry = surface->held.next_geometry;
+	surface->held.has_next_geometry = has_next_geometry;
+	surface->held.next_geometry = next_geometry;
+
+	bool has_pending_ack = surface->has_pending_ack;
+	uint32_t pending_ack_serial = surface->pending_ack_serial;
+	surface->has_pending_ack = surface->held.has_pending_ack;
+	surface->pending_ack_serial = surface->held.pending_ack_serial;
+	surface->held.has_pending_ack = has_pending_ack;
+	surface->held.pending_ack_serial = pending_ack_serial;
+
+	if (surface->role == WLR_XDG_SURFACE_ROLE_TOPLEVEL) {
+		struct wlr_xdg_toplevel *toplevel = surface->toplevel;
+		swap_u32(&toplevel->client_pending.max_width,
+			&toplevel->held.max_width);
+		swap_u32(&toplevel->client_pending.max_height,
+			&toplevel->held.max_height);
+		swap_u32(&toplevel->client_pending.min_width,
+			&toplevel->held.min_width);
+		swap_u32(&toplevel->client_pending.min_height,
+			&toplevel->held.min_height);
+	}
+}
+
 void handle_xdg_surface_precommit(struct wlr_surface *wlr_surface) {
 	struct wlr_xdg_surface *surface =
 		wlr_xdg_surface_from_wlr_surface(wlr_surface);
@@ -503,6 +612,8 @@ void reset_xdg_surface(struct wlr_xdg_surface *xdg_surface) {
 	}
 
 	xdg_surface->role = WLR_XDG_SURFACE_ROLE_NONE;
+	xdg_surface->has_pending_ack = false;
+	memset(&xdg_surface->held, 0, sizeof(xdg_surface->held));
 }
 
 void destroy_xdg_surface(struct wlr_xdg_surface *surface) {
@@ -221,6 +221,8 @@ void destroy_xdg_popup_v6(struct wlr_xdg_surface_v6 *surface) {
 	surface->popup = NULL;
 
 	surface->role = WLR_XDG_SURFACE_V6_ROLE_NONE;
+	surface->has_pending_ack = false;
+	memset(&surface->held, 0, sizeof(surface->held));
 }
 
 static void xdg_popup_handle_grab(struct wl_client *client,
@@ -311,6 +313,8 @@ const struct wlr_surface_role xdg_popup_v6_surface_role = {
 	.name = "xdg_popup_v6",
 	.commit = handle_xdg_surface_v6_commit,
 	.precommit = handle_xdg_surface_v6_precommit,
+	.hold = handle_xdg_surface_v6_hold,
+	.swap_held = handle_xdg_surface_v6_swap_held,
 };
 
 void create_xdg_popup_v6(struct wlr_xdg_surface_v6 *xdg_surface,
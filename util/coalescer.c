@@ -0,0 +1,83 @@
+#include <stdlib.h>
+#include <wlr/util/log.h>
+#include "util/coalescer.h"
+#include "util/time.h"
+
+static void coalescer_run(struct wlr_coalescer *coalescer) {
+	coalescer->pending = false;
+	coalescer->last_flush_ms = get_current_time_msec();
+	// The callback may schedule another flush
+	coalescer->flush(coalescer->data);
+}
+
+static void handle_idle(void *data) {
+	struct wlr_coalescer *coalescer = data;
+	coalescer->idle_source = NULL;
+	coalescer_run(coalescer);
+}
+
+static int handle_timer(void *data) {
+	struct wlr_coalescer *coalescer = data;
+	coalescer_run(coalescer);
+	return 0;
+}
+
+struct wlr_coalescer *coalescer_create(struct wl_event_loop *event_loop,
+		coalescer_flush_func_t flush, void *data) {
+	struct wlr_coalescer *coalescer = calloc(1, sizeof(struct wlr_coalescer));
+	if (coalescer == NULL) {
+		return NULL;
+	}
+	coalescer->event_loop = event_loop;
+	coalescer->flush = flush;
+	coalescer->data = data;
+	return coalescer;
+}
+
+void coalescer_destroy(struct wlr_coalescer *coalescer) {
+	if (coalescer == NULL) {
+		return;
+	}
+	if (coalescer->idle_source != NULL) {
+		wl_event_source_remove(coalescer->idle_source);
+	}
+	if (coalescer->timer_source != NULL) {
+		wl_event_source_remove(coalescer->timer_source);
+	}
+	free(coalescer);
+}
+
+void coalescer_set_interval(struct wlr_coalescer *coalescer,
+		uint32_t interval_ms) {
+	coalescer->interval_ms = interval_ms;
+}
+
+void coalescer_schedule(struct wlr_coalescer *coalescer) {
+	if (coalescer->pending) {
+		return;
+	}
+
+	uint32_t elapsed = get_current_time_msec() - coalescer->last_flush_ms;
+	if (coalescer->interval_ms > 0 && elapsed < coalescer->interval_ms) {
+		if (coalescer->timer_source == NULL) {
+			coalescer->timer_source = wl_event_loop_add_timer(
+				coalescer->event_loop, handle_timer, coalescer);
+		}
+		if (coalescer->timer_source != NULL) {
+			wl_event_source_timer_update(coalescer->timer_source,
+				coalescer->interval_ms - elapsed);
+			coalescer->pending = true;
+			return;
+		}
+		wlr_log(WLR_ERROR, "Failed to create timer, flushing on idle");
+	}
+
+	coalescer->idle_source = wl_event_loop_add_idle(coalescer->event_loop,
+		handle_idle, coalescer);
+	if (coalescer->idle_source == NULL) {
+		wlr_log(WLR_ERROR, "Failed to create idle source, flushing now");
+		coalescer_run(coalescer);
+		return;
+	}
+	coalescer->pending = true;
+}
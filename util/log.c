@@ -1,6 +1,10 @@
 #define _XOPEN_SOURCE 700 // for snprintf
 #include <errno.h>
+#include <limits.h>
+#include <signal.h>
 #include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -14,6 +18,39 @@ static bool colored = true;
 static enum wlr_log_importance log_importance = WLR_ERROR;
 static struct timespec start_time = {-1};
 
+#define LOG_RING_ENTRY_SIZE 256
+#define LOG_RING_LINE_SIZE 1024
+
+/**
+ * A message recorded in the ring buffer. The arguments are stored one after
+ * the other as they are consumed by the format string: integers as 64-bit
+ * values, floating point values as double or long double, pointers as is and
+ * strings copied inline, NUL-terminated.
+ */
+struct log_ring_entry {
+	struct timespec time;
+	const char *fmt;
+	uint16_t len; // bytes of data used
+	uint8_t verbosity;
+	bool truncated;
+	unsigned char data[];
+};
+
+#define LOG_RING_DATA_SIZE \
+	(LOG_RING_ENTRY_SIZE - offsetof(struct log_ring_entry, data))
+
+static struct {
+	unsigned char *entries;
+	size_t len, head, count;
+	enum wlr_log_importance verbosity;
+} ring = {0};
+
+static const int crash_signals[] = { SIGSEGV, SIGBUS, SIGILL, SIGFPE, SIGABRT };
+#define CRASH_SIGNALS_LEN (sizeof(crash_signals) / sizeof(crash_signals[0]))
+
+static int crash_fd = -1;
+static struct sigaction crash_prev_actions[CRASH_SIGNALS_LEN];
+
 static const char *verbosity_colors[] = {
 	[WLR_SILENT] = "",
 	[WLR_ERROR] = "\x1B[1;31m",
@@ -70,12 +107,449 @@ static void log_stderr(enum wlr_log_importance verbosity, const char *fmt,
 static wlr_log_func_t log_callback = log_stderr;
 
 static void log_wl(const char *fmt, va_list args) {
-	static char wlr_fmt[1024];
-	int n = snprintf(wlr_fmt, sizeof(wlr_fmt), "[wayland] %s", fmt);
-	if (n > 0 && wlr_fmt[n - 1] == '\n') {
-		wlr_fmt[n - 1] = '\0';
+	// Custom callbacks receive all messages, the default one filters them
+	bool recorded = ring.entries != NULL && WLR_INFO <= ring.verbosity;
+	if (!recorded && log_callback == log_stderr && WLR_INFO > log_importance) {
+		return;
+	}
+
+	// Format right away: recorded messages must keep a valid format string
+	char msg[1024];
+	int n = vsnprintf(msg, sizeof(msg), fmt, args);
+	if (n > 0 && (size_t)n < sizeof(msg) && msg[n - 1] == '\n') {
+		msg[n - 1] = '\0';
+	}
+	_wlr_log(WLR_INFO, "[wayland] %s", msg);
+}
+
+enum format_length {
+	FORMAT_LENGTH_NONE,
+	FORMAT_LENGTH_HH,
+	FORMAT_LENGTH_H,
+	FORMAT_LENGTH_L,
+	FORMAT_LENGTH_LL,
+	FORMAT_LENGTH_J,
+	FORMAT_LENGTH_Z,
+	FORMAT_LENGTH_T,
+	FORMAT_LENGTH_BIG_L,
+};
+
+struct format_spec {
+	const char *start; // points to the '%'
+	size_t len;
+	enum format_length length;
+	int stars; // number of '*' width and precision arguments
+	bool star_precision; // the last '*' argument is the precision
+	int precision; // -1 if unspecified
+	char conversion;
+};
+
+static const char *skip_digits(const char *p) {
+	while (*p >= '0' && *p <= '9') {
+		p++;
+	}
+	return p;
+}
+
+static const char *parse_digits(const char *p, int *value) {
+	*value = 0;
+	while (*p >= '0' && *p <= '9') {
+		if (*value <= (INT_MAX - 9) / 10) {
+			*value = *value * 10 + (*p - '0');
+		}
+		p++;
+	}
+	return p;
+}
+
+/**
+ * Parse the printf conversion specification starting at `fmt`, which must
+ * point to a '%'. Returns a pointer past the specification.
+ */
+static const char *parse_format_spec(const char *fmt,
+		struct format_spec *spec) {
+	const char *p = fmt + 1;
+	spec->start = fmt;
+	spec->stars = 0;
+	spec->star_precision = false;
+	spec->precision = -1;
+	spec->length = FORMAT_LENGTH_NONE;
+
+	while (*p != '\0' && strchr("-+ #0'", *p) != NULL) {
+		p++;
+	}
+	if (*p == '*') {
+		spec->stars++;
+		p++;
+	} else {
+		p = skip_digits(p);
+	}
+	if (*p == '.') {
+		p++;
+		if (*p == '*') {
+			spec->stars++;
+			spec->star_precision = true;
+			p++;
+		} else {
+			p = parse_digits(p, &spec->precision);
+		}
+	}
+
+	switch (*p) {
+	case 'h':
+		if (p[1] == 'h') {
+			spec->length = FORMAT_LENGTH_HH;
+			p++;
+		} else {
+			spec->length = FORMAT_LENGTH_H;
+		}
+		p++;
+		break;
+	case 'l':
+		if (p[1] == 'l') {
+			spec->length = FORMAT_LENGTH_LL;
+			p++;
+		} else {
+			spec->length = FORMAT_LENGTH_L;
+		}
+		p++;
+		break;
+	case 'j':
+		spec->length = FORMAT_LENGTH_J;
+		p++;
+		break;
+	case 'z':
+		spec->length = FORMAT_LENGTH_Z;
+		p++;
+		break;
+	case 't':
+		spec->length = FORMAT_LENGTH_T;
+		p++;
+		break;
+	case 'L':
+		spec->length = FORMAT_LENGTH_BIG_L;
+		p++;
+		break;
+	}
+
+	spec->conversion = *p;
+	if (*p != '\0') {
+		p++;
+	}
+	spec->len = p - fmt;
+	return p;
+}
+
+static bool entry_push(struct log_ring_entry *entry, const void *value,
+		size_t size) {
+	if (entry->len + size > LOG_RING_DATA_SIZE) {
+		entry->truncated = true;
+		return false;
+	}
+	memcpy(entry->data + entry->len, value, size);
+	entry->len += size;
+	return true;
+}
+
+static bool entry_push_int(struct log_ring_entry *entry, uint64_t value) {
+	return entry_push(entry, &value, sizeof(value));
+}
+
+/**
+ * Copy at most `max_len` bytes of `str`, or the whole string if `max_len` is
+ * negative. The string doesn't need to be NUL-terminated within `max_len`.
+ */
+static bool entry_push_strn(struct log_ring_entry *entry, const char *str,
+		int max_len) {
+	if (str == NULL) {
+		str = "(null)";
+	}
+	size_t avail = LOG_RING_DATA_SIZE - entry->len;
+	if (avail == 0) {
+		entry->truncated = true;
+		return false;
+	}
+	size_t len;
+	if (max_len >= 0 && (size_t)max_len < avail) {
+		len = strnlen(str, max_len);
+	} else {
+		// str[len] is within max_len, if any, since len < avail <= max_len
+		len = strnlen(str, avail - 1);
+		if (str[len] != '\0') {
+			entry->truncated = true;
+		}
+	}
+	memcpy(entry->data + entry->len, str, len);
+	entry->data[entry->len + len] = '\0';
+	entry->len += len + 1;
+	return true;
+}
+
+static bool entry_push_str(struct log_ring_entry *entry, const char *str) {
+	return entry_push_strn(entry, str, -1);
+}
+
+static bool is_int_conversion(char conversion) {
+	return strchr("diouxXc", conversion) != NULL;
+}
+
+static bool is_float_conversion(char conversion) {
+	return strchr("fFeEgGaA", conversion) != NULL;
+}
+
+static bool record_arg(struct log_ring_entry *entry,
+		const struct format_spec *spec, va_list *args, int saved_errno) {
+	char conv = spec->conversion;
+	if (conv == '%') {
+		return true;
+	} else if (conv == 'm') {
+		return entry_push_str(entry, strerror(saved_errno));
+	} else if (conv == 's') {
+		if (spec->length == FORMAT_LENGTH_L) {
+			va_arg(*args, const void *);
+			return entry_push_str(entry, "(wide string)");
+		}
+		// The precision bounds the string, which may not be NUL-terminated
+		return entry_push_strn(entry, va_arg(*args, const char *),
+			spec->precision);
+	} else if (conv == 'p') {
+		void *ptr = va_arg(*args, void *);
+		return entry_push(entry, &ptr, sizeof(ptr));
+	} else if (conv == 'n') {
+		va_arg(*args, void *);
+		return true;
+	} else if (is_float_conversion(conv)) {
+		if (spec->length == FORMAT_LENGTH_BIG_L) {
+			long double value = va_arg(*args, long double);
+			return entry_push(entry, &value, sizeof(value));
+		}
+		double value = va_arg(*args, double);
+		return entry_push(entry, &value, sizeof(value));
+	} else if (is_int_conversion(conv)) {
+		switch (spec->length) {
+		case FORMAT_LENGTH_L:
+			return entry_push_int(entry, va_arg(*args, long));
+		case FORMAT_LENGTH_LL:
+			return entry_push_int(entry, va_arg(*args, long long));
+		case FORMAT_LENGTH_J:
+			return entry_push_int(entry, va_arg(*args, intmax_t));
+		case FORMAT_LENGTH_Z:
+			return entry_push_int(entry, va_arg(*args, size_t));
+		case FORMAT_LENGTH_T:
+			return entry_push_int(entry, va_arg(*args, ptrdiff_t));
+		default:
+			return entry_push_int(entry, va_arg(*args, int));
+		}
+	}
+
+	// Unknown conversion, the size of the remaining arguments is unknown
+	entry->truncated = true;
+	return false;
+}
+
+static void ring_record(enum wlr_log_importance verbosity, const char *fmt,
+		va_list args) {
+	int saved_errno = errno;
+
+	struct log_ring_entry *entry = (struct log_ring_entry *)
+		(ring.entries + ring.head * LOG_RING_ENTRY_SIZE);
+	ring.head = (ring.head + 1) % ring.len;
+	if (ring.count < ring.len) {
+		ring.count++;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &entry->time);
+	entry->fmt = fmt;
+	entry->verbosity = verbosity;
+	entry->len = 0;
+	entry->truncated = false;
+
+	va_list copy;
+	va_copy(copy, args);
+	const char *p = fmt;
+	while ((p = strchr(p, '%')) != NULL) {
+		struct format_spec spec;
+		p = parse_format_spec(p, &spec);
+
+		bool ok = true;
+		for (int i = 0; i < spec.stars && ok; i++) {
+			int value = va_arg(copy, int);
+			if (spec.star_precision && i == spec.stars - 1) {
+				// A negative precision is taken as if it were omitted
+				spec.precision = value < 0 ? -1 : value;
+			}
+			ok = entry_push_int(entry, value);
+		}
+		if (!ok || !record_arg(entry, &spec, &copy, saved_errno)) {
+			break;
+		}
+	}
+	va_end(copy);
+
+	errno = saved_errno;
+}
+
+struct log_line {
+	char *buf;
+	size_t size, len;
+};
+
+static void line_append(struct log_line *line, const char *str, size_t len) {
+	size_t avail = line->size - 1 - line->len;
+	if (len > avail) {
+		len = avail;
+	}
+	memcpy(line->buf + line->len, str, len);
+	line->len += len;
+	line->buf[line->len] = '\0';
+}
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wformat-nonliteral"
+
+static void line_appendf(struct log_line *line, const char *fmt, ...) {
+	va_list args;
+	va_start(args, fmt);
+	int n = vsnprintf(line->buf + line->len, line->size - line->len, fmt, args);
+	va_end(args);
+	if (n > 0) {
+		line->len += (size_t)n < line->size - line->len ?
+			(size_t)n : line->size - 1 - line->len;
+	}
+}
+
+static bool entry_pop(const struct log_ring_entry *entry, size_t *offset,
+		void *value, size_t size) {
+	if (*offset + size > entry->len) {
+		return false;
+	}
+	memcpy(value, entry->data + *offset, size);
+	*offset += size;
+	return true;
+}
+
+/**
+ * Format a single argument with the original conversion specification, the
+ * '*' width and precision replaced with their recorded values.
+ */
+static bool format_arg(struct log_line *line, const struct log_ring_entry *entry,
+		size_t *offset, const struct format_spec *spec) {
+	char spec_fmt[64];
+	struct log_line spec_line = { .buf = spec_fmt, .size = sizeof(spec_fmt) };
+	spec_fmt[0] = '\0';
+
+	for (size_t i = 0; i < spec->len; i++) {
+		if (spec->start[i] == '*') {
+			uint64_t value;
+			if (!entry_pop(entry, offset, &value, sizeof(value))) {
+				return false;
+			}
+			line_appendf(&spec_line, "%d", (int)value);
+		} else if (i == spec->len - 1 && spec->conversion == 'm') {
+			line_append(&spec_line, "s", 1);
+		} else if (spec->conversion == 's' && spec->start[i] == 'l') {
+			// Wide strings are recorded as narrow ones
+		} else {
+			line_append(&spec_line, &spec->start[i], 1);
+		}
+	}
+
+	char conv = spec->conversion;
+	if (conv == '%') {
+		line_append(line, "%", 1);
+	} else if (conv == 's' || conv == 'm') {
+		const char *str = (const char *)entry->data + *offset;
+		if (*offset >= entry->len) {
+			return false;
+		}
+		*offset += strlen(str) + 1;
+		line_appendf(line, spec_fmt, str);
+	} else if (conv == 'p') {
+		void *ptr;
+		if (!entry_pop(entry, offset, &ptr, sizeof(ptr))) {
+			return false;
+		}
+		line_appendf(line, spec_fmt, ptr);
+	} else if (conv == 'n') {
+		// Nothing to print
+	} else if (is_float_conversion(conv)) {
+		if (spec->length == FORMAT_LENGTH_BIG_L) {
+			long double value;
+			if (!entry_pop(entry, offset, &value, sizeof(value))) {
+				return false;
+			}
+			line_appendf(line, spec_fmt, value);
+		} else {
+			double value;
+			if (!entry_pop(entry, offset, &value, sizeof(value))) {
+				return false;
+			}
+			line_appendf(line, spec_fmt, value);
+		}
+	} else if (is_int_conversion(conv)) {
+		uint64_t value;
+		if (!entry_pop(entry, offset, &value, sizeof(value))) {
+			return false;
+		}
+		switch (spec->length) {
+		case FORMAT_LENGTH_L:
+			line_appendf(line, spec_fmt, (long)value);
+			break;
+		case FORMAT_LENGTH_LL:
+			line_appendf(line, spec_fmt, (long long)value);
+			break;
+		case FORMAT_LENGTH_J:
+			line_appendf(line, spec_fmt, (intmax_t)value);
+			break;
+		case FORMAT_LENGTH_Z:
+			line_appendf(line, spec_fmt, (size_t)value);
+			break;
+		case FORMAT_LENGTH_T:
+			line_appendf(line, spec_fmt, (ptrdiff_t)value);
+			break;
+		default:
+			line_appendf(line, spec_fmt, (int)value);
+			break;
+		}
+	} else {
+		return false;
+	}
+	return true;
+}
+
+#pragma GCC diagnostic pop
+
+static void format_entry(struct log_line *line,
+		const struct log_ring_entry *entry) {
+	struct timespec ts;
+	timespec_sub(&ts, &entry->time, &start_time);
+	unsigned c = (entry->verbosity < WLR_LOG_IMPORTANCE_LAST) ?
+		entry->verbosity : WLR_LOG_IMPORTANCE_LAST - 1;
+	line_appendf(line, "%02d:%02d:%02d.%03ld %s ",
+		(int)(ts.tv_sec / 60 / 60), (int)(ts.tv_sec / 60 % 60),
+		(int)(ts.tv_sec % 60), ts.tv_nsec / 1000000, verbosity_headers[c]);
+
+	size_t offset = 0;
+	const char *p = entry->fmt;
+	while (*p != '\0') {
+		const char *percent = strchr(p, '%');
+		if (percent == NULL) {
+			line_append(line, p, strlen(p));
+			break;
+		}
+		line_append(line, p, percent - p);
+
+		struct format_spec spec;
+		p = parse_format_spec(percent, &spec);
+		if (!format_arg(line, entry, &offset, &spec)) {
+			break;
+		}
+	}
+
+	if (entry->truncated) {
+		line_append(line, "...", 3);
 	}
-	_wlr_vlog(WLR_INFO, wlr_fmt, args);
+	line_append(line, "\n", 1);
 }
 
 void wlr_log_init(enum wlr_log_importance verbosity, wlr_log_func_t callback) {
@@ -92,16 +566,103 @@ void wlr_log_init(enum wlr_log_importance verbosity, wlr_log_func_t callback) {
 }
 
 void _wlr_vlog(enum wlr_log_importance verbosity, const char *fmt, va_list args) {
+	if (ring.entries != NULL && verbosity <= ring.verbosity) {
+		ring_record(verbosity, fmt, args);
+	}
 	log_callback(verbosity, fmt, args);
 }
 
 void _wlr_log(enum wlr_log_importance verbosity, const char *fmt, ...) {
 	va_list args;
 	va_start(args, fmt);
-	log_callback(verbosity, fmt, args);
+	_wlr_vlog(verbosity, fmt, args);
 	va_end(args);
 }
 
 enum wlr_log_importance wlr_log_get_verbosity(void) {
 	return log_importance;
 }
+
+bool wlr_log_ring_init(size_t size, enum wlr_log_importance verbosity) {
+	init_start_time();
+
+	size_t len = size / LOG_RING_ENTRY_SIZE;
+	unsigned char *entries = NULL;
+	if (len > 0) {
+		entries = calloc(len, LOG_RING_ENTRY_SIZE);
+		if (entries == NULL) {
+			return false;
+		}
+	}
+
+	free(ring.entries);
+	ring.entries = entries;
+	ring.len = len;
+	ring.head = ring.count = 0;
+	ring.verbosity = verbosity < WLR_LOG_IMPORTANCE_LAST ?
+		verbosity : WLR_LOG_IMPORTANCE_LAST - 1;
+	return true;
+}
+
+void wlr_log_ring_dump(int fd) {
+	char buf[LOG_RING_LINE_SIZE];
+	for (size_t i = 0; i < ring.count; i++) {
+		size_t index = (ring.head + ring.len - ring.count + i) % ring.len;
+		const struct log_ring_entry *entry = (const struct log_ring_entry *)
+			(ring.entries + index * LOG_RING_ENTRY_SIZE);
+
+		struct log_line line = { .buf = buf, .size = sizeof(buf) };
+		buf[0] = '\0';
+		format_entry(&line, entry);
+
+		size_t written = 0;
+		while (written < line.len) {
+			ssize_t n = write(fd, buf + written, line.len - written);
+			if (n < 0 && errno == EINTR) {
+				continue;
+			} else if (n <= 0) {
+				return;
+			}
+			written += n;
+		}
+	}
+}
+
+static void handle_crash_signal(int sig) {
+	int saved_errno = errno;
+	// Not async-signal-safe, but the process is going down anyway
+	if (crash_fd >= 0) {
+		wlr_log_ring_dump(crash_fd);
+	}
+
+	// Hand the signal over to the previous handler, or the default action
+	for (size_t i = 0; i < CRASH_SIGNALS_LEN; i++) {
+		if (crash_signals[i] == sig) {
+			sigaction(sig, &crash_prev_actions[i], NULL);
+			break;
+		}
+	}
+	errno = saved_errno;
+	raise(sig);
+}
+
+void wlr_log_ring_set_crash_fd(int fd) {
+	bool installed = crash_fd >= 0;
+	crash_fd = fd;
+	if (installed == (fd >= 0)) {
+		return;
+	}
+
+	for (size_t i = 0; i < CRASH_SIGNALS_LEN; i++) {
+		if (fd >= 0) {
+			struct sigaction action = {
+				.sa_handler = handle_crash_signal,
+				.sa_flags = SA_NODEFER,
+			};
+			sigemptyset(&action.sa_mask);
+			sigaction(crash_signals[i], &action, &crash_prev_actions[i]);
+		} else {
+			sigaction(crash_signals[i], &crash_prev_actions[i], NULL);
+		}
+	}
+}
@@ -0,0 +1,221 @@
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <wayland-server-protocol.h>
+#include "util/pixel_convert.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86 1
+#endif
+#if defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+struct pixel_layout {
+	enum wl_shm_format format;
+	// Offsets of the red, green, blue and alpha (or padding) bytes in memory
+	uint8_t offsets[4];
+	bool has_alpha;
+};
+
+/*
+ * The wayland formats are little endian, e.g. WL_SHM_FORMAT_ARGB8888 is stored
+ * as B, G, R, A in memory.
+ */
+static const struct pixel_layout layouts[] = {
+	{ WL_SHM_FORMAT_ARGB8888, { 2, 1, 0, 3 }, true },
+	{ WL_SHM_FORMAT_XRGB8888, { 2, 1, 0, 3 }, false },
+	{ WL_SHM_FORMAT_ABGR8888, { 0, 1, 2, 3 }, true },
+	{ WL_SHM_FORMAT_XBGR8888, { 0, 1, 2, 3 }, false },
+	{ WL_SHM_FORMAT_RGBA8888, { 3, 2, 1, 0 }, true },
+	{ WL_SHM_FORMAT_RGBX8888, { 3, 2, 1, 0 }, false },
+	{ WL_SHM_FORMAT_BGRA8888, { 1, 2, 3, 0 }, true },
+	{ WL_SHM_FORMAT_BGRX8888, { 1, 2, 3, 0 }, false },
+};
+
+struct convert_op {
+	// For each destination byte of 4 pixels, the source byte to pick, or
+	// 0x80 to zero it
+	uint8_t shuffle[16];
+	// Or'ed to each destination pixel, sets missing alpha to 0xFF
+	uint32_t alpha_mask;
+	bool identity;
+	// Only the red and blue bytes, at offsets 0 and 2, are swapped
+	bool swap_rb;
+};
+
+static const struct pixel_layout *get_layout(enum wl_shm_format fmt) {
+	for (size_t i = 0; i < sizeof(layouts) / sizeof(layouts[0]); ++i) {
+		if (layouts[i].format == fmt) {
+			return &layouts[i];
+		}
+	}
+	return NULL;
+}
+
+static void init_convert_op(struct convert_op *op,
+		const struct pixel_layout *dst, const struct pixel_layout *src) {
+	uint8_t shuffle[4];
+	uint8_t alpha[4] = {0};
+	for (size_t c = 0; c < 4; ++c) {
+		if (c == 3 && !(dst->has_alpha && src->has_alpha)) {
+			shuffle[dst->offsets[c]] = 0x80;
+			alpha[dst->offsets[c]] = 0xFF;
+		} else {
+			shuffle[dst->offsets[c]] = src->offsets[c];
+		}
+	}
+
+	for (size_t i = 0; i < 16; ++i) {
+		uint8_t s = shuffle[i % 4];
+		op->shuffle[i] = s == 0x80 ? 0x80 : (i / 4) * 4 + s;
+	}
+	memcpy(&op->alpha_mask, alpha, sizeof(alpha));
+
+	bool rb_ga_kept = shuffle[1] == 1 && (shuffle[3] == 3 || shuffle[3] == 0x80);
+	op->identity = rb_ga_kept && shuffle[0] == 0 && shuffle[2] == 2;
+	op->swap_rb = rb_ga_kept && shuffle[0] == 2 && shuffle[2] == 0;
+}
+
+static void convert_row_scalar(uint8_t *dst, const uint8_t *src, size_t n,
+		const struct convert_op *op) {
+	for (size_t i = 0; i < n; ++i) {
+		uint8_t px[4];
+		for (size_t j = 0; j < 4; ++j) {
+			uint8_t s = op->shuffle[j];
+			px[j] = s == 0x80 ? 0 : src[4 * i + s];
+		}
+		uint32_t v;
+		memcpy(&v, px, sizeof(v));
+		v |= op->alpha_mask;
+		memcpy(&dst[4 * i], &v, sizeof(v));
+	}
+}
+
+#if defined(__SSE2__)
+/**
+ * SSE2 has no byte shuffle, only handle the common red/blue swap with shifts.
+ */
+static void convert_row_sse2(uint8_t *dst, const uint8_t *src, size_t n,
+		const struct convert_op *op) {
+	const __m128i ga = _mm_set1_epi32(0xFF00FF00);
+	const __m128i low = _mm_set1_epi32(0x000000FF);
+	const __m128i alpha = _mm_set1_epi32(op->alpha_mask);
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4) {
+		__m128i px = _mm_loadu_si128((const __m128i *)&src[4 * i]);
+		if (op->swap_rb) {
+			__m128i r = _mm_and_si128(_mm_srli_epi32(px, 16), low);
+			__m128i b = _mm_slli_epi32(_mm_and_si128(px, low), 16);
+			px = _mm_or_si128(_mm_and_si128(px, ga), _mm_or_si128(r, b));
+		}
+		px = _mm_or_si128(px, alpha);
+		_mm_storeu_si128((__m128i *)&dst[4 * i], px);
+	}
+	convert_row_scalar(&dst[4 * i], &src[4 * i], n - i, op);
+}
+#endif
+
+#if defined(HAVE_X86)
+__attribute__((target("avx2")))
+static void convert_row_avx2(uint8_t *dst, const uint8_t *src, size_t n,
+		const struct convert_op *op) {
+	// The shuffle works within each 128-bit lane
+	const __m128i shuffle128 = _mm_loadu_si128((const __m128i *)op->shuffle);
+	const __m256i shuffle = _mm256_broadcastsi128_si256(shuffle128);
+	const __m256i alpha = _mm256_set1_epi32(op->alpha_mask);
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m256i px = _mm256_loadu_si256((const __m256i *)&src[4 * i]);
+		px = _mm256_or_si256(_mm256_shuffle_epi8(px, shuffle), alpha);
+		_mm256_storeu_si256((__m256i *)&dst[4 * i], px);
+	}
+	convert_row_scalar(&dst[4 * i], &src[4 * i], n - i, op);
+}
+#endif
+
+#if defined(__aarch64__)
+static void convert_row_neon(uint8_t *dst, const uint8_t *src, size_t n,
+		const struct convert_op *op) {
+	// Out of range indices, such as 0x80, select zero
+	const uint8x16_t shuffle = vld1q_u8(op->shuffle);
+	const uint8x16_t alpha = vreinterpretq_u8_u32(vdupq_n_u32(op->alpha_mask));
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4) {
+		uint8x16_t px = vld1q_u8(&src[4 * i]);
+		px = vorrq_u8(vqtbl1q_u8(px, shuffle), alpha);
+		vst1q_u8(&dst[4 * i], px);
+	}
+	convert_row_scalar(&dst[4 * i], &src[4 * i], n - i, op);
+}
+#endif
+
+typedef void (*convert_row_func_t)(uint8_t *dst, const uint8_t *src,
+	size_t n, const struct convert_op *op);
+
+static convert_row_func_t get_convert_row_func(const struct convert_op *op) {
+#if defined(HAVE_X86)
+	static int has_avx2 = -1;
+	if (has_avx2 < 0) {
+		__builtin_cpu_init();
+		has_avx2 = __builtin_cpu_supports("avx2");
+	}
+	if (has_avx2) {
+		return convert_row_avx2;
+	}
+#endif
+#if defined(__SSE2__)
+	if (op->identity || op->swap_rb) {
+		return convert_row_sse2;
+	}
+#endif
+#if defined(__aarch64__)
+	return convert_row_neon;
+#endif
+	return convert_row_scalar;
+}
+
+bool pixel_convert_supported(enum wl_shm_format dst_fmt,
+		enum wl_shm_format src_fmt) {
+	return get_layout(dst_fmt) != NULL && get_layout(src_fmt) != NULL;
+}
+
+bool convert_pixels(enum wl_shm_format dst_fmt, void *dst, uint32_t dst_stride,
+		enum wl_shm_format src_fmt, const void *src, uint32_t src_stride,
+		uint32_t width, uint32_t height, bool flip_y) {
+	const struct pixel_layout *dst_layout = get_layout(dst_fmt);
+	const struct pixel_layout *src_layout = get_layout(src_fmt);
+	if (dst_layout == NULL || src_layout == NULL) {
+		return false;
+	}
+
+	struct convert_op op;
+	init_convert_op(&op, dst_layout, src_layout);
+
+	uint8_t *dst_row = dst;
+	const uint8_t *src_row = src;
+	size_t row_size = (size_t)width * 4;
+
+	// Plain copies without repacking or flipping are a single memcpy
+	if (op.identity && op.alpha_mask == 0 && !flip_y &&
+			dst_stride == src_stride && dst_stride == row_size) {
+		memcpy(dst_row, src_row, row_size * height);
+		return true;
+	}
+
+	convert_row_func_t convert_row = get_convert_row_func(&op);
+	for (uint32_t y = 0; y < height; ++y) {
+		uint32_t src_y = flip_y ? height - y - 1 : y;
+		uint8_t *d = dst_row + (size_t)y * dst_stride;
+		const uint8_t *s = src_row + (size_t)src_y * src_stride;
+		if (op.identity && op.alpha_mask == 0) {
+			memcpy(d, s, row_size);
+		} else {
+			convert_row(d, s, width, &op);
+		}
+	}
+
+	return true;
+}
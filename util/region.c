@@ -1,7 +1,10 @@
 #include <assert.h>
 #include <math.h>
 #include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include <wlr/types/wlr_box.h>
 #include <wlr/util/region.h>
 
@@ -10,36 +13,67 @@ void wlr_region_scale(pixman_region32_t *dst, pixman_region32_t *src,
 	wlr_region_scale_xy(dst, src, scale, scale);
 }
 
-void wlr_region_scale_xy(pixman_region32_t *dst, pixman_region32_t *src,
+/**
+ * Transforms and scales an array of rectangles in one pass. A transform is
+ * decomposed into an optional swap of the axes followed by optional flips, so
+ * that the loops are free of branches.
+ */
+static void transform_scale_rects(pixman_box32_t *dst,
+		const pixman_box32_t *src, int nrects,
+		enum wl_output_transform transform, int width, int height,
 		float scale_x, float scale_y) {
+	bool swap = transform % 2 != 0;
+	bool flip_x = transform == WL_OUTPUT_TRANSFORM_90 ||
+		transform == WL_OUTPUT_TRANSFORM_180 ||
+		transform == WL_OUTPUT_TRANSFORM_FLIPPED ||
+		transform == WL_OUTPUT_TRANSFORM_FLIPPED_270;
+	bool flip_y = transform == WL_OUTPUT_TRANSFORM_180 ||
+		transform == WL_OUTPUT_TRANSFORM_270 ||
+		transform == WL_OUTPUT_TRANSFORM_FLIPPED_180 ||
+		transform == WL_OUTPUT_TRANSFORM_FLIPPED_270;
+	int32_t dst_width = swap ? height : width;
+	int32_t dst_height = swap ? width : height;
+
+	for (int i = 0; i < nrects; ++i) {
+		int32_t x1 = swap ? src[i].y1 : src[i].x1;
+		int32_t y1 = swap ? src[i].x1 : src[i].y1;
+		int32_t x2 = swap ? src[i].y2 : src[i].x2;
+		int32_t y2 = swap ? src[i].x2 : src[i].y2;
+		dst[i].x1 = flip_x ? dst_width - x2 : x1;
+		dst[i].x2 = flip_x ? dst_width - x1 : x2;
+		dst[i].y1 = flip_y ? dst_height - y2 : y1;
+		dst[i].y2 = flip_y ? dst_height - y1 : y2;
+	}
+
 	if (scale_x == 1.0 && scale_y == 1.0) {
-		pixman_region32_copy(dst, src);
 		return;
 	}
 
-	int nrects;
-	pixman_box32_t *src_rects = pixman_region32_rectangles(src, &nrects);
-
-	pixman_box32_t *dst_rects = malloc(nrects * sizeof(pixman_box32_t));
-	if (dst_rects == NULL) {
+	int32_t int_scale_x = (int32_t)scale_x, int_scale_y = (int32_t)scale_y;
+	if (int_scale_x == scale_x && int_scale_y == scale_y) {
+		// Integer scale, no rounding needed
+		for (int i = 0; i < nrects; ++i) {
+			dst[i].x1 *= int_scale_x;
+			dst[i].x2 *= int_scale_x;
+			dst[i].y1 *= int_scale_y;
+			dst[i].y2 *= int_scale_y;
+		}
 		return;
 	}
 
 	for (int i = 0; i < nrects; ++i) {
-		dst_rects[i].x1 = floor(src_rects[i].x1 * scale_x);
-		dst_rects[i].x2 = ceil(src_rects[i].x2 * scale_x);
-		dst_rects[i].y1 = floor(src_rects[i].y1 * scale_y);
-		dst_rects[i].y2 = ceil(src_rects[i].y2 * scale_y);
+		dst[i].x1 = floor(dst[i].x1 * scale_x);
+		dst[i].x2 = ceil(dst[i].x2 * scale_x);
+		dst[i].y1 = floor(dst[i].y1 * scale_y);
+		dst[i].y2 = ceil(dst[i].y2 * scale_y);
 	}
-
-	pixman_region32_fini(dst);
-	pixman_region32_init_rects(dst, dst_rects, nrects);
-	free(dst_rects);
 }
 
-void wlr_region_transform(pixman_region32_t *dst, pixman_region32_t *src,
-		enum wl_output_transform transform, int width, int height) {
-	if (transform == WL_OUTPUT_TRANSFORM_NORMAL) {
+static void region_transform_scale(pixman_region32_t *dst,
+		pixman_region32_t *src, enum wl_output_transform transform,
+		int width, int height, float scale_x, float scale_y) {
+	if (transform == WL_OUTPUT_TRANSFORM_NORMAL &&
+			scale_x == 1.0 && scale_y == 1.0) {
 		pixman_region32_copy(dst, src);
 		return;
 	}
@@ -47,69 +81,50 @@ void wlr_region_transform(pixman_region32_t *dst, pixman_region32_t *src,
 	int nrects;
 	pixman_box32_t *src_rects = pixman_region32_rectangles(src, &nrects);
 
+	if (transform == WL_OUTPUT_TRANSFORM_NORMAL && nrects == 1 &&
+			scale_x == (int32_t)scale_x && scale_y == (int32_t)scale_y) {
+		// A single rectangle with an integer scale stays a single rectangle
+		pixman_box32_t box = {
+			.x1 = src_rects[0].x1 * (int32_t)scale_x,
+			.y1 = src_rects[0].y1 * (int32_t)scale_y,
+			.x2 = src_rects[0].x2 * (int32_t)scale_x,
+			.y2 = src_rects[0].y2 * (int32_t)scale_y,
+		};
+		pixman_region32_fini(dst);
+		pixman_region32_init_with_extents(dst, &box);
+		return;
+	}
+
 	pixman_box32_t *dst_rects = malloc(nrects * sizeof(pixman_box32_t));
 	if (dst_rects == NULL) {
 		return;
 	}
 
-	for (int i = 0; i < nrects; ++i) {
-		switch (transform) {
-		case WL_OUTPUT_TRANSFORM_NORMAL:
-			dst_rects[i].x1 = src_rects[i].x1;
-			dst_rects[i].y1 = src_rects[i].y1;
-			dst_rects[i].x2 = src_rects[i].x2;
-			dst_rects[i].y2 = src_rects[i].y2;
-			break;
-		case WL_OUTPUT_TRANSFORM_90:
-			dst_rects[i].x1 = height - src_rects[i].y2;
-			dst_rects[i].y1 = src_rects[i].x1;
-			dst_rects[i].x2 = height - src_rects[i].y1;
-			dst_rects[i].y2 = src_rects[i].x2;
-			break;
-		case WL_OUTPUT_TRANSFORM_180:
-			dst_rects[i].x1 = width - src_rects[i].x2;
-			dst_rects[i].y1 = height - src_rects[i].y2;
-			dst_rects[i].x2 = width - src_rects[i].x1;
-			dst_rects[i].y2 = height - src_rects[i].y1;
-			break;
-		case WL_OUTPUT_TRANSFORM_270:
-			dst_rects[i].x1 = src_rects[i].y1;
-			dst_rects[i].y1 = width - src_rects[i].x2;
-			dst_rects[i].x2 = src_rects[i].y2;
-			dst_rects[i].y2 = width - src_rects[i].x1;
-			break;
-		case WL_OUTPUT_TRANSFORM_FLIPPED:
-			dst_rects[i].x1 = width - src_rects[i].x2;
-			dst_rects[i].y1 = src_rects[i].y1;
-			dst_rects[i].x2 = width - src_rects[i].x1;
-			dst_rects[i].y2 = src_rects[i].y2;
-			break;
-		case WL_OUTPUT_TRANSFORM_FLIPPED_90:
-			dst_rects[i].x1 = src_rects[i].y1;
-			dst_rects[i].y1 = src_rects[i].x1;
-			dst_rects[i].x2 = src_rects[i].y2;
-			dst_rects[i].y2 = src_rects[i].x2;
-			break;
-		case WL_OUTPUT_TRANSFORM_FLIPPED_180:
-			dst_rects[i].x1 = src_rects[i].x1;
-			dst_rects[i].y1 = height - src_rects[i].y2;
-			dst_rects[i].x2 = src_rects[i].x2;
-			dst_rects[i].y2 = height - src_rects[i].y1;
-			break;
-		case WL_OUTPUT_TRANSFORM_FLIPPED_270:
-			dst_rects[i].x1 = height - src_rects[i].y2;
-			dst_rects[i].y1 = width - src_rects[i].x2;
-			dst_rects[i].x2 = height - src_rects[i].y1;
-			dst_rects[i].y2 = width - src_rects[i].x1;
-			break;
-		}
-	}
+	transform_scale_rects(dst_rects, src_rects, nrects, transform,
+		width, height, scale_x, scale_y);
 
 	pixman_region32_fini(dst);
 	pixman_region32_init_rects(dst, dst_rects, nrects);
 	free(dst_rects);
 }
 
+void wlr_region_scale_xy(pixman_region32_t *dst, pixman_region32_t *src,
+		float scale_x, float scale_y) {
+	region_transform_scale(dst, src, WL_OUTPUT_TRANSFORM_NORMAL, 0, 0,
+		scale_x, scale_y);
+}
+
+void wlr_region_transform(pixman_region32_t *dst, pixman_region32_t *src,
+		enum wl_output_transform transform, int width, int height) {
+	region_transform_scale(dst, src, transform, width, height, 1.0, 1.0);
+}
+
+void wlr_region_transform_scale(pixman_region32_t *dst,
+		pixman_region32_t *src, enum wl_output_transform transform,
+		int width, int height, float scale) {
+	region_transform_scale(dst, src, transform, width, height, scale, scale);
+}
+
 void wlr_region_expand(pixman_region32_t *dst, pixman_region32_t *src,
 		int distance) {
 	if (distance == 0) {
@@ -186,6 +201,112 @@ void wlr_region_rotated_bounds(pixman_region32_t *dst, pixman_region32_t *src,
 	free(dst_rects);
 }
 
+static int64_t box_area(const pixman_box32_t *box) {
+	return (int64_t)(box->x2 - box->x1) * (box->y2 - box->y1);
+}
+
+static int64_t box_overlap_area(const pixman_box32_t *a,
+		const pixman_box32_t *b) {
+	pixman_box32_t overlap = {
+		.x1 = a->x1 > b->x1 ? a->x1 : b->x1,
+		.y1 = a->y1 > b->y1 ? a->y1 : b->y1,
+		.x2 = a->x2 < b->x2 ? a->x2 : b->x2,
+		.y2 = a->y2 < b->y2 ? a->y2 : b->y2,
+	};
+	if (overlap.x1 >= overlap.x2 || overlap.y1 >= overlap.y2) {
+		return 0;
+	}
+	return box_area(&overlap);
+}
+
+static int64_t region_paint_cost(pixman_region32_t *region, int rect_cost) {
+	int nrects;
+	pixman_box32_t *rects = pixman_region32_rectangles(region, &nrects);
+	int64_t cost = 0;
+	for (int i = 0; i < nrects; ++i) {
+		cost += box_area(&rects[i]) + rect_cost;
+	}
+	return cost;
+}
+
+void wlr_region_merge_rects(pixman_region32_t *dst, pixman_region32_t *src,
+		int rect_cost, int max_rects) {
+	int nrects;
+	pixman_box32_t *src_rects = pixman_region32_rectangles(src, &nrects);
+	if (nrects <= 1 || rect_cost <= 0 ||
+			nrects > WLR_REGION_MERGE_RECTS_MAX) {
+		if (nrects > max_rects) {
+			pixman_box32_t extents = *pixman_region32_extents(src);
+			pixman_region32_fini(dst);
+			pixman_region32_init_with_extents(dst, &extents);
+		} else {
+			pixman_region32_copy(dst, src);
+		}
+		return;
+	}
+
+	pixman_box32_t *rects = malloc(nrects * sizeof(pixman_box32_t));
+	if (rects == NULL) {
+		pixman_region32_copy(dst, src);
+		return;
+	}
+	memcpy(rects, src_rects, nrects * sizeof(pixman_box32_t));
+
+	// Greedily merge two rectangles whenever the area painted needlessly by
+	// their bounding box costs less than drawing them separately
+	for (int i = 0; i < nrects; ++i) {
+		int j = i + 1;
+		while (j < nrects) {
+			pixman_box32_t *a = &rects[i], *b = &rects[j];
+			pixman_box32_t merged = {
+				.x1 = a->x1 < b->x1 ? a->x1 : b->x1,
+				.y1 = a->y1 < b->y1 ? a->y1 : b->y1,
+				.x2 = a->x2 > b->x2 ? a->x2 : b->x2,
+				.y2 = a->y2 > b->y2 ? a->y2 : b->y2,
+			};
+			int64_t overdraw = box_area(&merged) -
+				(box_area(a) + box_area(b) - box_overlap_area(a, b));
+			if (overdraw >= rect_cost) {
+				++j;
+				continue;
+			}
+
+			*a = merged;
+			rects[j] = rects[--nrects];
+			// The merged rectangle grew, so the rectangles following it which
+			// were skipped may be worth merging now: scan them again.
+			// Rectangles before it aren't reconsidered.
+			j = i + 1;
+		}
+	}
+
+	// pixman splits boxes which overlap vertically into bands, so the merged
+	// region may have more rectangles than estimated above. Keep the cheapest
+	// of the merged region, the original one and their extents.
+	pixman_region32_t merged;
+	pixman_region32_init_rects(&merged, rects, nrects);
+	free(rects);
+
+	pixman_box32_t extents = *pixman_region32_extents(src);
+	int64_t src_cost = region_paint_cost(src, rect_cost);
+	int64_t merged_cost = region_paint_cost(&merged, rect_cost);
+	int64_t extents_cost = box_area(&extents) + rect_cost;
+	if (extents_cost <= merged_cost && extents_cost <= src_cost) {
+		pixman_region32_fini(dst);
+		pixman_region32_init_with_extents(dst, &extents);
+	} else if (merged_cost < src_cost) {
+		pixman_region32_copy(dst, &merged);
+	} else {
+		pixman_region32_copy(dst, src);
+	}
+	pixman_region32_fini(&merged);
+
+	if (pixman_region32_n_rects(dst) > max_rects) {
+		pixman_region32_fini(dst);
+		pixman_region32_init_with_extents(dst, &extents);
+	}
+}
+
 static void region_confine(pixman_region32_t *region, double x1, double y1, double x2,
 		double y2, double *x2_out, double *y2_out, pixman_box32_t box) {
 	double x_clamped = fmax(fmin(x2, box.x2 - 1), box.x1);
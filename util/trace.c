@@ -0,0 +1,236 @@
+#define _POSIX_C_SOURCE 200809L
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <wlr/util/log.h>
+#include <wlr/util/trace.h>
+#include "util/trace.h"
+
+struct trace_event {
+	uint64_t ts; // ns, CLOCK_MONOTONIC
+	const char *name;
+	char phase;
+	char label[23];
+};
+
+/**
+ * Only written by its thread. Readers may race with the writer and get a
+ * partially overwritten old event, which is acceptable for tracing.
+ *
+ * Rings are never freed, since their thread may be recording an event at any
+ * time: a thread re-uses its ring when tracing is restarted, and only
+ * allocates a new one if the capacity has changed.
+ */
+struct trace_ring {
+	struct trace_ring *next;
+	int tid;
+	size_t capacity;
+	// Tracing session the events belong to, rings of previous sessions are
+	// skipped by readers
+	atomic_uint generation;
+	_Atomic uint64_t head; // total number of events recorded
+	uint64_t flushed; // events already written by wlr_trace_flush
+	struct trace_event events[];
+};
+
+atomic_bool trace_enabled = false;
+
+static _Atomic(struct trace_ring *) rings = NULL;
+static atomic_int next_tid = 1;
+static atomic_uint generation = 0;
+static _Atomic size_t ring_capacity = 0;
+static bool stream_started = false, stream_has_events = false;
+
+static _Thread_local struct trace_ring *thread_ring = NULL;
+static _Thread_local unsigned thread_ring_generation = 0;
+
+static uint64_t get_time_nsec(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static struct trace_ring *get_thread_ring(void) {
+	unsigned gen = atomic_load(&generation);
+	if (thread_ring != NULL && thread_ring_generation == gen) {
+		return thread_ring;
+	}
+
+	size_t capacity = atomic_load(&ring_capacity);
+	if (thread_ring != NULL && thread_ring->capacity == capacity) {
+		// Only this thread writes to its ring, it can be reset safely
+		atomic_store_explicit(&thread_ring->head, 0, memory_order_relaxed);
+		atomic_store_explicit(&thread_ring->generation, gen,
+			memory_order_release);
+		thread_ring_generation = gen;
+		return thread_ring;
+	}
+
+	// The previous ring, if any, stays in the list of rings
+	struct trace_ring *ring = calloc(1, sizeof(struct trace_ring) +
+		capacity * sizeof(struct trace_event));
+	if (ring == NULL) {
+		return NULL;
+	}
+	ring->tid = thread_ring != NULL ?
+		thread_ring->tid : atomic_fetch_add(&next_tid, 1);
+	ring->capacity = capacity;
+	atomic_init(&ring->generation, gen);
+
+	// Lock-free push, rings are never removed from the list
+	ring->next = atomic_load(&rings);
+	while (!atomic_compare_exchange_weak(&rings, &ring->next, ring)) {
+		// ring->next has been updated with the current head
+	}
+
+	thread_ring = ring;
+	thread_ring_generation = gen;
+	return ring;
+}
+
+/**
+ * Returns whether a ring has been written to during the current tracing
+ * session. Its events can then be read.
+ */
+static bool ring_is_current(struct trace_ring *ring) {
+	return atomic_load_explicit(&ring->generation, memory_order_acquire) ==
+		atomic_load(&generation);
+}
+
+void trace_record(char phase, const char *name, const char *label) {
+	struct trace_ring *ring = get_thread_ring();
+	if (ring == NULL) {
+		return;
+	}
+
+	uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+	struct trace_event *event = &ring->events[head % ring->capacity];
+	event->ts = get_time_nsec();
+	event->name = name;
+	event->phase = phase;
+	snprintf(event->label, sizeof(event->label), "%s",
+		label != NULL ? label : "");
+	atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+bool wlr_trace_start(size_t capacity) {
+	if (capacity == 0) {
+		return false;
+	}
+
+	atomic_store(&trace_enabled, false);
+	atomic_store(&ring_capacity, capacity);
+	stream_started = stream_has_events = false;
+	struct trace_ring *ring = atomic_load(&rings);
+	for (; ring != NULL; ring = ring->next) {
+		ring->flushed = 0;
+	}
+	// Invalidate the rings cached by threads, they reset them before
+	// recording new events
+	atomic_fetch_add(&generation, 1);
+	atomic_store(&trace_enabled, true);
+	return true;
+}
+
+void wlr_trace_stop(void) {
+	atomic_store(&trace_enabled, false);
+	// Recorded events are discarded, but threads may still be writing to
+	// their rings: keep them
+	atomic_fetch_add(&generation, 1);
+}
+
+static bool write_event(int fd, const struct trace_ring *ring,
+		const struct trace_event *event, const char *separator) {
+	// Labels are output names and the like, drop anything needing escaping
+	char label[sizeof(event->label)];
+	size_t j = 0;
+	for (size_t i = 0; event->label[i] != '\0'; ++i) {
+		char c = event->label[i];
+		if (c >= 0x20 && c != '"' && c != '\\') {
+			label[j++] = c;
+		}
+	}
+	label[j] = '\0';
+
+	int ret = dprintf(fd, "%s{\"name\":\"%s\",\"cat\":\"wlr\",\"ph\":\"%c\","
+		"\"ts\":%"PRIu64".%03"PRIu64",\"pid\":%d,\"tid\":%d,", separator,
+		event->name, event->phase, event->ts / 1000, event->ts % 1000,
+		(int)getpid(), ring->tid);
+	if (ret < 0) {
+		return false;
+	}
+	if (event->phase == 'i') {
+		// Thread-scoped instant event
+		ret = dprintf(fd, "\"s\":\"t\",");
+	}
+	if (ret >= 0) {
+		ret = dprintf(fd, "\"args\":{\"label\":\"%s\"}}", label);
+	}
+	return ret >= 0;
+}
+
+/**
+ * Write the events of a ring from index `start`, clamped to the ones still in
+ * the ring buffer. Returns the index of the next event to write.
+ */
+static uint64_t write_ring(int fd, struct trace_ring *ring, uint64_t start,
+		bool *first, bool *ok) {
+	uint64_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+	if (head - start > ring->capacity) {
+		start = head - ring->capacity;
+	}
+	for (uint64_t i = start; i < head && *ok; ++i) {
+		const struct trace_event *event = &ring->events[i % ring->capacity];
+		*ok = write_event(fd, ring, event, *first ? "" : ",\n");
+		*first = false;
+	}
+	return head;
+}
+
+bool wlr_trace_dump(int fd) {
+	if (dprintf(fd, "{\"traceEvents\":[\n") < 0) {
+		wlr_log_errno(WLR_ERROR, "Failed to write trace");
+		return false;
+	}
+
+	bool first = true, ok = true;
+	struct trace_ring *ring = atomic_load(&rings);
+	for (; ring != NULL && ok; ring = ring->next) {
+		if (ring_is_current(ring)) {
+			write_ring(fd, ring, 0, &first, &ok);
+		}
+	}
+
+	if (!ok || dprintf(fd, "\n],\"displayTimeUnit\":\"ns\"}\n") < 0) {
+		wlr_log_errno(WLR_ERROR, "Failed to write trace");
+		return false;
+	}
+	return true;
+}
+
+bool wlr_trace_flush(int fd) {
+	// The JSON array format allows the trailing "]" to be omitted
+	bool ok = true;
+	if (!stream_started) {
+		ok = dprintf(fd, "[\n") >= 0;
+		stream_started = true;
+	}
+
+	bool first = !stream_has_events;
+	struct trace_ring *ring = atomic_load(&rings);
+	for (; ring != NULL && ok; ring = ring->next) {
+		if (ring_is_current(ring)) {
+			ring->flushed = write_ring(fd, ring, ring->flushed, &first, &ok);
+		}
+	}
+	stream_has_events = !first;
+
+	if (!ok) {
+		wlr_log_errno(WLR_ERROR, "Failed to write trace");
+	}
+	return ok;
+}
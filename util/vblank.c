@@ -0,0 +1,249 @@
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <stdlib.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include <wlr/util/log.h>
+#include "util/vblank.h"
+
+#define NSEC_PER_SEC 1000000000LL
+// Refresh rates are in mHz, so a clock does `refresh` cycles every KSEC
+#define NSEC_PER_KSEC (1000 * NSEC_PER_SEC)
+
+struct vblank_clock {
+	struct wl_list link; // clocks
+	struct wl_event_loop *event_loop;
+	int32_t refresh; // mHz
+	int64_t period; // ns, rounded down
+	int64_t epoch; // ns, time of vblank 0
+
+	int fd;
+	struct wl_event_source *event_source;
+	bool armed, dispatching;
+
+	struct wl_list timers; // vblank_timer::link
+};
+
+static struct wl_list clocks = { .prev = &clocks, .next = &clocks };
+
+static int64_t get_time_nsec(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (int64_t)now.tv_sec * NSEC_PER_SEC + now.tv_nsec;
+}
+
+/**
+ * Get the time of a vblank. Computed from the epoch rather than accumulated,
+ * so that the rounding of the period doesn't add up.
+ */
+static int64_t clock_get_vblank_time(struct vblank_clock *clock,
+		uint64_t seq) {
+	uint64_t q = seq / clock->refresh, r = seq % clock->refresh;
+	return clock->epoch + (int64_t)q * NSEC_PER_KSEC +
+		(int64_t)r * NSEC_PER_KSEC / clock->refresh;
+}
+
+/**
+ * Get the sequence number of the last vblank at or before `t`.
+ */
+static uint64_t clock_get_seq(struct vblank_clock *clock, int64_t t) {
+	if (t <= clock->epoch) {
+		return 0;
+	}
+	// The period is rounded down, so this estimate is off by a few at most
+	uint64_t seq = (t - clock->epoch) / clock->period;
+	while (seq > 0 && clock_get_vblank_time(clock, seq) > t) {
+		seq--;
+	}
+	while (clock_get_vblank_time(clock, seq + 1) <= t) {
+		seq++;
+	}
+	return seq;
+}
+
+static void clock_arm(struct vblank_clock *clock) {
+	if (clock->armed) {
+		return;
+	}
+
+	int64_t deadline = clock_get_vblank_time(clock,
+		clock_get_seq(clock, get_time_nsec()) + 1);
+	struct itimerspec its = {
+		.it_value = {
+			.tv_sec = deadline / NSEC_PER_SEC,
+			.tv_nsec = deadline % NSEC_PER_SEC,
+		},
+	};
+	if (timerfd_settime(clock->fd, TFD_TIMER_ABSTIME, &its, NULL) != 0) {
+		wlr_log_errno(WLR_ERROR, "timerfd_settime failed");
+		return;
+	}
+	clock->armed = true;
+}
+
+static void clock_destroy(struct vblank_clock *clock) {
+	wl_list_remove(&clock->link);
+	wl_event_source_remove(clock->event_source);
+	close(clock->fd);
+	free(clock);
+}
+
+static int clock_handle_timer(int fd, uint32_t mask, void *data) {
+	struct vblank_clock *clock = data;
+
+	uint64_t expirations;
+	if (read(fd, &expirations, sizeof(expirations)) < 0) {
+		if (errno != EAGAIN) {
+			wlr_log_errno(WLR_ERROR, "Failed to read timerfd");
+		}
+		return 0;
+	}
+	clock->armed = false;
+
+	// Report the vblank which just happened, even if we woke up late
+	uint64_t seq = clock_get_seq(clock, get_time_nsec());
+	int64_t when_nsec = clock_get_vblank_time(clock, seq);
+	struct timespec when = {
+		.tv_sec = when_nsec / NSEC_PER_SEC,
+		.tv_nsec = when_nsec % NSEC_PER_SEC,
+	};
+
+	struct vblank_timer *timer;
+	wl_list_for_each(timer, &clock->timers, link) {
+		timer->firing = timer->scheduled;
+		timer->scheduled = false;
+	}
+
+	// Callbacks may schedule, add or remove timers: restart the iteration
+	// after each of them
+	clock->dispatching = true;
+	bool found;
+	do {
+		found = false;
+		wl_list_for_each(timer, &clock->timers, link) {
+			if (timer->firing) {
+				timer->firing = false;
+				found = true;
+				timer->func(timer, &when, seq);
+				break;
+			}
+		}
+	} while (found);
+	clock->dispatching = false;
+
+	if (wl_list_empty(&clock->timers)) {
+		clock_destroy(clock);
+		return 0;
+	}
+
+	wl_list_for_each(timer, &clock->timers, link) {
+		if (timer->scheduled) {
+			clock_arm(clock);
+			break;
+		}
+	}
+	return 0;
+}
+
+static struct vblank_clock *clock_get_or_create(
+		struct wl_event_loop *event_loop, int32_t refresh) {
+	struct vblank_clock *clock;
+	wl_list_for_each(clock, &clocks, link) {
+		if (clock->event_loop == event_loop && clock->refresh == refresh) {
+			return clock;
+		}
+	}
+
+	clock = calloc(1, sizeof(struct vblank_clock));
+	if (clock == NULL) {
+		return NULL;
+	}
+	clock->event_loop = event_loop;
+	clock->refresh = refresh;
+	clock->period = NSEC_PER_KSEC / refresh;
+	clock->epoch = get_time_nsec();
+	wl_list_init(&clock->timers);
+
+	clock->fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+	if (clock->fd < 0) {
+		wlr_log_errno(WLR_ERROR, "timerfd_create failed");
+		free(clock);
+		return NULL;
+	}
+	clock->event_source = wl_event_loop_add_fd(event_loop, clock->fd,
+		WL_EVENT_READABLE, clock_handle_timer, clock);
+	if (clock->event_source == NULL) {
+		close(clock->fd);
+		free(clock);
+		return NULL;
+	}
+
+	wl_list_insert(&clocks, &clock->link);
+	return clock;
+}
+
+static void timer_detach(struct vblank_timer *timer) {
+	struct vblank_clock *clock = timer->clock;
+	if (clock == NULL) {
+		return;
+	}
+	wl_list_remove(&timer->link);
+	timer->clock = NULL;
+	timer->firing = false;
+	// Destroyed after dispatching if this happens from a callback
+	if (wl_list_empty(&clock->timers) && !clock->dispatching) {
+		clock_destroy(clock);
+	}
+}
+
+void vblank_timer_init(struct vblank_timer *timer,
+		struct wl_event_loop *event_loop, vblank_func_t func, void *data) {
+	*timer = (struct vblank_timer){
+		.event_loop = event_loop,
+		.func = func,
+		.data = data,
+	};
+	wl_list_init(&timer->link);
+}
+
+void vblank_timer_finish(struct vblank_timer *timer) {
+	timer_detach(timer);
+}
+
+bool vblank_timer_set_refresh(struct vblank_timer *timer, int32_t refresh) {
+	if (refresh <= 0) {
+		return false;
+	}
+	if (timer->clock != NULL && timer->clock->refresh == refresh) {
+		return true;
+	}
+
+	struct vblank_clock *clock =
+		clock_get_or_create(timer->event_loop, refresh);
+	if (clock == NULL) {
+		return false;
+	}
+
+	timer_detach(timer);
+	timer->clock = clock;
+	wl_list_insert(&clock->timers, &timer->link);
+	if (timer->scheduled) {
+		clock_arm(clock);
+	}
+	return true;
+}
+
+void vblank_timer_schedule(struct vblank_timer *timer) {
+	timer->scheduled = true;
+	if (timer->clock != NULL && !timer->clock->dispatching) {
+		clock_arm(timer->clock);
+	}
+	// Otherwise armed after dispatching, or when a refresh rate is set
+}
+
+int64_t vblank_timer_get_period(struct vblank_timer *timer) {
+	if (timer->clock == NULL) {
+		return 0;
+	}
+	return timer->clock->period;
+}